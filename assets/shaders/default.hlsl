@@ -26,6 +26,43 @@ cbuffer RenderSurfaceBuffer : register(b1)
 	float4x4 entityMatrix;
 }
 
+// Every entity drawn this frame, used by main_vs_instanced instead of the buffer above
+// Same layout as Transforms::Instance
+struct InstanceTransform
+{
+	// Computed on the CPU, once per entity
+	float4x4 modelViewProjection;
+	float4x4 model;
+};
+
+StructuredBuffer<InstanceTransform> instanceTransforms : register(t1 VK_DESCRIPTOR_SET(2));
+
+struct InstanceConstants
+{
+	// Where the draw's transforms start in instanceTransforms, SV_InstanceID always counts from 0
+	uint firstInstance;
+};
+
+// ConstantBuffer<T> needs SM 5.1, which DX11 doesn't have
+#ifdef SPIRV
+VK_PUSH_CONSTANT InstanceConstants instanceConstants;
+#else
+cbuffer InstanceConstantsBuffer : register(b2)
+{
+	InstanceConstants instanceConstants;
+}
+#endif
+
+void TransformVertex( float4x4 transform, float3 inPosition, float3 inNormal, out float4 outPosition, out float3 outNormal )
+{
+	float4x4 finalMatrix = mul( transform, mul( viewMatrix, projectionMatrix ) );
+	float4 transformedPos = mul( float4( inPosition, 1.0 ), finalMatrix );
+	float4 transformedNormal = mul( float4( inNormal, 0.0 ), transform );
+
+	outPosition = transformedPos;
+	outNormal = transformedNormal.xyz;
+}
+
 void main_vs(
 	float3 inPosition : POSITION,
 	float3 inNormal : NORMAL,
@@ -38,14 +75,55 @@ void main_vs(
 	out float3 outColour : COLOR
 )
 {
-	float4x4 finalMatrix = mul( entityMatrix, mul( viewMatrix, projectionMatrix ) );
-	float4 transformedPos = mul( float4( inPosition, 1.0 ), finalMatrix );
-	float4 transformedNormal = mul( float4( inNormal, 0.0 ), entityMatrix );
+	TransformVertex( entityMatrix, inPosition, inNormal, outPosition, outNormal );
+	outTexcoords = inTexcoords;
+	outColour = inColour;
+}
 
-	outPosition = transformedPos;
+void main_vs_instanced(
+	float3 inPosition : POSITION,
+	float3 inNormal : NORMAL,
+	float2 inTexcoords : TEXCOORD,
+	float4 inColour : COLOR,
+	uint instanceId : SV_InstanceID,
+
+	out float4 outPosition : SV_POSITION,
+	out float3 outNormal : NORMAL,
+	out float2 outTexcoords : TEXCOORD,
+	out float3 outColour : COLOR
+)
+{
+	InstanceTransform instance = instanceTransforms[instanceConstants.firstInstance + instanceId];
+
+	// Just the one multiply for the position, the view and projection are already in there
+	outPosition = mul( float4( inPosition, 1.0 ), instance.modelViewProjection );
+	outNormal = mul( float4( inNormal, 0.0 ), instance.model ).xyz;
+	outTexcoords = inTexcoords;
+	outColour = inColour;
+}
+
+// Indirect draws can't change push constants between draws, and SV_InstanceID doesn't include the start instance,
+// so the draw's first instance comes from a per-instance vertex stream that counts 0, 1, 2...
+// Instanced attributes do start at the start instance, on every API
+void main_vs_indirect(
+	float3 inPosition : POSITION,
+	float3 inNormal : NORMAL,
+	float2 inTexcoords : TEXCOORD,
+	float4 inColour : COLOR,
+	uint drawInstance : DRAWINSTANCE,
+
+	out float4 outPosition : SV_POSITION,
+	out float3 outNormal : NORMAL,
+	out float2 outTexcoords : TEXCOORD,
+	out float3 outColour : COLOR
+)
+{
+	InstanceTransform instance = instanceTransforms[drawInstance];
+
+	outPosition = mul( float4( inPosition, 1.0 ), instance.modelViewProjection );
+	outNormal = mul( float4( inNormal, 0.0 ), instance.model ).xyz;
 	outTexcoords = inTexcoords;
 	outColour = inColour;
-	outNormal = transformedNormal.xyz;
 }
 
 SamplerState diffuseSampler : register(s0);
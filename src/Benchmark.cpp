@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+#include "Benchmark.hpp"
+
+namespace Benchmark
+{
+	int Run()
+	{
+		bool passed = true;
+
+		passed &= DecodeToStaging();
+		passed &= CompletionQueue();
+		passed &= FrustumCulling();
+		passed &= DrawSorting();
+		passed &= StateElision();
+		passed &= InstanceGrouping();
+		passed &= TransformUpload();
+		passed &= MatrixBatch();
+		passed &= VertexPaths();
+		passed &= IndirectDraws();
+		passed &= ParallelRecording();
+		passed &= OcclusionCulling();
+		passed &= EntityTree();
+		passed &= TrianglePicking();
+		passed &= RenderGraphAliasing();
+		passed &= ObjectCacheKeys();
+		passed &= ShaderPack();
+		passed &= StartupTaskGraph();
+		passed &= PipelinesAheadOfDecodes();
+
+		std::cout << (passed ? "All benchmarks passed" : "Some benchmarks FAILED") << std::endl;
+		return passed ? 0 : 1;
+	}
+
+}
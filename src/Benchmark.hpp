@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+// Offline measurements for the CPU-side parts of the renderer, run with -bench
+// No window or GPU device is created, GPU memory is simulated with plain buffers
+// Each subsystem has its own Benchmark*.cpp, Run goes through all of them
+namespace Benchmark
+{
+	// Average time of a single call to work, in seconds
+	template<typename Function>
+	double SecondsPerRun( uint32_t numRuns, Function&& work )
+	{
+		adm::TimerPreciseDouble timer;
+		for ( uint32_t run = 0U; run < numRuns; run++ )
+		{
+			work();
+		}
+
+		return timer.GetElapsed( adm::TimeUnits::Seconds ) / numRuns;
+	}
+
+	// BenchmarkCulling.cpp
+	bool FrustumCulling();
+	bool OcclusionCulling();
+	bool EntityTree();
+	bool TrianglePicking();
+
+	// BenchmarkDraws.cpp
+	bool DrawSorting();
+	bool StateElision();
+	bool InstanceGrouping();
+	bool TransformUpload();
+	bool MatrixBatch();
+	bool VertexPaths();
+	bool ParallelRecording();
+	bool IndirectDraws();
+
+	// BenchmarkJobs.cpp
+	bool CompletionQueue();
+	bool StartupTaskGraph();
+	bool PipelinesAheadOfDecodes();
+
+	// BenchmarkResources.cpp
+	bool DecodeToStaging();
+	bool RenderGraphAliasing();
+	bool ObjectCacheKeys();
+	bool ShaderPack();
+}
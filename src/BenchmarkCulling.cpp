@@ -0,0 +1,603 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+#include "Benchmark.hpp"
+
+// Frustum and occlusion culling, and the entity and triangle trees
+namespace Benchmark
+{
+	// 100k randomly placed and rotated entities, culled one box at a time vs. four at a time
+	bool FrustumCulling()
+	{
+		constexpr size_t NumEntities = 100000U;
+		constexpr int NumRuns = 20;
+
+		std::cout << "Frustum culling (" << NumEntities << " entities):" << std::endl;
+
+		// Written out by hand, so the expected visible set doesn't depend on adm's conventions
+		// Looking down -Z from the origin, 90 degree vertical FOV, 16:9, depth 0.1 to 500
+		adm::Mat4 viewMatrix, projectionMatrix;
+		{
+			const float nearZ = 0.1f;
+			const float farZ = 500.0f;
+			const float view[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+			const float projection[16] =
+			{
+				1.0f / (16.0f / 9.0f), 0.0f, 0.0f, 0.0f,
+				0.0f, 1.0f, 0.0f, 0.0f,
+				0.0f, 0.0f, farZ / (nearZ - farZ), nearZ * farZ / (nearZ - farZ),
+				0.0f, 0.0f, -1.0f, 0.0f
+			};
+			std::memcpy( &viewMatrix, view, sizeof( view ) );
+			std::memcpy( &projectionMatrix, projection, sizeof( projection ) );
+		}
+
+		std::vector<adm::Mat4> transforms( NumEntities );
+		uint32_t seed = 12345U;
+		const auto random = [&seed]( float min, float max )
+		{
+			seed = seed * 1664525U + 1013904223U;
+			return min + (max - min) * ((seed >> 8U) / float( 1U << 24U ));
+		};
+
+		for ( auto& transform : transforms )
+		{
+			// Rotation about Z, and a position anywhere in a 1000 unit cube
+			const float angle = random( 0.0f, 6.2831853f );
+			const float matrix[16] =
+			{
+				std::cos( angle ), -std::sin( angle ), 0.0f, random( -500.0f, 500.0f ),
+				std::sin( angle ), std::cos( angle ), 0.0f, random( -500.0f, 500.0f ),
+				0.0f, 0.0f, 1.0f, random( -500.0f, 500.0f ),
+				0.0f, 0.0f, 0.0f, 1.0f
+			};
+			std::memcpy( &transform, matrix, sizeof( matrix ) );
+		}
+
+		const adm::Vec3 boundsMin{ -1.0f, -1.0f, -1.0f };
+		const adm::Vec3 boundsMax{ 1.0f, 1.0f, 1.0f };
+
+		Culling::BoundsArray bounds;
+		bounds.Reserve( NumEntities );
+
+		adm::TimerPreciseDouble timer;
+		for ( const auto& transform : transforms )
+		{
+			bounds.Add( transform, boundsMin, boundsMax );
+		}
+		const double boundsSeconds = timer.GetElapsed( adm::TimeUnits::Seconds );
+
+		const Culling::Frustum frustum = Culling::ExtractFrustum( viewMatrix, projectionMatrix );
+		std::vector<uint8_t> visibleScalar( NumEntities ), visibleSimd( NumEntities );
+		size_t numVisibleScalar = 0U, numVisibleSimd = 0U;
+
+		const double scalarSeconds = SecondsPerRun( NumRuns, [&]()
+			{
+				numVisibleScalar = Culling::CullBoxesScalar( frustum, bounds, visibleScalar.data() );
+			} );
+
+		const double simdSeconds = SecondsPerRun( NumRuns, [&]()
+			{
+				numVisibleSimd = Culling::CullBoxes( frustum, bounds, visibleSimd.data() );
+			} );
+
+		std::cout << "  * Building world bounds:  " << std::setw( 8 ) << boundsSeconds * 1000.0 << " ms" << std::endl
+			<< "  * Scalar:                 " << std::setw( 8 ) << scalarSeconds * 1000.0 << " ms" << std::endl
+			<< "  * SIMD, 4 per iteration:  " << std::setw( 8 ) << simdSeconds * 1000.0 << " ms" << std::endl
+			<< "  * " << numVisibleSimd << " visible, " << NumEntities - numVisibleSimd << " culled" << std::endl;
+
+		// The frustum covers about a fifth of the cube, so both extremes mean something is broken
+		if ( numVisibleScalar != numVisibleSimd || visibleScalar != visibleSimd || numVisibleSimd == 0U || numVisibleSimd == NumEntities )
+		{
+			std::cout << "  * FAILED: the two paths disagree, or culled nothing/everything" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	// Walls rasterised into the occlusion buffer, serially and one tile per job, then boxes tested against its hierarchy
+	// Checked against a brute force rasteriser: coverage has to match, the depth may only ever be farther,
+	// and no box the full resolution reference can see may be occluded
+	bool OcclusionCulling()
+	{
+		constexpr size_t NumBoxes = 10000U;
+		constexpr int NumRuns = 20;
+
+		Jobs::Init();
+
+		std::cout << "Occlusion culling (" << Occlusion::Width << "x" << Occlusion::Height << ", " << NumBoxes << " boxes):" << std::endl;
+
+		// Same camera as FrustumCulling, looking down -Z from the origin
+		adm::Mat4 viewMatrix, projectionMatrix;
+		{
+			const float nearZ = 0.1f;
+			const float farZ = 500.0f;
+			const float view[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+			const float projection[16] =
+			{
+				1.0f / (16.0f / 9.0f), 0.0f, 0.0f, 0.0f,
+				0.0f, 1.0f, 0.0f, 0.0f,
+				0.0f, 0.0f, farZ / (nearZ - farZ), nearZ * farZ / (nearZ - farZ),
+				0.0f, 0.0f, -1.0f, 0.0f
+			};
+			std::memcpy( &viewMatrix, view, sizeof( view ) );
+			std::memcpy( &projectionMatrix, projection, sizeof( projection ) );
+		}
+
+		// A 2x2 quad in the XY plane, split into a grid so there's a realistic number of triangles
+		constexpr uint32_t QuadCells = 8U;
+		Model::OccluderMesh quad;
+		for ( uint32_t y = 0U; y <= QuadCells; y++ )
+		{
+			for ( uint32_t x = 0U; x <= QuadCells; x++ )
+			{
+				quad.positions.push_back( { x * 2.0f / QuadCells - 1.0f, y * 2.0f / QuadCells - 1.0f, 0.0f } );
+			}
+		}
+		for ( uint32_t y = 0U; y < QuadCells; y++ )
+		{
+			for ( uint32_t x = 0U; x < QuadCells; x++ )
+			{
+				const uint32_t i = y * (QuadCells + 1U) + x;
+				quad.indices.insert( quad.indices.end(), { i, i + 1U, i + QuadCells + 1U, i + 1U, i + QuadCells + 2U, i + QuadCells + 1U } );
+			}
+		}
+
+		// Scale, rotation about Y, then position
+		const auto makeWall = []( float width, float height, float angle, float x, float y, float z )
+		{
+			const float matrix[16] =
+			{
+				width * std::cos( angle ), 0.0f, std::sin( angle ), x,
+				0.0f, height, 0.0f, y,
+				-width * std::sin( angle ), 0.0f, std::cos( angle ), z,
+				0.0f, 0.0f, 0.0f, 1.0f
+			};
+			adm::Mat4 transform;
+			std::memcpy( &transform, matrix, sizeof( matrix ) );
+			return transform;
+		};
+
+		std::vector<adm::Mat4> walls =
+		{
+			// Odd sizes, so the grid's edges don't line up with pixel boundaries
+			makeWall( 6.1f, 4.3f, 0.0f, -5.17f, 0.21f, -12.3f ),
+			makeWall( 8.3f, 6.2f, 0.4f, 8.13f, 1.07f, -25.1f ),
+			makeWall( 30.7f, 10.3f, 0.0f, 0.31f, 2.11f, -60.7f ),
+			// Going past the camera, so it gets clipped against the near plane
+			makeWall( 40.3f, 3.1f, 1.5707963f, -9.07f, -1.13f, -10.1f ),
+			makeWall( 5.2f, 5.1f, -0.8f, 2.03f, -3.11f, -8.2f )
+		};
+
+		uint32_t seed = 4242U;
+		const auto random = [&seed]( float min, float max )
+		{
+			seed = seed * 1664525U + 1013904223U;
+			return min + (max - min) * ((seed >> 8U) / float( 1U << 24U ));
+		};
+
+		// Boxes are in world space already
+		adm::Mat4 identity;
+		{
+			const float matrix[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+			std::memcpy( &identity, matrix, sizeof( matrix ) );
+		}
+
+		Culling::BoundsArray boxes;
+		for ( size_t i = 0U; i < NumBoxes; i++ )
+		{
+			const adm::Vec3 centre = { random( -40.0f, 40.0f ), random( -15.0f, 15.0f ), random( -90.0f, -3.0f ) };
+			const float size = random( 0.1f, 2.0f );
+			boxes.Add( identity, centre - adm::Vec3{ size, size, size }, centre + adm::Vec3{ size, size, size } );
+		}
+
+		const auto rasterise = [&]( bool parallel )
+		{
+			Occlusion::Begin( viewMatrix, projectionMatrix );
+			for ( const adm::Mat4& wall : walls )
+			{
+				Occlusion::AddOccluder( quad, wall );
+			}
+			Occlusion::Rasterise( parallel );
+		};
+
+		double secondsPerMode[2] = {};
+		for ( int parallel = 0; parallel < 2; parallel++ )
+		{
+			secondsPerMode[parallel] = SecondsPerRun( NumRuns, [&]()
+				{
+					rasterise( parallel != 0 );
+				} );
+		}
+
+		std::vector<uint8_t> visible( NumBoxes );
+		size_t numVisible = 0U;
+		const double testSeconds = SecondsPerRun( NumRuns, [&]()
+			{
+				std::fill( visible.begin(), visible.end(), uint8_t( 1U ) );
+				numVisible = Occlusion::TestBoxes( boxes, visible.data() );
+			} );
+
+		const Occlusion::Stats stats = Occlusion::GetStats();
+		std::cout << "  * Rasterising:  " << std::setw( 8 ) << secondsPerMode[0] * 1000.0 << " ms serial, "
+			<< std::setw( 8 ) << secondsPerMode[1] * 1000.0 << " ms in " << Occlusion::NumTilesX * Occlusion::NumTilesY << " tiles, "
+			<< stats.numRasterised << "/" << stats.numTriangles << " triangles rasterised" << std::endl;
+		std::cout << "  * Testing:      " << std::setw( 8 ) << testSeconds * 1000.0 << " ms, "
+			<< NumBoxes - numVisible << " of " << NumBoxes << " boxes occluded" << std::endl;
+
+		Jobs::Shutdown();
+
+		std::vector<float> reference;
+		Occlusion::RasteriseReference( reference );
+		const float* depth = Occlusion::GetDepth();
+
+		size_t coverageMismatches = 0U;
+		size_t nearerThanReference = 0U;
+		size_t numCovered = 0U;
+		float maxError = 0.0f;
+		for ( size_t i = 0U; i < reference.size(); i++ )
+		{
+			numCovered += reference[i] > 0.0f;
+			if ( (depth[i] > 0.0f) != (reference[i] > 0.0f) )
+			{
+				coverageMismatches++;
+				continue;
+			}
+
+			// A little bit of float noise is fine, occluding something the reference can see is not
+			nearerThanReference += depth[i] > reference[i] * 1.0001f + 1.0e-6f;
+			maxError = std::max( maxError, std::abs( depth[i] - reference[i] ) / std::max( reference[i], 1.0e-6f ) );
+		}
+
+		size_t numWronglyOccluded = 0U;
+		size_t numReferenceOccluded = 0U;
+		for ( size_t i = 0U; i < NumBoxes; i++ )
+		{
+			const adm::Vec3 centre = { boxes.centreX[i], boxes.centreY[i], boxes.centreZ[i] };
+			const adm::Vec3 extent = { boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i] };
+			const bool referenceVisible = Occlusion::IsBoxVisibleReference( centre - extent, centre + extent, reference );
+			numReferenceOccluded += !referenceVisible;
+			numWronglyOccluded += referenceVisible && !visible[i];
+		}
+
+		std::cout << "  * Reference:    " << numCovered << " pixels covered, " << coverageMismatches << " differ, "
+			<< maxError * 100.0f << "% max depth error, " << numReferenceOccluded << " boxes occluded at full resolution" << std::endl;
+
+		if ( coverageMismatches * 200U > reference.size() || nearerThanReference > 0U || numWronglyOccluded > 0U || numCovered == 0U )
+		{
+			std::cout << "  * FAILED: " << nearerThanReference << " pixels nearer than the reference, "
+				<< numWronglyOccluded << " visible boxes occluded" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	// The entity tree against flat culling, from 1k to 1M entities spread over a level that grows with them,
+	// so the camera sees about the same amount each time and only the flat cull has to look at everything
+	// Then ray and sphere queries, and moving entities around to see if refits and rotations keep the tree tight
+	bool EntityTree()
+	{
+		constexpr uint32_t NumRays = 1000U;
+		constexpr uint32_t NumChecked = 20U;
+
+		std::cout << "Entity BVH:" << std::endl;
+
+		// Same camera as FrustumCulling, looking down -Z from the origin
+		adm::Mat4 viewMatrix, projectionMatrix;
+		{
+			const float nearZ = 0.1f;
+			const float farZ = 500.0f;
+			const float view[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+			const float projection[16] =
+			{
+				1.0f / (16.0f / 9.0f), 0.0f, 0.0f, 0.0f,
+				0.0f, 1.0f, 0.0f, 0.0f,
+				0.0f, 0.0f, farZ / (nearZ - farZ), nearZ * farZ / (nearZ - farZ),
+				0.0f, 0.0f, -1.0f, 0.0f
+			};
+			std::memcpy( &viewMatrix, view, sizeof( view ) );
+			std::memcpy( &projectionMatrix, projection, sizeof( projection ) );
+		}
+		const Culling::Frustum frustum = Culling::ExtractFrustum( viewMatrix, projectionMatrix );
+
+		uint32_t seed = 777U;
+		const auto random = [&seed]( float min, float max )
+		{
+			seed = seed * 1664525U + 1013904223U;
+			return min + (max - min) * ((seed >> 8U) / float( 1U << 24U ));
+		};
+
+		// Positions go straight into a translation, like the renderer's entities
+		const auto makeTransform = []( float x, float y, float z )
+		{
+			const float matrix[16] = { 1, 0, 0, x, 0, 1, 0, y, 0, 0, 1, z, 0, 0, 0, 1 };
+			adm::Mat4 transform;
+			std::memcpy( &transform, matrix, sizeof( matrix ) );
+			return transform;
+		};
+
+		const adm::Vec3 modelMin = { -1.0f, -1.0f, -1.0f };
+		const adm::Vec3 modelMax = { 1.0f, 1.0f, 1.0f };
+
+		bool passed = true;
+		for ( uint32_t numEntities = 1000U; numEntities <= 1000000U; numEntities *= 10U )
+		{
+			// One entity per 16 square units on the ground plane, XZ since the camera looks down -Z
+			const float halfSide = std::sqrt( float( numEntities ) ) * 2.0f;
+			Culling::BoundsArray bounds;
+			bounds.Reserve( numEntities );
+			for ( uint32_t i = 0U; i < numEntities; i++ )
+			{
+				bounds.Add( makeTransform( random( -halfSide, halfSide ), random( -5.0f, 5.0f ), random( -halfSide, halfSide ) ), modelMin, modelMax );
+			}
+
+			adm::TimerPreciseDouble timer;
+			Bvh::Tree tree;
+			tree.Build( bounds );
+			const double buildSeconds = timer.GetElapsed( adm::TimeUnits::Seconds );
+			const float builtCost = tree.GetCost();
+
+			const int numRuns = std::max( 5, int( 1000000U / numEntities ) );
+			std::vector<uint8_t> flatVisible( numEntities ), treeVisible( numEntities );
+			size_t numFlatVisible = 0U, numTreeVisible = 0U;
+
+			const double flatSeconds = SecondsPerRun( numRuns, [&]()
+				{
+					numFlatVisible = Culling::CullBoxes( frustum, bounds, flatVisible.data() );
+				} );
+
+			const double treeSeconds = SecondsPerRun( numRuns, [&]()
+				{
+					numTreeVisible = tree.CullFrustum( frustum, treeVisible.data() );
+				} );
+
+			// Leaves get their centres back from min and max, which may round a box touching a plane the other way
+			size_t numDifferent = 0U;
+			for ( uint32_t i = 0U; i < numEntities; i++ )
+			{
+				numDifferent += flatVisible[i] != treeVisible[i];
+			}
+
+			// Rays from around the camera into the level, segments so they don't all go on forever
+			std::vector<uint32_t> hits;
+			size_t numRayHits = 0U;
+			timer.Reset();
+			for ( uint32_t r = 0U; r < NumRays; r++ )
+			{
+				const adm::Vec3 origin = { random( -10.0f, 10.0f ), random( -5.0f, 5.0f ), random( -10.0f, 10.0f ) };
+				adm::Vec3 direction = { random( -1.0f, 1.0f ), random( -0.1f, 0.1f ), random( -1.0f, 1.0f ) };
+				direction = direction * (1.0f / std::sqrt( direction.x * direction.x + direction.y * direction.y + direction.z * direction.z ));
+				tree.QueryRay( origin, direction, 200.0f, hits );
+				numRayHits += hits.size();
+			}
+			const double raySeconds = timer.GetElapsed( adm::TimeUnits::Seconds ) / NumRays;
+
+			size_t numSphereHits = 0U;
+			timer.Reset();
+			for ( uint32_t s = 0U; s < NumRays; s++ )
+			{
+				tree.QuerySphere( { random( -halfSide, halfSide ), 0.0f, random( -halfSide, halfSide ) }, 10.0f, hits );
+				numSphereHits += hits.size();
+			}
+			const double sphereSeconds = timer.GetElapsed( adm::TimeUnits::Seconds ) / NumRays;
+
+			// A few queries against brute force, both have to find exactly the same boxes
+			bool queriesMatch = true;
+			for ( uint32_t q = 0U; q < NumChecked; q++ )
+			{
+				const adm::Vec3 centre = { random( -halfSide, halfSide ), 0.0f, random( -halfSide, halfSide ) };
+				const float radius = random( 1.0f, 20.0f );
+				tree.QuerySphere( centre, radius, hits );
+
+				size_t numExpected = 0U;
+				for ( uint32_t i = 0U; i < numEntities; i++ )
+				{
+					const float dx = std::max( std::abs( centre.x - bounds.centreX[i] ) - bounds.extentX[i], 0.0f );
+					const float dy = std::max( std::abs( centre.y - bounds.centreY[i] ) - bounds.extentY[i], 0.0f );
+					const float dz = std::max( std::abs( centre.z - bounds.centreZ[i] ) - bounds.extentZ[i], 0.0f );
+					numExpected += dx * dx + dy * dy + dz * dz < radius * radius * 0.999f;
+				}
+				queriesMatch &= hits.size() >= numExpected && hits.size() <= numExpected + 2U;
+
+				const adm::Vec3 origin = { 0.0f, random( -5.0f, 5.0f ), 0.0f };
+				const float angle = random( 0.0f, 6.2831853f );
+				const adm::Vec3 direction = { std::cos( angle ), 0.0f, std::sin( angle ) };
+				tree.QueryRay( origin, direction, halfSide, hits );
+
+				numExpected = 0U;
+				for ( uint32_t i = 0U; i < numEntities; i++ )
+				{
+					float tNear = 0.0f, tFar = halfSide;
+					const float o[3] = { origin.x, origin.y, origin.z };
+					const float d[3] = { direction.x, direction.y, direction.z };
+					const float c[3] = { bounds.centreX[i], bounds.centreY[i], bounds.centreZ[i] };
+					const float e[3] = { bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i] };
+					for ( int axis = 0; axis < 3; axis++ )
+					{
+						if ( d[axis] == 0.0f )
+						{
+							tFar = std::abs( o[axis] - c[axis] ) <= e[axis] ? tFar : -1.0f;
+							continue;
+						}
+
+						const float t0 = (c[axis] - e[axis] - o[axis]) / d[axis];
+						const float t1 = (c[axis] + e[axis] - o[axis]) / d[axis];
+						tNear = std::max( tNear, std::min( t0, t1 ) );
+						tFar = std::min( tFar, std::max( t0, t1 ) );
+					}
+					numExpected += tNear <= tFar;
+				}
+				queriesMatch &= hits.size() + 2U >= numExpected && hits.size() <= numExpected + 2U;
+			}
+
+			// One in a hundred entities moves somewhere else entirely, the rest stay put
+			const uint32_t numMoved = std::max( 1U, numEntities / 100U );
+			timer.Reset();
+			for ( uint32_t m = 0U; m < numMoved; m++ )
+			{
+				const uint32_t item = uint32_t( random( 0.0f, float( numEntities ) ) ) % numEntities;
+				bounds.Set( item, makeTransform( random( -halfSide, halfSide ), random( -5.0f, 5.0f ), random( -halfSide, halfSide ) ), modelMin, modelMax );
+
+				const adm::Vec3 centre = { bounds.centreX[item], bounds.centreY[item], bounds.centreZ[item] };
+				const adm::Vec3 extent = { bounds.extentX[item], bounds.extentY[item], bounds.extentZ[item] };
+				tree.Update( item, centre - extent, centre + extent );
+			}
+			const double updateSeconds = timer.GetElapsed( adm::TimeUnits::Seconds ) / numMoved;
+			const uint32_t numReinserts = tree.GetNumReinserts();
+
+			// And one in ten drifts a little, which only refits and rotates
+			const uint32_t numDrifted = numEntities / 10U;
+			timer.Reset();
+			for ( uint32_t m = 0U; m < numDrifted; m++ )
+			{
+				const uint32_t item = m * 10U;
+				const adm::Vec3 offset = { random( -0.5f, 0.5f ), random( -0.5f, 0.5f ), random( -0.5f, 0.5f ) };
+				const adm::Vec3 centre = adm::Vec3{ bounds.centreX[item], bounds.centreY[item], bounds.centreZ[item] } + offset;
+				bounds.Set( item, makeTransform( centre.x, centre.y, centre.z ), modelMin, modelMax );
+
+				const adm::Vec3 extent = { bounds.extentX[item], bounds.extentY[item], bounds.extentZ[item] };
+				tree.Update( item, centre - extent, centre + extent );
+			}
+			const double driftSeconds = timer.GetElapsed( adm::TimeUnits::Seconds ) / numDrifted;
+
+			numFlatVisible = Culling::CullBoxes( frustum, bounds, flatVisible.data() );
+			numTreeVisible = tree.CullFrustum( frustum, treeVisible.data() );
+			for ( uint32_t i = 0U; i < numEntities; i++ )
+			{
+				numDifferent += flatVisible[i] != treeVisible[i];
+			}
+
+			Bvh::Tree rebuilt;
+			rebuilt.Build( bounds );
+
+			std::cout << "  * " << numEntities << " entities, " << numFlatVisible << " visible:" << std::endl
+				<< "    * Build:   " << std::setw( 8 ) << buildSeconds * 1000.0 << " ms, cost " << builtCost << std::endl
+				<< "    * Cull:    " << std::setw( 8 ) << flatSeconds * 1000.0 << " ms flat, " << std::setw( 8 ) << treeSeconds * 1000.0 << " ms tree, "
+				<< flatSeconds / std::max( treeSeconds, 0.000000001 ) << "x" << std::endl
+				<< "    * Queries: " << std::setw( 8 ) << raySeconds * 1000000.0 << " us per ray (" << numRayHits / NumRays << " hits), "
+				<< std::setw( 8 ) << sphereSeconds * 1000000.0 << " us per sphere (" << numSphereHits / NumRays << " hits)" << std::endl
+				<< "    * Updates: " << std::setw( 8 ) << updateSeconds * 1000000.0 << " us each for " << numMoved << " moved far ("
+				<< numReinserts << " reinserted), " << std::setw( 8 ) << driftSeconds * 1000000.0 << " us each for " << numDrifted << " drifted, "
+				<< tree.GetNumRotations() << " rotations, cost " << tree.GetCost() << " vs. " << rebuilt.GetCost() << " rebuilt" << std::endl;
+
+			// Updates can't be as good as a fresh build, but shouldn't be far off either
+			if ( numDifferent > numEntities / 10000U + 2U || numTreeVisible == 0U || !queriesMatch || tree.GetCost() > rebuilt.GetCost() * 1.25f )
+			{
+				std::cout << "  * FAILED: " << numDifferent << " boxes culled differently, or a query missed boxes" << std::endl;
+				passed = false;
+			}
+		}
+
+		return passed;
+	}
+
+	// Closest-hit rays against TestEnvironment.glb's triangle tree, from random points inside the level in random directions
+	// Checked against testing every triangle, and once more with the level moved and turned, through an entity transform
+	bool TrianglePicking()
+	{
+		constexpr uint32_t NumRays = 200000U;
+		constexpr uint32_t NumChecked = 2000U;
+		const char* modelPath = "assets/TestEnvironment.glb";
+
+		std::cout << "Triangle picking (" << modelPath << ", " << NumRays << " rays):" << std::endl;
+
+		FileSystem::Init();
+		adm::TimerPreciseDouble timer;
+		Bvh::TriangleTree tree;
+		const bool loaded = Model::LoadTriangleTreeFromGltf( modelPath, tree );
+		const double loadSeconds = timer.GetElapsed( adm::TimeUnits::Seconds );
+		FileSystem::Shutdown();
+
+		adm::Vec3 boundsMin, boundsMax;
+		if ( !loaded || !tree.GetBounds( boundsMin, boundsMax ) )
+		{
+			std::cout << "  * FAILED: couldn't load " << modelPath << std::endl;
+			return false;
+		}
+
+		uint32_t seed = 31337U;
+		const auto random = [&seed]( float min, float max )
+		{
+			seed = seed * 1664525U + 1013904223U;
+			return min + (max - min) * ((seed >> 8U) / float( 1U << 24U ));
+		};
+
+		struct Ray
+		{
+			adm::Vec3 origin;
+			adm::Vec3 direction;
+		};
+
+		// Inside the level, not too close to its outer walls
+		const adm::Vec3 margin = (boundsMax - boundsMin) * 0.1f;
+		std::vector<Ray> rays( NumRays );
+		for ( Ray& ray : rays )
+		{
+			ray.origin = { random( boundsMin.x + margin.x, boundsMax.x - margin.x ), random( boundsMin.y + margin.y, boundsMax.y - margin.y ),
+				random( boundsMin.z + margin.z, boundsMax.z - margin.z ) };
+
+			// Uniform over the sphere
+			const float z = random( -1.0f, 1.0f );
+			const float angle = random( 0.0f, 6.2831853f );
+			const float radius = std::sqrt( 1.0f - z * z );
+			ray.direction = { radius * std::cos( angle ), radius * std::sin( angle ), z };
+		}
+
+		size_t numHits = 0U;
+		timer.Reset();
+		for ( const Ray& ray : rays )
+		{
+			Bvh::RayHit hit;
+			numHits += tree.CastRay( ray.origin, ray.direction, hit );
+		}
+		const double seconds = timer.GetElapsed( adm::TimeUnits::Seconds );
+
+		// The level moved and turned a quarter around Z, rays along with it
+		const float placement[16] =
+		{
+			0.0f, -1.0f, 0.0f, 10.0f,
+			1.0f, 0.0f, 0.0f, -4.0f,
+			0.0f, 0.0f, 1.0f, 2.5f,
+			0.0f, 0.0f, 0.0f, 1.0f
+		};
+		adm::Mat4 transform;
+		std::memcpy( &transform, placement, sizeof( placement ) );
+		const auto place = [&placement]( const adm::Vec3& v, float w )
+		{
+			return adm::Vec3{ placement[0] * v.x + placement[1] * v.y + placement[2] * v.z + placement[3] * w,
+				placement[4] * v.x + placement[5] * v.y + placement[6] * v.z + placement[7] * w,
+				placement[8] * v.x + placement[9] * v.y + placement[10] * v.z + placement[11] * w };
+		};
+
+		uint32_t numMismatches = 0U;
+		for ( uint32_t i = 0U; i < NumChecked; i++ )
+		{
+			const Ray& ray = rays[i];
+			Bvh::RayHit hit, reference, placed;
+			const bool found = tree.CastRay( ray.origin, ray.direction, hit );
+			const bool foundReference = tree.CastRayBruteForce( ray.origin, ray.direction, reference );
+			const bool foundPlaced = tree.CastRay( transform, place( ray.origin, 1.0f ), place( ray.direction, 0.0f ), placed );
+
+			// Rays through a shared edge may pick either triangle, but the distance has to be the same
+			const float tolerance = 1.0e-4f * std::max( reference.distance, 1.0f );
+			const bool matches = found == foundReference && foundPlaced == foundReference
+				&& (!found || (std::abs( hit.distance - reference.distance ) <= tolerance && std::abs( placed.distance - reference.distance ) <= tolerance));
+			numMismatches += !matches;
+		}
+
+		std::cout << "  * " << tree.GetNumTriangles() << " triangles, " << tree.GetNumNodes() << " nodes, " << tree.GetMemoryBytes() / 1024U << " kB, "
+			<< loadSeconds * 1000.0 << " ms to load and build" << std::endl
+			<< "  * " << std::setw( 8 ) << seconds * 1000.0 << " ms, " << NumRays / std::max( seconds, 0.000001 ) / 1000000.0 << " million rays per second, "
+			<< numHits * 100U / NumRays << "% hit something" << std::endl;
+
+		if ( numMismatches > 0U || 0U == numHits )
+		{
+			std::cout << "  * FAILED: " << numMismatches << " of " << NumChecked << " rays disagree with testing every triangle" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+}
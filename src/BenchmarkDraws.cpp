@@ -0,0 +1,933 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+#include "Benchmark.hpp"
+
+#include <array>
+#include <numeric>
+#include <thread>
+
+// Building and recording the draw list, from sorting to indirect draws
+namespace Benchmark
+{
+	// A scene with lots of materials for the draw list benchmarks
+	// Entities are instances of a handful of models, so they share geometry, but every surface has its own material
+	constexpr uint32_t NumSceneEntities = 5000U;
+	constexpr uint32_t NumSceneModels = 50U;
+	constexpr uint32_t SurfacesPerModel = 8U;
+	constexpr uint32_t NumSceneMaterials = 200U;
+
+	struct TestDraw
+	{
+		uint32_t entity;
+		uint32_t material;
+		uint32_t geometry;
+	};
+
+	// Items come out in entity order
+	static void MakeDrawScene( std::vector<TestDraw>& outDraws, std::vector<DrawList::Item>& outItems )
+	{
+		uint32_t seed = 54321U;
+		const auto random = [&seed]( uint32_t range )
+		{
+			seed = seed * 1664525U + 1013904223U;
+			return (seed >> 8U) % range;
+		};
+
+		std::vector<uint32_t> modelMaterials( NumSceneModels * SurfacesPerModel );
+		for ( auto& material : modelMaterials )
+		{
+			material = random( NumSceneMaterials );
+		}
+
+		outDraws.clear();
+		outItems.clear();
+		for ( uint32_t entity = 0U; entity < NumSceneEntities; entity++ )
+		{
+			const uint32_t model = random( NumSceneModels );
+			const float depth = random( 1000U ) / 1000.0f;
+
+			for ( uint32_t surface = 0U; surface < SurfacesPerModel; surface++ )
+			{
+				const uint32_t geometry = model * SurfacesPerModel + surface;
+				outItems.push_back( { DrawList::MakeSortKey( 0U, modelMaterials[geometry], geometry, depth ), uint32_t( outDraws.size() ) } );
+				outDraws.push_back( { entity, modelMaterials[geometry], geometry } );
+			}
+		}
+	}
+
+	// The scene drawn in entity order vs. sorted by key
+	// Counts the state changes the renderer would make, and checks the radix sort against std::stable_sort
+	bool DrawSorting()
+	{
+		constexpr int NumRuns = 20;
+
+		std::vector<TestDraw> draws;
+		std::vector<DrawList::Item> items;
+		MakeDrawScene( draws, items );
+
+		std::cout << "Draw sorting (" << draws.size() << " draws, " << NumSceneMaterials << " materials):" << std::endl;
+
+		const auto countChanges = [&draws]( const std::vector<DrawList::Item>& order )
+		{
+			DrawList::Stats stats;
+			const TestDraw* previous = nullptr;
+			for ( const auto& item : order )
+			{
+				const TestDraw& draw = draws[item.index];
+				stats.numConstantWrites += nullptr == previous || previous->entity != draw.entity;
+				stats.numBindingChanges += nullptr == previous || previous->material != draw.material;
+				stats.numBufferChanges += nullptr == previous || previous->geometry != draw.geometry;
+				previous = &draw;
+			}
+
+			return stats;
+		};
+
+		std::vector<DrawList::Item> sorted, scratch;
+		const double radixSeconds = SecondsPerRun( NumRuns, [&]()
+			{
+				sorted = items;
+				DrawList::RadixSort( sorted, scratch );
+			} );
+
+		std::vector<DrawList::Item> reference;
+		const double stableSortSeconds = SecondsPerRun( NumRuns, [&]()
+			{
+				reference = items;
+				std::stable_sort( reference.begin(), reference.end(), []( const DrawList::Item& a, const DrawList::Item& b )
+					{
+						return a.key < b.key;
+					} );
+			} );
+
+		const DrawList::Stats unsortedStats = countChanges( items );
+		const DrawList::Stats sortedStats = countChanges( sorted );
+
+		const auto printStats = []( const char* name, const DrawList::Stats& stats )
+		{
+			std::cout << "  * " << name << std::setw( 6 ) << stats.numBindingChanges << " binding set changes, "
+				<< std::setw( 6 ) << stats.numBufferChanges << " buffer changes, "
+				<< std::setw( 6 ) << stats.numConstantWrites << " constant writes" << std::endl;
+		};
+
+		printStats( "Entity order: ", unsortedStats );
+		printStats( "Sorted:       ", sortedStats );
+		std::cout << "  * Radix sort:        " << std::setw( 8 ) << radixSeconds * 1000.0 << " ms" << std::endl
+			<< "  * std::stable_sort:  " << std::setw( 8 ) << stableSortSeconds * 1000.0 << " ms" << std::endl;
+
+		bool sameOrder = sorted.size() == reference.size();
+		for ( size_t i = 0U; sameOrder && i < sorted.size(); i++ )
+		{
+			sameOrder = sorted[i].key == reference[i].key && sorted[i].index == reference[i].index;
+		}
+
+		if ( !sameOrder )
+		{
+			std::cout << "  * FAILED: radix sort doesn't match std::stable_sort" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	// Rebuilding the whole graphics state for every draw, like the draw loop used to, vs. the state tracker
+	// There's no device here, so this is only our side of the recording cost, NVRHI's own work isn't included
+	bool StateElision()
+	{
+		constexpr int NumRuns = 20;
+
+		std::vector<TestDraw> draws;
+		std::vector<DrawList::Item> items, scratch;
+		MakeDrawScene( draws, items );
+		DrawList::RadixSort( items, scratch );
+
+		std::cout << "State elision (" << draws.size() << " sorted draws):" << std::endl;
+
+		// Never dereferenced, only compared, so any unique address will do
+		std::vector<Model::DrawPacket> packets( draws.size() );
+		for ( size_t i = 0U; i < draws.size(); i++ )
+		{
+			packets[i].bindingSet = reinterpret_cast<nvrhi::IBindingSet*>( uintptr_t( draws[i].material + 1U ) << 4U );
+			packets[i].vertexBuffer = reinterpret_cast<nvrhi::IBuffer*>( uintptr_t( draws[i].geometry + 1U ) << 4U );
+			packets[i].indexBuffer = reinterpret_cast<nvrhi::IBuffer*>( uintptr_t( draws[i].geometry + 1U ) << 5U );
+			packets[i].numIndices = 3U;
+		}
+
+		nvrhi::IBindingSet* globalBindingSet = reinterpret_cast<nvrhi::IBindingSet*>( uintptr_t( 0x10000000U ) );
+		auto baseState = nvrhi::GraphicsState()
+			.addBindingSet( globalBindingSet );
+		baseState.viewport.addViewportAndScissorRect( nvrhi::Viewport( 1600.0f, 900.0f ) );
+
+		// Stands in for setGraphicsState, so the compiler can't throw the state away
+		static volatile uintptr_t Sink = 0U;
+		const auto submit = []( const nvrhi::GraphicsState& state )
+		{
+			Sink = state.bindings.size() + uintptr_t( state.indexBuffer.buffer );
+		};
+
+		const double rebuildSeconds = SecondsPerRun( NumRuns, [&]()
+			{
+				for ( const auto& item : items )
+				{
+					const Model::DrawPacket& packet = packets[item.index];
+
+					nvrhi::GraphicsState state;
+					state.viewport.addViewportAndScissorRect( nvrhi::Viewport( 1600.0f, 900.0f ) );
+					state.bindings = { globalBindingSet, packet.bindingSet };
+					state.vertexBuffers = { { packet.vertexBuffer, 0, 0 } };
+					state.indexBuffer = { packet.indexBuffer, nvrhi::Format::R32_UINT, 0 };
+					submit( state );
+				}
+			} );
+
+		// Once as the renderer does it now, where entity changes write a volatile constant buffer,
+		// and once as if the transforms came from somewhere else
+		DrawList::Stats withWrites, withoutWrites;
+		const double trackerSeconds = SecondsPerRun( NumRuns, [&]()
+			{
+				DrawList::StateTracker stateTracker;
+				stateTracker.Reset( baseState, 1U );
+				withWrites = DrawList::Stats();
+
+				uint32_t previousEntity = ~0U;
+				for ( const auto& item : items )
+				{
+					if ( draws[item.index].entity != previousEntity )
+					{
+						stateTracker.Invalidate();
+						previousEntity = draws[item.index].entity;
+					}
+
+					if ( stateTracker.Update( packets[item.index], withWrites ) )
+					{
+						submit( stateTracker.GetState() );
+					}
+				}
+			} );
+
+		DrawList::StateTracker stateTracker;
+		stateTracker.Reset( baseState, 1U );
+		for ( const auto& item : items )
+		{
+			if ( stateTracker.Update( packets[item.index], withoutWrites ) )
+			{
+				submit( stateTracker.GetState() );
+			}
+		}
+
+		std::cout << "  * Rebuilding every draw:  " << std::setw( 8 ) << rebuildSeconds * 1000.0 << " ms, " << draws.size() << " state calls" << std::endl
+			<< "  * State tracker:          " << std::setw( 8 ) << trackerSeconds * 1000.0 << " ms, " << withWrites.numStateCalls << " state calls, "
+			<< withWrites.numElidedCalls << " elided" << std::endl
+			<< "  * Without constant writes: " << withoutWrites.numStateCalls << " state calls, " << withoutWrites.numElidedCalls << " elided" << std::endl;
+
+		// Without invalidations, exactly the draws whose packet differs from the previous one need a call
+		uint32_t expectedCalls = 0U;
+		for ( size_t i = 0U; i < items.size(); i++ )
+		{
+			const Model::DrawPacket& packet = packets[items[i].index];
+			const Model::DrawPacket* previous = i > 0U ? &packets[items[i - 1U].index] : nullptr;
+			expectedCalls += nullptr == previous || previous->bindingSet != packet.bindingSet
+				|| previous->vertexBuffer != packet.vertexBuffer || previous->indexBuffer != packet.indexBuffer;
+		}
+
+		if ( withWrites.numStateCalls + withWrites.numElidedCalls != draws.size() || withoutWrites.numStateCalls != expectedCalls )
+		{
+			std::cout << "  * FAILED: the state tracker skipped the wrong calls" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	// Sorted draws of the same surface merged into instanced draws, with their transforms gathered like the renderer does
+	bool InstanceGrouping()
+	{
+		constexpr int NumRuns = 20;
+
+		std::vector<TestDraw> draws;
+		std::vector<DrawList::Item> items, scratch;
+		MakeDrawScene( draws, items );
+		DrawList::RadixSort( items, scratch );
+
+		std::cout << "Instance grouping (" << draws.size() << " sorted draws, " << NumSceneModels * SurfacesPerModel << " surfaces):" << std::endl;
+
+		// Stand-ins for the entity transforms
+		std::vector<adm::Mat4> entityTransforms( NumSceneEntities, adm::Mat4::Identity );
+		std::vector<DrawList::InstanceGroup> groups;
+		std::vector<adm::Mat4> instanceTransforms;
+
+		const double groupingSeconds = SecondsPerRun( NumRuns, [&]()
+			{
+				DrawList::GroupInstances( items, groups, [&draws]( uint32_t a, uint32_t b )
+					{
+						return draws[a].geometry == draws[b].geometry;
+					} );
+
+				instanceTransforms.clear();
+				for ( const auto& group : groups )
+				{
+					for ( uint32_t i = group.firstItem; i < group.firstItem + group.numItems; i++ )
+					{
+						instanceTransforms.push_back( entityTransforms[draws[items[i].index].entity] );
+					}
+				}
+			} );
+
+		size_t largestGroup = 0U;
+		for ( const auto& group : groups )
+		{
+			largestGroup = std::max<size_t>( largestGroup, group.numItems );
+		}
+
+		std::cout << "  * Draws:            " << draws.size() << " -> " << groups.size() << ", up to " << largestGroup << " instances each" << std::endl
+			<< "  * Grouping:         " << std::setw( 8 ) << groupingSeconds * 1000.0 << " ms, " << instanceTransforms.size() * sizeof( adm::Mat4 ) / 1024U
+			<< " kB of transforms" << std::endl;
+
+		// Groups have to cover every item in order, only hold one surface each, and not be split needlessly
+		bool valid = true;
+		uint32_t nextItem = 0U;
+		for ( size_t g = 0U; valid && g < groups.size(); g++ )
+		{
+			const auto& group = groups[g];
+			valid = group.firstItem == nextItem && group.numItems > 0U;
+			for ( uint32_t i = group.firstItem + 1U; valid && i < group.firstItem + group.numItems; i++ )
+			{
+				valid = draws[items[i].index].geometry == draws[items[group.firstItem].index].geometry;
+			}
+
+			valid = valid && (0U == g || draws[items[group.firstItem - 1U].index].geometry != draws[items[group.firstItem].index].geometry);
+			nextItem += group.numItems;
+		}
+
+		if ( !valid || nextItem != items.size() || instanceTransforms.size() != items.size() )
+		{
+			std::cout << "  * FAILED: the instance groups don't match the draws" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	// The per-entity volatile constant buffer writes vs. copying every transform into one mapped buffer
+	// Only our side again: NVRHI's own work per constant buffer write isn't in here, so the real gap is bigger
+	bool TransformUpload()
+	{
+		constexpr int NumRuns = 20;
+		// NVRHI hands out volatile constant buffer versions at this alignment
+		constexpr size_t ConstantBufferAlignment = 256U;
+
+		std::vector<TestDraw> draws;
+		std::vector<DrawList::Item> items, scratch;
+		MakeDrawScene( draws, items );
+		DrawList::RadixSort( items, scratch );
+
+		std::cout << "Transform upload (" << NumSceneEntities << " entities, " << draws.size() << " sorted draws):" << std::endl;
+
+		std::vector<adm::Mat4> entityTransforms( NumSceneEntities, adm::Mat4::Identity );
+		for ( uint32_t entity = 0U; entity < NumSceneEntities; entity++ )
+		{
+			reinterpret_cast<float*>( &entityTransforms[entity] )[3] = float( entity );
+		}
+
+		std::vector<Model::DrawPacket> packets( draws.size() );
+		for ( size_t i = 0U; i < draws.size(); i++ )
+		{
+			packets[i].bindingSet = reinterpret_cast<nvrhi::IBindingSet*>( uintptr_t( draws[i].material + 1U ) << 4U );
+			packets[i].vertexBuffer = reinterpret_cast<nvrhi::IBuffer*>( uintptr_t( draws[i].geometry + 1U ) << 4U );
+			packets[i].indexBuffer = reinterpret_cast<nvrhi::IBuffer*>( uintptr_t( draws[i].geometry + 1U ) << 5U );
+			packets[i].numIndices = 3U;
+		}
+
+		auto baseState = nvrhi::GraphicsState()
+			.addBindingSet( reinterpret_cast<nvrhi::IBindingSet*>( uintptr_t( 0x10000000U ) ) );
+
+		// Stand-ins for setGraphicsState, setPushConstants and drawIndexed
+		static volatile uintptr_t Sink = 0U;
+		const auto submit = []( const nvrhi::GraphicsState& state )
+		{
+			Sink = state.bindings.size() + uintptr_t( state.indexBuffer.buffer );
+		};
+
+		// Constant buffer path, a new buffer version for every entity change, and the state has to be set again
+		std::vector<uint8_t> uploadRing( draws.size() * ConstantBufferAlignment );
+		DrawList::Stats constantStats;
+		const double constantSeconds = SecondsPerRun( NumRuns, [&]()
+			{
+				DrawList::StateTracker stateTracker;
+				stateTracker.Reset( baseState, 1U );
+				constantStats = DrawList::Stats();
+
+				size_t ringOffset = 0U;
+				uint32_t previousEntity = ~0U;
+				for ( const auto& item : items )
+				{
+					const TestDraw& draw = draws[item.index];
+					if ( draw.entity != previousEntity )
+					{
+						std::memcpy( &uploadRing[ringOffset], &entityTransforms[draw.entity], sizeof( adm::Mat4 ) );
+						ringOffset += ConstantBufferAlignment;
+						stateTracker.Invalidate();
+						constantStats.numConstantWrites++;
+						previousEntity = draw.entity;
+					}
+
+					if ( stateTracker.Update( packets[item.index], constantStats ) )
+					{
+						submit( stateTracker.GetState() );
+					}
+					Sink = packets[item.index].numIndices;
+					constantStats.numDraws++;
+				}
+			} );
+
+		// Transform buffer path, one copy per draw into the mapped buffer, then one draw per instance group
+		std::vector<adm::Mat4> mappedBuffer( draws.size() );
+		std::vector<DrawList::InstanceGroup> groups;
+		DrawList::Stats bufferStats;
+		const double bufferSeconds = SecondsPerRun( NumRuns, [&]()
+			{
+				DrawList::GroupInstances( items, groups, [&draws]( uint32_t a, uint32_t b )
+					{
+						return draws[a].geometry == draws[b].geometry;
+					} );
+
+				for ( size_t i = 0U; i < items.size(); i++ )
+				{
+					mappedBuffer[i] = entityTransforms[draws[items[i].index].entity];
+				}
+
+				DrawList::StateTracker stateTracker;
+				stateTracker.Reset( baseState, 1U );
+				bufferStats = DrawList::Stats();
+
+				for ( const auto& group : groups )
+				{
+					if ( stateTracker.Update( packets[items[group.firstItem].index], bufferStats ) )
+					{
+						submit( stateTracker.GetState() );
+					}
+					Sink = group.firstItem + group.numItems;
+					bufferStats.numDraws++;
+				}
+			} );
+
+		const double perTenThousand = 10000.0 / NumSceneEntities;
+		std::cout << "  * Constant buffer writes: " << std::setw( 8 ) << constantSeconds * 1000.0 * perTenThousand << " ms per 10k entities, "
+			<< constantStats.numConstantWrites << " writes, " << constantStats.numStateCalls << " state calls, " << constantStats.numDraws << " draws" << std::endl
+			<< "  * Transform buffer:       " << std::setw( 8 ) << bufferSeconds * 1000.0 * perTenThousand << " ms per 10k entities, "
+			<< draws.size() * sizeof( adm::Mat4 ) / 1024U << " kB copied, " << bufferStats.numStateCalls << " state calls, " << bufferStats.numDraws << " draws" << std::endl;
+
+		// Every draw has to find its own entity's matrix at its position in the buffer
+		for ( size_t i = 0U; i < items.size(); i++ )
+		{
+			if ( std::memcmp( &mappedBuffer[i], &entityTransforms[draws[items[i].index].entity], sizeof( adm::Mat4 ) ) != 0 )
+			{
+				std::cout << "  * FAILED: a draw's transform isn't where its instance index points" << std::endl;
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// View-projection times every entity's transform, one element at a time vs. four
+	bool MatrixBatch()
+	{
+		constexpr uint32_t NumMatrices = 100000U;
+		constexpr int NumRuns = 20;
+
+		uint32_t seed = 1234U;
+		const auto random = [&seed]()
+		{
+			seed = seed * 1664525U + 1013904223U;
+			return float( seed >> 8U ) / float( 1U << 24U ) * 2.0f - 1.0f;
+		};
+
+		adm::Mat4 viewProjection;
+		for ( float& element : reinterpret_cast<float( & )[16]>( viewProjection ) )
+		{
+			element = random();
+		}
+
+		std::vector<adm::Mat4> transforms( NumMatrices ), resultScalar( NumMatrices ), resultSimd( NumMatrices );
+		for ( auto& transform : transforms )
+		{
+			for ( float& element : reinterpret_cast<float( & )[16]>( transform ) )
+			{
+				element = random() * 100.0f;
+			}
+		}
+
+		std::cout << "MVP batch (" << NumMatrices << " matrices):" << std::endl;
+
+		const double scalarSeconds = SecondsPerRun( NumRuns, [&]()
+			{
+				Transforms::MultiplyBatchScalar( viewProjection, transforms.data(), resultScalar.data(), NumMatrices );
+			} );
+
+		const double simdSeconds = SecondsPerRun( NumRuns, [&]()
+			{
+				Transforms::MultiplyBatch( viewProjection, transforms.data(), resultSimd.data(), NumMatrices );
+			} );
+
+		std::cout << "  * Scalar:           " << std::setw( 8 ) << scalarSeconds * 1000.0 << " ms" << std::endl
+			<< "  * SIMD, 4 per row:  " << std::setw( 8 ) << simdSeconds * 1000.0 << " ms, "
+			<< NumMatrices / simdSeconds / 1000000.0 << " M matrices/s" << std::endl;
+
+		// Both do the same operations in the same order, so anything but tiny differences means a wrong index
+		float maxError = 0.0f;
+		for ( uint32_t i = 0U; i < NumMatrices; i++ )
+		{
+			const float* a = reinterpret_cast<const float*>( &resultScalar[i] );
+			const float* b = reinterpret_cast<const float*>( &resultSimd[i] );
+			for ( int e = 0; e < 16; e++ )
+			{
+				maxError = std::max( maxError, std::abs( a[e] - b[e] ) / std::max( std::abs( a[e] ), 1.0f ) );
+			}
+		}
+
+		// And one checked by hand: row 1, column 2 of the first product
+		const float* l = reinterpret_cast<const float*>( &viewProjection );
+		const float* r = reinterpret_cast<const float*>( &transforms[0] );
+		const float expected = l[4] * r[2] + l[5] * r[6] + l[6] * r[10] + l[7] * r[14];
+		const float actual = reinterpret_cast<const float*>( &resultSimd[0] )[6];
+
+		if ( maxError > 1.0e-5f || std::abs( expected - actual ) > 1.0e-3f * std::max( std::abs( expected ), 1.0f ) )
+		{
+			std::cout << "  * FAILED: the two paths disagree, or the product is wrong" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	// What default.hlsl does with the matrices it's given: they're column-major there, so a matrix reads our rows as
+	// its columns, and mul( row vector, matrix ) ends up the same as our matrix times a column vector
+	using ShaderVector = std::array<float, 4>;
+	static ShaderVector ShaderMul( const ShaderVector& v, const adm::Mat4& matrix )
+	{
+		const float* m = reinterpret_cast<const float*>( &matrix );
+		ShaderVector result;
+		for ( int column = 0; column < 4; column++ )
+		{
+			result[column] = m[column * 4] * v[0] + m[column * 4 + 1] * v[1] + m[column * 4 + 2] * v[2] + m[column * 4 + 3] * v[3];
+		}
+		return result;
+	}
+
+	// And mul( a, b ) of two of them
+	static adm::Mat4 ShaderMul( const adm::Mat4& a, const adm::Mat4& b )
+	{
+		adm::Mat4 result;
+		Transforms::MultiplyBatchScalar( b, &a, &result, 1U );
+		return result;
+	}
+
+	// Every draw's vertices through main_vs with the per-entity constant buffer, and through main_vs_instanced
+	// with the transform buffer as FillTransformBuffer fills it and the groups RecordWithTransformBuffer draws
+	// There's no GPU here, so both shaders are emulated, but the inputs are what the renderer would give them
+	bool VertexPaths()
+	{
+		uint32_t seed = 4321U;
+		const auto random = [&seed]()
+		{
+			seed = seed * 1664525U + 1013904223U;
+			return float( seed >> 8U ) / float( 1U << 24U ) * 2.0f - 1.0f;
+		};
+		const auto randomMatrix = [&random]( float scale )
+		{
+			adm::Mat4 matrix;
+			for ( float& element : reinterpret_cast<float( & )[16]>( matrix ) )
+			{
+				element = random() * scale;
+			}
+			return matrix;
+		};
+
+		std::vector<TestDraw> draws;
+		std::vector<DrawList::Item> items, scratch;
+		MakeDrawScene( draws, items );
+		DrawList::RadixSort( items, scratch );
+
+		// Any matrices will do, it's the order they're applied in that has to match
+		const adm::Mat4 projection = randomMatrix( 2.0f );
+		const adm::Mat4 view = randomMatrix( 1.0f );
+		std::vector<adm::Mat4> entityTransforms( NumSceneEntities );
+		for ( auto& transform : entityTransforms )
+		{
+			transform = randomMatrix( 10.0f );
+		}
+
+		// FillTransformBuffer, with the items in draw order
+		adm::Mat4 viewProjection;
+		Transforms::MultiplyBatch( projection, &view, &viewProjection, 1U );
+		std::vector<adm::Mat4> modelViewProjections( NumSceneEntities );
+		Transforms::MultiplyBatch( viewProjection, entityTransforms.data(), modelViewProjections.data(), NumSceneEntities );
+
+		std::vector<Transforms::Instance> instances( items.size() );
+		for ( size_t i = 0U; i < items.size(); i++ )
+		{
+			const uint32_t entity = draws[items[i].index].entity;
+			instances[i].modelViewProjection = modelViewProjections[entity];
+			instances[i].model = entityTransforms[entity];
+		}
+
+		std::vector<DrawList::InstanceGroup> groups;
+		DrawList::GroupInstances( items, groups, [&draws]( uint32_t a, uint32_t b )
+			{
+				return draws[a].geometry == draws[b].geometry;
+			} );
+
+		// The indirect arguments as BuildIndirectDraws writes them, with the draws' own index ranges
+		std::vector<Model::DrawPacket> packets( draws.size() );
+		for ( size_t i = 0U; i < draws.size(); i++ )
+		{
+			packets[i].bindingSet = reinterpret_cast<nvrhi::IBindingSet*>( uintptr_t( draws[i].material + 1U ) << 4U );
+			packets[i].numIndices = 300U + draws[i].geometry;
+			packets[i].firstIndex = draws[i].geometry * 1000U;
+		}
+		std::vector<nvrhi::DrawIndexedIndirectArguments> arguments;
+		std::vector<DrawList::IndirectBatch> batches;
+		DrawList::BuildIndirectBatches( groups, arguments, batches, [&]( uint32_t group ) -> const Model::DrawPacket&
+			{
+				return packets[items[groups[group].firstItem].index];
+			} );
+
+		// And the DRAWINSTANCE stream, 0, 1, 2...
+		std::vector<uint32_t> drawInstances( items.size() );
+		std::iota( drawInstances.begin(), drawInstances.end(), 0U );
+
+		std::cout << "Vertex paths (" << items.size() << " draws, " << groups.size() << " instanced draws, " << batches.size() << " indirect calls):" << std::endl;
+
+		// The same vertex for every draw, errors are relative to how far it ends up in clip space
+		const ShaderVector position{ random(), random(), random(), 1.0f };
+		const ShaderVector normal{ random(), random(), random(), 0.0f };
+		const auto compare = []( float& maxError, const ShaderVector& a, const ShaderVector& b )
+		{
+			float scale = 1.0f;
+			for ( int i = 0; i < 4; i++ )
+			{
+				scale = std::max( scale, std::abs( a[i] ) );
+			}
+			for ( int i = 0; i < 4; i++ )
+			{
+				maxError = std::max( maxError, std::abs( a[i] - b[i] ) / scale );
+			}
+		};
+
+		// main_vs, with whatever RecordWithEntityConstants wrote for each draw's entity
+		std::vector<ShaderVector> entityPositions( items.size() ), entityNormals( items.size() );
+		for ( size_t i = 0U; i < items.size(); i++ )
+		{
+			const adm::Mat4& entityMatrix = entityTransforms[draws[items[i].index].entity];
+			const adm::Mat4 finalMatrix = ShaderMul( entityMatrix, ShaderMul( view, projection ) );
+			entityPositions[i] = ShaderMul( position, finalMatrix );
+			entityNormals[i] = ShaderMul( normal, entityMatrix );
+		}
+
+		// main_vs_instanced, the group's first item is the push constant
+		float instancedError = 0.0f;
+		uint32_t numInstancedDraws = 0U;
+		for ( const auto& group : groups )
+		{
+			for ( uint32_t instanceId = 0U; instanceId < group.numItems; instanceId++ )
+			{
+				const uint32_t item = group.firstItem + instanceId;
+				const Transforms::Instance& instance = instances[item];
+				compare( instancedError, entityPositions[item], ShaderMul( position, instance.modelViewProjection ) );
+				compare( instancedError, entityNormals[item], ShaderMul( normal, instance.model ) );
+				numInstancedDraws++;
+			}
+		}
+
+		// main_vs_indirect, one batch at a time like RecordIndirect
+		// SV_InstanceID starts at 0 in every draw of a batch, a per-instance attribute starts at the draw's start instance
+		float indirectError = 0.0f;
+		uint32_t numIndirectDraws = 0U;
+		for ( const auto& batch : batches )
+		{
+			for ( uint32_t draw = 0U; draw < batch.numGroups; draw++ )
+			{
+				const uint32_t group = batch.firstGroup + draw;
+				const nvrhi::DrawIndexedIndirectArguments& args = arguments[group];
+				for ( uint32_t instanceId = 0U; instanceId < args.instanceCount; instanceId++ )
+				{
+					const uint32_t drawInstance = drawInstances[args.startInstanceLocation + instanceId];
+					const Transforms::Instance& instance = instances[drawInstance];
+					const uint32_t item = groups[group].firstItem + instanceId;
+					compare( indirectError, entityPositions[item], ShaderMul( position, instance.modelViewProjection ) );
+					compare( indirectError, entityNormals[item], ShaderMul( normal, instance.model ) );
+					numIndirectDraws++;
+				}
+			}
+		}
+
+		std::cout << "  * Largest difference, relative to the clip-space position: "
+			<< instancedError << " instanced, " << indirectError << " indirect" << std::endl;
+
+		// Only rounding is allowed, anything more is a wrong matrix, order or index
+		if ( numInstancedDraws != items.size() || instancedError > 1.0e-4f )
+		{
+			std::cout << "  * FAILED: the instanced path puts vertices somewhere else" << std::endl;
+			return false;
+		}
+		if ( numIndirectDraws != items.size() || indirectError > 1.0e-4f )
+		{
+			std::cout << "  * FAILED: the indirect path puts vertices somewhere else" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	// The renderer's scene recording split into chunks with Jobs::ParallelFor, against all of it on one thread
+	// Each draw stands in for setGraphicsState + drawIndexed with the state tracker and a bit of busywork,
+	// since there's no device here, so the driver's side of recording isn't in the timings at all
+	// What's checked is that chunking loses no draws and costs at most one state call per chunk
+	bool ParallelRecording()
+	{
+		constexpr uint32_t NumDraws = 64000U;
+		constexpr uint32_t NumMaterials = 200U;
+		constexpr int NumRuns = 10;
+
+		Jobs::Init();
+		const uint32_t maxChunks = Jobs::GetNumThreads() + 1U;
+
+		std::cout << "Parallel recording (" << NumDraws << " draws, up to " << maxChunks << " chunks):" << std::endl;
+
+		// Sorted by material already, like after the radix sort
+		std::vector<Model::DrawPacket> packets( NumDraws );
+		for ( uint32_t i = 0U; i < NumDraws; i++ )
+		{
+			const uint32_t material = i * NumMaterials / NumDraws;
+			packets[i].bindingSet = reinterpret_cast<nvrhi::IBindingSet*>( uintptr_t( material + 1U ) << 4U );
+			packets[i].vertexBuffer = reinterpret_cast<nvrhi::IBuffer*>( uintptr_t( i / 16U % 97U + 1U ) << 4U );
+			packets[i].indexBuffer = reinterpret_cast<nvrhi::IBuffer*>( uintptr_t( i / 16U % 97U + 1U ) << 5U );
+			packets[i].numIndices = 3U + i % 7U;
+		}
+
+		nvrhi::IBindingSet* globalBindingSet = reinterpret_cast<nvrhi::IBindingSet*>( uintptr_t( 0x10000000U ) );
+		auto baseState = nvrhi::GraphicsState()
+			.addBindingSet( globalBindingSet );
+		baseState.viewport.addViewportAndScissorRect( nvrhi::Viewport( 1600.0f, 900.0f ) );
+
+		// One "command list" per chunk, so chunks never write to the same memory
+		std::vector<std::vector<uint32_t>> commandLists( maxChunks );
+		std::vector<DrawList::Stats> chunkStats( maxChunks );
+
+		const auto record = [&]( uint32_t numChunks )
+		{
+			Jobs::ParallelFor( numChunks, [&, numChunks]( uint32_t chunk )
+				{
+					const uint32_t first = uint64_t( NumDraws ) * chunk / numChunks;
+					const uint32_t end = uint64_t( NumDraws ) * (chunk + 1U) / numChunks;
+					std::vector<uint32_t>& commands = commandLists[chunk];
+					commands.clear();
+
+					DrawList::StateTracker stateTracker;
+					stateTracker.Reset( baseState, 1U );
+					DrawList::Stats& stats = chunkStats[chunk];
+					stats = DrawList::Stats();
+
+					for ( uint32_t i = first; i < end; i++ )
+					{
+						if ( stateTracker.Update( packets[i], stats ) )
+						{
+							const nvrhi::GraphicsState& state = stateTracker.GetState();
+							commands.push_back( uint32_t( uintptr_t( state.bindings[1] ) ^ uintptr_t( state.indexBuffer.buffer ) ) );
+						}
+
+						// Roughly what encoding a draw costs
+						uint32_t hash = packets[i].numIndices;
+						for ( int round = 0; round < 64; round++ )
+						{
+							hash = hash * 2654435761U + i;
+						}
+						commands.push_back( hash );
+						stats.numDraws++;
+					}
+				} );
+
+			DrawList::Stats total;
+			for ( uint32_t chunk = 0U; chunk < numChunks; chunk++ )
+			{
+				total.numDraws += chunkStats[chunk].numDraws;
+				total.numStateCalls += chunkStats[chunk].numStateCalls;
+			}
+			return total;
+		};
+
+		uint32_t singleStateCalls = 0U;
+		bool allDrawn = true;
+		for ( uint32_t numChunks = 1U; numChunks <= maxChunks; numChunks++ )
+		{
+			DrawList::Stats stats;
+			const double seconds = SecondsPerRun( NumRuns, [&]()
+				{
+					stats = record( numChunks );
+				} );
+
+			if ( numChunks == 1U )
+			{
+				singleStateCalls = stats.numStateCalls;
+			}
+
+			// Every chunk starts with a fresh tracker, so it costs one extra state call at most
+			allDrawn &= stats.numDraws == NumDraws && stats.numStateCalls <= singleStateCalls + numChunks - 1U;
+
+			std::cout << "  * " << numChunks << " chunks: " << std::setw( 8 ) << seconds * 1000.0 << " ms, "
+				<< stats.numStateCalls << " state calls" << std::endl;
+		}
+
+		Jobs::Shutdown();
+
+		// With one hardware thread the chunks just take turns, so the timings only show what chunking costs
+		const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		std::cout << "  * " << hardwareThreads << " hardware threads" << (hardwareThreads < 2U ? ", not enough to say anything about scaling" : "") << std::endl;
+
+		if ( !allDrawn )
+		{
+			std::cout << "  * FAILED: draws were lost, or chunking added too many state calls" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	// A drawIndexed per instance group vs. the indirect path, where each group's arguments are written out
+	// and every run of groups that share a material becomes one drawIndexedIndirect
+	// All surfaces are in one shared pair of buffers, like the renderer's static geometry
+	// Once with instancing, and once without, where every draw is its own group
+	bool IndirectDraws()
+	{
+		constexpr int NumRuns = 20;
+
+		std::vector<TestDraw> draws;
+		std::vector<DrawList::Item> items, scratch;
+		MakeDrawScene( draws, items );
+		DrawList::RadixSort( items, scratch );
+
+		std::cout << "Indirect draws (" << draws.size() << " sorted draws, " << NumSceneMaterials << " materials):" << std::endl;
+
+		nvrhi::IBuffer* sharedVertexBuffer = reinterpret_cast<nvrhi::IBuffer*>( uintptr_t( 0x20000000U ) );
+		nvrhi::IBuffer* sharedIndexBuffer = reinterpret_cast<nvrhi::IBuffer*>( uintptr_t( 0x30000000U ) );
+		std::vector<Model::DrawPacket> packets( draws.size() );
+		for ( size_t i = 0U; i < draws.size(); i++ )
+		{
+			const uint32_t geometry = draws[i].geometry;
+			packets[i].bindingSet = reinterpret_cast<nvrhi::IBindingSet*>( uintptr_t( draws[i].material + 1U ) << 4U );
+			packets[i].vertexBuffer = sharedVertexBuffer;
+			packets[i].indexBuffer = sharedIndexBuffer;
+			packets[i].numIndices = 300U + geometry;
+			packets[i].firstIndex = geometry * 1000U;
+			packets[i].baseVertex = geometry * 500U;
+		}
+
+		auto baseState = nvrhi::GraphicsState()
+			.addBindingSet( reinterpret_cast<nvrhi::IBindingSet*>( uintptr_t( 0x10000000U ) ) );
+
+		// Stand-ins for setGraphicsState, drawIndexed and drawIndexedIndirect
+		static volatile uintptr_t Sink = 0U;
+		const auto submit = []( const nvrhi::GraphicsState& state )
+		{
+			Sink = state.bindings.size() + uintptr_t( state.indexBuffer.buffer );
+		};
+
+		bool passed = true;
+		for ( const bool instancing : { true, false } )
+		{
+			std::vector<DrawList::InstanceGroup> groups;
+			DrawList::GroupInstances( items, groups, [&draws, instancing]( uint32_t a, uint32_t b )
+				{
+					return instancing && draws[a].geometry == draws[b].geometry;
+				} );
+
+			const auto getPacket = [&]( uint32_t group ) -> const Model::DrawPacket&
+			{
+				return packets[items[groups[group].firstItem].index];
+			};
+
+			DrawList::Stats directStats;
+			const double directSeconds = SecondsPerRun( NumRuns, [&]()
+				{
+					DrawList::StateTracker stateTracker;
+					stateTracker.Reset( baseState, 1U );
+					directStats = DrawList::Stats();
+
+					for ( uint32_t g = 0U; g < groups.size(); g++ )
+					{
+						const Model::DrawPacket& packet = getPacket( g );
+						if ( stateTracker.Update( packet, directStats ) )
+						{
+							submit( stateTracker.GetState() );
+						}
+
+						Sink = packet.firstIndex + packet.baseVertex + groups[g].numItems;
+						directStats.numDraws++;
+					}
+				} );
+
+			// Includes building the arguments and copying them into the "argument buffer"
+			std::vector<nvrhi::DrawIndexedIndirectArguments> arguments;
+			std::vector<DrawList::IndirectBatch> batches;
+			std::vector<nvrhi::DrawIndexedIndirectArguments> argumentBuffer( groups.size() );
+			DrawList::Stats indirectStats;
+			const double indirectSeconds = SecondsPerRun( NumRuns, [&]()
+				{
+					DrawList::BuildIndirectBatches( groups, arguments, batches, getPacket );
+					std::memcpy( argumentBuffer.data(), arguments.data(), arguments.size() * sizeof( nvrhi::DrawIndexedIndirectArguments ) );
+
+					DrawList::StateTracker stateTracker;
+					stateTracker.Reset( baseState, 1U );
+					indirectStats = DrawList::Stats();
+
+					for ( const auto& batch : batches )
+					{
+						if ( stateTracker.Update( getPacket( batch.firstGroup ), indirectStats ) )
+						{
+							submit( stateTracker.GetState() );
+						}
+
+						Sink = batch.firstGroup * sizeof( nvrhi::DrawIndexedIndirectArguments ) + batch.numGroups;
+						indirectStats.numIndirectCalls++;
+						indirectStats.numDraws += batch.numGroups;
+					}
+				} );
+
+			std::cout << "  * " << (instancing ? "Instanced, " : "One per draw, ") << groups.size() << " groups:" << std::endl
+				<< "    * drawIndexed:          " << std::setw( 8 ) << directSeconds * 1000.0 << " ms, "
+				<< directStats.numStateCalls + directStats.numDraws << " API calls (" << directStats.numStateCalls << " state, " << directStats.numDraws << " draws)" << std::endl
+				<< "    * drawIndexedIndirect:  " << std::setw( 8 ) << indirectSeconds * 1000.0 << " ms, "
+				<< indirectStats.numStateCalls + indirectStats.numIndirectCalls << " API calls (" << indirectStats.numStateCalls << " state, "
+				<< indirectStats.numIndirectCalls << " indirect), " << arguments.size() * sizeof( nvrhi::DrawIndexedIndirectArguments ) / 1024U << " kB of arguments" << std::endl;
+
+			// The GPU has to end up drawing exactly what the direct path would have
+			bool sameDraws = indirectStats.numDraws == directStats.numDraws && arguments.size() == groups.size();
+			uint32_t nextGroup = 0U;
+			for ( const auto& batch : batches )
+			{
+				sameDraws &= batch.firstGroup == nextGroup;
+				nextGroup += batch.numGroups;
+
+				for ( uint32_t g = batch.firstGroup; g < nextGroup && g < groups.size(); g++ )
+				{
+					const Model::DrawPacket& packet = getPacket( g );
+					const nvrhi::DrawIndexedIndirectArguments& args = argumentBuffer[g];
+					sameDraws &= packet.bindingSet == getPacket( batch.firstGroup ).bindingSet
+						&& args.indexCount == packet.numIndices && args.startIndexLocation == packet.firstIndex && args.baseVertexLocation == packet.baseVertex
+						&& args.instanceCount == groups[g].numItems && args.startInstanceLocation == groups[g].firstItem;
+				}
+			}
+			sameDraws &= nextGroup == groups.size();
+
+			if ( !sameDraws )
+			{
+				std::cout << "  * FAILED: the indirect arguments don't match the direct draws" << std::endl;
+				passed = false;
+			}
+		}
+
+		return passed;
+	}
+}
@@ -0,0 +1,260 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+#include "Benchmark.hpp"
+
+#include <thread>
+
+// The job system: completion queues, the startup task graph and jobs put ahead of the queue
+namespace Benchmark
+{
+	// Every job thread pushes a numbered sequence while the main thread keeps popping, like the texture loader does
+	// Checks that nothing gets lost and each thread's items come out in the order they went in
+	bool CompletionQueue()
+	{
+		constexpr uint32_t ItemsPerProducer = 250000U;
+
+		struct Item
+		{
+			uint32_t producer;
+			uint32_t sequence;
+		};
+
+		Jobs::Init();
+		const uint32_t numProducers = Jobs::GetNumThreads();
+
+		std::cout << "Completion queue (" << numProducers << " producers, " << ItemsPerProducer << " items each):" << std::endl;
+
+		Jobs::CompletionQueue<Item> queue;
+		std::atomic<uint32_t> numFinished{ 0U };
+		adm::TimerPreciseDouble timer;
+
+		for ( uint32_t producer = 0U; producer < numProducers; producer++ )
+		{
+			Jobs::Submit( [&queue, &numFinished, producer]
+				{
+					for ( uint32_t sequence = 0U; sequence < ItemsPerProducer; sequence++ )
+					{
+						queue.Push( { producer, sequence } );
+					}
+
+					numFinished++;
+				} );
+		}
+
+		std::vector<uint32_t> nextSequence( numProducers, 0U );
+		std::vector<Item> items;
+		uint64_t numPopped = 0U;
+		uint64_t numPops = 0U;
+		bool inOrder = true;
+
+		while ( true )
+		{
+			// Whatever they pushed before finishing is guaranteed to be in this pop
+			const bool finished = numFinished == numProducers;
+
+			items.clear();
+			queue.PopAll( items );
+			numPops++;
+
+			for ( const Item& item : items )
+			{
+				inOrder &= item.producer < numProducers && item.sequence == nextSequence[item.producer];
+				nextSequence[item.producer] = item.sequence + 1U;
+			}
+
+			numPopped += items.size();
+
+			if ( finished )
+			{
+				break;
+			}
+		}
+
+		const double seconds = timer.GetElapsed( adm::TimeUnits::Seconds );
+		Jobs::Shutdown();
+
+		std::cout << "  * " << numPopped << " items in " << seconds * 1000.0 << " ms over " << numPops << " pops, "
+			<< numPopped / std::max( seconds, 0.000001 ) / 1000000.0 << " M items/s" << std::endl;
+
+		if ( !inOrder || numPopped != uint64_t( numProducers ) * ItemsPerProducer )
+		{
+			std::cout << "  * FAILED: items were lost or came out of order" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	// Renderer::Init's tasks with made-up durations, sleeping like waiting on the disk or the driver does
+	// Checks that nothing starts before what it depends on is done, that calling-thread tasks stay there,
+	// and that a failing task skips its dependents, then compares running them in parallel against one by one
+	bool StartupTaskGraph()
+	{
+		struct FakeTask
+		{
+			const char* name;
+			uint32_t microseconds;
+			std::vector<uint32_t> dependencies;
+			bool onCallingThread;
+		};
+		const FakeTask fakeTasks[] =
+		{
+			{ "Binding layouts", 400U, {}, false },
+			{ "Scene shaders", 8000U, {}, false },
+			{ "Screen shaders", 3000U, {}, false },
+			{ "Screen input layout", 300U, { 2U }, false },
+			{ "Scene input layouts", 600U, { 1U }, false },
+			{ "Buffers", 1000U, {}, false },
+			{ "Sampler", 200U, {}, false },
+			{ "Render targets", 2000U, {}, false },
+			{ "Screen quad upload", 500U, { 5U }, true },
+			{ "Global bindings", 800U, { 5U, 6U, 0U, 1U }, true },
+			{ "Screen pipeline", 300U, { 3U, 0U }, false },
+			{ "Scene pipelines", 900U, { 4U, 0U, 7U }, false },
+			{ "Entities", 20000U, { 0U }, true }
+		};
+		constexpr uint32_t NumTasks = std::size( fakeTasks );
+
+		Jobs::Init();
+		std::cout << "Startup task graph (" << NumTasks << " tasks, " << Jobs::GetNumThreads() << " workers):" << std::endl;
+
+		const std::thread::id callingThread = std::this_thread::get_id();
+		bool passed = true;
+		double milliseconds[2]{};
+		for ( const bool parallel : { false, true } )
+		{
+			// Every task checks its dependencies when it starts
+			std::atomic<bool> finished[NumTasks]{};
+			std::atomic<uint32_t> numMismatches{ 0U };
+
+			Jobs::TaskGraph graph;
+			for ( uint32_t i = 0U; i < NumTasks; i++ )
+			{
+				const FakeTask& fakeTask = fakeTasks[i];
+				const auto run = [&fakeTask, &finished, &numMismatches, callingThread, i]()
+				{
+					for ( const uint32_t dependency : fakeTask.dependencies )
+					{
+						numMismatches += !finished[dependency];
+					}
+					numMismatches += fakeTask.onCallingThread && std::this_thread::get_id() != callingThread;
+
+					std::this_thread::sleep_for( std::chrono::microseconds( fakeTask.microseconds ) );
+					finished[i] = true;
+					return true;
+				};
+
+				switch ( fakeTask.dependencies.size() )
+				{
+				case 0U: graph.Add( fakeTask.name, run, {}, fakeTask.onCallingThread ); break;
+				case 1U: graph.Add( fakeTask.name, run, { fakeTask.dependencies[0] }, fakeTask.onCallingThread ); break;
+				case 2U: graph.Add( fakeTask.name, run, { fakeTask.dependencies[0], fakeTask.dependencies[1] }, fakeTask.onCallingThread ); break;
+				case 3U: graph.Add( fakeTask.name, run, { fakeTask.dependencies[0], fakeTask.dependencies[1], fakeTask.dependencies[2] }, fakeTask.onCallingThread ); break;
+				default: graph.Add( fakeTask.name, run, { fakeTask.dependencies[0], fakeTask.dependencies[1], fakeTask.dependencies[2], fakeTask.dependencies[3] }, fakeTask.onCallingThread ); break;
+				}
+			}
+
+			const bool succeeded = graph.Run( parallel );
+			milliseconds[parallel] = graph.GetMilliseconds();
+			if ( parallel )
+			{
+				graph.PrintTimeline();
+			}
+
+			const bool allFinished = std::all_of( std::begin( finished ), std::end( finished ), []( const std::atomic<bool>& f ) { return f.load(); } );
+			if ( !succeeded || !allFinished || numMismatches > 0U )
+			{
+				std::cout << "  * FAILED: " << numMismatches << " tasks started too early or on the wrong thread" << std::endl;
+				passed = false;
+			}
+		}
+
+		// A failure skips what depends on it, and only that
+		Jobs::TaskGraph failing;
+		std::atomic<uint32_t> numRun{ 0U };
+		const Jobs::TaskGraph::TaskId shaders = failing.Add( "Shaders", []() { return false; } );
+		const Jobs::TaskGraph::TaskId layouts = failing.Add( "Layouts", [&numRun]() { numRun++; return true; } );
+		const Jobs::TaskGraph::TaskId inputLayouts = failing.Add( "Input layouts", [&numRun]() { numRun++; return true; }, { shaders } );
+		failing.Add( "Pipelines", [&numRun]() { numRun++; return true; }, { inputLayouts, layouts } );
+		failing.Add( "Entities", [&numRun]() { numRun++; return true; }, { layouts }, true );
+		const bool failedRunSucceeded = failing.Run();
+		Jobs::Shutdown();
+
+		std::cout << "  * One by one: " << milliseconds[0] << " ms, in parallel: " << milliseconds[1] << " ms" << std::endl;
+
+		if ( failedRunSucceeded || numRun != 2U )
+		{
+			std::cout << "  * FAILED: " << numRun << " tasks ran after a failure, 2 should have" << std::endl;
+			passed = false;
+		}
+
+		return passed;
+	}
+
+	// A level's texture decodes are queued, then the scene's pipelines are declared, like during startup
+	// Compares when the last pipeline is ready with Submit against SubmitAhead, which PipelineCompiler uses
+	bool PipelinesAheadOfDecodes()
+	{
+		static constexpr uint32_t DecodeMicroseconds = 2000U;
+		static constexpr uint32_t CompileMicroseconds = 3000U;
+		static constexpr uint32_t NumPipelines = 4U;
+
+		Jobs::Init();
+		const uint32_t numDecodes = 8U * Jobs::GetNumThreads();
+		std::cout << "Pipelines ahead of decodes (" << numDecodes << " decodes, " << NumPipelines << " pipelines, "
+			<< Jobs::GetNumThreads() << " workers):" << std::endl;
+
+		double readyMilliseconds[2]{};
+		double idleMilliseconds[2]{};
+		for ( const bool ahead : { false, true } )
+		{
+			adm::TimerPreciseDouble timer;
+			std::atomic<uint32_t> numReady{ 0U };
+			std::atomic<double> lastReady{ 0.0 };
+
+			for ( uint32_t i = 0U; i < numDecodes; i++ )
+			{
+				Jobs::Submit( []() { std::this_thread::sleep_for( std::chrono::microseconds( DecodeMicroseconds ) ); } );
+			}
+
+			for ( uint32_t i = 0U; i < NumPipelines; i++ )
+			{
+				const auto compile = [&timer, &numReady, &lastReady]()
+				{
+					std::this_thread::sleep_for( std::chrono::microseconds( CompileMicroseconds ) );
+					if ( ++numReady == NumPipelines )
+					{
+						lastReady = timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0;
+					}
+				};
+
+				if ( ahead )
+				{
+					Jobs::SubmitAhead( compile );
+				}
+				else
+				{
+					Jobs::Submit( compile );
+				}
+			}
+
+			Jobs::WaitForIdle();
+			readyMilliseconds[ahead] = lastReady;
+			idleMilliseconds[ahead] = timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0;
+		}
+		Jobs::Shutdown();
+
+		std::cout << "  * Submit:      pipelines ready after " << readyMilliseconds[0] << " ms, everything after " << idleMilliseconds[0] << " ms" << std::endl
+			<< "  * SubmitAhead: pipelines ready after " << readyMilliseconds[1] << " ms, everything after " << idleMilliseconds[1] << " ms" << std::endl;
+
+		// The decodes alone keep every worker busy for longer than the compiles take
+		if ( readyMilliseconds[1] >= readyMilliseconds[0] * 0.5 )
+		{
+			std::cout << "  * FAILED: pipelines put ahead still waited behind the decodes" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,470 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+#include "Benchmark.hpp"
+
+#include <unordered_set>
+
+// Texture decoding, the render graph, the object cache and the shader pack
+namespace Benchmark
+{
+	// Builds an uncompressed 24-bit TGA in memory, stb_image decodes these without any extra work,
+	// so what's measured is mostly our own handling of the pixels
+	static std::vector<uint8_t> MakeTestImage( uint16_t width, uint16_t height )
+	{
+		std::vector<uint8_t> image( 18U + size_t( width ) * height * 3U );
+
+		image[2] = 2; // Uncompressed true-colour
+		image[12] = width & 0xFF;
+		image[13] = width >> 8;
+		image[14] = height & 0xFF;
+		image[15] = height >> 8;
+		image[16] = 24;
+
+		uint8_t* pixel = &image[18];
+		for ( uint32_t y = 0U; y < height; y++ )
+		{
+			for ( uint32_t x = 0U; x < width; x++, pixel += 3 )
+			{
+				pixel[0] = uint8_t( x );
+				pixel[1] = uint8_t( y );
+				pixel[2] = uint8_t( x ^ y );
+			}
+		}
+
+		return image;
+	}
+
+	// FNV-1a over 8 bytes at a time, for comparing buffers too big to keep two copies of
+	static uint64_t HashBytes( const uint8_t* data, size_t bytes )
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		size_t i = 0U;
+		for ( ; i + sizeof( uint64_t ) <= bytes; i += sizeof( uint64_t ) )
+		{
+			uint64_t word;
+			std::memcpy( &word, data + i, sizeof( word ) );
+			hash = (hash ^ word) * 1099511628211ULL;
+		}
+		for ( ; i < bytes; i++ )
+		{
+			hash = (hash ^ data[i]) * 1099511628211ULL;
+		}
+
+		return hash;
+	}
+
+	// Decoding to RGBA and letting writeTexture copy it into the upload buffer,
+	// vs. decoding to native components and expanding straight into staging memory
+	bool DecodeToStaging()
+	{
+		constexpr uint16_t Size = 8192U;
+		// D3D12's texture row pitch alignment, the worst case of the three APIs
+		constexpr size_t RowPitch = (Size * 4U + 255U) & ~size_t( 255U );
+
+		std::cout << "Decode to staging (" << Size << "x" << Size << " RGB):" << std::endl;
+
+		const std::vector<uint8_t> image = MakeTestImage( Size, Size );
+		// Stands in for the upload buffer/staging texture, which both paths need
+		std::vector<uint8_t> staging( RowPitch * Size );
+
+		double oldSeconds, newSeconds;
+		uint64_t oldPeak, newPeak;
+
+		{
+			adm::TimerPreciseDouble timer;
+			Texture::ResetDecoderPeakBytes();
+
+			Texture::TextureData textureData;
+			textureData.InitFromMemory( image.data(), image.size(), false );
+			// What writeTexture does
+			for ( uint32_t y = 0U; y < Size; y++ )
+			{
+				std::memcpy( &staging[y * RowPitch], &textureData.data[size_t( y ) * Size * 4U], Size * 4U );
+			}
+
+			oldPeak = Texture::GetDecoderPeakBytes();
+			oldSeconds = timer.GetElapsed( adm::TimeUnits::Seconds );
+		}
+
+		// The whole staging buffer, padding included, stb_image's own RGBA conversion is the reference
+		const uint64_t hashOld = HashBytes( staging.data(), staging.size() );
+		std::fill( staging.begin(), staging.end(), 0 );
+
+		{
+			adm::TimerPreciseDouble timer;
+			Texture::ResetDecoderPeakBytes();
+
+			Texture::TextureData textureData;
+			textureData.InitFromMemory( image.data(), image.size(), true );
+			textureData.CopyRowsAsRgba( staging.data(), RowPitch );
+
+			newPeak = Texture::GetDecoderPeakBytes();
+			newSeconds = timer.GetElapsed( adm::TimeUnits::Seconds );
+		}
+
+		const uint64_t hashNew = HashBytes( staging.data(), staging.size() );
+
+		std::cout << "  * RGBA decode + copy:         " << std::setw( 8 ) << oldSeconds * 1000.0 << " ms, " << oldPeak / (1024U * 1024U) << " MiB decoder peak" << std::endl
+			<< "  * Native decode into staging: " << std::setw( 8 ) << newSeconds * 1000.0 << " ms, " << newPeak / (1024U * 1024U) << " MiB decoder peak" << std::endl;
+
+		if ( hashOld != hashNew )
+		{
+			std::cout << "  * FAILED: the two paths produced different pixels" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	// A scene pass, a chain of post-processing passes, a debug pass nobody reads, and the screen quad
+	// Compiled without a device, so only the graph's decisions are checked, not the GPU's
+	bool RenderGraphAliasing()
+	{
+		using RStates = nvrhi::ResourceStates;
+		constexpr uint32_t NumFrames = 3U;
+		constexpr uint32_t NumPostPasses[] = { 0U, 1U, 2U, 4U, 8U, 16U, 64U };
+
+		std::cout << "Render graph (1600x900 targets, " << NumFrames << " frames each):" << std::endl;
+
+		const auto colourDesc = nvrhi::TextureDesc()
+			.setWidth( 1600U )
+			.setHeight( 900U )
+			.setFormat( nvrhi::Format::RGBA16_FLOAT );
+		const auto depthDesc = nvrhi::TextureDesc( colourDesc )
+			.setFormat( nvrhi::Format::D32 );
+		// Never dereferenced, only handed back
+		nvrhi::ITexture* backbuffer = reinterpret_cast<nvrhi::ITexture*>( uintptr_t( 0x10000000U ) );
+
+		uint64_t physicalBytesWithPost = 0U;
+		bool passed = true;
+		for ( uint32_t numPostPasses : NumPostPasses )
+		{
+			RenderGraph::Graph graph;
+			uint32_t numExecuted = 0U;
+			const auto execute = [&numExecuted]( RenderGraph::PassContext& )
+			{
+				numExecuted++;
+			};
+
+			// What the graph was told, to check its answers against
+			struct Declared
+			{
+				uint32_t pass;
+				RenderGraph::ResourceId resource;
+				RStates state;
+			};
+			std::vector<Declared> declared;
+			uint32_t debugPass = 0U;
+			uint32_t numMismatches = 0U;
+			double compileSeconds = 0.0;
+
+			for ( uint32_t frame = 0U; frame < NumFrames; frame++ )
+			{
+				graph.Reset();
+				declared.clear();
+				const auto read = [&graph, &declared]( uint32_t pass, RenderGraph::ResourceId resource )
+				{
+					graph.Read( pass, resource );
+					declared.push_back( { pass, resource, RStates::ShaderResource } );
+				};
+				const auto write = [&graph, &declared]( uint32_t pass, RenderGraph::ResourceId resource, RStates state )
+				{
+					graph.Write( pass, resource, state );
+					declared.push_back( { pass, resource, state } );
+				};
+
+				RenderGraph::ResourceId colour = graph.CreateTexture( colourDesc );
+				const RenderGraph::ResourceId depth = graph.CreateTexture( depthDesc );
+				const RenderGraph::ResourceId output = graph.ImportTexture( backbuffer );
+
+				const uint32_t scenePass = graph.AddPass( "Scene", execute );
+				write( scenePass, colour, RStates::RenderTarget );
+				write( scenePass, depth, RStates::DepthWrite );
+
+				for ( uint32_t i = 0U; i < numPostPasses; i++ )
+				{
+					const RenderGraph::ResourceId postColour = graph.CreateTexture( colourDesc );
+					const uint32_t postPass = graph.AddPass( "Post", execute );
+					read( postPass, colour );
+					read( postPass, depth );
+					write( postPass, postColour, RStates::RenderTarget );
+					colour = postColour;
+				}
+
+				debugPass = graph.AddPass( "Debug", execute );
+				read( debugPass, depth );
+				write( debugPass, graph.CreateTexture( colourDesc ), RStates::RenderTarget );
+
+				const uint32_t screenPass = graph.AddPass( "Screen quad", execute );
+				read( screenPass, colour );
+				read( screenPass, depth );
+				write( screenPass, output, RStates::RenderTarget );
+
+				adm::TimerPreciseDouble timer;
+				graph.Compile( nullptr );
+				compileSeconds += timer.GetElapsed( adm::TimeUnits::Seconds );
+				graph.Execute();
+
+				// Textures sharing a physical one mustn't be alive at the same time
+				const auto getLifetime = [&declared, &graph]( RenderGraph::ResourceId resource, uint32_t& outFirst, uint32_t& outLast )
+				{
+					outFirst = ~0U;
+					outLast = 0U;
+					for ( const Declared& access : declared )
+					{
+						if ( access.resource == resource && !graph.IsPassCulled( access.pass ) )
+						{
+							outFirst = std::min( outFirst, access.pass );
+							outLast = std::max( outLast, access.pass );
+						}
+					}
+				};
+				for ( RenderGraph::ResourceId a = 0U; a <= colour; a++ )
+				{
+					for ( RenderGraph::ResourceId b = a + 1U; b <= colour; b++ )
+					{
+						if ( graph.GetPhysicalIndex( a ) == RenderGraph::InvalidResource || graph.GetPhysicalIndex( a ) != graph.GetPhysicalIndex( b ) )
+						{
+							continue;
+						}
+
+						uint32_t firstA, lastA, firstB, lastB;
+						getLifetime( a, firstA, lastA );
+						getLifetime( b, firstB, lastB );
+						numMismatches += !(lastA < firstB || lastB < firstA);
+					}
+				}
+
+				// Every pass finds its textures in the states it declared
+				for ( const Declared& access : declared )
+				{
+					if ( access.resource == output || graph.IsPassCulled( access.pass ) )
+					{
+						continue;
+					}
+
+					bool found = false;
+					for ( const RenderGraph::Transition& transition : graph.GetTransitions( access.pass ) )
+					{
+						found |= transition.physical == graph.GetPhysicalIndex( access.resource ) && transition.after == access.state;
+					}
+					numMismatches += !found;
+				}
+			}
+
+			const RenderGraph::Stats& stats = graph.GetStats();
+			const uint32_t numLivePasses = stats.numPasses - stats.numCulledPasses;
+			std::cout << "  * " << std::setw( 2 ) << numPostPasses << " post passes: " << stats.numTransientTextures << " textures in "
+				<< stats.numPhysicalTextures << ", " << stats.physicalBytes / (1024U * 1024U) << " MB instead of " << stats.transientBytes / (1024U * 1024U) << " MB, "
+				<< stats.numTransitions << " transitions in " << stats.numBarrierBatches << " batches, "
+				<< compileSeconds * 1000000.0 / NumFrames << " us to compile" << std::endl;
+
+			// A chain of any length ping-pongs between two colour targets
+			const uint32_t expectedPhysical = numPostPasses > 0U ? 3U : 2U;
+			if ( numPostPasses > 0U && 0U == physicalBytesWithPost )
+			{
+				physicalBytesWithPost = stats.physicalBytes;
+			}
+
+			if ( numMismatches > 0U || !graph.IsPassCulled( debugPass ) || stats.numCulledPasses != 1U
+				|| numExecuted != numLivePasses * NumFrames || stats.numCreatedTextures != 0U
+				|| stats.numPhysicalTextures != expectedPhysical || (numPostPasses > 0U && stats.physicalBytes != physicalBytesWithPost)
+				|| stats.numBarrierBatches > numLivePasses )
+			{
+				std::cout << "  * FAILED: " << numMismatches << " bad lifetimes or states, " << stats.numCulledPasses << " passes culled, "
+					<< stats.numCreatedTextures << " textures created after the first frame" << std::endl;
+				passed = false;
+			}
+		}
+
+		return passed;
+	}
+
+	bool ObjectCacheKeys()
+	{
+		using nvrhi::ComparisonFunc;
+		constexpr nvrhi::RasterCullMode CullModes[] = { nvrhi::RasterCullMode::Back, nvrhi::RasterCullMode::Front, nvrhi::RasterCullMode::None };
+		constexpr nvrhi::RasterFillMode FillModes[] = { nvrhi::RasterFillMode::Solid, nvrhi::RasterFillMode::Wireframe };
+		constexpr ComparisonFunc DepthFuncs[] = { ComparisonFunc::Never, ComparisonFunc::Less, ComparisonFunc::Equal, ComparisonFunc::LessOrEqual,
+			ComparisonFunc::Greater, ComparisonFunc::NotEqual, ComparisonFunc::GreaterOrEqual, ComparisonFunc::Always };
+		constexpr nvrhi::PrimitiveType PrimTypes[] = { nvrhi::PrimitiveType::TriangleList, nvrhi::PrimitiveType::TriangleStrip };
+		constexpr nvrhi::Format ColourFormats[] = { nvrhi::Format::RGBA8_UNORM, nvrhi::Format::SRGBA8_UNORM, nvrhi::Format::RGBA16_FLOAT };
+		constexpr uint32_t SampleCounts[] = { 1U, 4U };
+		constexpr uint32_t NumBindingSets = 4096U;
+		constexpr uint32_t NumLookups = 100000U;
+
+		struct PipelineKey
+		{
+			nvrhi::GraphicsPipelineDesc desc;
+			nvrhi::FramebufferInfo framebufferInfo;
+		};
+
+		// Every combination is a different pipeline
+		std::vector<PipelineKey> pipelines;
+		for ( auto cullMode : CullModes ) for ( auto fillMode : FillModes ) for ( auto depthFunc : DepthFuncs )
+		for ( bool depthWrite : { false, true } ) for ( auto primType : PrimTypes ) for ( auto format : ColourFormats )
+		for ( uint32_t sampleCount : SampleCounts )
+		{
+			PipelineKey key;
+			key.desc.primType = primType;
+			key.desc.renderState.rasterState.cullMode = cullMode;
+			key.desc.renderState.rasterState.fillMode = fillMode;
+			key.desc.renderState.depthStencilState.depthFunc = depthFunc;
+			key.desc.renderState.depthStencilState.depthWriteEnable = depthWrite;
+			key.framebufferInfo.colorFormats.push_back( format );
+			key.framebufferInfo.depthFormat = nvrhi::Format::D32;
+			key.framebufferInfo.sampleCount = sampleCount;
+			key.framebufferInfo.width = 1600U;
+			key.framebufferInfo.height = 900U;
+			pipelines.push_back( key );
+		}
+
+		// Never dereferenced, only compared and hashed
+		const auto fakeTexture = []( uint32_t i )
+		{
+			return reinterpret_cast<nvrhi::ITexture*>( uintptr_t( 0x10000000U + i * 0x100U ) );
+		};
+		nvrhi::IBindingLayout* layout = reinterpret_cast<nvrhi::IBindingLayout*>( uintptr_t( 0x20000000U ) );
+		std::vector<nvrhi::BindingSetDesc> bindingSets( NumBindingSets );
+		for ( uint32_t i = 0U; i < NumBindingSets; i++ )
+		{
+			bindingSets[i].bindings =
+			{
+				nvrhi::BindingSetItem::Texture_SRV( 0, fakeTexture( i ) ),
+				nvrhi::BindingSetItem::Texture_SRV( 1, fakeTexture( i / 2U ) )
+			};
+		}
+
+		uint32_t numMismatches = 0U;
+		std::unordered_set<size_t> pipelineHashes;
+		for ( size_t i = 0U; i < pipelines.size(); i++ )
+		{
+			const PipelineKey& key = pipelines[i];
+			pipelineHashes.insert( ObjectCache::HashGraphicsPipeline( key.desc, key.framebufferInfo ) );
+
+			// A copy for a framebuffer of another size is still the same pipeline
+			PipelineKey copy = key;
+			copy.framebufferInfo.width = 800U;
+			numMismatches += ObjectCache::HashGraphicsPipeline( copy.desc, copy.framebufferInfo ) != ObjectCache::HashGraphicsPipeline( key.desc, key.framebufferInfo );
+			numMismatches += !ObjectCache::IsSameGraphicsPipeline( copy.desc, copy.framebufferInfo, key.desc, key.framebufferInfo );
+
+			for ( size_t j = i + 1U; j < pipelines.size(); j++ )
+			{
+				numMismatches += ObjectCache::IsSameGraphicsPipeline( key.desc, key.framebufferInfo, pipelines[j].desc, pipelines[j].framebufferInfo );
+			}
+		}
+
+		std::unordered_set<size_t> bindingSetHashes;
+		for ( uint32_t i = 0U; i < NumBindingSets; i++ )
+		{
+			bindingSetHashes.insert( ObjectCache::HashBindingSet( bindingSets[i], layout ) );
+			nvrhi::BindingSetDesc copy = bindingSets[i];
+			numMismatches += ObjectCache::HashBindingSet( copy, layout ) != ObjectCache::HashBindingSet( bindingSets[i], layout );
+			numMismatches += !(copy == bindingSets[i]) || (i > 0U && bindingSets[i - 1U] == bindingSets[i]);
+		}
+
+		// What a lookup costs before it even touches the maps
+		size_t sink = 0U;
+		adm::TimerPreciseDouble timer;
+		for ( uint32_t i = 0U; i < NumLookups; i++ )
+		{
+			const PipelineKey& key = pipelines[i % pipelines.size()];
+			sink += ObjectCache::HashGraphicsPipeline( key.desc, key.framebufferInfo );
+		}
+		const double pipelineSeconds = timer.GetElapsed( adm::TimeUnits::Seconds );
+
+		timer.Reset();
+		for ( uint32_t i = 0U; i < NumLookups; i++ )
+		{
+			sink += ObjectCache::HashBindingSet( bindingSets[i % NumBindingSets], layout );
+		}
+		const double bindingSetSeconds = timer.GetElapsed( adm::TimeUnits::Seconds );
+
+		const size_t pipelineCollisions = pipelines.size() - pipelineHashes.size();
+		const size_t bindingSetCollisions = NumBindingSets - bindingSetHashes.size();
+		std::cout << "Object cache keys:" << std::endl
+			<< "  * " << pipelines.size() << " pipelines: " << pipelineCollisions << " hash collisions, "
+			<< pipelineSeconds * 1000000000.0 / NumLookups << " ns to hash" << std::endl
+			<< "  * " << NumBindingSets << " binding sets: " << bindingSetCollisions << " hash collisions, "
+			<< bindingSetSeconds * 1000000000.0 / NumLookups << " ns to hash (" << (sink & 1U) << ")" << std::endl;
+
+		// Collisions only cost a compare, but lots of them would mean the hash misses a field
+		if ( numMismatches > 0U || pipelineCollisions > pipelines.size() / 100U || bindingSetCollisions > NumBindingSets / 100U )
+		{
+			std::cout << "  * FAILED: " << numMismatches << " descs hashed or compared wrong" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	// Packs assets/shaders into a temporary shader pack, checks every shader in it against its loose file,
+	// and compares looking them up in the pack with mapping the loose files one by one
+	bool ShaderPack()
+	{
+		constexpr uint32_t NumRounds = 200U;
+		const char* packPath = "bench_shaders.pack";
+		const char* binaryFiles[] = { "default_main_vs.bin", "default_main_ps.bin", "screen_main_vs.bin", "screen_main_ps.bin" };
+		const char* backends[] = { "dx11", "dx12", "vk" };
+
+		std::cout << "Shader pack (assets/shaders, " << NumRounds << " rounds):" << std::endl;
+
+		FileSystem::Init();
+		const bool built = Shader::BuildPack( "assets/shaders", packPath );
+
+		// Loose files first, without the pack
+		double looseSeconds = 0.0;
+		size_t looseBytes = 0U;
+		adm::TimerPreciseDouble timer;
+		for ( uint32_t round = 0U; round < NumRounds; round++ )
+		{
+			for ( const char* backend : backends ) for ( const char* binaryFile : binaryFiles )
+			{
+				FileSystem::FileData bytecode;
+				Shader::Load( backend, binaryFile, bytecode );
+				looseBytes += bytecode.size;
+			}
+		}
+		looseSeconds = timer.GetElapsed( adm::TimeUnits::Seconds );
+
+		const bool opened = built && Shader::OpenPack( packPath );
+		uint32_t numMismatches = 0U;
+		for ( const char* backend : backends ) for ( const char* binaryFile : binaryFiles )
+		{
+			FileSystem::FileData packed, loose;
+			FileSystem::ReadFile( std::string( "assets/shaders/" ) + backend + "/" + binaryFile, loose );
+			numMismatches += !Shader::Load( backend, binaryFile, packed ) || packed.size != loose.size
+				|| std::memcmp( packed.data, loose.data, loose.size ) || uintptr_t( packed.data ) % 4U != 0U;
+		}
+
+		size_t packBytes = 0U;
+		timer.Reset();
+		for ( uint32_t round = 0U; round < NumRounds; round++ )
+		{
+			for ( const char* backend : backends ) for ( const char* binaryFile : binaryFiles )
+			{
+				FileSystem::FileData bytecode;
+				Shader::Load( backend, binaryFile, bytecode );
+				packBytes += bytecode.size;
+			}
+		}
+		const double packSeconds = timer.GetElapsed( adm::TimeUnits::Seconds );
+
+		Shader::ClosePack();
+		FileSystem::Shutdown();
+		std::remove( packPath );
+
+		const uint32_t numLoads = NumRounds * std::size( backends ) * std::size( binaryFiles );
+		std::cout << "  * Loose files: " << looseSeconds * 1000000.0 / numLoads << " us per shader" << std::endl
+			<< "  * Pack:        " << packSeconds * 1000000.0 / numLoads << " us per shader" << std::endl;
+
+		if ( !opened || numMismatches > 0U || packBytes != looseBytes )
+		{
+			std::cout << "  * FAILED: " << numMismatches << " shaders differ from their loose files" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,872 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+
+#include <numeric>
+
+// SSE2 is always there on x64, anything else takes the scalar path
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define BVH_SSE 1
+#include <emmintrin.h>
+#else
+#define BVH_SSE 0
+#endif
+
+namespace Bvh
+{
+	// Half the surface area, the factor doesn't matter for comparing costs
+	static float HalfArea( const adm::Vec3& boundsMin, const adm::Vec3& boundsMax )
+	{
+		const adm::Vec3 size = boundsMax - boundsMin;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+
+	static float UnionArea( const Node& a, const Node& b )
+	{
+		const adm::Vec3 boundsMin = { std::min( a.boundsMin.x, b.boundsMin.x ), std::min( a.boundsMin.y, b.boundsMin.y ), std::min( a.boundsMin.z, b.boundsMin.z ) };
+		const adm::Vec3 boundsMax = { std::max( a.boundsMax.x, b.boundsMax.x ), std::max( a.boundsMax.y, b.boundsMax.y ), std::max( a.boundsMax.z, b.boundsMax.z ) };
+		return HalfArea( boundsMin, boundsMax );
+	}
+
+	static void GrowBounds( float* boundsMin, float* boundsMax, const float* itemMin, const float* itemMax )
+	{
+		for ( int axis = 0; axis < 3; axis++ )
+		{
+			boundsMin[axis] = std::min( boundsMin[axis], itemMin[axis] );
+			boundsMax[axis] = std::max( boundsMax[axis], itemMax[axis] );
+		}
+	}
+
+	static float HalfArea( const float* boundsMin, const float* boundsMax )
+	{
+		return HalfArea( adm::Vec3{ boundsMin[0], boundsMin[1], boundsMin[2] }, adm::Vec3{ boundsMax[0], boundsMax[1], boundsMax[2] } );
+	}
+
+	// Binned SAH, shared by both trees: every bin boundary on every axis is costed as area * items on either side,
+	// and the items are partitioned at the cheapest one, returns how many went to the left
+	// getBounds( item, float* outMin, float* outMax ) gives an item's box, which is split by its centre
+	template<typename GetBoundsFunction>
+	static uint32_t SplitItems( uint32_t* items, uint32_t count, const GetBoundsFunction& getBounds )
+	{
+		constexpr float Huge = std::numeric_limits<float>::max();
+		const auto getCentre = [&getBounds]( uint32_t item, int axis )
+		{
+			float itemMin[3], itemMax[3];
+			getBounds( item, itemMin, itemMax );
+			return (itemMin[axis] + itemMax[axis]) * 0.5f;
+		};
+
+		// Splits are placed between centres, so that's what the bins span
+		float centreMin[3] = { Huge, Huge, Huge };
+		float centreMax[3] = { -Huge, -Huge, -Huge };
+		for ( uint32_t i = 0U; i < count; i++ )
+		{
+			float itemMin[3], itemMax[3];
+			getBounds( items[i], itemMin, itemMax );
+			for ( int axis = 0; axis < 3; axis++ )
+			{
+				centreMin[axis] = std::min( centreMin[axis], (itemMin[axis] + itemMax[axis]) * 0.5f );
+				centreMax[axis] = std::max( centreMax[axis], (itemMin[axis] + itemMax[axis]) * 0.5f );
+			}
+		}
+
+		const auto getBin = [&]( int axis, float centre )
+		{
+			const float scale = NumBins / (centreMax[axis] - centreMin[axis]);
+			return std::min( uint32_t( (centre - centreMin[axis]) * scale ), NumBins - 1U );
+		};
+
+		struct Bin
+		{
+			float boundsMin[3]{ Huge, Huge, Huge };
+			float boundsMax[3]{ -Huge, -Huge, -Huge };
+			uint32_t count{};
+		};
+
+		float bestCost = Huge;
+		int bestAxis = -1;
+		uint32_t bestSplit = 0U;
+		for ( int axis = 0; axis < 3; axis++ )
+		{
+			if ( centreMax[axis] <= centreMin[axis] )
+			{
+				continue;
+			}
+
+			Bin bins[NumBins];
+			for ( uint32_t i = 0U; i < count; i++ )
+			{
+				float itemMin[3], itemMax[3];
+				getBounds( items[i], itemMin, itemMax );
+
+				Bin& bin = bins[getBin( axis, (itemMin[axis] + itemMax[axis]) * 0.5f )];
+				GrowBounds( bin.boundsMin, bin.boundsMax, itemMin, itemMax );
+				bin.count++;
+			}
+
+			float rightAreas[NumBins]{};
+			uint32_t rightCounts[NumBins]{};
+			Bin right;
+			for ( uint32_t b = NumBins - 1U; b > 0U; b-- )
+			{
+				GrowBounds( right.boundsMin, right.boundsMax, bins[b].boundsMin, bins[b].boundsMax );
+				right.count += bins[b].count;
+				rightAreas[b] = right.count ? HalfArea( right.boundsMin, right.boundsMax ) : 0.0f;
+				rightCounts[b] = right.count;
+			}
+
+			Bin left;
+			for ( uint32_t split = 1U; split < NumBins; split++ )
+			{
+				GrowBounds( left.boundsMin, left.boundsMax, bins[split - 1U].boundsMin, bins[split - 1U].boundsMax );
+				left.count += bins[split - 1U].count;
+				if ( 0U == left.count || 0U == rightCounts[split] )
+				{
+					continue;
+				}
+
+				const float cost = HalfArea( left.boundsMin, left.boundsMax ) * left.count + rightAreas[split] * rightCounts[split];
+				if ( cost < bestCost )
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = split;
+				}
+			}
+		}
+
+		// All centres in one spot can't be split by position, halving keeps the tree balanced at least
+		if ( bestAxis < 0 )
+		{
+			return count / 2U;
+		}
+
+		return std::partition( items, items + count, [&]( uint32_t item ) { return getBin( bestAxis, getCentre( item, bestAxis ) ) < bestSplit; } ) - items;
+	}
+
+	void Tree::Build( const Culling::BoundsArray& bounds )
+	{
+		Clear();
+
+		const uint32_t count = bounds.Size();
+		if ( 0U == count )
+		{
+			return;
+		}
+
+		nodes.reserve( count * 2U - 1U );
+		itemLeaves.resize( count );
+
+		std::vector<uint32_t> items( count );
+		std::iota( items.begin(), items.end(), 0U );
+		root = BuildRange( items.data(), count, InvalidIndex, bounds );
+	}
+
+	void Tree::Clear()
+	{
+		nodes.clear();
+		itemLeaves.clear();
+		root = InvalidIndex;
+		freeNode = InvalidIndex;
+		numRotations = 0U;
+		numReinserts = 0U;
+	}
+
+	uint32_t Tree::BuildRange( uint32_t* items, uint32_t count, uint32_t parent, const Culling::BoundsArray& bounds )
+	{
+		const std::vector<float>* centres[3] = { &bounds.centreX, &bounds.centreY, &bounds.centreZ };
+		const std::vector<float>* extents[3] = { &bounds.extentX, &bounds.extentY, &bounds.extentZ };
+		const auto getItemBounds = [&]( uint32_t item, float* outMin, float* outMax )
+		{
+			for ( int axis = 0; axis < 3; axis++ )
+			{
+				outMin[axis] = (*centres[axis])[item] - (*extents[axis])[item];
+				outMax[axis] = (*centres[axis])[item] + (*extents[axis])[item];
+			}
+		};
+
+		const uint32_t index = nodes.size();
+		nodes.emplace_back();
+		nodes[index].parent = parent;
+
+		if ( 1U == count )
+		{
+			float itemMin[3], itemMax[3];
+			getItemBounds( items[0], itemMin, itemMax );
+
+			Node& leaf = nodes[index];
+			leaf.item = items[0];
+			leaf.boundsMin = { itemMin[0], itemMin[1], itemMin[2] };
+			leaf.boundsMax = { itemMax[0], itemMax[1], itemMax[2] };
+			itemLeaves[items[0]] = index;
+			return index;
+		}
+
+		const uint32_t middle = SplitItems( items, count, getItemBounds );
+
+		const uint32_t leftChild = BuildRange( items, middle, index, bounds );
+		const uint32_t rightChild = BuildRange( items + middle, count - middle, index, bounds );
+		nodes[index].children[0] = leftChild;
+		nodes[index].children[1] = rightChild;
+		Refit( index );
+
+		return index;
+	}
+
+	void Tree::Refit( uint32_t index )
+	{
+		Node& node = nodes[index];
+		const Node& left = nodes[node.children[0]];
+		const Node& right = nodes[node.children[1]];
+
+		node.boundsMin = { std::min( left.boundsMin.x, right.boundsMin.x ), std::min( left.boundsMin.y, right.boundsMin.y ), std::min( left.boundsMin.z, right.boundsMin.z ) };
+		node.boundsMax = { std::max( left.boundsMax.x, right.boundsMax.x ), std::max( left.boundsMax.y, right.boundsMax.y ), std::max( left.boundsMax.z, right.boundsMax.z ) };
+	}
+
+	// Kopta et al., "Fast, Effective BVH Updates for Animated Scenes"
+	// A child can trade places with a grandchild on the other side, which leaves this node's bounds alone
+	// but can shrink the other child's a lot, e.g. after something moved from one end of the level to the other
+	void Tree::Rotate( uint32_t index )
+	{
+		const Node& node = nodes[index];
+
+		float bestGain = 0.0f;
+		uint32_t bestChild = InvalidIndex;
+		uint32_t bestGrandchild = InvalidIndex;
+		for ( int side = 0; side < 2; side++ )
+		{
+			const uint32_t child = node.children[side];
+			const Node& other = nodes[node.children[1 - side]];
+			if ( other.IsLeaf() )
+			{
+				continue;
+			}
+
+			const float otherArea = HalfArea( other.boundsMin, other.boundsMax );
+			for ( int g = 0; g < 2; g++ )
+			{
+				// The child goes where grandchild g was, so the other child ends up holding it and the remaining grandchild
+				const float gain = otherArea - UnionArea( nodes[child], nodes[other.children[1 - g]] );
+				if ( gain > bestGain )
+				{
+					bestGain = gain;
+					bestChild = child;
+					bestGrandchild = other.children[g];
+				}
+			}
+		}
+
+		if ( InvalidIndex == bestChild )
+		{
+			return;
+		}
+
+		const uint32_t otherChild = nodes[bestGrandchild].parent;
+		const auto replaceChild = [this]( uint32_t parent, uint32_t from, uint32_t to )
+		{
+			uint32_t* children = nodes[parent].children;
+			children[children[0] == from ? 0 : 1] = to;
+			nodes[to].parent = parent;
+		};
+
+		replaceChild( index, bestChild, bestGrandchild );
+		replaceChild( otherChild, bestGrandchild, bestChild );
+		Refit( otherChild );
+		numRotations++;
+	}
+
+	void Tree::RemoveLeaf( uint32_t leaf )
+	{
+		// The leaf's parent goes away and the sibling takes its place
+		const uint32_t parent = nodes[leaf].parent;
+		if ( InvalidIndex == parent )
+		{
+			root = InvalidIndex;
+			return;
+		}
+
+		const uint32_t grandparent = nodes[parent].parent;
+		const uint32_t sibling = nodes[parent].children[nodes[parent].children[0] == leaf ? 1 : 0];
+		nodes[sibling].parent = grandparent;
+		if ( InvalidIndex == grandparent )
+		{
+			root = sibling;
+		}
+		else
+		{
+			uint32_t* children = nodes[grandparent].children;
+			children[children[0] == parent ? 0 : 1] = sibling;
+			for ( uint32_t index = grandparent; index != InvalidIndex; index = nodes[index].parent )
+			{
+				Refit( index );
+			}
+		}
+
+		nodes[leaf].parent = InvalidIndex;
+		// Kept around for InsertLeaf, so the node array never grows or gets holes
+		nodes[parent].parent = InvalidIndex;
+		nodes[parent].children[0] = nodes[parent].children[1] = InvalidIndex;
+		freeNode = parent;
+	}
+
+	void Tree::InsertLeaf( uint32_t leaf )
+	{
+		if ( InvalidIndex == root )
+		{
+			root = leaf;
+			return;
+		}
+
+		// Goes down towards whichever child grows the least, until pairing up with the current node is cheaper than that
+		// Every node on the way grows by the same amount no matter where the leaf ends up below it, so that part is carried along
+		const Node& leafNode = nodes[leaf];
+		const float leafArea = HalfArea( leafNode.boundsMin, leafNode.boundsMax );
+		uint32_t sibling = root;
+		float inheritedCost = 0.0f;
+		while ( !nodes[sibling].IsLeaf() )
+		{
+			const Node& node = nodes[sibling];
+			const float combinedArea = UnionArea( node, leafNode );
+			const float pairCost = combinedArea + inheritedCost;
+			const float childInherited = inheritedCost + combinedArea - HalfArea( node.boundsMin, node.boundsMax );
+
+			float childCosts[2];
+			for ( int c = 0; c < 2; c++ )
+			{
+				const Node& child = nodes[node.children[c]];
+				childCosts[c] = child.IsLeaf() ? UnionArea( child, leafNode ) : UnionArea( child, leafNode ) - HalfArea( child.boundsMin, child.boundsMax ) + leafArea;
+				childCosts[c] += childInherited;
+			}
+
+			if ( pairCost <= childCosts[0] && pairCost <= childCosts[1] )
+			{
+				break;
+			}
+
+			inheritedCost = childInherited;
+			sibling = node.children[childCosts[0] <= childCosts[1] ? 0 : 1];
+		}
+
+		const uint32_t parent = freeNode;
+		const uint32_t grandparent = nodes[sibling].parent;
+		freeNode = InvalidIndex;
+
+		nodes[parent].parent = grandparent;
+		nodes[parent].children[0] = sibling;
+		nodes[parent].children[1] = leaf;
+		nodes[sibling].parent = parent;
+		nodes[leaf].parent = parent;
+		if ( InvalidIndex == grandparent )
+		{
+			root = parent;
+		}
+		else
+		{
+			uint32_t* children = nodes[grandparent].children;
+			children[children[0] == sibling ? 0 : 1] = parent;
+		}
+	}
+
+	void Tree::Update( uint32_t item, const adm::Vec3& boundsMin, const adm::Vec3& boundsMax )
+	{
+		uint32_t index = itemLeaves[item];
+		Node& leaf = nodes[index];
+
+		// Something that moved further than its own size would stretch every box up to the root, so it's taken out and put back in
+		// Anything less is left where it is, the rotations sort out small drifts
+		const bool overlapsOld = boundsMin.x <= leaf.boundsMax.x && boundsMax.x >= leaf.boundsMin.x
+			&& boundsMin.y <= leaf.boundsMax.y && boundsMax.y >= leaf.boundsMin.y
+			&& boundsMin.z <= leaf.boundsMax.z && boundsMax.z >= leaf.boundsMin.z;
+
+		leaf.boundsMin = boundsMin;
+		leaf.boundsMax = boundsMax;
+		if ( !overlapsOld && InvalidIndex != leaf.parent )
+		{
+			RemoveLeaf( index );
+			InsertLeaf( index );
+			numReinserts++;
+		}
+
+		// Every ancestor's children are up to date by the time it's refit, so it can rotate right after
+		for ( index = nodes[index].parent; index != InvalidIndex; index = nodes[index].parent )
+		{
+			Refit( index );
+			Rotate( index );
+		}
+	}
+
+	size_t Tree::CullFrustum( const Culling::Frustum& frustum, uint8_t* outVisible ) const
+	{
+		std::fill_n( outVisible, itemLeaves.size(), uint8_t( 0U ) );
+		if ( InvalidIndex == root )
+		{
+			return 0U;
+		}
+
+		// Along with each node go the planes its parent wasn't entirely inside of, the others can't cull anything below
+		constexpr uint32_t AllPlanes = (1U << 6U) - 1U;
+		std::vector<std::pair<uint32_t, uint32_t>> stack;
+		stack.reserve( 64U );
+		stack.push_back( { root, AllPlanes } );
+
+		size_t numVisible = 0U;
+		while ( !stack.empty() )
+		{
+			auto [index, planeMask] = stack.back();
+			stack.pop_back();
+
+			const Node& node = nodes[index];
+			const adm::Vec3 centre = (node.boundsMin + node.boundsMax) * 0.5f;
+			const adm::Vec3 extent = (node.boundsMax - node.boundsMin) * 0.5f;
+
+			bool outside = false;
+			for ( uint32_t p = 0U; p < 6U && !outside; p++ )
+			{
+				if ( !(planeMask & (1U << p)) )
+				{
+					continue;
+				}
+
+				// Same test as Culling::CullBoxes
+				const float* plane = frustum.planes[p];
+				const float distance = plane[0] * centre.x + plane[1] * centre.y + plane[2] * centre.z + plane[3];
+				const float radius = std::abs( plane[0] ) * extent.x + std::abs( plane[1] ) * extent.y + std::abs( plane[2] ) * extent.z;
+
+				outside = distance + radius < 0.0f;
+				if ( distance - radius >= 0.0f )
+				{
+					planeMask &= ~(1U << p);
+				}
+			}
+
+			if ( outside )
+			{
+				continue;
+			}
+
+			if ( node.IsLeaf() )
+			{
+				outVisible[node.item] = 1U;
+				numVisible++;
+				continue;
+			}
+
+			stack.push_back( { node.children[0], planeMask } );
+			stack.push_back( { node.children[1], planeMask } );
+		}
+
+		return numVisible;
+	}
+
+	void Tree::QueryRay( const adm::Vec3& origin, const adm::Vec3& direction, float maxDistance, std::vector<uint32_t>& outItems ) const
+	{
+		outItems.clear();
+		if ( InvalidIndex == root )
+		{
+			return;
+		}
+
+		const adm::Vec3 inverseDirection = { 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z };
+
+		std::vector<uint32_t> stack;
+		stack.reserve( 64U );
+		stack.push_back( root );
+		while ( !stack.empty() )
+		{
+			const Node& node = nodes[stack.back()];
+			stack.pop_back();
+
+			// Slabs, the segment has to be inside all three at once
+			const float tx0 = (node.boundsMin.x - origin.x) * inverseDirection.x, tx1 = (node.boundsMax.x - origin.x) * inverseDirection.x;
+			const float ty0 = (node.boundsMin.y - origin.y) * inverseDirection.y, ty1 = (node.boundsMax.y - origin.y) * inverseDirection.y;
+			const float tz0 = (node.boundsMin.z - origin.z) * inverseDirection.z, tz1 = (node.boundsMax.z - origin.z) * inverseDirection.z;
+			const float tNear = std::max( { std::min( tx0, tx1 ), std::min( ty0, ty1 ), std::min( tz0, tz1 ), 0.0f } );
+			const float tFar = std::min( { std::max( tx0, tx1 ), std::max( ty0, ty1 ), std::max( tz0, tz1 ), maxDistance } );
+			if ( tNear > tFar )
+			{
+				continue;
+			}
+
+			if ( node.IsLeaf() )
+			{
+				outItems.push_back( node.item );
+				continue;
+			}
+
+			stack.push_back( node.children[0] );
+			stack.push_back( node.children[1] );
+		}
+	}
+
+	void Tree::QuerySphere( const adm::Vec3& centre, float radius, std::vector<uint32_t>& outItems ) const
+	{
+		outItems.clear();
+		if ( InvalidIndex == root )
+		{
+			return;
+		}
+
+		std::vector<uint32_t> stack;
+		stack.reserve( 64U );
+		stack.push_back( root );
+		while ( !stack.empty() )
+		{
+			const Node& node = nodes[stack.back()];
+			stack.pop_back();
+
+			// From the centre to the nearest point of the box
+			const float dx = std::clamp( centre.x, node.boundsMin.x, node.boundsMax.x ) - centre.x;
+			const float dy = std::clamp( centre.y, node.boundsMin.y, node.boundsMax.y ) - centre.y;
+			const float dz = std::clamp( centre.z, node.boundsMin.z, node.boundsMax.z ) - centre.z;
+			if ( dx * dx + dy * dy + dz * dz > radius * radius )
+			{
+				continue;
+			}
+
+			if ( node.IsLeaf() )
+			{
+				outItems.push_back( node.item );
+				continue;
+			}
+
+			stack.push_back( node.children[0] );
+			stack.push_back( node.children[1] );
+		}
+	}
+
+	float Tree::GetCost() const
+	{
+		if ( InvalidIndex == root || nodes[root].IsLeaf() )
+		{
+			return 0.0f;
+		}
+
+		float totalArea = 0.0f;
+		for ( const Node& node : nodes )
+		{
+			if ( !node.IsLeaf() )
+			{
+				totalArea += HalfArea( node.boundsMin, node.boundsMax );
+			}
+		}
+
+		return totalArea / HalfArea( nodes[root].boundsMin, nodes[root].boundsMax );
+	}
+
+	static float Dot( const adm::Vec3& a, const adm::Vec3& b )
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	static void GetTriangleBounds( const Triangle& triangle, float* outMin, float* outMax )
+	{
+		const adm::Vec3 b = triangle.vertex + triangle.edge1;
+		const adm::Vec3 c = triangle.vertex + triangle.edge2;
+		outMin[0] = std::min( { triangle.vertex.x, b.x, c.x } );
+		outMin[1] = std::min( { triangle.vertex.y, b.y, c.y } );
+		outMin[2] = std::min( { triangle.vertex.z, b.z, c.z } );
+		outMax[0] = std::max( { triangle.vertex.x, b.x, c.x } );
+		outMax[1] = std::max( { triangle.vertex.y, b.y, c.y } );
+		outMax[2] = std::max( { triangle.vertex.z, b.z, c.z } );
+	}
+
+	// Möller & Trumbore, from either side, only counts if it's closer than inOutDistance
+	static bool IntersectTriangle( const Triangle& triangle, const adm::Vec3& origin, const adm::Vec3& direction, float& inOutDistance )
+	{
+		const adm::Vec3 p = direction.Cross( triangle.edge2 );
+		const float determinant = Dot( triangle.edge1, p );
+		if ( std::abs( determinant ) < 1.0e-12f )
+		{
+			return false;
+		}
+
+		const float inverseDeterminant = 1.0f / determinant;
+		const adm::Vec3 s = origin - triangle.vertex;
+		const float u = Dot( s, p ) * inverseDeterminant;
+		if ( u < 0.0f || u > 1.0f )
+		{
+			return false;
+		}
+
+		const adm::Vec3 q = s.Cross( triangle.edge1 );
+		const float v = Dot( direction, q ) * inverseDeterminant;
+		if ( v < 0.0f || u + v > 1.0f )
+		{
+			return false;
+		}
+
+		const float distance = Dot( triangle.edge2, q ) * inverseDeterminant;
+		if ( distance < 0.0f || distance >= inOutDistance )
+		{
+			return false;
+		}
+
+		inOutDistance = distance;
+		return true;
+	}
+
+	void TriangleTree::AddTriangle( const adm::Vec3& a, const adm::Vec3& b, const adm::Vec3& c, uint32_t surface )
+	{
+		triangles.push_back( { a, b - a, c - a, surface } );
+	}
+
+	void TriangleTree::Clear()
+	{
+		nodes.clear();
+		triangles.clear();
+	}
+
+	// Deeper than this, nodes are just halved, which keeps the traversal stack's size fixed
+	constexpr uint32_t MaxSahDepth = 32U;
+	constexpr uint32_t MaxStackDepth = 64U;
+
+	void TriangleTree::Build()
+	{
+		nodes.clear();
+		if ( triangles.empty() )
+		{
+			return;
+		}
+
+		// Leaves point into a range of triangles, so they're copied over in leaf order
+		std::vector<Triangle> source;
+		source.swap( triangles );
+		triangles.reserve( source.size() );
+		nodes.reserve( source.size() );
+
+		std::vector<uint32_t> items( source.size() );
+		std::iota( items.begin(), items.end(), 0U );
+		BuildRange( source, items.data(), items.size(), 0U );
+
+		nodes.shrink_to_fit();
+	}
+
+	uint32_t TriangleTree::BuildRange( const std::vector<Triangle>& source, uint32_t* items, uint32_t count, uint32_t depth )
+	{
+		const auto getItemBounds = [&source]( uint32_t item, float* outMin, float* outMax )
+		{
+			GetTriangleBounds( source[item], outMin, outMax );
+		};
+
+		const uint32_t index = nodes.size();
+		nodes.emplace_back();
+
+		constexpr float Huge = std::numeric_limits<float>::max();
+		float boundsMin[3] = { Huge, Huge, Huge };
+		float boundsMax[3] = { -Huge, -Huge, -Huge };
+		for ( uint32_t i = 0U; i < count; i++ )
+		{
+			float itemMin[3], itemMax[3];
+			getItemBounds( items[i], itemMin, itemMax );
+			GrowBounds( boundsMin, boundsMax, itemMin, itemMax );
+		}
+
+		std::copy_n( boundsMin, 3, nodes[index].boundsMin );
+		std::copy_n( boundsMax, 3, nodes[index].boundsMax );
+
+		if ( count <= MaxLeafTriangles )
+		{
+			nodes[index].offset = triangles.size();
+			nodes[index].numTriangles = count;
+			for ( uint32_t i = 0U; i < count; i++ )
+			{
+				triangles.push_back( source[items[i]] );
+			}
+			return index;
+		}
+
+		const uint32_t middle = depth < MaxSahDepth ? SplitItems( items, count, getItemBounds ) : count / 2U;
+
+		// The first child lands right after this node
+		BuildRange( source, items, middle, depth + 1U );
+		const uint32_t second = BuildRange( source, items + middle, count - middle, depth + 1U );
+		nodes[index].offset = second;
+		nodes[index].numTriangles = 0U;
+
+		return index;
+	}
+
+	bool TriangleTree::CastRay( const adm::Vec3& origin, const adm::Vec3& direction, RayHit& inOutHit ) const
+	{
+		if ( nodes.empty() )
+		{
+			return false;
+		}
+
+#if BVH_SSE
+		const __m128 rayOrigin = _mm_setr_ps( origin.x, origin.y, origin.z, 0.0f );
+		const __m128 rayInverse = _mm_setr_ps( 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z, 0.0f );
+		const __m128 zero = _mm_setzero_ps();
+#else
+		const float rayOrigin[3] = { origin.x, origin.y, origin.z };
+		const float rayInverse[3] = { 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z };
+#endif
+
+		// Slabs, all three axes in one go, outNear is where the ray enters the box
+		const auto intersectNode = [&]( const FlatNode& node, float maxDistance, float& outNear )
+		{
+#if BVH_SSE
+			// The fourth lanes are offset and numTriangles, they're carried along but never looked at
+			const __m128 t0 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( node.boundsMin ), rayOrigin ), rayInverse );
+			const __m128 t1 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( node.boundsMax ), rayOrigin ), rayInverse );
+			const __m128 tMin = _mm_min_ps( t0, t1 );
+			const __m128 tMax = _mm_max_ps( t0, t1 );
+
+			const __m128 tNear = _mm_max_ss( _mm_max_ss( tMin, _mm_shuffle_ps( tMin, tMin, _MM_SHUFFLE( 1, 1, 1, 1 ) ) ),
+				_mm_max_ss( _mm_shuffle_ps( tMin, tMin, _MM_SHUFFLE( 2, 2, 2, 2 ) ), zero ) );
+			const __m128 tFar = _mm_min_ss( _mm_min_ss( tMax, _mm_shuffle_ps( tMax, tMax, _MM_SHUFFLE( 1, 1, 1, 1 ) ) ),
+				_mm_min_ss( _mm_shuffle_ps( tMax, tMax, _MM_SHUFFLE( 2, 2, 2, 2 ) ), _mm_set_ss( maxDistance ) ) );
+
+			outNear = _mm_cvtss_f32( tNear );
+			return 0 != (_mm_movemask_ps( _mm_cmple_ss( tNear, tFar ) ) & 1);
+#else
+			float tNear = 0.0f;
+			float tFar = maxDistance;
+			for ( int axis = 0; axis < 3; axis++ )
+			{
+				const float t0 = (node.boundsMin[axis] - rayOrigin[axis]) * rayInverse[axis];
+				const float t1 = (node.boundsMax[axis] - rayOrigin[axis]) * rayInverse[axis];
+				tNear = std::max( tNear, std::min( t0, t1 ) );
+				tFar = std::min( tFar, std::max( t0, t1 ) );
+			}
+
+			outNear = tNear;
+			return tNear <= tFar;
+#endif
+		};
+
+		struct StackEntry
+		{
+			uint32_t node;
+			float distance;
+		};
+		StackEntry stack[MaxStackDepth];
+		uint32_t stackSize = 0U;
+
+		float rootDistance;
+		if ( !intersectNode( nodes[0], inOutHit.distance, rootDistance ) )
+		{
+			return false;
+		}
+
+		bool found = false;
+		uint32_t index = 0U;
+		while ( true )
+		{
+			const FlatNode& node = nodes[index];
+			if ( node.numTriangles > 0U )
+			{
+				for ( uint32_t i = node.offset; i < node.offset + node.numTriangles; i++ )
+				{
+					if ( IntersectTriangle( triangles[i], origin, direction, inOutHit.distance ) )
+					{
+						inOutHit.triangle = i;
+						inOutHit.surface = triangles[i].surface;
+						found = true;
+					}
+				}
+			}
+			else
+			{
+				const uint32_t first = index + 1U;
+				const uint32_t second = node.offset;
+				float firstDistance, secondDistance;
+				const bool hitFirst = intersectNode( nodes[first], inOutHit.distance, firstDistance );
+				const bool hitSecond = intersectNode( nodes[second], inOutHit.distance, secondDistance );
+
+				// The nearer child first, the other one can often be skipped once that found something
+				if ( hitFirst && hitSecond )
+				{
+					const bool secondIsNearer = secondDistance < firstDistance;
+					stack[stackSize++] = secondIsNearer ? StackEntry{ first, firstDistance } : StackEntry{ second, secondDistance };
+					index = secondIsNearer ? second : first;
+					continue;
+				}
+
+				if ( hitFirst || hitSecond )
+				{
+					index = hitFirst ? first : second;
+					continue;
+				}
+			}
+
+			// Whatever's left on the stack, unless it starts behind the closest hit so far
+			while ( stackSize > 0U && stack[stackSize - 1U].distance > inOutHit.distance )
+			{
+				stackSize--;
+			}
+
+			if ( 0U == stackSize )
+			{
+				break;
+			}
+
+			index = stack[--stackSize].node;
+		}
+
+		return found;
+	}
+
+	bool TriangleTree::CastRay( const adm::Mat4& transform, const adm::Vec3& origin, const adm::Vec3& direction, RayHit& inOutHit ) const
+	{
+		// The ray goes into model space instead of the triangles into world space
+		// Its direction isn't normalised again, so distances along it stay the same in both spaces
+		const float* m = reinterpret_cast<const float*>( &transform );
+		const float a = m[0], b = m[1], c = m[2];
+		const float d = m[4], e = m[5], f = m[6];
+		const float g = m[8], h = m[9], i = m[10];
+
+		const float determinant = a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+		if ( std::abs( determinant ) < 1.0e-12f )
+		{
+			return false;
+		}
+
+		// Inverse of the upper 3x3, from its cofactors
+		const float s = 1.0f / determinant;
+		const float inverse[9] =
+		{
+			(e * i - f * h) * s, (c * h - b * i) * s, (b * f - c * e) * s,
+			(f * g - d * i) * s, (a * i - c * g) * s, (c * d - a * f) * s,
+			(d * h - e * g) * s, (b * g - a * h) * s, (a * e - b * d) * s
+		};
+
+		const auto toModel = [&inverse]( const adm::Vec3& v )
+		{
+			return adm::Vec3{ inverse[0] * v.x + inverse[1] * v.y + inverse[2] * v.z,
+				inverse[3] * v.x + inverse[4] * v.y + inverse[5] * v.z,
+				inverse[6] * v.x + inverse[7] * v.y + inverse[8] * v.z };
+		};
+
+		const adm::Vec3 translation = { m[3], m[7], m[11] };
+		return CastRay( toModel( origin - translation ), toModel( direction ), inOutHit );
+	}
+
+	bool TriangleTree::GetBounds( adm::Vec3& outMin, adm::Vec3& outMax ) const
+	{
+		if ( nodes.empty() )
+		{
+			return false;
+		}
+
+		outMin = { nodes[0].boundsMin[0], nodes[0].boundsMin[1], nodes[0].boundsMin[2] };
+		outMax = { nodes[0].boundsMax[0], nodes[0].boundsMax[1], nodes[0].boundsMax[2] };
+		return true;
+	}
+
+	bool TriangleTree::CastRayBruteForce( const adm::Vec3& origin, const adm::Vec3& direction, RayHit& inOutHit ) const
+	{
+		bool found = false;
+		for ( uint32_t i = 0U; i < triangles.size(); i++ )
+		{
+			if ( IntersectTriangle( triangles[i], origin, direction, inOutHit.distance ) )
+			{
+				inOutHit.triangle = i;
+				inOutHit.surface = triangles[i].surface;
+				found = true;
+			}
+		}
+
+		return found;
+	}
+}
@@ -4,12 +4,17 @@
 
 #include "Precompiled.hpp"
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <iostream>
+#include <mutex>
 
 #include <nvrhi/nvrhi.h>
 #include <nvrhi/utils.h>
 
 struct SDL_Window;
+union SDL_Event;
 
 inline bool Check( void* ptr, const char* message )
 {
@@ -36,11 +41,345 @@ namespace Renderer
 	}
 }
 
+// Virtual file system
+// The asset directory is indexed once at startup, and a packed archive (assets.pak) may be mounted on top
+// of it, so every lookup is a single hash map query and missing files never hit the OS
+namespace FileSystem
+{
+	// Read-only memory mapping of a whole file
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		MappedFile( const MappedFile& ) = delete;
+		MappedFile& operator=( const MappedFile& ) = delete;
+		~MappedFile();
+
+		bool Open( const char* path );
+		void Close();
+
+		const uint8_t* GetData() const { return data; }
+		size_t GetSize() const { return size; }
+
+	private:
+		const uint8_t* data{ nullptr };
+		size_t size{ 0U };
+#if _WIN32
+		void* fileHandle{ nullptr };
+		void* mappingHandle{ nullptr };
+#endif
+	};
+
+	// Contents of a file, either pointing straight into a mapping or owning a decompressed copy
+	struct FileData
+	{
+		const uint8_t* data{ nullptr };
+		size_t size{ 0U };
+
+		std::vector<uint8_t> storage{};
+		std::shared_ptr<MappedFile> mapping{};
+
+		operator bool() const
+		{
+			return nullptr != data;
+		}
+	};
+
+	// Indexes every file under rootDirectory and mounts pakPath if it exists
+	bool Init( const char* rootDirectory = "assets", const char* pakPath = "assets.pak" );
+	void Shutdown();
+
+	bool Exists( const std::string& path );
+	// Finds the first of path + extension that exists, e.g. for textures referenced without an extension
+	// Only the index is probed, so this never touches the disk
+	bool FindWithExtensions( const std::string& path, const std::vector<std::string>& extensions, std::string& outPath );
+	bool ReadFile( const std::string& path, FileData& outFileData );
+
+	// Packs every file under rootDirectory into a single archive, compressing entries with LZ4 where it pays off
+	bool BuildPak( const char* rootDirectory, const char* pakPath, bool compress );
+}
+
+// Keeps track of how much CPU and GPU memory our resources take up
+namespace Memory
+{
+	enum class Category : uint8_t
+	{
+		Textures,
+		// Render graph targets
+		RenderTargets,
+		VertexBuffers,
+		IndexBuffers,
+		ConstantBuffers,
+		// Upload ring and staging textures
+		Staging,
+		Count
+	};
+
+	struct Totals
+	{
+		int64_t cpuBytes{};
+		int64_t gpuBytes{};
+		int64_t numResources{};
+	};
+
+	const char* CategoryToString( Category category );
+
+	// Positive deltas for allocations, negative ones for releases
+	void Track( Category category, int64_t cpuBytesDelta, int64_t gpuBytesDelta, int64_t numResourcesDelta = 0 );
+	Totals GetTotals( Category category );
+	Totals GetGrandTotal();
+	void PrintStats();
+
+	uint64_t EstimateTextureBytes( const nvrhi::TextureDesc& desc );
+	uint64_t EstimateBufferBytes( const nvrhi::BufferDesc& desc );
+	Category GetBufferCategory( const nvrhi::BufferDesc& desc );
+}
+
+// A few worker threads for loading work that would otherwise stall the main thread, e.g. decoding images
+namespace Jobs
+{
+	constexpr uint32_t MaxThreads = 4U;
+
+	// Many threads push, one thread pops, and nobody ever takes a lock
+	// Pushing swaps the head of a linked list, popping takes the whole list at once,
+	// so nodes are never reused while someone else might be looking at them
+	template<typename T>
+	class CompletionQueue
+	{
+	public:
+		CompletionQueue() = default;
+		CompletionQueue( const CompletionQueue& ) = delete;
+		CompletionQueue& operator=( const CompletionQueue& ) = delete;
+
+		~CompletionQueue()
+		{
+			Node* node = head.exchange( nullptr );
+			while ( nullptr != node )
+			{
+				Node* next = node->next;
+				delete node;
+				node = next;
+			}
+		}
+
+		// Safe to call from any thread
+		void Push( T&& item )
+		{
+			Node* node = new Node{ std::move( item ), head.load( std::memory_order_relaxed ) };
+			while ( !head.compare_exchange_weak( node->next, node, std::memory_order_release, std::memory_order_relaxed ) )
+			{
+			}
+		}
+
+		// Only ever call from one thread, appends everything pushed so far in the order it was pushed
+		template<typename Container>
+		void PopAll( Container& outItems )
+		{
+			Node* node = head.exchange( nullptr, std::memory_order_acquire );
+
+			// The list is newest first
+			Node* oldest = nullptr;
+			while ( nullptr != node )
+			{
+				Node* next = node->next;
+				node->next = oldest;
+				oldest = node;
+				node = next;
+			}
+
+			while ( nullptr != oldest )
+			{
+				Node* next = oldest->next;
+				outItems.push_back( std::move( oldest->item ) );
+				delete oldest;
+				oldest = next;
+			}
+		}
+
+	private:
+		struct Node
+		{
+			T item;
+			Node* next;
+		};
+
+		std::atomic<Node*> head{ nullptr };
+	};
+
+	void Init();
+	// Finishes the jobs that were already submitted, then stops the threads
+	void Shutdown();
+
+	uint32_t GetNumThreads();
+	// Runs the job on one of the worker threads, in submission order, but possibly in parallel with others
+	void Submit( std::function<void()> job );
+	// Same, but ahead of every job submitted the normal way, for short jobs that others are waiting on,
+	// like pipeline compiles, which shouldn't wait behind texture decoding
+	void SubmitAhead( std::function<void()> job );
+	// Blocks until every submitted job has finished
+	void WaitForIdle();
+	// Calls function( i ) for every i below count, on the worker threads and the calling thread together
+	// Workers join in ahead of queued jobs, and the caller takes whatever they haven't started,
+	// so this never waits behind e.g. texture decoding
+	void ParallelFor( uint32_t count, const std::function<void( uint32_t )>& function );
+
+	// Tasks that depend on each other, each one is submitted as soon as everything it depends on is done
+	// Some things may only be touched by one thread, e.g. Upload's pending requests, so tasks can ask for the calling thread
+	class TaskGraph
+	{
+	public:
+		using TaskId = uint32_t;
+
+		// Dependencies have to be added first, a task returning false skips everything that depends on it
+		TaskId Add( const char* name, std::function<bool()> function, std::initializer_list<TaskId> dependencies = {}, bool onCallingThread = false );
+		// Blocks until every task has finished or been skipped, false if any of them failed
+		// Without parallel, everything runs on the calling thread in the order it was added
+		bool Run( bool parallel = true );
+
+		// When every task started and finished, and on which thread, 0 being the calling one
+		void PrintTimeline() const;
+		double GetMilliseconds() const { return milliseconds; }
+
+	private:
+		enum class State : uint8_t
+		{
+			Waiting,
+			Done,
+			Failed,
+			Skipped
+		};
+
+		struct Task
+		{
+			std::string name;
+			std::function<bool()> function;
+			std::vector<TaskId> dependents;
+			uint32_t numDependencies{};
+			uint32_t numUnfinishedDependencies{};
+			bool onCallingThread{};
+			bool dependencyFailed{};
+			State state{ State::Waiting };
+			uint32_t thread{};
+			double startMilliseconds{};
+			double endMilliseconds{};
+		};
+
+		void Execute( TaskId id );
+		// With the lock held, hands the dependents that can go now to the workers or the calling thread
+		void Finish( TaskId id, bool succeeded );
+		void Schedule( TaskId id );
+
+		std::vector<Task> tasks;
+		std::vector<TaskId> callingThreadQueue;
+		size_t nextCallingThreadTask{};
+		uint32_t numUnfinished{};
+		bool parallel{};
+		adm::TimerPreciseDouble timer;
+		double milliseconds{};
+
+		std::mutex mutex;
+		std::condition_variable changed;
+	};
+}
+
+// Collects resource uploads and records them on a separate thread, in as few command lists as possible
+// On D3D12 the uploads go to the copy queue, and the graphics queue only waits for the uploads
+// of resources a frame actually uses, see Acquire
+// D3D11 has neither, so everything is recorded and submitted right away on the main thread
+namespace Upload
+{
+	// Whichever is hit first causes a flush
+	constexpr uint64_t FlushThresholdBytes = 64ULL * 1024ULL * 1024ULL;
+	constexpr uint32_t FlushThresholdRequests = 256U;
+
+	// Buffer data is copied into a persistent ring buffer, and the space is reclaimed once
+	// the GPU signals that the batch which copied out of it is done
+	constexpr uint64_t RingBytes = 32ULL * 1024ULL * 1024ULL;
+	constexpr uint64_t RingAlignment = 256U;
+	// Pooled staging textures nobody has reused for this many batches get freed
+	constexpr uint64_t StagingTextureLifetime = 120U;
+
+	struct TextureWrite
+	{
+		uint32_t mipLevel{};
+		const void* data{};
+		size_t rowPitch{};
+		uint64_t bytes{};
+		// Keeps 'data' alive until it's in a staging texture, so it doesn't have to be copied
+		// Nobody may change the data in the meantime
+		std::shared_ptr<const void> owner{};
+	};
+
+	// Writes one mip level into a mapped staging texture, rows are rowPitch bytes apart
+	// Called on the upload thread
+	using StagingFiller = std::function<void( uint32_t mipLevel, uint8_t* destination, size_t rowPitch )>;
+
+	struct Stats
+	{
+		// Each request used to be its own submission
+		uint64_t numRequests{};
+		uint64_t numSubmissions{};
+		uint64_t numBytes{};
+		// Times the graphics queue had to wait for the copy queue
+		uint64_t numQueueWaits{};
+		// If there are stalls, the ring is too small
+		uint64_t peakRingBytes{};
+		uint64_t numStalls{};
+		double stallSeconds{};
+		// Mapping the ring or a staging texture waits for the GPU's last use of it, the ring is only mapped once outside D3D11
+		uint64_t numMaps{};
+		double mapSeconds{};
+		// Uploads bigger than the ring go through NVRHI's own upload manager
+		uint64_t numRingFallbacks{};
+		uint64_t numStagingTexturesReused{};
+	};
+
+	bool Init( bool copyQueueAvailable );
+	void Shutdown();
+
+	// Buffer data is copied right away, so it can be freed after this returns
+	void WriteBuffer( nvrhi::IBuffer* buffer, const void* data, size_t bytes, nvrhi::ResourceStates finalState );
+	// Same for texture data, the writes' memory can be freed after this returns, except for writes with an owner
+	void WriteTexture( nvrhi::ITexture* texture, const std::vector<TextureWrite>& writes, nvrhi::ResourceStates finalState );
+	// Fills every mip level of the texture through 'filler'
+	void FillTexture( nvrhi::ITexture* texture, uint64_t bytes, StagingFiller filler, nvrhi::ResourceStates finalState );
+
+	// Hands everything requested so far to the upload thread, never blocks
+	void Flush();
+	// Submits whatever the upload thread has finished recording, call once per frame
+	void Update();
+
+	// Whether the resource still has uploads that haven't been submitted
+	bool IsPending( nvrhi::IResource* resource );
+	// Puts an uploaded resource into its final state on the graphics queue, and makes the frame wait for its upload
+	// Returns false if it's not uploaded yet, in which case it shouldn't be used this frame
+	bool Acquire( nvrhi::ICommandList* commandList, nvrhi::IBuffer* buffer );
+	bool Acquire( nvrhi::ICommandList* commandList, nvrhi::ITexture* texture );
+	// Call right before executing the frame's command list
+	void SubmitFrameWaits();
+
+	Stats GetStats();
+	void PrintStats();
+}
+
 namespace Texture
 {
+	// What to do with the decoded pixels once they're on the GPU
+	enum class Retention : uint8_t
+	{
+		ReleaseAfterUpload,
+		Keep
+	};
+
 	struct TextureData
 	{
-		void Init( const char* fileName );
+		// With keepNativeComponents, RGB images stay RGB in memory and only get expanded by CopyRowsAsRgba
+		void Init( const char* fileName, bool keepNativeComponents = false );
+		void InitFromMemory( const uint8_t* fileData, size_t fileSize, bool keepNativeComponents = false );
+		// Writes the pixels as RGBA8 rows that are rowPitch bytes apart, e.g. into a mapped staging texture
+		void CopyRowsAsRgba( uint8_t* destination, size_t rowPitch ) const;
+		// Frees the pixels, but keeps the dimensions and format around
+		void Release();
 
 		TextureData() = default;
 		TextureData( TextureData&& texture ) noexcept;
@@ -48,6 +387,8 @@ namespace Texture
 
 		TextureData& operator=( TextureData&& texture ) noexcept
 		{
+			Release();
+
 			width = texture.width;
 			height = texture.height;
 			data = texture.data;
@@ -67,8 +408,14 @@ namespace Texture
 			return nullptr != data;
 		}
 
+		uint64_t GetDataBytes() const
+		{
+			return uint64_t( width ) * height * components * bytesPerComponent;
+		}
+
 		uint16_t width{};
 		uint16_t height{};
+		// Allocated by stb_image's allocator, so it can be freed the same way
 		uint8_t* data{};
 
 		// RGB vs. RGBA
@@ -80,7 +427,317 @@ namespace Texture
 	extern nvrhi::static_vector<TextureData, 32U> TextureDatas;
 	extern nvrhi::static_vector<nvrhi::TextureHandle, 32U> TextureObjects;
 	
-	int32_t FindOrCreateMaterial( const char* materialName );
+	// Images are decoded in the background, the handle shows the default texture until then
+	int32_t FindOrCreateMaterial( const char* materialName, Retention retention = Retention::ReleaseAfterUpload );
+	// Creates the texture object behind an already reserved handle and queues its upload
+	// Returns how many bytes are going to be uploaded
+	uint64_t CreateFromData( int32_t textureHandle, TextureData&& textureData, const char* debugName, Retention retention );
+
+	// The most memory stb_image has held at once since the last reset
+	uint64_t GetDecoderPeakBytes();
+	void ResetDecoderPeakBytes();
+
+	struct MipLevel
+	{
+		uint32_t width{};
+		uint32_t height{};
+		// Never changed once decoded, so the uploader can share them instead of taking a copy
+		std::shared_ptr<const std::vector<uint8_t>> pixels{};
+
+		uint64_t GetPixelBytes() const
+		{
+			return nullptr != pixels ? pixels->size() : 0U;
+		}
+	};
+
+	// Uploads mips [firstMip, mips.size()) into a fresh texture object
+	nvrhi::TextureHandle CreateTextureObject( const std::vector<MipLevel>& mips, uint32_t firstMip, nvrhi::Format format, const char* debugName );
+
+	// Large textures are first uploaded with only their smallest mips resident, the renderer
+	// then requests finer mips every frame, based on how big the surfaces using them are on screen
+	// When the memory budget is exceeded, the least recently used textures get dropped back to their small mips
+	namespace Streaming
+	{
+		// Mips this big or smaller are always resident, so every surface has something to render with
+		constexpr uint32_t BaseResidentSize = 64U;
+		// How many textures may get a new set of mips per frame
+		constexpr uint32_t MaxUpgradesPerFrame = 2U;
+
+		struct Stats
+		{
+			uint32_t numStreamedTextures{};
+			uint32_t numPendingRequests{};
+			uint64_t residentBytes{};
+			uint64_t budgetBytes{};
+			uint64_t numUpgrades{};
+			uint64_t numEvictions{};
+			// Times the finer mips had to be read from the file again
+			uint64_t numDecodes{};
+		};
+
+		bool ShouldStream( const TextureData& textureData );
+		// Doesn't touch any shared state, so it can run on the job threads
+		void GenerateMipChain( const TextureData& textureData, std::vector<MipLevel>& outMips );
+		// Takes over a mip chain made by GenerateMipChain, and creates the texture behind an already reserved handle
+		// Only the base mips are kept in system memory, the finer ones are decoded again from the file when needed
+		// Retention only applies to the original pixels
+		// Returns how many bytes are going to be uploaded
+		uint64_t CreateStreamedTexture( int32_t textureHandle, TextureData&& textureData, std::vector<MipLevel>&& mips, const char* debugName, Retention retention );
+
+		// uvDensity is UV units per world unit of the surface, pixelsPerWorldUnit is how many
+		// screen pixels a world unit covers at the surface's distance
+		void RequestForScreenSize( int32_t textureHandle, float uvDensity, float pixelsPerWorldUnit );
+
+		bool IsStreamed( int32_t textureHandle );
+		uint32_t GetResidentMip( int32_t textureHandle );
+		uint32_t GetRequestedMip( int32_t textureHandle );
+		void SetBudget( uint64_t bytes );
+		Stats GetStats();
+		void PrintStats();
+
+		// Uploads pending mip requests and evicts textures over budget, call outside of frame recording
+		void Update();
+		void Shutdown();
+	}
+
+	// Images are decoded on the job threads, which hand them back through a lock-free queue
+	// Creating and uploading them is spread over several frames, so a lot of them finishing at once
+	// doesn't turn into a single long frame
+	namespace Loader
+	{
+		// Once either of these is used up, the rest waits for the next frame
+		constexpr uint64_t DefaultFrameBudgetBytes = 16ULL * 1024ULL * 1024ULL;
+		constexpr double DefaultFrameBudgetMilliseconds = 2.0;
+		// The frame cost percentiles only look at this many of the latest busy frames
+		constexpr size_t BusyFrameWindow = 1024U;
+
+		struct FrameStats
+		{
+			uint32_t numCreated{};
+			uint64_t uploadedBytes{};
+			double milliseconds{};
+			// Decoded, but held back by the budget
+			uint32_t numWaiting{};
+			uint32_t numDecoding{};
+		};
+
+		struct Stats
+		{
+			uint64_t numRequests{};
+			uint64_t numCreated{};
+			uint64_t numFailed{};
+			uint64_t uploadedBytes{};
+			// Frames that created at least one texture
+			uint64_t numBusyFrames{};
+			// Over the last BusyFrameWindow busy frames
+			double medianMilliseconds{};
+			double p99Milliseconds{};
+			double maxMilliseconds{};
+		};
+
+		void Request( int32_t textureHandle, const char* fileName, Retention retention );
+		void SetFrameBudget( uint64_t bytes, double milliseconds );
+
+		// Creates textures that finished decoding until the frame budget runs out, call outside of frame recording
+		void Update();
+		FrameStats GetFrameStats();
+		Stats GetStats();
+		void PrintStats();
+		// Abandons whatever is still being decoded
+		void Shutdown();
+	}
+}
+
+// View frustum culling of axis-aligned boxes, four at a time with SSE
+namespace Culling
+{
+	// Each plane is a normal pointing into the frustum, and a distance
+	struct Frustum
+	{
+		float planes[6][4]{};
+	};
+
+	// Boxes as centres and half-extents, one array per component, so the SIMD kernel can load four of anything at once
+	struct BoundsArray
+	{
+		std::vector<float> centreX, centreY, centreZ;
+		std::vector<float> extentX, extentY, extentZ;
+
+		void Clear();
+		void Reserve( size_t count );
+		// Transforms model-space bounds into a world-space box that encloses them
+		void Add( const adm::Mat4& transform, const adm::Vec3& boundsMin, const adm::Vec3& boundsMax );
+		// Same as Add, for a box that's already there, e.g. after its entity moved
+		void Set( size_t index, const adm::Mat4& transform, const adm::Vec3& boundsMin, const adm::Vec3& boundsMax );
+
+		size_t Size() const
+		{
+			return centreX.size();
+		}
+	};
+
+	struct Stats
+	{
+		uint32_t numEntitiesVisible{};
+		uint32_t numEntitiesCulled{};
+		uint32_t numSurfacesVisible{};
+		uint32_t numSurfacesCulled{};
+		// Out of the culled ones above, how many were inside the frustum but behind occluders
+		uint32_t numEntitiesOccluded{};
+		uint32_t numSurfacesOccluded{};
+	};
+
+	// Works with both 0..1 and -1..1 clip space depth
+	Frustum ExtractFrustum( const adm::Mat4& viewMatrix, const adm::Mat4& projectionMatrix );
+
+	// Writes 1 for every box that's at least partially inside the frustum, 0 otherwise, returns the number of visible ones
+	size_t CullBoxes( const Frustum& frustum, const BoundsArray& bounds, uint8_t* outVisible );
+	// One box at a time, without SIMD, as a reference for the benchmark
+	size_t CullBoxesScalar( const Frustum& frustum, const BoundsArray& bounds, uint8_t* outVisible );
+}
+
+// Bounding volume hierarchies, so visibility and proximity queries don't have to look at everything
+namespace Bvh
+{
+	constexpr uint32_t InvalidIndex = ~0U;
+	// Split candidates per axis when building
+	constexpr uint32_t NumBins = 16U;
+
+	struct Node
+	{
+		adm::Vec3 boundsMin;
+		adm::Vec3 boundsMax;
+		uint32_t parent{ InvalidIndex };
+		uint32_t children[2]{ InvalidIndex, InvalidIndex };
+		// Leaves hold exactly one item, InvalidIndex for inner nodes
+		uint32_t item{ InvalidIndex };
+
+		bool IsLeaf() const
+		{
+			return item != InvalidIndex;
+		}
+	};
+
+	// One leaf per box, built top-down with binned SAH, then kept up to date box by box
+	// Moving a box refits its ancestors and rotates them where that makes the tree tighter, boxes that moved far are reinserted,
+	// so it stays close to a fresh build without ever rebuilding
+	class Tree
+	{
+	public:
+		// Item i is box i, any previous contents are thrown away
+		void Build( const Culling::BoundsArray& bounds );
+		void Clear();
+		void Update( uint32_t item, const adm::Vec3& boundsMin, const adm::Vec3& boundsMax );
+
+		// Same contract as Culling::CullBoxes, outVisible needs room for every item
+		// Subtrees entirely inside the frustum are accepted without testing anything below them
+		size_t CullFrustum( const Culling::Frustum& frustum, uint8_t* outVisible ) const;
+		// Items whose boxes the segment from origin to origin + direction * maxDistance passes through, in no particular order
+		void QueryRay( const adm::Vec3& origin, const adm::Vec3& direction, float maxDistance, std::vector<uint32_t>& outItems ) const;
+		// Items whose boxes touch the sphere
+		void QuerySphere( const adm::Vec3& centre, float radius, std::vector<uint32_t>& outItems ) const;
+
+		// Sum of inner node surface areas over the root's, lower means queries visit fewer nodes
+		float GetCost() const;
+		uint32_t GetNumRotations() const
+		{
+			return numRotations;
+		}
+		uint32_t GetNumReinserts() const
+		{
+			return numReinserts;
+		}
+
+	private:
+		uint32_t BuildRange( uint32_t* items, uint32_t count, uint32_t parent, const Culling::BoundsArray& bounds );
+		void Refit( uint32_t node );
+		void Rotate( uint32_t node );
+		void RemoveLeaf( uint32_t leaf );
+		void InsertLeaf( uint32_t leaf );
+
+		std::vector<Node> nodes;
+		std::vector<uint32_t> itemLeaves;
+		uint32_t root{ InvalidIndex };
+		// The inner node RemoveLeaf freed up, InsertLeaf takes it right back
+		uint32_t freeNode{ InvalidIndex };
+		uint32_t numRotations{};
+		uint32_t numReinserts{};
+	};
+
+	// Leaves of a TriangleTree hold up to this many
+	constexpr uint32_t MaxLeafTriangles = 4U;
+
+	// 32 bytes, two per cache line
+	// An inner node's first child always comes right after it, so only the second one needs an index
+	struct FlatNode
+	{
+		float boundsMin[3];
+		// Inner nodes: the second child, leaves: the first triangle
+		uint32_t offset;
+		float boundsMax[3];
+		// 0 for inner nodes
+		uint32_t numTriangles;
+	};
+
+	// Set up for the ray test, one corner and the two edges leaving it
+	struct Triangle
+	{
+		adm::Vec3 vertex;
+		adm::Vec3 edge1;
+		adm::Vec3 edge2;
+		// Which surface of the model it came from
+		uint32_t surface;
+	};
+
+	struct RayHit
+	{
+		// Along the ray's direction, in world units if it's normalised
+		// Set it before a cast to only look for hits closer than that
+		float distance{ std::numeric_limits<float>::max() };
+		// Into the tree's triangles, InvalidIndex until something is hit
+		uint32_t triangle{ InvalidIndex };
+		uint32_t surface{ InvalidIndex };
+		// Only filled in by scene casts
+		uint32_t entity{ InvalidIndex };
+	};
+
+	// A model's triangles in model space, built once at load time and never changed after that
+	class TriangleTree
+	{
+	public:
+		void AddTriangle( const adm::Vec3& a, const adm::Vec3& b, const adm::Vec3& c, uint32_t surface );
+		// Binned SAH like Tree, up to MaxLeafTriangles per leaf, triangles get reordered to match the leaves
+		void Build();
+		void Clear();
+
+		// Closest hit in both directions of facing, returns true and updates inOutHit if it's closer than inOutHit.distance
+		bool CastRay( const adm::Vec3& origin, const adm::Vec3& direction, RayHit& inOutHit ) const;
+		// Same, for a world-space ray against the model placed with an entity's transform
+		bool CastRay( const adm::Mat4& transform, const adm::Vec3& origin, const adm::Vec3& direction, RayHit& inOutHit ) const;
+		// Every triangle, as a reference for the benchmark
+		bool CastRayBruteForce( const adm::Vec3& origin, const adm::Vec3& direction, RayHit& inOutHit ) const;
+
+		size_t GetNumNodes() const
+		{
+			return nodes.size();
+		}
+		size_t GetNumTriangles() const
+		{
+			return triangles.size();
+		}
+		size_t GetMemoryBytes() const
+		{
+			return nodes.size() * sizeof( FlatNode ) + triangles.size() * sizeof( Triangle );
+		}
+		// False if there are no triangles
+		bool GetBounds( adm::Vec3& outMin, adm::Vec3& outMax ) const;
+
+	private:
+		uint32_t BuildRange( const std::vector<Triangle>& source, uint32_t* items, uint32_t count, uint32_t depth );
+
+		std::vector<FlatNode> nodes;
+		std::vector<Triangle> triangles;
+	};
 }
 
 namespace Model
@@ -111,6 +768,19 @@ namespace Model
 		std::vector<DrawSurface> surfaces{};
 	};
 
+	// Everything a surface's draw needs, gathered once instead of every frame
+	// Only valid as long as the surface holds onto the resources
+	struct DrawPacket
+	{
+		nvrhi::IBindingSet* bindingSet{};
+		nvrhi::IBuffer* vertexBuffer{};
+		nvrhi::IBuffer* indexBuffer{};
+		uint32_t numIndices{};
+		// Where the surface starts in the buffers above, non-zero when they're the shared geometry buffers
+		uint32_t firstIndex{};
+		int32_t baseVertex{};
+	};
+
 	struct RenderSurface
 	{
 		RenderSurface() = default;
@@ -121,10 +791,34 @@ namespace Model
 		int32_t textureObjectHandle{};
 		int32_t numIndices{};
 		int32_t numVertices{};
+		// Model-space bounds
+		adm::Vec3 boundsMin{};
+		adm::Vec3 boundsMax{};
+		// Identifies the vertex and index buffers in draw sort keys
+		uint32_t geometryId{};
+		// Offsets into the shared geometry buffers, if the surface is in there, otherwise 0
+		uint32_t firstIndex{};
+		int32_t baseVertex{};
+		// Average UV units per world unit, used to pick texture mips for streaming
+		float uvDensity{ 1.0f };
 		// Contains a reference to a texture object
 		nvrhi::BindingSetHandle bindingSet;
 		nvrhi::BufferHandle vertexBuffer;
 		nvrhi::BufferHandle indexBuffer;
+		// Rebuilt whenever any of the above changes
+		DrawPacket drawPacket;
+
+		void UpdateDrawPacket()
+		{
+			drawPacket = { bindingSet, vertexBuffer, indexBuffer, uint32_t( numIndices ), firstIndex, baseVertex };
+		}
+	};
+
+	// Model-space triangles, only kept for models that are used as occluders
+	struct OccluderMesh
+	{
+		std::vector<adm::Vec3> positions;
+		std::vector<uint32_t> indices;
 	};
 
 	struct RenderModel
@@ -136,6 +830,13 @@ namespace Model
 		// Typically the filename
 		std::string name;
 		std::vector<RenderSurface> surfaces;
+		// Model-space bounds of all surfaces together
+		adm::Vec3 boundsMin{};
+		adm::Vec3 boundsMax{};
+		// Empty unless the model was loaded as an occluder
+		OccluderMesh occluder;
+		// All surfaces' triangles, for picking and line of sight
+		Bvh::TriangleTree triangles;
 	};
 
 	extern std::vector<RenderModel> RenderModels;
@@ -156,18 +857,28 @@ namespace Model
 		bufferDesc.initialState = nvrhi::ResourceStates::CopyDest;
 		auto bufferObject = Renderer::Device->createBuffer( bufferDesc );
 
-		::Renderer::CommandList->open();
-		::Renderer::CommandList->beginTrackingBufferState( bufferObject, nvrhi::ResourceStates::CopyDest );
-		::Renderer::CommandList->writeBuffer( bufferObject, data.data(), bufferDesc.byteSize );
-		::Renderer::CommandList->setPermanentBufferState( bufferObject, isVertexBuffer ? nvrhi::ResourceStates::VertexBuffer : nvrhi::ResourceStates::IndexBuffer );
-		::Renderer::CommandList->close();
+		Upload::WriteBuffer( bufferObject, data.data(), bufferDesc.byteSize, isVertexBuffer ? nvrhi::ResourceStates::VertexBuffer : nvrhi::ResourceStates::IndexBuffer );
 
-		Renderer::Device->executeCommandList( ::Renderer::CommandList );
+		Memory::Track( Memory::GetBufferCategory( bufferDesc ), 0, Memory::EstimateBufferBytes( bufferDesc ), 1 );
 
 		return bufferObject;
 	}
 
-	int32_t LoadRenderModelFromGltf( const char* fileName );
+	// Occluders keep a copy of their triangles on the CPU for Occlusion
+	int32_t LoadRenderModelFromGltf( const char* fileName, bool isOccluder = false );
+	// Entities using the same file share its render model, so their surfaces can be drawn instanced
+	// Whoever loads it first decides whether it's an occluder
+	int32_t FindOrLoadRenderModel( const char* fileName, bool isOccluder = false );
+	// Only the triangle tree, without creating anything on the GPU
+	bool LoadTriangleTreeFromGltf( const char* fileName, Bvh::TriangleTree& outTree );
+	// Recreates the binding sets of all surfaces that use this texture, e.g. after streaming swapped it
+	void UpdateTextureBindings( int32_t textureObjectHandle );
+
+	// Models loaded before this is called put their vertices and indices into one pair of buffers,
+	// so their draws never switch buffers and can be batched into indirect draws
+	// Anything loaded afterwards gets its own buffers as usual
+	void CreateSharedGeometry();
+	void ReleaseSharedGeometry();
 
 	// Fullscreen quad used to render framebuffers
 	namespace ScreenQuad
@@ -242,10 +953,542 @@ namespace Model
 	}
 }
 
+// Compiled shaders for every backend can come in one pack, which is mapped once and handed to createShader in place
+// Its table is sorted by name hash, and the names are the loose files' paths under assets/shaders, e.g. "vk/default_main_vs.bin"
 namespace Shader
 {
-	using ShaderBinary = std::vector<uint8_t>;
-	bool LoadShaderBinary( const char* fileName, ShaderBinary& outShaderBinary );
+	// Packs whatever binaries shaders.cfg in shaderDirectory produces for dx11, dx12 and vk
+	bool BuildPack( const char* shaderDirectory = "assets/shaders", const char* packPath = "shaders.pack" );
+	// Without a pack, shaders are loaded from the loose files
+	bool OpenPack( const char* packPath = "shaders.pack" );
+	void ClosePack();
+
+	// From the pack if it's there, otherwise from the loose file, the data points into a mapping either way
+	bool Load( const char* backend, const char* binaryFile, FileSystem::FileData& outBytecode );
+}
+
+// Graphics pipelines and binding sets, looked up by a hash of everything that goes into them,
+// so asking for the same one twice returns the object that already exists instead of making the driver build another
+namespace ObjectCache
+{
+	struct Stats
+	{
+		uint32_t pipelineHits{};
+		uint32_t pipelineMisses{};
+		uint32_t numPipelines{};
+		uint32_t bindingSetHits{};
+		uint32_t bindingSetMisses{};
+		uint32_t numBindingSets{};
+		// Different descs with the same hash, they still get their own objects
+		uint32_t numCollisions{};
+		// Dropped by ReleaseUnused
+		uint32_t numReleased{};
+		// Spent creating the objects that weren't there yet
+		double missMilliseconds{};
+	};
+
+	// Same hash for descs that would give the same object, within one run, as resources are hashed by address
+	// Only the framebuffer's formats and sample count matter to a pipeline
+	size_t HashGraphicsPipeline( const nvrhi::GraphicsPipelineDesc& desc, const nvrhi::FramebufferInfo& framebufferInfo );
+	bool IsSameGraphicsPipeline( const nvrhi::GraphicsPipelineDesc& a, const nvrhi::FramebufferInfo& framebufferA,
+		const nvrhi::GraphicsPipelineDesc& b, const nvrhi::FramebufferInfo& framebufferB );
+	size_t HashBindingSet( const nvrhi::BindingSetDesc& desc, nvrhi::IBindingLayout* layout );
+
+	// Thread-safe, null if the device couldn't create it
+	nvrhi::GraphicsPipelineHandle GetGraphicsPipeline( const nvrhi::GraphicsPipelineDesc& desc, nvrhi::IFramebuffer* framebuffer );
+	nvrhi::BindingSetHandle GetBindingSet( const nvrhi::BindingSetDesc& desc, nvrhi::IBindingLayout* layout );
+
+	// Drops binding sets only the cache still holds on to, e.g. ones for textures that streaming replaced
+	// Pipelines stay, they're expensive to make again and there are only a few
+	void ReleaseUnused();
+	void Clear();
+
+	Stats GetStats();
+	void PrintStats();
+}
+
+// Creates pipelines on the job threads, so a permutation nobody asked for in time costs a skipped draw, not a hitch
+// Everything known up front is declared at startup or level load, and the renderer checks each frame what's ready
+namespace PipelineCompiler
+{
+	using Id = uint32_t;
+	constexpr Id InvalidId = ~0U;
+
+	struct Stats
+	{
+		uint32_t numDeclared{};
+		uint32_t numReady{};
+		uint32_t numFailed{};
+		// Declared but not compiled yet
+		uint32_t queueDepth{};
+		uint32_t maxQueueDepth{};
+		// Sum and maximum over single pipelines, the total is spread over the job threads
+		double compileMilliseconds{};
+		double longestCompileMilliseconds{};
+		// From the queue going from empty to empty again, most recent time
+		double batchMilliseconds{};
+	};
+
+	// Queues the permutation, the framebuffer is only kept around until then for its formats
+	Id Declare( const char* name, const nvrhi::GraphicsPipelineDesc& desc, nvrhi::IFramebuffer* framebuffer );
+	// Never blocks, null until the pipeline is ready, or if it couldn't be created
+	nvrhi::GraphicsPipelineHandle Get( Id id );
+	// Blocks until this one is done, for the few things there's no sensible way around
+	nvrhi::GraphicsPipelineHandle Wait( Id id );
+	void WaitForAll();
+	uint32_t GetQueueDepth();
+	// Waits for the queue to drain and lets go of every pipeline
+	void Shutdown();
+
+	Stats GetStats();
+	// Also lists every pipeline with its compile time
+	void PrintStats();
+}
+
+// Software occlusion culling, big occluders like the level itself are rasterised into a small depth buffer on the CPU,
+// and boxes that the frustum let through are tested against it before any draws are made
+// The buffer holds 1/w, so it doesn't care whether the projection's depth goes 0..1, -1..1 or is reversed
+namespace Occlusion
+{
+	constexpr uint32_t Width = 256U;
+	constexpr uint32_t Height = 144U;
+	// Every tile is rasterised by one thread, so nobody writes into anyone else's pixels
+	constexpr uint32_t TileWidth = 32U;
+	constexpr uint32_t TileHeight = 16U;
+	constexpr uint32_t NumTilesX = Width / TileWidth;
+	constexpr uint32_t NumTilesY = Height / TileHeight;
+	// Down to 1x1, each level holds the farthest depth of the four texels below it
+	constexpr uint32_t NumLevels = 9U;
+	// Anything closer than this gets clipped, same as the camera's near plane
+	constexpr float NearW = 0.01f;
+	static_assert( Width % TileWidth == 0U && Height % TileHeight == 0U && TileWidth % 4U == 0U );
+
+	struct Stats
+	{
+		uint32_t numOccluders{};
+		uint32_t numTriangles{};
+		// After clipping, and without the ones too small to cover a whole pixel
+		uint32_t numRasterised{};
+		uint32_t numBoxesTested{};
+		uint32_t numBoxesOccluded{};
+		double rasterMilliseconds{};
+		double testMilliseconds{};
+	};
+
+	// Clears everything for a new frame
+	void Begin( const adm::Mat4& viewMatrix, const adm::Mat4& projectionMatrix );
+	// Occluders are double-sided, so the winding of their triangles doesn't matter
+	// Only pixels entirely inside one triangle are written, so big, low-poly occluders work best
+	void AddOccluder( const Model::OccluderMesh& mesh, const adm::Mat4& transform );
+	// Rasterises all occluders added since Begin, one tile per Jobs::ParallelFor index, then builds the hierarchy
+	void Rasterise( bool parallel = true );
+
+	// World-space box, false only if it's entirely behind the occluders
+	bool IsBoxVisible( const adm::Vec3& boundsMin, const adm::Vec3& boundsMax );
+	// Tests every box that's still marked visible, returns the number of visible ones afterwards
+	size_t TestBoxes( const Culling::BoundsArray& bounds, uint8_t* inOutVisible );
+
+	// Brute force, every pixel's corners against every triangle, as a reference for the benchmark
+	void RasteriseReference( std::vector<float>& outDepth );
+	// Same as IsBoxVisible, against a full resolution buffer from RasteriseReference
+	bool IsBoxVisibleReference( const adm::Vec3& boundsMin, const adm::Vec3& boundsMax, const std::vector<float>& depth );
+	// The full resolution buffer, Width * Height texels, row by row
+	const float* GetDepth();
+
+	Stats GetStats();
+}
+
+// Draws are collected with a sort key, and sorted so that draws sharing state end up next to each other
+namespace DrawList
+{
+	// From the most significant bits down, so draws get grouped by pipeline, then material, then geometry,
+	// and within that, go front to back
+	constexpr uint32_t PipelineBits = 8U;
+	constexpr uint32_t MaterialBits = 16U;
+	constexpr uint32_t GeometryBits = 16U;
+	constexpr uint32_t DepthBits = 24U;
+	static_assert( PipelineBits + MaterialBits + GeometryBits + DepthBits == 64U );
+
+	struct Item
+	{
+		uint64_t key{};
+		// Whatever the renderer needs to find the draw again
+		uint32_t index{};
+	};
+
+	// How often consecutive draws had to change state, and how long it took
+	struct Stats
+	{
+		uint32_t numDraws{};
+		uint32_t numPipelineChanges{};
+		uint32_t numBindingChanges{};
+		uint32_t numBufferChanges{};
+		uint32_t numConstantWrites{};
+		// Draws that covered more than one entity, and how many entities went through them
+		uint32_t numInstancedDraws{};
+		uint32_t numInstances{};
+		// setGraphicsState calls that were made, and ones that were skipped since nothing changed
+		uint32_t numStateCalls{};
+		uint32_t numElidedCalls{};
+		// drawIndexedIndirect calls, each one covers one or more of the draws above
+		uint32_t numIndirectCalls{};
+		// The draws were recorded into this many command lists in parallel
+		uint32_t numCommandLists{};
+		double sortMilliseconds{};
+		double submitMilliseconds{};
+	};
+
+	// Depth goes from 0 to 1, nearest first
+	uint64_t MakeSortKey( uint32_t pipeline, uint32_t material, uint32_t geometry, float depth );
+	// Stable LSD radix sort, 8 bits per pass, passes where every key has the same byte are skipped
+	// 'scratch' is only there so its memory can be reused between frames
+	void RadixSort( std::vector<Item>& items, std::vector<Item>& scratch );
+
+	// A run of consecutive items that draw the same surface, so one instanced draw can cover all of them
+	struct InstanceGroup
+	{
+		uint32_t firstItem{};
+		uint32_t numItems{};
+	};
+
+	// Splits the items into runs of neighbours for which 'sameSurface( indexA, indexB )' holds
+	// Only sorted items make long runs, the depth is below the material and geometry in the key
+	template<typename SameSurfaceFunction>
+	void GroupInstances( const std::vector<Item>& items, std::vector<InstanceGroup>& outGroups, SameSurfaceFunction sameSurface )
+	{
+		outGroups.clear();
+		for ( uint32_t i = 0U; i < items.size(); i++ )
+		{
+			if ( outGroups.empty() || !sameSurface( items[i - 1U].index, items[i].index ) )
+			{
+				outGroups.push_back( { i, 0U } );
+			}
+
+			outGroups.back().numItems++;
+		}
+	}
+
+	// A run of consecutive instance groups whose draw packets only differ in their index count and offsets,
+	// which all fit into indirect draw arguments, so one drawIndexedIndirect call covers all of them
+	struct IndirectBatch
+	{
+		uint32_t firstGroup{};
+		uint32_t numGroups{};
+	};
+
+	// Writes one set of arguments per group, in the same order, so a batch's arguments start at its first group
+	// 'getPacket( groupIndex )' returns the draw packet of the group's surface
+	template<typename GetPacketFunction>
+	void BuildIndirectBatches( const std::vector<InstanceGroup>& groups, std::vector<nvrhi::DrawIndexedIndirectArguments>& outArguments,
+		std::vector<IndirectBatch>& outBatches, GetPacketFunction getPacket )
+	{
+		outArguments.clear();
+		outBatches.clear();
+
+		const Model::DrawPacket* batchPacket = nullptr;
+		for ( uint32_t g = 0U; g < groups.size(); g++ )
+		{
+			const Model::DrawPacket& packet = getPacket( g );
+			outArguments.push_back( nvrhi::DrawIndexedIndirectArguments()
+				.setIndexCount( packet.numIndices )
+				.setInstanceCount( groups[g].numItems )
+				.setStartIndexLocation( packet.firstIndex )
+				.setBaseVertexLocation( packet.baseVertex )
+				.setStartInstanceLocation( groups[g].firstItem ) );
+
+			// Anything the state tracker would have to set starts a new batch
+			if ( nullptr == batchPacket || batchPacket->bindingSet != packet.bindingSet
+				|| batchPacket->vertexBuffer != packet.vertexBuffer || batchPacket->indexBuffer != packet.indexBuffer )
+			{
+				outBatches.push_back( { g, 0U } );
+				batchPacket = &packet;
+			}
+
+			outBatches.back().numGroups++;
+		}
+	}
+
+	// Keeps the graphics state that was last handed to setGraphicsState, and patches only what a draw packet changes
+	// NVRHI has no way of setting just a part of the state, so the most we can do is skip the call when nothing changed
+	class StateTracker
+	{
+	public:
+		// Starts over from the state every draw shares, i.e. pipeline, framebuffer, viewport and the global binding sets
+		// The surface's binding set goes into 'surfaceSlot', which is added to the base state if it isn't there
+		// Its vertex buffer goes into slot 0, any other vertex buffers of the base state are kept
+		void Reset( const nvrhi::GraphicsState& baseState, uint32_t surfaceSlot );
+		// Call after anything that makes NVRHI forget the graphics state, e.g. writing into a volatile constant buffer
+		void Invalidate()
+		{
+			valid = false;
+		}
+
+		// Returns false if setGraphicsState can be skipped for this packet
+		bool Update( const Model::DrawPacket& packet, Stats& stats );
+
+		const nvrhi::GraphicsState& GetState() const
+		{
+			return state;
+		}
+
+	private:
+		nvrhi::GraphicsState state;
+		nvrhi::IGraphicsPipeline* submittedPipeline{};
+		uint32_t surfaceBindingSlot{};
+		bool valid{ false };
+	};
+}
+
+// Every draw's entity matrix for a whole frame, in a structured buffer the vertex shader indexes
+// There's one buffer per frame in flight, persistently mapped where the API allows it, so filling it is a plain copy
+// instead of a constant buffer write per entity
+namespace Transforms
+{
+	// 128 kB, the buffers double whenever a frame needs more
+	constexpr uint32_t InitialCapacity = 1024U;
+
+	// What the vertex shader gets per draw, see InstanceTransform in default.hlsl
+	struct Instance
+	{
+		// Projection * view * model, computed once per entity so positions only need one multiply per vertex
+		adm::Mat4 modelViewProjection;
+		// Normals still need the entity's own rotation
+		adm::Mat4 model;
+	};
+
+	struct Stats
+	{
+		uint32_t numTransforms{};
+		uint32_t capacity{};
+		uint32_t numBuffers{};
+		uint32_t numGrowths{};
+		// Time spent waiting for the GPU to let go of a buffer, should stay at 0
+		double waitMilliseconds{};
+	};
+
+	// D3D11 can't draw from a mapped buffer, so there it's mapped and unmapped every frame
+	bool Init( nvrhi::IBindingLayout* bindingLayout, uint32_t numBuffers, bool persistentMapping );
+	void Shutdown();
+
+	// Moves on to the next frame's buffer and makes room for 'count' instances
+	Instance* Map( uint32_t count );
+	void Unmap();
+	// Binds the buffer that was mapped last, the draw's first matrix goes in as a push constant
+	nvrhi::IBindingSet* GetBindingSet();
+	// Call after executing the frame's command list, so the buffer isn't touched until the GPU is done with it
+	void FrameSubmitted();
+
+	Stats GetStats();
+	void PrintStats();
+
+	// outMatrices[i] = left * rightMatrices[i], with SSE where available
+	// 'left' is the view-projection matrix, and the right ones the entities', in the same order the shader used to apply them
+	void MultiplyBatch( const adm::Mat4& left, const adm::Mat4* rightMatrices, adm::Mat4* outMatrices, size_t count );
+	// Same as above, one component at a time
+	void MultiplyBatchScalar( const adm::Mat4& left, const adm::Mat4* rightMatrices, adm::Mat4* outMatrices, size_t count );
+}
+
+// A frame described as passes that declare which textures they read and write, instead of a fixed sequence of calls
+// Compiling it drops the passes nothing ends up using, works out which state every texture has to be in for each pass,
+// and lets transient textures whose lifetimes don't overlap share one physical texture, which is kept for the next frames
+namespace RenderGraph
+{
+	using ResourceId = uint32_t;
+	constexpr ResourceId InvalidResource = ~0U;
+	// Pooled textures no frame has needed for this long are released
+	constexpr uint32_t MaxIdleFrames = 120U;
+
+	struct Access
+	{
+		ResourceId resource{ InvalidResource };
+		nvrhi::ResourceStates state{ nvrhi::ResourceStates::Unknown };
+		bool read{ false };
+		bool write{ false };
+	};
+
+	// What a transient texture's physical texture is in before a pass, and what the pass needs it in
+	// Imported textures keep their own state tracking and never show up here
+	struct Transition
+	{
+		uint32_t physical{};
+		nvrhi::ResourceStates before{ nvrhi::ResourceStates::Unknown };
+		nvrhi::ResourceStates after{ nvrhi::ResourceStates::Unknown };
+	};
+
+	struct Stats
+	{
+		uint32_t numPasses{};
+		uint32_t numCulledPasses{};
+		uint32_t numTransientTextures{};
+		// Physical textures this frame's transient ones were packed into
+		uint32_t numPhysicalTextures{};
+		// Ones that weren't in the pool yet, usually only in the first frame
+		uint32_t numCreatedTextures{};
+		uint32_t numReleasedTextures{};
+		// State changes, and how many batches they were submitted in, i.e. one per pass that needed any
+		uint32_t numTransitions{};
+		uint32_t numBarrierBatches{};
+		// Every transient texture having its own memory, against what they actually took up
+		uint64_t transientBytes{};
+		uint64_t physicalBytes{};
+		double compileMilliseconds{};
+	};
+
+	class Graph;
+
+	// Handed to a pass while the graph executes it
+	class PassContext
+	{
+	public:
+		nvrhi::ITexture* GetTexture( ResourceId resource ) const;
+		// The pass's render target writes in the order they were declared, plus its depth write if it has one
+		// Passes drawing into imported textures, e.g. the backbuffer, bring their own
+		nvrhi::IFramebuffer* GetFramebuffer() const;
+
+		// Call on the first command list the pass records into, before touching any of its textures
+		// Tells NVRHI which states the textures are in and submits all of the pass's transitions in one batch
+		void Begin( nvrhi::ICommandList* commandList ) const;
+		// Call on any other command list the pass records into, those execute after the first one
+		void Track( nvrhi::ICommandList* commandList ) const;
+		// Moves the textures back into the states the graph expects after this pass, if anything in between changed them
+		// Clears do that on some APIs
+		void End( nvrhi::ICommandList* commandList ) const;
+
+	private:
+		friend class Graph;
+		const Graph* graph{};
+		uint32_t pass{};
+	};
+
+	class Graph
+	{
+	public:
+		// Starts describing a new frame, the pooled textures stay
+		void Reset();
+		// Releases the pooled textures too
+		void Clear();
+
+		// Only lives for the frame, its physical texture is picked when compiling and its contents are undefined on the first write
+		// Render target and UAV flags are added to match how the passes use it
+		ResourceId CreateTexture( const nvrhi::TextureDesc& desc );
+		// Lives outside the graph, e.g. the backbuffer, so the graph leaves its states alone
+		// Passes that write it are the ones everything else is kept alive for, and it's never dereferenced
+		ResourceId ImportTexture( nvrhi::ITexture* texture );
+
+		// Passes execute in the order they were added
+		uint32_t AddPass( const char* name, std::function<void( PassContext& )> execute );
+		void Read( uint32_t pass, ResourceId resource, nvrhi::ResourceStates state = nvrhi::ResourceStates::ShaderResource );
+		void Write( uint32_t pass, ResourceId resource, nvrhi::ResourceStates state = nvrhi::ResourceStates::RenderTarget );
+
+		// Culls passes, assigns physical textures and works out the transitions
+		// Without a device, no textures are created, which is enough to check what the graph would do
+		void Compile( nvrhi::IDevice* device );
+		// Runs every pass that wasn't culled, has to follow Compile
+		void Execute();
+
+		// Puts a texture into the pool ahead of time, e.g. to create pipelines against before the first frame
+		nvrhi::ITexture* Reserve( nvrhi::IDevice* device, const nvrhi::TextureDesc& desc );
+		// Cached for as long as its textures are in the pool, the depth attachment is optional
+		nvrhi::IFramebuffer* GetFramebuffer( nvrhi::IDevice* device, const std::vector<nvrhi::ITexture*>& colourAttachments, nvrhi::ITexture* depthAttachment );
+
+		bool IsPassCulled( uint32_t pass ) const;
+		// Index of the pooled texture the resource was given, InvalidResource for imported and unused ones
+		uint32_t GetPhysicalIndex( ResourceId resource ) const;
+		nvrhi::ITexture* GetTexture( ResourceId resource ) const;
+		const std::vector<Transition>& GetTransitions( uint32_t pass ) const;
+		const Stats& GetStats() const
+		{
+			return stats;
+		}
+		void PrintStats() const;
+
+	private:
+		friend class PassContext;
+
+		struct Resource
+		{
+			nvrhi::TextureDesc desc;
+			nvrhi::ITexture* imported{};
+			bool isImported{ false };
+			uint32_t physical{ InvalidResource };
+			uint32_t firstPass{ InvalidResource };
+			uint32_t lastPass{};
+		};
+
+		struct Pass
+		{
+			std::string name;
+			std::function<void( PassContext& )> execute;
+			std::vector<Access> accesses;
+			// Every transient texture the pass touches, including the ones already in the right state
+			std::vector<Transition> states;
+			// Made when compiling, so passes recording on several threads only ever read it
+			nvrhi::IFramebuffer* framebuffer{};
+			uint32_t numTransitions{};
+			bool culled{ false };
+		};
+
+		struct PhysicalTexture
+		{
+			nvrhi::TextureDesc desc;
+			nvrhi::TextureHandle texture;
+			// As the last compiled frame left it
+			nvrhi::ResourceStates state{ nvrhi::ResourceStates::Common };
+			uint64_t bytes{};
+			uint32_t lastUsedFrame{};
+			bool inUse{ false };
+		};
+
+		struct CachedFramebuffer
+		{
+			// Colour attachments, then the depth one or null
+			std::vector<nvrhi::ITexture*> attachments;
+			nvrhi::FramebufferHandle framebuffer;
+		};
+
+		void CullPasses();
+		void ReleaseIdleTextures();
+		uint32_t AcquirePhysical( nvrhi::IDevice* device, const nvrhi::TextureDesc& desc, nvrhi::ResourceStates firstState );
+
+		std::vector<Resource> resources;
+		std::vector<Pass> passes;
+		std::vector<PhysicalTexture> pool;
+		std::vector<CachedFramebuffer> framebuffers;
+		uint32_t frameIndex{};
+		Stats stats;
+	};
+}
+
+// Renderer state that Debug reads and flips, it all lives in Main.cpp
+namespace Renderer
+{
+	// Switches to compare the renderer's paths against each other, all on by default
+	extern bool SortDraws;
+	extern bool InstanceDraws;
+	extern bool UseTransformBuffer;
+	extern bool RecordInParallel;
+	extern bool UseIndirectDraws;
+	extern bool OcclusionCulling;
+	extern bool UseEntityTree;
+
+	// Last frame's numbers
+	extern Culling::Stats CullingStats;
+	extern Occlusion::Stats OcclusionStats;
+	extern DrawList::Stats DrawStats;
+	extern bool DrawIndirect;
+	extern RenderGraph::Graph FrameGraph;
+}
+
+// Debug keys and the periodic stats dump
+// F1 prints every subsystem's stats, F2-F8 flip the renderer's switches
+namespace Debug
+{
+	// Frames between stats dumps, 0 turns them off, set with -stats <frames>
+	extern uint32_t StatsInterval;
+
+	void HandleEvent( const SDL_Event& event );
+	// Keeps the framerate averages, and prints them with the last frame's stats every StatsInterval frames
+	void FrameEnded( float cappedFps, float uncappedFps );
 }
 
 namespace nvrhi
@@ -256,6 +1499,13 @@ namespace nvrhi
 	}
 }
 
+// Offline benchmarks and self-checks, run with -bench
+namespace Benchmark
+{
+	// Returns the process exit code
+	int Run();
+}
+
 namespace System
 {
 	bool GetWindowFormat( SDL_Window* window, nvrhi::Format format );
@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+
+// SSE2 is always there on x64, anything else takes the scalar path
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define CULLING_SSE 1
+#include <emmintrin.h>
+#else
+#define CULLING_SSE 0
+#endif
+
+namespace Culling
+{
+	void BoundsArray::Clear()
+	{
+		centreX.clear();
+		centreY.clear();
+		centreZ.clear();
+		extentX.clear();
+		extentY.clear();
+		extentZ.clear();
+	}
+
+	void BoundsArray::Reserve( size_t count )
+	{
+		centreX.reserve( count );
+		centreY.reserve( count );
+		centreZ.reserve( count );
+		extentX.reserve( count );
+		extentY.reserve( count );
+		extentZ.reserve( count );
+	}
+
+	void BoundsArray::Add( const adm::Mat4& transform, const adm::Vec3& boundsMin, const adm::Vec3& boundsMax )
+	{
+		centreX.push_back( 0.0f );
+		centreY.push_back( 0.0f );
+		centreZ.push_back( 0.0f );
+		extentX.push_back( 0.0f );
+		extentY.push_back( 0.0f );
+		extentZ.push_back( 0.0f );
+
+		Set( Size() - 1U, transform, boundsMin, boundsMax );
+	}
+
+	void BoundsArray::Set( size_t index, const adm::Mat4& transform, const adm::Vec3& boundsMin, const adm::Vec3& boundsMax )
+	{
+		// adm::Mat4, read row by row, transforms column vectors
+		const float* m = reinterpret_cast<const float*>( &transform );
+
+		const float c[3] = { (boundsMin.x + boundsMax.x) * 0.5f, (boundsMin.y + boundsMax.y) * 0.5f, (boundsMin.z + boundsMax.z) * 0.5f };
+		const float e[3] = { (boundsMax.x - boundsMin.x) * 0.5f, (boundsMax.y - boundsMin.y) * 0.5f, (boundsMax.z - boundsMin.z) * 0.5f };
+
+		// A rotated box's world-space extents are its extents projected onto each axis
+		float worldCentre[3], worldExtent[3];
+		for ( int row = 0; row < 3; row++ )
+		{
+			const float* r = &m[row * 4];
+			worldCentre[row] = r[0] * c[0] + r[1] * c[1] + r[2] * c[2] + r[3];
+			worldExtent[row] = std::abs( r[0] ) * e[0] + std::abs( r[1] ) * e[1] + std::abs( r[2] ) * e[2];
+		}
+
+		centreX[index] = worldCentre[0];
+		centreY[index] = worldCentre[1];
+		centreZ[index] = worldCentre[2];
+		extentX[index] = worldExtent[0];
+		extentY[index] = worldExtent[1];
+		extentZ[index] = worldExtent[2];
+	}
+
+	Frustum ExtractFrustum( const adm::Mat4& viewMatrix, const adm::Mat4& projectionMatrix )
+	{
+		const float* p = reinterpret_cast<const float*>( &projectionMatrix );
+		const float* v = reinterpret_cast<const float*>( &viewMatrix );
+
+		// Same order the shader applies them in, projection * view
+		float vp[16];
+		for ( int row = 0; row < 4; row++ )
+		{
+			for ( int column = 0; column < 4; column++ )
+			{
+				vp[row * 4 + column] = p[row * 4 + 0] * v[0 * 4 + column]
+					+ p[row * 4 + 1] * v[1 * 4 + column]
+					+ p[row * 4 + 2] * v[2 * 4 + column]
+					+ p[row * 4 + 3] * v[3 * 4 + column];
+			}
+		}
+
+		// Gribb & Hartmann: a point is inside when -w <= x, y <= w
+		// For depth, -w <= z is only exact for -1..1, with 0..1 it lets through a little bit behind the near plane, which is harmless
+		const float* w = &vp[12];
+		Frustum frustum;
+		for ( int axis = 0; axis < 3; axis++ )
+		{
+			const float* r = &vp[axis * 4];
+			for ( int i = 0; i < 4; i++ )
+			{
+				frustum.planes[axis * 2 + 0][i] = w[i] + r[i];
+				frustum.planes[axis * 2 + 1][i] = w[i] - r[i];
+			}
+		}
+
+		for ( auto& plane : frustum.planes )
+		{
+			const float length = std::sqrt( plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2] );
+			if ( length > 0.0f )
+			{
+				for ( float& component : plane )
+				{
+					component /= length;
+				}
+			}
+		}
+
+		return frustum;
+	}
+
+	// A box is outside if it's entirely behind any of the planes
+	static bool IsBoxVisible( const Frustum& frustum, const BoundsArray& bounds, size_t i )
+	{
+		for ( const auto& plane : frustum.planes )
+		{
+			const float distance = plane[0] * bounds.centreX[i] + plane[1] * bounds.centreY[i] + plane[2] * bounds.centreZ[i] + plane[3];
+			const float radius = std::abs( plane[0] ) * bounds.extentX[i] + std::abs( plane[1] ) * bounds.extentY[i] + std::abs( plane[2] ) * bounds.extentZ[i];
+
+			if ( distance + radius < 0.0f )
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	size_t CullBoxesScalar( const Frustum& frustum, const BoundsArray& bounds, uint8_t* outVisible )
+	{
+		size_t numVisible = 0U;
+		for ( size_t i = 0U; i < bounds.Size(); i++ )
+		{
+			outVisible[i] = IsBoxVisible( frustum, bounds, i );
+			numVisible += outVisible[i];
+		}
+
+		return numVisible;
+	}
+
+	size_t CullBoxes( const Frustum& frustum, const BoundsArray& bounds, uint8_t* outVisible )
+	{
+		const size_t count = bounds.Size();
+		size_t numVisible = 0U;
+		size_t i = 0U;
+
+#if CULLING_SSE
+		// Every plane component broadcast into its own register once, instead of per box
+		__m128 normalX[6], normalY[6], normalZ[6], distance[6];
+		__m128 absNormalX[6], absNormalY[6], absNormalZ[6];
+		for ( int p = 0; p < 6; p++ )
+		{
+			const float* plane = frustum.planes[p];
+			normalX[p] = _mm_set1_ps( plane[0] );
+			normalY[p] = _mm_set1_ps( plane[1] );
+			normalZ[p] = _mm_set1_ps( plane[2] );
+			distance[p] = _mm_set1_ps( plane[3] );
+			absNormalX[p] = _mm_set1_ps( std::abs( plane[0] ) );
+			absNormalY[p] = _mm_set1_ps( std::abs( plane[1] ) );
+			absNormalZ[p] = _mm_set1_ps( std::abs( plane[2] ) );
+		}
+
+		const __m128 zero = _mm_setzero_ps();
+		for ( ; i + 4U <= count; i += 4U )
+		{
+			const __m128 cx = _mm_loadu_ps( &bounds.centreX[i] );
+			const __m128 cy = _mm_loadu_ps( &bounds.centreY[i] );
+			const __m128 cz = _mm_loadu_ps( &bounds.centreZ[i] );
+			const __m128 ex = _mm_loadu_ps( &bounds.extentX[i] );
+			const __m128 ey = _mm_loadu_ps( &bounds.extentY[i] );
+			const __m128 ez = _mm_loadu_ps( &bounds.extentZ[i] );
+
+			// No early-out, testing all six planes is cheaper than branching on four boxes at once
+			__m128 outside = zero;
+			for ( int p = 0; p < 6; p++ )
+			{
+				// Same order of operations as IsBoxVisible, so both give the same answer for boxes touching a plane
+				__m128 d = _mm_add_ps( _mm_mul_ps( normalX[p], cx ), _mm_mul_ps( normalY[p], cy ) );
+				d = _mm_add_ps( d, _mm_mul_ps( normalZ[p], cz ) );
+				d = _mm_add_ps( d, distance[p] );
+
+				__m128 r = _mm_mul_ps( absNormalX[p], ex );
+				r = _mm_add_ps( r, _mm_mul_ps( absNormalY[p], ey ) );
+				r = _mm_add_ps( r, _mm_mul_ps( absNormalZ[p], ez ) );
+
+				outside = _mm_or_ps( outside, _mm_cmplt_ps( _mm_add_ps( d, r ), zero ) );
+			}
+
+			const int outsideMask = _mm_movemask_ps( outside );
+			for ( int lane = 0; lane < 4; lane++ )
+			{
+				const uint8_t visible = !(outsideMask & (1 << lane));
+				outVisible[i + lane] = visible;
+				numVisible += visible;
+			}
+		}
+#endif
+
+		// Whatever doesn't fill a group of four
+		for ( ; i < count; i++ )
+		{
+			outVisible[i] = IsBoxVisible( frustum, bounds, i );
+			numVisible += outVisible[i];
+		}
+
+		return numVisible;
+	}
+}
@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: MIT
+
+#include <numeric>
+
+#include "Common.hpp"
+
+#include "SDL.h"
+
+namespace Debug
+{
+	uint32_t StatsInterval = 0U;
+
+	// A renderer switch and the function key that flips it
+	struct Toggle
+	{
+		SDL_Scancode key;
+		const char* name;
+		bool& value;
+	};
+
+	static const Toggle Toggles[] =
+	{
+		// Compare sorted draws against drawing in entity order
+		{ SDL_SCANCODE_F2, "Draw sorting", Renderer::SortDraws },
+		// Compare instanced draws against one draw per entity
+		{ SDL_SCANCODE_F3, "Instancing", Renderer::InstanceDraws },
+		// Compare the transform buffer against a constant buffer write per entity
+		{ SDL_SCANCODE_F4, "Transform buffer", Renderer::UseTransformBuffer },
+		// Compare recording on the worker threads against the main thread only
+		{ SDL_SCANCODE_F5, "Parallel recording", Renderer::RecordInParallel },
+		// Compare indirect batches against a drawIndexed call per instance group
+		{ SDL_SCANCODE_F6, "Indirect draws", Renderer::UseIndirectDraws },
+		// Compare occlusion culling against the frustum alone
+		{ SDL_SCANCODE_F7, "Occlusion culling", Renderer::OcclusionCulling },
+		// Compare the entity tree against culling every entity's box
+		{ SDL_SCANCODE_F8, "Entity tree", Renderer::UseEntityTree }
+	};
+
+	constexpr size_t MaxFrames = 100U;
+	static std::list<float> FrameratesCapped;
+	static std::list<float> FrameratesUncapped;
+	static uint32_t FramesSinceStats = 0U;
+
+	static void PrintAllStats()
+	{
+		Memory::PrintStats();
+		Upload::PrintStats();
+		Texture::Loader::PrintStats();
+		Texture::Streaming::PrintStats();
+		Transforms::PrintStats();
+		Renderer::FrameGraph.PrintStats();
+		PipelineCompiler::PrintStats();
+		ObjectCache::PrintStats();
+	}
+
+	static void PrintFrameStats( float averageCapped, float averageUncapped )
+	{
+		const Culling::Stats& culling = Renderer::CullingStats;
+		std::cout << "Capped fps:   " << std::setw( 4 ) << int( averageCapped ) << std::endl
+			      << "Uncapped fps: " << std::setw( 4 ) << int( averageUncapped ) << std::endl
+			      << "Visible:      " << culling.numEntitiesVisible << " entities (" << culling.numEntitiesCulled << " culled), "
+			      << culling.numSurfacesVisible << " surfaces (" << culling.numSurfacesCulled << " culled)" << std::endl;
+
+		const Occlusion::Stats& occlusion = Renderer::OcclusionStats;
+		std::cout << "Occlusion:    " << (Renderer::OcclusionCulling ? "" : "(off) ") << culling.numEntitiesOccluded << " entities and "
+			      << culling.numSurfacesOccluded << " surfaces occluded, " << occlusion.numOccluders << " occluders with "
+			      << occlusion.numRasterised << "/" << occlusion.numTriangles << " triangles rasterised, "
+			      << occlusion.rasterMilliseconds << " ms rasterising, " << occlusion.testMilliseconds << " ms testing" << std::endl;
+
+		const DrawList::Stats& draws = Renderer::DrawStats;
+		std::cout << "Draws:        " << draws.numDraws << (Renderer::SortDraws ? " sorted" : " unsorted") << ", "
+			      << draws.numBindingChanges << " binding set changes, " << draws.numBufferChanges << " buffer changes, "
+			      << draws.numInstancedDraws << (Renderer::InstanceDraws ? " instanced" : " instanced (off)") << " with "
+			      << draws.numInstances << " instances, " << draws.numIndirectCalls << (Renderer::DrawIndirect ? " indirect calls, " : " indirect calls (off), ") << draws.numCommandLists << " command lists, " << draws.numConstantWrites << " constant writes, " << draws.numStateCalls << " state calls ("
+			      << draws.numElidedCalls << " elided), " << draws.sortMilliseconds << " ms sorting, "
+			      << draws.submitMilliseconds << " ms recording" << std::endl;
+
+		const Texture::Loader::Stats textures = Texture::Loader::GetStats();
+		const Texture::Loader::FrameStats textureFrame = Texture::Loader::GetFrameStats();
+		std::cout << "Textures:     " << textures.numCreated << " created over " << textures.numBusyFrames << " frames, "
+			      << textureFrame.numWaiting << " waiting, " << textureFrame.numDecoding << " decoding, "
+			      << textures.medianMilliseconds << " ms median, " << textures.p99Milliseconds << " ms p99 per busy frame" << std::endl;
+	}
+
+	void HandleEvent( const SDL_Event& event )
+	{
+		if ( event.type != SDL_KEYDOWN )
+		{
+			return;
+		}
+
+		// Dump resource memory usage and everything else
+		if ( event.key.keysym.scancode == SDL_SCANCODE_F1 )
+		{
+			PrintAllStats();
+			return;
+		}
+
+		for ( const Toggle& toggle : Toggles )
+		{
+			if ( event.key.keysym.scancode == toggle.key )
+			{
+				toggle.value = !toggle.value;
+				std::cout << toggle.name << (toggle.value ? " enabled" : " disabled") << std::endl;
+				return;
+			}
+		}
+	}
+
+	void FrameEnded( float cappedFps, float uncappedFps )
+	{
+		if ( FrameratesCapped.size() >= MaxFrames )
+		{
+			FrameratesCapped.pop_front();
+		}
+		if ( FrameratesUncapped.size() >= MaxFrames )
+		{
+			FrameratesUncapped.pop_front();
+		}
+
+		FrameratesCapped.push_back( cappedFps );
+		FrameratesUncapped.push_back( uncappedFps );
+
+		if ( 0U == StatsInterval || ++FramesSinceStats < StatsInterval )
+		{
+			return;
+		}
+
+		const float averageCapped = std::accumulate( FrameratesCapped.begin(), FrameratesCapped.end(), 0.0f ) / FrameratesCapped.size();
+		const float averageUncapped = std::accumulate( FrameratesUncapped.begin(), FrameratesUncapped.end(), 0.0f ) / FrameratesUncapped.size();
+		PrintFrameStats( averageCapped, averageUncapped );
+		FramesSinceStats = 0U;
+	}
+}
@@ -132,6 +132,10 @@ namespace nvrhi::app
         // Severity of the information log messages from the device manager, like the device name or enabled extensions.
         nvrhi::MessageSeverity infoLogSeverity = nvrhi::MessageSeverity::Info;
 
+        // Where compiled pipelines are loaded from when the device is created, and saved to when it's destroyed.
+        // Only Vulkan has one so far. Leave empty to go without.
+        std::string pipelineCachePath;
+
 #if USE_DX11 || USE_DX12
         // Adapter to create the device on. Setting this to non-null overrides adapterNameSubstring.
         // If device creation fails on the specified adapter, it will *not* try any other adapters.
@@ -228,6 +232,11 @@ namespace nvrhi::app
         [[nodiscard]] bool IsVsyncEnabled() const { return m_DeviceParams.vsyncEnabled; }
         virtual void SetVsyncEnabled(bool enabled) { m_RequestedVSync = enabled; /* will be processed later */ }
         virtual void ReportLiveObjects() {}
+        // drawIndexedIndirect with a draw count above 1 and a non-zero first instance
+        // D3D always has both, Vulkan needs the multiDrawIndirect and drawIndirectFirstInstance features
+        [[nodiscard]] virtual bool IsMultiDrawIndirectSupported() const { return true; }
+        // How much of the pipeline cache was loaded from disk, zero means pipelines are compiled from scratch
+        [[nodiscard]] virtual size_t GetLoadedPipelineCacheBytes() const { return 0; }
 
         [[nodiscard]] void* GetWindow() const { return m_Window; }
         [[nodiscard]] uint32_t GetFrameIndex() const { return m_FrameIndex; }
@@ -23,6 +23,10 @@
 // Adapted from Donut's DeviceManagerVK
 // https://github.com/NVIDIAGameWorks/donut/blob/main/src/app/vulkan/DeviceManager_VK.cpp
 
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <string>
 #include <queue>
 #include <unordered_set>
@@ -49,6 +53,35 @@ const char* va( const char* message, ... )
 // Define the Vulkan dynamic dispatcher - this needs to occur in exactly one cpp file in the program.
 VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 
+// Goes in front of the driver's data, so a cache from another GPU or driver is thrown away before the driver ever sees it
+// Drivers are supposed to reject foreign data themselves, not all of them do it gracefully
+struct PipelineCacheFileHeader
+{
+	static constexpr uint32_t Magic = 0x48434C50; // PLCH
+	static constexpr uint32_t Version = 1U;
+
+	uint32_t magic{ Magic };
+	uint32_t version{ Version };
+	uint32_t vendorId{};
+	uint32_t deviceId{};
+	uint32_t driverVersion{};
+	uint8_t deviceUuid[VK_UUID_SIZE]{};
+	uint8_t pipelineCacheUuid[VK_UUID_SIZE]{};
+	uint64_t dataSize{};
+	// FNV-1a of the data, catches files cut short by a crash while saving
+	uint64_t dataHash{};
+};
+
+static uint64_t HashPipelineCacheData( const uint8_t* data, size_t size )
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for ( size_t i = 0U; i < size; i++ )
+	{
+		hash = (hash ^ data[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
 class DeviceManager_VK : public DeviceManager
 {
 public:
@@ -105,6 +138,16 @@ protected:
 		return m_RendererString.c_str();
 	}
 
+	bool IsMultiDrawIndirectSupported() const override
+	{
+		return m_MultiDrawIndirectSupported;
+	}
+
+	size_t GetLoadedPipelineCacheBytes() const override
+	{
+		return m_LoadedPipelineCacheBytes;
+	}
+
 	bool IsVulkanInstanceExtensionEnabled( const char* extensionName ) const override
 	{
 		return enabledExtensions.instance.find( extensionName ) != enabledExtensions.instance.end();
@@ -147,6 +190,9 @@ private:
 	bool createDevice();
 	bool createSwapChain();
 	void destroySwapChain();
+	PipelineCacheFileHeader getPipelineCacheFileHeader() const;
+	void createPipelineCache();
+	void savePipelineCache();
 	bool getPhysicalDevicePresentationSupport( vk::PhysicalDevice& physicalDevice, int queueFamilyIndex );
 
 	struct VulkanExtensionSet
@@ -204,12 +250,15 @@ private:
 	vk::DebugReportCallbackEXT m_DebugReportCallback;
 
 	vk::PhysicalDevice m_VulkanPhysicalDevice;
+	bool m_MultiDrawIndirectSupported = false;
 	int m_GraphicsQueueFamily = -1;
 	int m_ComputeQueueFamily = -1;
 	int m_TransferQueueFamily = -1;
 	int m_PresentQueueFamily = -1;
 
 	vk::Device m_VulkanDevice;
+	vk::PipelineCache m_PipelineCache;
+	size_t m_LoadedPipelineCacheBytes = 0;
 	vk::Queue m_GraphicsQueue;
 	vk::Queue m_ComputeQueue;
 	vk::Queue m_TransferQueue;
@@ -606,6 +655,13 @@ bool DeviceManager_VK::findQueueFamilies( vk::PhysicalDevice physicalDevice )
 		}
 	}
 
+	// Plenty of GPUs don't have a dedicated transfer queue, uploads will go through the graphics queue there
+	if ( m_TransferQueueFamily == -1 && m_DeviceParams.enableCopyQueue )
+	{
+		Message( "No dedicated transfer queue family, disabling the copy queue" );
+		m_DeviceParams.enableCopyQueue = false;
+	}
+
 	if ( m_GraphicsQueueFamily == -1 ||
 		m_PresentQueueFamily == -1 ||
 		(m_ComputeQueueFamily == -1 && m_DeviceParams.enableComputeQueue) ||
@@ -708,7 +764,13 @@ bool DeviceManager_VK::createDevice()
 		APPEND_EXTENSION( vrsSupported, vrsFeatures )
 #undef APPEND_EXTENSION
 
+		// Optional, the renderer falls back to direct draws without them
+		const auto physicalDeviceFeatures = m_VulkanPhysicalDevice.getFeatures();
+		m_MultiDrawIndirectSupported = physicalDeviceFeatures.multiDrawIndirect && physicalDeviceFeatures.drawIndirectFirstInstance;
+
 		auto deviceFeatures = vk::PhysicalDeviceFeatures()
+		.setMultiDrawIndirect( m_MultiDrawIndirectSupported )
+		.setDrawIndirectFirstInstance( m_MultiDrawIndirectSupported )
 		.setShaderImageGatherExtended( true )
 		.setSamplerAnisotropy( true )
 		.setTessellationShader( true )
@@ -764,9 +826,135 @@ bool DeviceManager_VK::createDevice()
 
 	Message( va( "Created Vulkan device: %s", m_RendererString.c_str() ), m_DeviceParams.infoLogSeverity );
 
+	createPipelineCache();
+
 	return true;
 }
 
+PipelineCacheFileHeader DeviceManager_VK::getPipelineCacheFileHeader() const
+{
+	const auto properties = m_VulkanPhysicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceIDProperties>();
+	const vk::PhysicalDeviceProperties& deviceProperties = properties.get<vk::PhysicalDeviceProperties2>().properties;
+	const vk::PhysicalDeviceIDProperties& idProperties = properties.get<vk::PhysicalDeviceIDProperties>();
+
+	PipelineCacheFileHeader header;
+	header.vendorId = deviceProperties.vendorID;
+	header.deviceId = deviceProperties.deviceID;
+	header.driverVersion = deviceProperties.driverVersion;
+	memcpy( header.deviceUuid, idProperties.deviceUUID.data(), VK_UUID_SIZE );
+	memcpy( header.pipelineCacheUuid, deviceProperties.pipelineCacheUUID.data(), VK_UUID_SIZE );
+	return header;
+}
+
+// Starts out with whatever the last run saved, if it was saved on this very device and driver
+void DeviceManager_VK::createPipelineCache()
+{
+	if ( m_DeviceParams.pipelineCachePath.empty() )
+	{
+		return;
+	}
+
+	const PipelineCacheFileHeader expected = getPipelineCacheFileHeader();
+	std::vector<uint8_t> data;
+
+	std::ifstream file( m_DeviceParams.pipelineCachePath, std::ios::binary );
+	PipelineCacheFileHeader header;
+	if ( file && file.read( reinterpret_cast<char*>( &header ), sizeof( header ) ) )
+	{
+		const char* rejection = nullptr;
+		if ( header.magic != expected.magic || header.version != expected.version )
+			rejection = "it's not a pipeline cache or an old one";
+		else if ( header.vendorId != expected.vendorId || header.deviceId != expected.deviceId
+			|| memcmp( header.deviceUuid, expected.deviceUuid, VK_UUID_SIZE ) != 0 )
+			rejection = "it was made on a different device";
+		else if ( header.driverVersion != expected.driverVersion
+			|| memcmp( header.pipelineCacheUuid, expected.pipelineCacheUuid, VK_UUID_SIZE ) != 0 )
+			rejection = "it was made with a different driver";
+		else
+		{
+			data.resize( header.dataSize );
+			if ( !file.read( reinterpret_cast<char*>( data.data() ), data.size() )
+				|| HashPipelineCacheData( data.data(), data.size() ) != header.dataHash )
+				rejection = "it's damaged";
+		}
+
+		if ( nullptr != rejection )
+		{
+			Message( va( "Ignoring pipeline cache '%s', %s", m_DeviceParams.pipelineCachePath.c_str(), rejection ), nvrhi::MessageSeverity::Warning );
+			data.clear();
+		}
+	}
+
+	auto createInfo = vk::PipelineCacheCreateInfo()
+		.setInitialDataSize( data.size() )
+		.setPInitialData( data.data() );
+
+	vk::Result res = m_VulkanDevice.createPipelineCache( &createInfo, nullptr, &m_PipelineCache );
+	if ( res != vk::Result::eSuccess && !data.empty() )
+	{
+		// The driver didn't like it after all, starting over with an empty one is still better than none
+		data.clear();
+		createInfo.setInitialDataSize( 0 ).setPInitialData( nullptr );
+		res = m_VulkanDevice.createPipelineCache( &createInfo, nullptr, &m_PipelineCache );
+	}
+
+	if ( res != vk::Result::eSuccess )
+	{
+		Message( va( "Failed to create a pipeline cache, error code = %s", nvrhi::vulkan::resultToString( res ) ), nvrhi::MessageSeverity::Warning );
+		m_PipelineCache = nullptr;
+		return;
+	}
+
+	m_LoadedPipelineCacheBytes = data.size();
+	Message( va( "Loaded %u kB of cached pipelines from '%s'", uint32_t( data.size() / 1024U ), m_DeviceParams.pipelineCachePath.c_str() ),
+		m_DeviceParams.infoLogSeverity );
+}
+
+// Written to a temporary file first, so a crash halfway through doesn't leave a broken cache behind
+void DeviceManager_VK::savePipelineCache()
+{
+	if ( !m_PipelineCache )
+	{
+		return;
+	}
+
+	const std::vector<uint8_t> data = m_VulkanDevice.getPipelineCacheData( m_PipelineCache );
+
+	PipelineCacheFileHeader header = getPipelineCacheFileHeader();
+	header.dataSize = data.size();
+	header.dataHash = HashPipelineCacheData( data.data(), data.size() );
+
+	const std::string temporaryPath = m_DeviceParams.pipelineCachePath + ".tmp";
+	bool written = false;
+	{
+		std::ofstream file( temporaryPath, std::ios::binary | std::ios::trunc );
+		written = file.write( reinterpret_cast<const char*>( &header ), sizeof( header ) )
+			&& file.write( reinterpret_cast<const char*>( data.data() ), data.size() );
+	}
+
+	// Replaces the old cache in one step, std::rename can't do that on Windows
+	std::error_code renameError;
+	if ( written )
+	{
+		std::filesystem::rename( temporaryPath, m_DeviceParams.pipelineCachePath, renameError );
+	}
+
+	if ( !written || renameError )
+	{
+		Message( va( "Failed to save the pipeline cache to '%s'", m_DeviceParams.pipelineCachePath.c_str() ), nvrhi::MessageSeverity::Warning );
+		std::remove( temporaryPath.c_str() );
+	}
+	else
+	{
+		Message( va( "Saved %u kB of cached pipelines to '%s'", uint32_t( data.size() / 1024U ), m_DeviceParams.pipelineCachePath.c_str() ),
+			m_DeviceParams.infoLogSeverity );
+	}
+
+	m_VulkanDevice.destroyPipelineCache( m_PipelineCache );
+	m_PipelineCache = nullptr;
+	m_LoadedPipelineCacheBytes = 0;
+}
+
 bool DeviceManager_VK::createWindowSurface()
 {
 	vk::Result res = vk::Result::eErrorUnknown;
@@ -958,6 +1146,8 @@ bool DeviceManager_VK::CreateDeviceAndSwapChain()
 	deviceDesc.numInstanceExtensions = vecInstanceExt.size();
 	deviceDesc.deviceExtensions = vecDeviceExt.data();
 	deviceDesc.numDeviceExtensions = vecDeviceExt.size();
+	// NVRHI only gets this through external/patches/nvrhi-vulkan-pipeline-cache.patch, it stays ours to save and destroy
+	deviceDesc.pipelineCache = static_cast<VkPipelineCache>( m_PipelineCache );
 
 	m_NvrhiDevice = nvrhi::vulkan::createDevice( deviceDesc );
 
@@ -997,6 +1187,8 @@ void DeviceManager_VK::DestroyDeviceAndSwapChain()
 
 	if ( m_VulkanDevice )
 	{
+		// NVRHI's pipelines are gone by now, and they've left everything they compiled in the cache
+		savePipelineCache();
 		m_VulkanDevice.destroy();
 		m_VulkanDevice = nullptr;
 	}
@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+
+namespace DrawList
+{
+	uint64_t MakeSortKey( uint32_t pipeline, uint32_t material, uint32_t geometry, float depth )
+	{
+		constexpr uint64_t MaxDepth = (1ULL << DepthBits) - 1ULL;
+		const uint64_t quantisedDepth = uint64_t( std::clamp( depth, 0.0f, 1.0f ) * MaxDepth );
+
+		// Anything over the limit wraps around, which only costs a bit of sorting quality
+		uint64_t key = pipeline & ((1ULL << PipelineBits) - 1ULL);
+		key = (key << MaterialBits) | (material & ((1ULL << MaterialBits) - 1ULL));
+		key = (key << GeometryBits) | (geometry & ((1ULL << GeometryBits) - 1ULL));
+		key = (key << DepthBits) | quantisedDepth;
+
+		return key;
+	}
+
+	void RadixSort( std::vector<Item>& items, std::vector<Item>& scratch )
+	{
+		constexpr uint32_t NumPasses = sizeof( uint64_t );
+		constexpr uint32_t NumBuckets = 256U;
+
+		const size_t count = items.size();
+		if ( count < 2U )
+		{
+			return;
+		}
+
+		// All the histograms in a single read of the keys
+		uint32_t histograms[NumPasses][NumBuckets]{};
+		for ( const Item& item : items )
+		{
+			for ( uint32_t pass = 0U; pass < NumPasses; pass++ )
+			{
+				histograms[pass][(item.key >> (pass * 8U)) & 0xFFU]++;
+			}
+		}
+
+		scratch.resize( count );
+		Item* source = items.data();
+		Item* destination = scratch.data();
+
+		for ( uint32_t pass = 0U; pass < NumPasses; pass++ )
+		{
+			uint32_t* histogram = histograms[pass];
+
+			// Most of the key's bytes are the same for every item, e.g. the pipeline, nothing to do for those
+			if ( histogram[(source[0].key >> (pass * 8U)) & 0xFFU] == count )
+			{
+				continue;
+			}
+
+			uint32_t offset = 0U;
+			for ( uint32_t bucket = 0U; bucket < NumBuckets; bucket++ )
+			{
+				const uint32_t bucketSize = histogram[bucket];
+				histogram[bucket] = offset;
+				offset += bucketSize;
+			}
+
+			for ( size_t i = 0U; i < count; i++ )
+			{
+				destination[histogram[(source[i].key >> (pass * 8U)) & 0xFFU]++] = source[i];
+			}
+
+			std::swap( source, destination );
+		}
+
+		// An odd number of passes left the result in the scratch buffer
+		if ( source != items.data() )
+		{
+			items.swap( scratch );
+		}
+	}
+
+	void StateTracker::Reset( const nvrhi::GraphicsState& baseState, uint32_t surfaceSlot )
+	{
+		state = baseState;
+		surfaceBindingSlot = surfaceSlot;
+		while ( state.bindings.size() <= surfaceBindingSlot )
+		{
+			state.bindings.push_back( nullptr );
+		}
+		if ( state.vertexBuffers.empty() )
+		{
+			state.vertexBuffers.push_back( {} );
+		}
+		state.vertexBuffers[0] = { nullptr, 0, 0 };
+		state.indexBuffer = { nullptr, nvrhi::Format::R32_UINT, 0 };
+
+		submittedPipeline = nullptr;
+		valid = false;
+	}
+
+	bool StateTracker::Update( const Model::DrawPacket& packet, Stats& stats )
+	{
+		nvrhi::IBindingSet*& bindingSet = state.bindings[surfaceBindingSlot];
+		nvrhi::VertexBufferBinding& vertexBuffer = state.vertexBuffers[0];
+
+		const bool bindingChanged = bindingSet != packet.bindingSet;
+		const bool buffersChanged = vertexBuffer.buffer != packet.vertexBuffer || state.indexBuffer.buffer != packet.indexBuffer;
+
+		if ( valid && !bindingChanged && !buffersChanged )
+		{
+			stats.numElidedCalls++;
+			return false;
+		}
+
+		bindingSet = packet.bindingSet;
+		vertexBuffer.buffer = packet.vertexBuffer;
+		state.indexBuffer.buffer = packet.indexBuffer;
+
+		stats.numStateCalls++;
+		stats.numPipelineChanges += submittedPipeline != state.pipeline;
+		stats.numBindingChanges += bindingChanged;
+		stats.numBufferChanges += buffersChanged;
+
+		submittedPipeline = state.pipeline;
+		valid = true;
+		return true;
+	}
+}
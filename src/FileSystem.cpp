@@ -0,0 +1,500 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+
+#include <unordered_map>
+
+#include <lz4.h>
+
+#if _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace FileSystem
+{
+	// ==========================================================================================================
+	// MEMORY MAPPING
+	// ==========================================================================================================
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	bool MappedFile::Open( const char* path )
+	{
+		Close();
+
+#if _WIN32
+		HANDLE file = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+		if ( file == INVALID_HANDLE_VALUE )
+		{
+			return false;
+		}
+
+		LARGE_INTEGER fileSize{};
+		GetFileSizeEx( file, &fileSize );
+		fileHandle = file;
+		size = size_t( fileSize.QuadPart );
+
+		// Empty files cannot be mapped, but they're still valid files
+		if ( size == 0U )
+		{
+			return true;
+		}
+
+		mappingHandle = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+		if ( nullptr == mappingHandle )
+		{
+			Close();
+			return false;
+		}
+
+		data = static_cast<const uint8_t*>( MapViewOfFile( mappingHandle, FILE_MAP_READ, 0, 0, 0 ) );
+#else
+		const int file = open( path, O_RDONLY );
+		if ( file < 0 )
+		{
+			return false;
+		}
+
+		struct stat fileStat{};
+		fstat( file, &fileStat );
+		size = size_t( fileStat.st_size );
+
+		if ( size == 0U )
+		{
+			close( file );
+			return true;
+		}
+
+		void* mapped = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, file, 0 );
+		// The mapping stays valid after closing the descriptor
+		close( file );
+
+		data = mapped == MAP_FAILED ? nullptr : static_cast<const uint8_t*>( mapped );
+#endif
+
+		if ( nullptr == data )
+		{
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+#if _WIN32
+		if ( nullptr != data )
+		{
+			UnmapViewOfFile( data );
+		}
+		if ( nullptr != mappingHandle )
+		{
+			CloseHandle( mappingHandle );
+		}
+		if ( nullptr != fileHandle )
+		{
+			CloseHandle( fileHandle );
+		}
+
+		mappingHandle = nullptr;
+		fileHandle = nullptr;
+#else
+		if ( nullptr != data )
+		{
+			munmap( const_cast<uint8_t*>( data ), size );
+		}
+#endif
+
+		data = nullptr;
+		size = 0U;
+	}
+
+	// ==========================================================================================================
+	// PAK FORMAT
+	//
+	// Header
+	// File data, one entry after another
+	// Table of contents: PakEntry[numEntries]
+	// String table with all the paths
+	// Compressed entries are single LZ4 blocks
+	// ==========================================================================================================
+	constexpr char PakMagic[4] = { 'N', 'P', 'A', 'K' };
+	constexpr uint32_t PakVersion = 2U;
+	// File data is aligned so that it can be used in place, e.g. shader bytecode
+	constexpr uint64_t PakAlignment = 16U;
+
+	enum PakEntryFlags : uint32_t
+	{
+		PakEntry_Lz4 = 1U << 0U
+	};
+
+	struct PakHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t numEntries;
+		uint32_t stringTableSize;
+		uint64_t tocOffset;
+	};
+
+	struct PakEntry
+	{
+		uint32_t pathOffset;
+		uint32_t pathLength;
+		uint64_t dataOffset;
+		uint64_t storedSize;
+		uint64_t originalSize;
+		uint32_t flags;
+		uint32_t padding;
+	};
+
+	// FNV-1a
+	static uint64_t HashPath( const std::string& path )
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		for ( const char c : path )
+		{
+			hash ^= uint8_t( c );
+			hash *= 1099511628211ULL;
+		}
+
+		return hash;
+	}
+
+	struct PathHasher
+	{
+		size_t operator()( const std::string& path ) const
+		{
+			return size_t( HashPath( path ) );
+		}
+	};
+
+	// ==========================================================================================================
+	// INDEX
+	// ==========================================================================================================
+	struct IndexEntry
+	{
+		// Loose file on disk
+		std::string diskPath{};
+		// ...or a pak entry
+		const PakEntry* pakEntry{ nullptr };
+		uint64_t size{ 0U };
+	};
+
+	static std::unordered_map<std::string, IndexEntry, PathHasher> Index;
+	static std::shared_ptr<MappedFile> PakFile;
+
+	// Backslashes to forward slashes, no leading ./
+	static std::string NormalisePath( std::string path )
+	{
+		std::replace( path.begin(), path.end(), '\\', '/' );
+		while ( path.size() > 2U && path[0] == '.' && path[1] == '/' )
+		{
+			path.erase( 0, 2 );
+		}
+
+		return path;
+	}
+
+	static bool MountPak( const char* pakPath )
+	{
+		auto pakFile = std::make_shared<MappedFile>();
+		if ( !pakFile->Open( pakPath ) )
+		{
+			return false;
+		}
+
+		const uint8_t* pakData = pakFile->GetData();
+		const size_t pakSize = pakFile->GetSize();
+
+		if ( pakSize < sizeof( PakHeader ) )
+		{
+			std::cout << "FileSystem::MountPak: '" << pakPath << "' is too small" << std::endl;
+			return false;
+		}
+
+		const PakHeader& header = *reinterpret_cast<const PakHeader*>( pakData );
+		if ( std::memcmp( header.magic, PakMagic, sizeof( PakMagic ) ) || header.version != PakVersion )
+		{
+			std::cout << "FileSystem::MountPak: '" << pakPath << "' is not a valid pak" << std::endl;
+			return false;
+		}
+
+		const uint64_t tocBytes = uint64_t( header.numEntries ) * sizeof( PakEntry );
+		if ( header.tocOffset + tocBytes + header.stringTableSize > pakSize )
+		{
+			std::cout << "FileSystem::MountPak: '" << pakPath << "' is truncated" << std::endl;
+			return false;
+		}
+
+		const PakEntry* entries = reinterpret_cast<const PakEntry*>( pakData + header.tocOffset );
+		const char* stringTable = reinterpret_cast<const char*>( pakData + header.tocOffset + tocBytes );
+
+		for ( uint32_t i = 0U; i < header.numEntries; i++ )
+		{
+			const PakEntry& entry = entries[i];
+			if ( entry.pathOffset + entry.pathLength > header.stringTableSize || entry.dataOffset + entry.storedSize > pakSize )
+			{
+				std::cout << "FileSystem::MountPak: '" << pakPath << "' has a broken entry, skipping" << std::endl;
+				continue;
+			}
+
+			IndexEntry indexEntry;
+			indexEntry.pakEntry = &entry;
+			indexEntry.size = entry.originalSize;
+
+			// Pak entries take precedence over loose files
+			Index[std::string( stringTable + entry.pathOffset, entry.pathLength )] = indexEntry;
+		}
+
+		PakFile = std::move( pakFile );
+
+		std::cout << "FileSystem: mounted '" << pakPath << "' with " << header.numEntries << " entries" << std::endl;
+		return true;
+	}
+
+	bool Init( const char* rootDirectory, const char* pakPath )
+	{
+		namespace fs = std::filesystem;
+
+		Index.clear();
+
+		std::error_code error;
+		for ( const auto& directoryEntry : fs::recursive_directory_iterator( rootDirectory, error ) )
+		{
+			if ( !directoryEntry.is_regular_file() )
+			{
+				continue;
+			}
+
+			IndexEntry indexEntry;
+			indexEntry.diskPath = directoryEntry.path().string();
+			indexEntry.size = directoryEntry.file_size();
+
+			Index[NormalisePath( directoryEntry.path().generic_string() )] = indexEntry;
+		}
+
+		if ( error )
+		{
+			std::cout << "FileSystem::Init: cannot index '" << rootDirectory << "' (" << error.message() << ")" << std::endl;
+		}
+
+		std::cout << "FileSystem: indexed " << Index.size() << " files in '" << rootDirectory << "'" << std::endl;
+
+		if ( nullptr != pakPath && fs::exists( pakPath, error ) )
+		{
+			MountPak( pakPath );
+		}
+
+		return !Index.empty();
+	}
+
+	void Shutdown()
+	{
+		Index.clear();
+		PakFile.reset();
+	}
+
+	bool Exists( const std::string& path )
+	{
+		return Index.find( NormalisePath( path ) ) != Index.end();
+	}
+
+	bool FindWithExtensions( const std::string& path, const std::vector<std::string>& extensions, std::string& outPath )
+	{
+		const std::string normalisedPath = NormalisePath( path );
+		for ( const auto& extension : extensions )
+		{
+			std::string candidate = normalisedPath + extension;
+			if ( Index.find( candidate ) != Index.end() )
+			{
+				outPath = std::move( candidate );
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	bool ReadFile( const std::string& path, FileData& outFileData )
+	{
+		outFileData = FileData();
+
+		const auto iterator = Index.find( NormalisePath( path ) );
+		if ( iterator == Index.end() )
+		{
+			return false;
+		}
+
+		const IndexEntry& indexEntry = iterator->second;
+
+		// Loose file, map it
+		if ( nullptr == indexEntry.pakEntry )
+		{
+			auto mapping = std::make_shared<MappedFile>();
+			if ( !mapping->Open( indexEntry.diskPath.c_str() ) )
+			{
+				std::cout << "FileSystem::ReadFile: cannot open '" << indexEntry.diskPath << "'" << std::endl;
+				return false;
+			}
+
+			outFileData.data = mapping->GetData();
+			outFileData.size = mapping->GetSize();
+			outFileData.mapping = std::move( mapping );
+
+			// Empty file, still a success
+			static const uint8_t Empty = 0U;
+			if ( nullptr == outFileData.data )
+			{
+				outFileData.data = &Empty;
+			}
+			return true;
+		}
+
+		const PakEntry& pakEntry = *indexEntry.pakEntry;
+		const uint8_t* storedData = PakFile->GetData() + pakEntry.dataOffset;
+
+		// Stored as-is, point straight into the pak
+		if ( !(pakEntry.flags & PakEntry_Lz4) )
+		{
+			outFileData.data = storedData;
+			outFileData.size = pakEntry.storedSize;
+			outFileData.mapping = PakFile;
+			return true;
+		}
+
+		outFileData.storage.resize( pakEntry.originalSize );
+		const int decompressedSize = LZ4_decompress_safe( reinterpret_cast<const char*>( storedData ), reinterpret_cast<char*>( outFileData.storage.data() ),
+			int( pakEntry.storedSize ), int( outFileData.storage.size() ) );
+		if ( decompressedSize < 0 || uint64_t( decompressedSize ) != pakEntry.originalSize )
+		{
+			std::cout << "FileSystem::ReadFile: '" << path << "' is corrupted in the pak" << std::endl;
+			outFileData = FileData();
+			return false;
+		}
+
+		outFileData.data = outFileData.storage.data();
+		outFileData.size = outFileData.storage.size();
+		return true;
+	}
+
+	bool BuildPak( const char* rootDirectory, const char* pakPath, bool compress )
+	{
+		namespace fs = std::filesystem;
+
+		std::vector<std::string> paths;
+		std::error_code error;
+		for ( const auto& directoryEntry : fs::recursive_directory_iterator( rootDirectory, error ) )
+		{
+			if ( directoryEntry.is_regular_file() )
+			{
+				paths.push_back( NormalisePath( directoryEntry.path().generic_string() ) );
+			}
+		}
+
+		if ( error || paths.empty() )
+		{
+			std::cout << "FileSystem::BuildPak: nothing to pack in '" << rootDirectory << "'" << std::endl;
+			return false;
+		}
+
+		// Deterministic output
+		std::sort( paths.begin(), paths.end() );
+
+		std::ofstream pak( pakPath, std::ios::binary );
+		if ( !pak )
+		{
+			std::cout << "FileSystem::BuildPak: cannot write '" << pakPath << "'" << std::endl;
+			return false;
+		}
+
+		PakHeader header{};
+		std::memcpy( header.magic, PakMagic, sizeof( PakMagic ) );
+		header.version = PakVersion;
+		header.numEntries = paths.size();
+		pak.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+
+		std::vector<PakEntry> entries;
+		std::string stringTable;
+		std::vector<uint8_t> compressed;
+		uint64_t offset = sizeof( header );
+		uint64_t totalOriginal = 0U;
+
+		const auto writePadding = [&pak, &offset]()
+		{
+			static const char Zeroes[PakAlignment]{};
+			const uint64_t padding = (PakAlignment - offset % PakAlignment) % PakAlignment;
+			pak.write( Zeroes, padding );
+			offset += padding;
+		};
+
+		for ( const auto& path : paths )
+		{
+			MappedFile file;
+			if ( !file.Open( path.c_str() ) )
+			{
+				std::cout << "FileSystem::BuildPak: cannot read '" << path << "'" << std::endl;
+				return false;
+			}
+
+			writePadding();
+
+			PakEntry entry{};
+			entry.pathOffset = stringTable.size();
+			entry.pathLength = path.size();
+			entry.dataOffset = offset;
+			entry.originalSize = file.GetSize();
+			entry.storedSize = file.GetSize();
+
+			const uint8_t* storedData = file.GetData();
+			// LZ4 blocks are limited to ~2 GiB, anything bigger is stored as-is
+			if ( compress && file.GetSize() > 0U && file.GetSize() <= LZ4_MAX_INPUT_SIZE )
+			{
+				compressed.resize( LZ4_compressBound( int( file.GetSize() ) ) );
+				const int compressedSize = LZ4_compress_default( reinterpret_cast<const char*>( file.GetData() ), reinterpret_cast<char*>( compressed.data() ),
+					int( file.GetSize() ), int( compressed.size() ) );
+				compressed.resize( std::max( compressedSize, 0 ) );
+
+				// PNGs and the like are already compressed, don't bother if it saves less than ~6%
+				if ( compressedSize > 0 && compressed.size() < file.GetSize() - file.GetSize() / 16U )
+				{
+					entry.flags |= PakEntry_Lz4;
+					entry.storedSize = compressed.size();
+					storedData = compressed.data();
+				}
+			}
+
+			pak.write( reinterpret_cast<const char*>( storedData ), entry.storedSize );
+			offset += entry.storedSize;
+			totalOriginal += entry.originalSize;
+
+			stringTable += path;
+			entries.push_back( entry );
+
+			std::cout << "  " << path << ": " << entry.originalSize << " -> " << entry.storedSize << " bytes"
+				<< ((entry.flags & PakEntry_Lz4) ? " (LZ4)" : "") << std::endl;
+		}
+
+		writePadding();
+		header.tocOffset = offset;
+		header.stringTableSize = stringTable.size();
+		pak.write( reinterpret_cast<const char*>( entries.data() ), entries.size() * sizeof( PakEntry ) );
+		pak.write( stringTable.data(), stringTable.size() );
+
+		// Now that we know where the TOC is
+		pak.seekp( 0 );
+		pak.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+
+		std::cout << "FileSystem::BuildPak: packed " << entries.size() << " files, " << totalOriginal << " -> " << offset << " bytes into '" << pakPath << "'" << std::endl;
+		return pak.good();
+	}
+}
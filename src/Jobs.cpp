@@ -0,0 +1,367 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+
+namespace Jobs
+{
+	static std::vector<std::thread> Threads;
+
+	// Submitting is rare compared to how long a job takes, so a plain lock is fine here
+	static std::mutex QueueMutex;
+	static std::condition_variable WorkAvailable;
+	static std::condition_variable Idle;
+	static std::deque<std::function<void()>> Queue;
+	// The first this many jobs in Queue were put ahead of the rest
+	static size_t NumAhead = 0U;
+	static uint32_t NumRunning = 0U;
+	static bool Stop = false;
+	// 0 for every thread that isn't a worker
+	static thread_local uint32_t ThreadIndex = 0U;
+
+	static void WorkerMain( uint32_t index )
+	{
+		ThreadIndex = index + 1U;
+		while ( true )
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock( QueueMutex );
+				WorkAvailable.wait( lock, [] { return Stop || !Queue.empty(); } );
+
+				if ( Queue.empty() )
+				{
+					return;
+				}
+
+				job = std::move( Queue.front() );
+				Queue.pop_front();
+				NumAhead -= NumAhead > 0U ? 1U : 0U;
+				NumRunning++;
+			}
+
+			job();
+
+			{
+				std::lock_guard<std::mutex> lock( QueueMutex );
+				NumRunning--;
+				if ( Queue.empty() && 0U == NumRunning )
+				{
+					Idle.notify_all();
+				}
+			}
+		}
+	}
+
+	void Init()
+	{
+		// Leave a core for the main thread, and don't go overboard, decoding big images takes a lot of memory
+		const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		const uint32_t numThreads = std::clamp( hardwareThreads > 1U ? hardwareThreads - 1U : 1U, 1U, MaxThreads );
+
+		Stop = false;
+		for ( uint32_t i = 0U; i < numThreads; i++ )
+		{
+			Threads.emplace_back( WorkerMain, i );
+		}
+
+		std::cout << "Jobs: " << numThreads << " worker threads" << std::endl;
+	}
+
+	void Shutdown()
+	{
+		{
+			std::lock_guard<std::mutex> lock( QueueMutex );
+			Stop = true;
+		}
+		WorkAvailable.notify_all();
+
+		for ( auto& thread : Threads )
+		{
+			thread.join();
+		}
+
+		Threads.clear();
+	}
+
+	uint32_t GetNumThreads()
+	{
+		return Threads.size();
+	}
+
+	void Submit( std::function<void()> job )
+	{
+		// Without workers, e.g. in tools that never called Init, just do it right here
+		if ( Threads.empty() )
+		{
+			job();
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock( QueueMutex );
+			Queue.push_back( std::move( job ) );
+		}
+		WorkAvailable.notify_one();
+	}
+
+	void SubmitAhead( std::function<void()> job )
+	{
+		if ( Threads.empty() )
+		{
+			job();
+			return;
+		}
+
+		// Behind the other jobs that were put ahead, so they still run in submission order
+		{
+			std::lock_guard<std::mutex> lock( QueueMutex );
+			Queue.insert( Queue.begin() + NumAhead, std::move( job ) );
+			NumAhead++;
+		}
+		WorkAvailable.notify_one();
+	}
+
+	void WaitForIdle()
+	{
+		std::unique_lock<std::mutex> lock( QueueMutex );
+		Idle.wait( lock, [] { return Queue.empty() && 0U == NumRunning; } );
+	}
+
+	// Shared between everyone working on a ParallelFor, workers may only get to it after it's done
+	struct ParallelBatch
+	{
+		const std::function<void( uint32_t )>* function{};
+		uint32_t count{};
+		std::atomic<uint32_t> next{ 0U };
+		std::atomic<uint32_t> numFinished{ 0U };
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+
+	static void RunParallelBatch( ParallelBatch& batch )
+	{
+		for ( uint32_t i = batch.next++; i < batch.count; i = batch.next++ )
+		{
+			(*batch.function)( i );
+
+			if ( ++batch.numFinished == batch.count )
+			{
+				std::lock_guard<std::mutex> lock( batch.mutex );
+				batch.finished.notify_all();
+			}
+		}
+	}
+
+	void ParallelFor( uint32_t count, const std::function<void( uint32_t )>& function )
+	{
+		if ( 0U == count )
+		{
+			return;
+		}
+
+		auto batch = std::make_shared<ParallelBatch>();
+		batch->function = &function;
+		batch->count = count;
+
+		// The calling thread is one of the helpers
+		const uint32_t numHelpers = std::min<uint32_t>( count - 1U, Threads.size() );
+		if ( numHelpers > 0U )
+		{
+			{
+				std::lock_guard<std::mutex> lock( QueueMutex );
+				for ( uint32_t i = 0U; i < numHelpers; i++ )
+				{
+					Queue.push_front( [batch] { RunParallelBatch( *batch ); } );
+					NumAhead++;
+				}
+			}
+			WorkAvailable.notify_all();
+		}
+
+		RunParallelBatch( *batch );
+
+		// Whatever the workers already started
+		std::unique_lock<std::mutex> lock( batch->mutex );
+		batch->finished.wait( lock, [&batch] { return batch->numFinished == batch->count; } );
+	}
+
+	TaskGraph::TaskId TaskGraph::Add( const char* name, std::function<bool()> function, std::initializer_list<TaskId> dependencies, bool onCallingThread )
+	{
+		const TaskId id = tasks.size();
+		tasks.push_back( {} );
+		Task& task = tasks.back();
+		task.name = name;
+		task.function = std::move( function );
+		task.onCallingThread = onCallingThread;
+
+		for ( const TaskId dependency : dependencies )
+		{
+			tasks[dependency].dependents.push_back( id );
+			task.numDependencies++;
+		}
+
+		return id;
+	}
+
+	bool TaskGraph::Run( bool runInParallel )
+	{
+		// Without workers, there'd be nobody to run the tasks that don't want the calling thread
+		parallel = runInParallel && !Threads.empty();
+		timer.Reset();
+
+		std::unique_lock<std::mutex> lock( mutex );
+		callingThreadQueue.clear();
+		nextCallingThreadTask = 0U;
+		numUnfinished = tasks.size();
+		for ( Task& task : tasks )
+		{
+			task.numUnfinishedDependencies = task.numDependencies;
+			task.dependencyFailed = false;
+			task.state = State::Waiting;
+		}
+
+		std::vector<TaskId> roots;
+		for ( TaskId id = 0U; id < tasks.size(); id++ )
+		{
+			if ( 0U == tasks[id].numDependencies )
+			{
+				roots.push_back( id );
+			}
+		}
+
+		// Workers take what's pushed ahead newest first, so going backwards starts the first ones first
+		if ( parallel )
+		{
+			std::reverse( roots.begin(), roots.end() );
+		}
+
+		for ( const TaskId id : roots )
+		{
+			Schedule( id );
+		}
+
+		while ( true )
+		{
+			changed.wait( lock, [this]() { return 0U == numUnfinished || nextCallingThreadTask < callingThreadQueue.size(); } );
+			if ( nextCallingThreadTask == callingThreadQueue.size() )
+			{
+				break;
+			}
+
+			const TaskId id = callingThreadQueue[nextCallingThreadTask++];
+			lock.unlock();
+			Execute( id );
+			lock.lock();
+		}
+
+		milliseconds = timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0;
+		return std::all_of( tasks.begin(), tasks.end(), []( const Task& task ) { return task.state == State::Done; } );
+	}
+
+	void TaskGraph::Execute( TaskId id )
+	{
+		Task& task = tasks[id];
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			task.thread = ThreadIndex;
+			task.startMilliseconds = timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0;
+		}
+
+		const bool succeeded = task.function();
+
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			task.endMilliseconds = timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0;
+			if ( !succeeded )
+			{
+				std::cout << "Jobs::TaskGraph: '" << task.name << "' failed" << std::endl;
+			}
+			Finish( id, succeeded );
+			// Still under the lock, Run may return and the graph be gone as soon as it's released
+			changed.notify_all();
+		}
+	}
+
+	void TaskGraph::Finish( TaskId id, bool succeeded )
+	{
+		Task& task = tasks[id];
+		if ( task.state == State::Waiting )
+		{
+			task.state = succeeded ? State::Done : State::Failed;
+		}
+		numUnfinished--;
+
+		for ( const TaskId dependentId : task.dependents )
+		{
+			Task& dependent = tasks[dependentId];
+			dependent.dependencyFailed |= !succeeded;
+			if ( 0U == --dependent.numUnfinishedDependencies )
+			{
+				Schedule( dependentId );
+			}
+		}
+	}
+
+	void TaskGraph::Schedule( TaskId id )
+	{
+		Task& task = tasks[id];
+		if ( task.dependencyFailed )
+		{
+			task.state = State::Skipped;
+			Finish( id, false );
+		}
+		else if ( !parallel || task.onCallingThread )
+		{
+			callingThreadQueue.push_back( id );
+			changed.notify_all();
+		}
+		else
+		{
+			// Texture decoding may have queued up plenty by now, and pipelines waiting behind it would be a shame
+			SubmitAhead( [this, id]()
+				{
+					Execute( id );
+				} );
+		}
+	}
+
+	void TaskGraph::PrintTimeline() const
+	{
+		constexpr uint32_t BarWidth = 48U;
+
+		std::vector<const Task*> sorted;
+		double busyMilliseconds = 0.0;
+		for ( const Task& task : tasks )
+		{
+			sorted.push_back( &task );
+			busyMilliseconds += task.endMilliseconds - task.startMilliseconds;
+		}
+		std::sort( sorted.begin(), sorted.end(), []( const Task* a, const Task* b ) { return a->startMilliseconds < b->startMilliseconds; } );
+
+		std::cout << "Task graph: " << tasks.size() << " tasks, " << busyMilliseconds << " ms of work in " << milliseconds << " ms"
+			<< (parallel ? "" : ", on one thread") << std::endl;
+
+		const double scale = milliseconds > 0.0 ? BarWidth / milliseconds : 0.0;
+		for ( const Task* task : sorted )
+		{
+			std::cout << "  * " << std::setw( 24 ) << std::left << task->name << std::right;
+			if ( task->state == State::Skipped )
+			{
+				std::cout << " skipped" << std::endl;
+				continue;
+			}
+
+			const uint32_t barStart = std::min( uint32_t( task->startMilliseconds * scale ), BarWidth - 1U );
+			const uint32_t barEnd = std::clamp( uint32_t( task->endMilliseconds * scale ), barStart + 1U, BarWidth );
+			std::cout << " |" << std::string( barStart, ' ' ) << std::string( barEnd - barStart, '#' ) << std::string( BarWidth - barEnd, ' ' ) << "| "
+				<< "thread " << task->thread << ", " << std::fixed << std::setprecision( 2 ) << task->startMilliseconds << " - " << task->endMilliseconds << " ms"
+				<< std::defaultfloat << std::setprecision( 6 ) << (task->state == State::Failed ? ", failed" : "") << std::endl;
+		}
+	}
+}
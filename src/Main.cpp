@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: MIT
 
+#include <numeric>
 #include <thread>
 #include <string_view>
 using namespace std::string_literals;
@@ -18,7 +19,8 @@ namespace Renderer
 	// Fullscreen framebuffer rendering
 	namespace ScreenQuad
 	{
-		// Pipeline state
+		// Pipeline state, the pipeline is picked up from the compiler every frame and null until it's ready
+		PipelineCompiler::Id PipelineId = PipelineCompiler::InvalidId;
 		nvrhi::GraphicsPipelineHandle Pipeline;
 		nvrhi::InputLayoutHandle InputLayout;
 		nvrhi::ShaderHandle VertexShader;
@@ -29,35 +31,61 @@ namespace Renderer
 		nvrhi::BufferHandle IndexBuffer;
 
 		nvrhi::BindingLayoutHandle BindingLayout;
+		// For whichever textures the frame graph gave the scene's targets, the object cache has one per pair
 		nvrhi::BindingSetHandle BindingSet;
 	}
 
 	namespace Scene
 	{
-		// Pipeline state
+		// Pipeline state, the pipelines are picked up from the compiler every frame and null until they're ready
+		PipelineCompiler::Id PipelineId = PipelineCompiler::InvalidId;
 		nvrhi::GraphicsPipelineHandle Pipeline;
 		nvrhi::InputLayoutHandle InputLayout;
 		nvrhi::ShaderHandle VertexShader;
 		nvrhi::ShaderHandle PixelShader;
 
-		// Framebuffers
-		nvrhi::TextureHandle MainFramebufferColourImage;
-		nvrhi::TextureHandle MainFramebufferDepthImage;
-		nvrhi::FramebufferHandle MainFramebuffer;
+		// Same as above, but the vertex shader takes the entity transforms from the Transforms buffer
+		// Null if its shader binary isn't there, and until its pipeline is ready, or with F4, every entity writes its own constant buffer instead
+		PipelineCompiler::Id InstancedPipelineId = PipelineCompiler::InvalidId;
+		nvrhi::GraphicsPipelineHandle InstancedPipeline;
+		nvrhi::ShaderHandle InstancedVertexShader;
+
+		// Same again, but the draws' first instances come from a per-instance vertex stream, so they can be drawn indirectly
+		// Null on a device that can't do multi-draw indirect, and until its pipeline is ready
+		PipelineCompiler::Id IndirectPipelineId = PipelineCompiler::InvalidId;
+		nvrhi::GraphicsPipelineHandle IndirectPipeline;
+		nvrhi::InputLayoutHandle IndirectInputLayout;
+		nvrhi::ShaderHandle IndirectVertexShader;
+
+		// Render targets, the frame graph creates the actual textures
+		nvrhi::TextureDesc ColourDesc;
+		nvrhi::TextureDesc DepthDesc;
 
 		nvrhi::SamplerHandle DiffuseTextureSampler;
 
 		nvrhi::BufferHandle ConstantBufferGlobal;
 		nvrhi::BufferHandle ConstantBufferEntity;
+		// Every write is a new version, which NVRHI only recycles once the GPU is done with it,
+		// so on the per-entity path the buffer grows with the draw list, up to a cap, see EnsureEntityBufferVersions
+		uint32_t EntityBufferVersions = 0U;
 
 		nvrhi::BindingLayoutHandle BindingLayoutGlobal;
 		nvrhi::BindingLayoutHandle BindingLayoutEntity;
 		nvrhi::BindingSetHandle BindingSet;
+
+		// The Transforms buffer, and where each draw's first matrix is pushed as a constant
+		nvrhi::BindingLayoutHandle BindingLayoutInstances;
 	}
 
 	// Render commands
+	// Anything that has to be recorded on the main thread, i.e. uploads and acquiring their results
 	nvrhi::CommandListHandle CommandList;
-	nvrhi::CommandListHandle TransferList;
+	// Scene draws are split into chunks, and each one is recorded into its own list, possibly on a worker thread
+	std::vector<nvrhi::CommandListHandle> SceneCommandLists;
+	nvrhi::CommandListHandle ScreenQuadCommandList;
+
+	// Described again every frame, its textures are pooled across frames
+	RenderGraph::Graph FrameGraph;
 
 	namespace Logic
 	{
@@ -81,6 +109,23 @@ namespace Renderer
 	}
 
 	std::vector<Logic::RenderEntity> RenderEntities;
+	// World-space boxes of RenderEntities, in the same order, and a tree over them for culling and spatial queries
+	// Built once all entities are loaded, MoveEntity keeps both up to date
+	Culling::BoundsArray EntityBounds;
+	Bvh::Tree EntityTree;
+	// Copies of MossPatch.glb scattered around the origin, set with -scatter <count>
+	uint32_t NumScatteredEntities = 0U;
+	// -serialstartup runs Init's tasks one after another on the main thread
+	bool SerialStartup = false;
+	// Starts during static initialisation, so it's as close to process start as we can get without OS calls
+	adm::TimerPreciseDouble StartupTimer;
+	// The first present may only clear, the first scene frame is the one that has the level in it
+	bool FirstPresentReported = false;
+	bool FirstFrameReported = false;
+	// -firstframe quits once the scene is on screen, to time startup over many runs, with and without -serialstartup
+	bool QuitAfterFirstFrame = false;
+
+	void LoadEntities();
 
 	class MessageCallbackImpl final : public nvrhi::IMessageCallback
 	{
@@ -126,6 +171,7 @@ namespace Renderer
 	// i.e. the texture(s), look at Common.hpp::Model::RenderSurface
 
 	constexpr float MaxViewDistance = 100.0f;
+	constexpr float ViewFov = 105.0f;
 	constexpr float deg2rad = (3.14159f) / 180.0f;
 
 	ConstantBufferData TransformData
@@ -134,12 +180,65 @@ namespace Renderer
 		adm::Mat4::Identity,
 		//adm::Mat4::View( adm::Vec3{ 0.0f, 0.0f, 0.0f }, adm::Vec3{ -45.0f, 45.0f, 0.0f } ),
 		// Projection matrix
-		adm::Mat4::Perspective( 105.0f * deg2rad, 16.0f / 9.0f, 0.01f, MaxViewDistance ),
+		adm::Mat4::Perspective( ViewFov * deg2rad, 16.0f / 9.0f, 0.01f, MaxViewDistance ),
 		//adm::Mat4::Orthographic( -10.0f, 10.0f, 10.0f, -10.0f, 0.01f, MaxViewDistance ),
 		// Time
 		0.0f
 	};
 
+	adm::Vec3 ViewPosition{};
+
+	// adm::Mat4, read row by row, transforms column vectors, so the translation is in the 4th column
+	adm::Vec3 TransformPoint( const adm::Mat4& matrix, const adm::Vec3& point )
+	{
+		const float* m = reinterpret_cast<const float*>( &matrix );
+		return
+		{
+			m[0] * point.x + m[1] * point.y + m[2] * point.z + m[3],
+			m[4] * point.x + m[5] * point.y + m[6] * point.z + m[7],
+			m[8] * point.x + m[9] * point.y + m[10] * point.z + m[11]
+		};
+	}
+
+	// Versions a volatile buffer needs if it's written this many times a frame,
+	// as the device manager lets a couple of frames queue up behind the one being recorded
+	static uint32_t GetVolatileVersions( uint32_t writesPerFrame )
+	{
+		return writesPerFrame * (DeviceManager->GetDeviceParams().maxFramesInFlight + 2U);
+	}
+
+	static bool CreateEntityBuffer( uint32_t versions )
+	{
+		if ( nullptr != Scene::ConstantBufferEntity )
+		{
+			Memory::Track( Memory::Category::ConstantBuffers, 0, -int64_t( Memory::EstimateBufferBytes( Scene::ConstantBufferEntity->getDesc() ) ), -1 );
+		}
+
+		const nvrhi::BufferDesc bufferDesc = nvrhi::utils::CreateVolatileConstantBufferDesc( sizeof( ConstantBufferDataEntity ), "Per-entity constant buffer", versions );
+		Scene::ConstantBufferEntity = Device->createBuffer( bufferDesc );
+		Scene::EntityBufferVersions = versions;
+
+		if ( !Check( Scene::ConstantBufferEntity, "Failed to create Scene::ConstantBufferEntity" ) )
+			return false;
+
+		Memory::Track( Memory::Category::ConstantBuffers, 0, Memory::EstimateBufferBytes( bufferDesc ), 1 );
+		return true;
+	}
+
+	// The per-frame binding set, it has to be made again whenever one of its buffers is replaced
+	static void CreateGlobalBindingSet()
+	{
+		nvrhi::BindingSetDesc setDesc;
+		setDesc.bindings =
+		{
+			nvrhi::BindingSetItem::ConstantBuffer( 0, Scene::ConstantBufferGlobal ),
+			nvrhi::BindingSetItem::ConstantBuffer( 1, Renderer::Scene::ConstantBufferEntity ),
+			nvrhi::BindingSetItem::Sampler( 0, Renderer::Scene::DiffuseTextureSampler ),
+			// Diffuse texture will be filled in by render entities
+		};
+		Scene::BindingSet = ObjectCache::GetBindingSet( setDesc, Scene::BindingLayoutGlobal );
+	}
+
 	bool Init( SDL_Window* window, int windowWidth, int windowHeight, nvrhi::GraphicsAPI graphicsApi )
 	{
 		using nvrhi::MessageSeverity;
@@ -170,6 +269,10 @@ namespace Renderer
 		dcp.swapChainSampleCount = 1; // MSAA
 		dcp.swapChainBufferCount = 3; // double buffering or, in this case, triple buffering
 		dcp.refreshRate = 60; // this has no effect since V-sync is off
+		// Only D3D12 uploads go through the copy queue, Vulkan would create a transfer queue nobody uses
+		dcp.enableCopyQueue = graphicsApi == nvrhi::GraphicsAPI::D3D12;
+		// Saves the driver from compiling every pipeline again on the next launch
+		dcp.pipelineCachePath = "pipelines.cache";
 
 		System::GetVulkanExtensionsForSDL( dcp.requiredVulkanInstanceExtensions );
 		System::PopulateWindowData( window, dcp.windowSurfaceData );
@@ -185,169 +288,284 @@ namespace Renderer
 		// Get a device & command list
 		Device = DeviceManager->GetDevice();
 		CommandList = Device->createCommandList();
-		TransferList = Device->createCommandList( /*nvrhi::CommandListParameters().setQueueType(nvrhi::CommandQueue::Copy )*/ );
+		ScreenQuadCommandList = Device->createCommandList();
+
+		// One per thread that can record at the same time, D3D11 only has the immediate context, so there it's just one
+		const bool parallelRecording = graphicsApi != nvrhi::GraphicsAPI::D3D11;
+		const uint32_t numSceneCommandLists = parallelRecording ? Jobs::GetNumThreads() + 1U : 1U;
+		for ( uint32_t i = 0U; i < numSceneCommandLists; i++ )
+		{
+			SceneCommandLists.push_back( Device->createCommandList( nvrhi::CommandListParameters().setEnableImmediateExecution( !parallelRecording ) ) );
+		}
+		if ( !Upload::Init( DeviceManager->GetDeviceParams().enableCopyQueue ) )
+			return false;
+
+		// ==========================================================================================================
+		// STARTUP TASKS
+		// 
+		// Everything below is a task that runs as soon as what it needs exists, on the job threads, so shaders load
+		// while the level does and pipelines start compiling the moment their shaders and layouts are there
+		// Upload only takes requests from this thread, and Transforms maps buffers, which D3D11 does on its immediate context,
+		// so those tasks stay here. -serialstartup runs everything here, one after another, to compare against
+		// ==========================================================================================================
+		Jobs::TaskGraph startup;
+		using TaskId = Jobs::TaskGraph::TaskId;
+		constexpr bool OnThisThread = true;
+
+		// ==========================================================================================================
+		// LAYOUT BINDINGS
+		// 
+		// Layout bindings describe what kinds of parameters are passed to the shader
+		// First, as the level and every pipeline wait on them
+		// ==========================================================================================================
+		const TaskId bindingLayouts = startup.Add( "Binding layouts", []()
+			{
+				nvrhi::BindingLayoutDesc layoutDesc;
+				layoutDesc.registerSpace = 0U;
+				layoutDesc.visibility = nvrhi::ShaderType::Vertex | nvrhi::ShaderType::Pixel;
+				// Per-frame bindings
+				layoutDesc.bindings =
+				{
+					nvrhi::BindingLayoutItem::VolatileConstantBuffer( 0 ),
+					nvrhi::BindingLayoutItem::VolatileConstantBuffer( 1 ),
+					nvrhi::BindingLayoutItem::Sampler( 0 ),
+				};
+				Scene::BindingLayoutGlobal = Device->createBindingLayout( layoutDesc );
+
+				// Per-entity bindings
+				layoutDesc.bindings =
+				{
+					nvrhi::BindingLayoutItem::Texture_SRV( 0 ),
+				};
+				Scene::BindingLayoutEntity = Device->createBindingLayout( layoutDesc );
+
+				// Instanced draws' transforms
+				layoutDesc.visibility = nvrhi::ShaderType::Vertex;
+				layoutDesc.bindings =
+				{
+					nvrhi::BindingLayoutItem::StructuredBuffer_SRV( 1 ),
+					nvrhi::BindingLayoutItem::PushConstants( 2, sizeof( uint32_t ) ),
+				};
+				Scene::BindingLayoutInstances = Device->createBindingLayout( layoutDesc );
+
+				// The screen quad shader samples the scene's colour and depth attachments
+				// Which textures those are is up to the frame graph, so the set is made when rendering
+				layoutDesc.visibility = nvrhi::ShaderType::Vertex | nvrhi::ShaderType::Pixel;
+				layoutDesc.bindings =
+				{
+					nvrhi::BindingLayoutItem::Texture_SRV( 0 ),
+					nvrhi::BindingLayoutItem::Texture_SRV( 1 ),
+					nvrhi::BindingLayoutItem::Sampler( 0 )
+				};
+				ScreenQuad::BindingLayout = Device->createBindingLayout( layoutDesc );
+				return true;
+			} );
 
 		// ==========================================================================================================
 		// SHADER LOADING
 		// ==========================================================================================================
 
+		// shaders.pack has all of them in one mapping, built with -makeshaderpack, otherwise every binary gets mapped on its own
+		Shader::OpenPack();
+
 		// Load the shaders from a SPIR-V/DXIL/DXBC binary that we'll produce with NVRHI-SC
 		// A way that is IMO better would be to modify NVRHI-SC to output .dxil, .dxbc and .spv instead of .bin for everything
 		// I can always for the shader compiler frontend, so yeah, we'll see
-		const auto loadShaders = [&graphicsApi]( const char* vertexBinaryFile, const char* pixelBinaryFile, 
-			nvrhi::ShaderHandle& outVertexShader, nvrhi::ShaderHandle& outPixelShader )
+		const auto loadShader = [graphicsApi]( const char* binaryFile, nvrhi::ShaderType shaderType, const char* entryName, nvrhi::ShaderHandle& outShader )
 		{
-			std::string vertexBinaryPath, pixelBinaryPath;
-			Shader::ShaderBinary vertexBinary, pixelBinary;
-
+			const char* backend = "vk";
 			switch ( graphicsApi )
 			{
-			case nvrhi::GraphicsAPI::D3D11:
-				vertexBinaryPath = "assets/shaders/dx11/"s + vertexBinaryFile;
-				pixelBinaryPath  = "assets/shaders/dx11/"s + pixelBinaryFile;
-				break;
-			case nvrhi::GraphicsAPI::D3D12:
-				vertexBinaryPath = "assets/shaders/dx12/"s + vertexBinaryFile;
-				pixelBinaryPath  = "assets/shaders/dx12/"s + pixelBinaryFile;
-				break;
-			case nvrhi::GraphicsAPI::VULKAN:
-				vertexBinaryPath = "assets/shaders/vk/"s + vertexBinaryFile;
-				pixelBinaryPath  = "assets/shaders/vk/"s + pixelBinaryFile;
-				break;
+			case nvrhi::GraphicsAPI::D3D11: backend = "dx11"; break;
+			case nvrhi::GraphicsAPI::D3D12: backend = "dx12"; break;
+			case nvrhi::GraphicsAPI::VULKAN: backend = "vk"; break;
 			}
 
-			if ( !Shader::LoadShaderBinary( vertexBinaryPath.c_str(), vertexBinary) )
+			FileSystem::FileData bytecode;
+			if ( !Shader::Load( backend, binaryFile, bytecode ) )
 			{
-				std::cout << "Couldn't load shader '" << vertexBinaryFile << "'" << std::endl;
+				std::cout << "Couldn't load shader '" << binaryFile << "'" << std::endl;
 				return false;
 			}
 
-			if ( !Shader::LoadShaderBinary( pixelBinaryPath.c_str(), pixelBinary) )
-			{
-				std::cout << "Couldn't load shader '" << pixelBinaryFile << "'" << std::endl;
-				return false;
-			}
-			
-			std::cout << "Vertex shader size: " << vertexBinary.size() << std::endl
-				<< "Pixel shader size: " << pixelBinary.size() << std::endl;
+			std::cout << "Shader '" << binaryFile << "' size: " << bytecode.size << std::endl;
 
 			nvrhi::ShaderDesc shaderDesc;
-			shaderDesc.shaderType = nvrhi::ShaderType::Vertex;
-			shaderDesc.debugName = vertexBinaryFile;
-			shaderDesc.entryName = "main_vs";
+			shaderDesc.shaderType = shaderType;
+			shaderDesc.debugName = binaryFile;
+			shaderDesc.entryName = entryName;
 
-			outVertexShader = Device->createShader( shaderDesc, vertexBinary.data(), vertexBinary.size() );
-			if ( !Check( outVertexShader, "Failed to create vertex shader" ) )
-			{
-				return false;
-			}
+			// Straight out of the mapping, the device makes its own copy if it needs one
+			outShader = Device->createShader( shaderDesc, bytecode.data, bytecode.size );
+			return Check( outShader, "Failed to create shader" );
+		};
 
-			shaderDesc.shaderType = nvrhi::ShaderType::Pixel;
-			shaderDesc.debugName = pixelBinaryFile;
-			shaderDesc.entryName = "main_ps";
+		const auto loadShaders = [&loadShader]( const char* vertexBinaryFile, const char* pixelBinaryFile,
+			nvrhi::ShaderHandle& outVertexShader, nvrhi::ShaderHandle& outPixelShader )
+		{
+			return loadShader( vertexBinaryFile, nvrhi::ShaderType::Vertex, "main_vs", outVertexShader )
+				&& loadShader( pixelBinaryFile, nvrhi::ShaderType::Pixel, "main_ps", outPixelShader );
+		};
 
-			outPixelShader = Device->createShader( shaderDesc, pixelBinary.data(), pixelBinary.size() );
-			if ( !Check( outPixelShader, "Failed to create pixel shader" ) )
+		const TaskId sceneShaders = startup.Add( "Scene shaders", [&loadShader, &loadShaders]()
 			{
-				return false;
-			}
+				if ( !loadShaders( "default_main_vs.bin", "default_main_ps.bin", Scene::VertexShader, Scene::PixelShader ) )
+				{
+					std::cout << "Failed to load the scene shaders" << std::endl;
+					return false;
+				}
 
-			return true;
-		};
+				// Not fatal, every entity can still write its own constant buffer, but it's listed in shaders.cfg,
+				// so a missing binary means they weren't all compiled, which shouldn't go unnoticed either
+				if ( !loadShader( "default_main_vs_instanced.bin", nvrhi::ShaderType::Vertex, "main_vs_instanced", Scene::InstancedVertexShader ) )
+				{
+					std::cout << "WARNING: instancing and the transform buffer are disabled, run compile_shaders.ps1 to build default_main_vs_instanced.bin" << std::endl;
+					Scene::InstancedVertexShader = nullptr;
+				}
 
-		if ( !loadShaders( "default_main_vs.bin", "default_main_ps.bin", Scene::VertexShader, Scene::PixelShader ) )
-		{
-			std::cout << "Failed to load the scene shaders" << std::endl;
-			return false;
-		}
+				// Indirect draws build on top of the instanced ones
+				if ( nullptr == Scene::InstancedVertexShader )
+				{
+					std::cout << "Indirect draws are disabled, they need instancing" << std::endl;
+				}
+				else if ( !DeviceManager->IsMultiDrawIndirectSupported() )
+				{
+					std::cout << "Indirect draws are disabled, the device doesn't support multi-draw indirect" << std::endl;
+				}
+				// Not fatal either, Render only draws indirectly once the indirect pipeline exists
+				else if ( !loadShader( "default_main_vs_indirect.bin", nvrhi::ShaderType::Vertex, "main_vs_indirect", Scene::IndirectVertexShader ) )
+				{
+					std::cout << "WARNING: indirect draws are disabled, run compile_shaders.ps1 to build default_main_vs_indirect.bin" << std::endl;
+					Scene::IndirectVertexShader = nullptr;
+				}
 
-		if ( !loadShaders( "screen_main_vs.bin", "screen_main_ps.bin", ScreenQuad::VertexShader, ScreenQuad::PixelShader ) )
-		{
-			std::cout << "Failed to load the screen shaders" << std::endl;
-			return false;
-		}
+				return true;
+			} );
+
+		const TaskId screenShaders = startup.Add( "Screen shaders", [&loadShaders]()
+			{
+				if ( !loadShaders( "screen_main_vs.bin", "screen_main_ps.bin", ScreenQuad::VertexShader, ScreenQuad::PixelShader ) )
+				{
+					std::cout << "Failed to load the screen shaders" << std::endl;
+					return false;
+				}
+
+				return true;
+			} );
 
 		// ==========================================================================================================
 		// GEOMETRY LOADING
 		// Set up vertex attributes, i.e. describe how our vertex data will be interpreted
 		// If you're coming from OpenGL, this is similar to glVertexAttribPointer, but way nicer to work with IMO
 		// ==========================================================================================================
-		nvrhi::VertexAttributeDesc screenVertexAttributes[]
-		{
-			nvrhi::VertexAttributeDesc()
-			.setName( "POSITION" )
-			.setFormat( nvrhi::Format::RG32_FLOAT )
-			.setOffset( 0 )
-			.setElementStride( 4 * sizeof( float ) ),
-
-			nvrhi::VertexAttributeDesc()
-			.setName( "TEXCOORD" )
-			.setFormat( nvrhi::Format::RG32_FLOAT )
-			.setOffset( 2 * sizeof( float ) )
-			.setElementStride( 4 * sizeof( float) )
-		};
-		ScreenQuad::InputLayout = Device->createInputLayout( screenVertexAttributes, std::size( screenVertexAttributes ), ScreenQuad::VertexShader );
-
-		nvrhi::VertexAttributeDesc sceneVertexAttributes[]
-		{
-			nvrhi::VertexAttributeDesc()
-			.setName( "POSITION" )
-			.setFormat( nvrhi::Format::RGB32_FLOAT )
-			.setOffset( 0 )
-			.setElementStride( sizeof( Model::DrawVertex ) ),
-
-			nvrhi::VertexAttributeDesc()
-			.setName( "NORMAL" )
-			.setFormat( nvrhi::Format::RGB32_FLOAT )
-			.setOffset( sizeof( adm::Vec3 ) )
-			.setElementStride( sizeof( Model::DrawVertex ) ),
-
-			nvrhi::VertexAttributeDesc()
-			.setName( "TEXCOORD" )
-			.setFormat( nvrhi::Format::RG32_FLOAT )
-			.setOffset( sizeof( adm::Vec3 ) + sizeof( adm::Vec3 ) )
-			.setElementStride( sizeof( Model::DrawVertex ) ),
-
-			nvrhi::VertexAttributeDesc()
-			.setName( "COLOR" )
-			.setFormat( nvrhi::Format::RGBA32_FLOAT )
-			.setOffset( sizeof( adm::Vec3 ) + sizeof( adm::Vec3 ) + sizeof( adm::Vec2 ) )
-			.setElementStride( sizeof( Model::DrawVertex ) ),
-		};
-		Scene::InputLayout = Device->createInputLayout( sceneVertexAttributes, std::size( sceneVertexAttributes ), Scene::VertexShader );
-
-		// Vertex buffer stuff
-		nvrhi::BufferDesc bufferDesc;
-		bufferDesc.byteSize = Model::ScreenQuad::Vertices.size() * sizeof( float );
-		bufferDesc.initialState = nvrhi::ResourceStates::CopyDest;
-		bufferDesc.debugName = "Screenquad vertex buffer";
-		bufferDesc.isVertexBuffer = true;
-		ScreenQuad::VertexBuffer = Device->createBuffer( bufferDesc );
-
-		if ( !Check( ScreenQuad::VertexBuffer, "Failed to create ScreenQuad::VertexBuffer" ) )
-			return false;
-
-		// Index buffer stuff
-		bufferDesc.byteSize = Model::ScreenQuad::Indices.size() * sizeof( uint32_t );
-		bufferDesc.debugName = "Screenquad index buffer";
-		bufferDesc.isVertexBuffer = false;
-		bufferDesc.isIndexBuffer = true;
-		ScreenQuad::IndexBuffer = Device->createBuffer( bufferDesc );
+		const TaskId screenInputLayout = startup.Add( "Screen input layout", []()
+			{
+				nvrhi::VertexAttributeDesc screenVertexAttributes[]
+				{
+					nvrhi::VertexAttributeDesc()
+					.setName( "POSITION" )
+					.setFormat( nvrhi::Format::RG32_FLOAT )
+					.setOffset( 0 )
+					.setElementStride( 4 * sizeof( float ) ),
+
+					nvrhi::VertexAttributeDesc()
+					.setName( "TEXCOORD" )
+					.setFormat( nvrhi::Format::RG32_FLOAT )
+					.setOffset( 2 * sizeof( float ) )
+					.setElementStride( 4 * sizeof( float) )
+				};
+				ScreenQuad::InputLayout = Device->createInputLayout( screenVertexAttributes, std::size( screenVertexAttributes ), ScreenQuad::VertexShader );
+				return true;
+			}, { screenShaders } );
 
-		if ( !Check( ScreenQuad::IndexBuffer, "Failed to create ScreenQuad::IndexBuffer" ) )
-			return false;
+		const TaskId sceneInputLayouts = startup.Add( "Scene input layouts", []()
+			{
+				nvrhi::VertexAttributeDesc sceneVertexAttributes[]
+				{
+					nvrhi::VertexAttributeDesc()
+					.setName( "POSITION" )
+					.setFormat( nvrhi::Format::RGB32_FLOAT )
+					.setOffset( 0 )
+					.setElementStride( sizeof( Model::DrawVertex ) ),
+
+					nvrhi::VertexAttributeDesc()
+					.setName( "NORMAL" )
+					.setFormat( nvrhi::Format::RGB32_FLOAT )
+					.setOffset( sizeof( adm::Vec3 ) )
+					.setElementStride( sizeof( Model::DrawVertex ) ),
+
+					nvrhi::VertexAttributeDesc()
+					.setName( "TEXCOORD" )
+					.setFormat( nvrhi::Format::RG32_FLOAT )
+					.setOffset( sizeof( adm::Vec3 ) + sizeof( adm::Vec3 ) )
+					.setElementStride( sizeof( Model::DrawVertex ) ),
+
+					nvrhi::VertexAttributeDesc()
+					.setName( "COLOR" )
+					.setFormat( nvrhi::Format::RGBA32_FLOAT )
+					.setOffset( sizeof( adm::Vec3 ) + sizeof( adm::Vec3 ) + sizeof( adm::Vec2 ) )
+					.setElementStride( sizeof( Model::DrawVertex ) ),
+				};
+				Scene::InputLayout = Device->createInputLayout( sceneVertexAttributes, std::size( sceneVertexAttributes ), Scene::VertexShader );
 
-		// ==========================================================================================================
-		// CONSTANT BUFFER CREATION
-		// ==========================================================================================================
-		bufferDesc = nvrhi::utils::CreateVolatileConstantBufferDesc( sizeof( ConstantBufferData ), "Global constant buffer", 16U );
-		Scene::ConstantBufferGlobal = Device->createBuffer( bufferDesc );
+				// The same, plus the draw instance stream in the 2nd vertex buffer, which steps once per instance
+				if ( nullptr != Scene::IndirectVertexShader )
+				{
+					std::vector<nvrhi::VertexAttributeDesc> indirectVertexAttributes( std::begin( sceneVertexAttributes ), std::end( sceneVertexAttributes ) );
+					indirectVertexAttributes.push_back( nvrhi::VertexAttributeDesc()
+						.setName( "DRAWINSTANCE" )
+						.setFormat( nvrhi::Format::R32_UINT )
+						.setBufferIndex( 1 )
+						.setOffset( 0 )
+						.setElementStride( sizeof( uint32_t ) )
+						.setIsInstanced( true ) );
+					Scene::IndirectInputLayout = Device->createInputLayout( indirectVertexAttributes.data(), indirectVertexAttributes.size(), Scene::IndirectVertexShader );
+				}
 
-		if ( !Check( Scene::ConstantBufferGlobal, "Failed to create Scene::ConstantBufferGlobal" ) )
-			return false;
+				return true;
+			}, { sceneShaders } );
 
-		bufferDesc = nvrhi::utils::CreateVolatileConstantBufferDesc( sizeof( ConstantBufferDataEntity ), "Per-entity constant buffer", 16U );
-		Scene::ConstantBufferEntity = Device->createBuffer( bufferDesc );
+		const TaskId buffers = startup.Add( "Buffers", []()
+			{
+				// Vertex buffer stuff
+				nvrhi::BufferDesc bufferDesc;
+				bufferDesc.byteSize = Model::ScreenQuad::Vertices.size() * sizeof( float );
+				bufferDesc.initialState = nvrhi::ResourceStates::CopyDest;
+				bufferDesc.debugName = "Screenquad vertex buffer";
+				bufferDesc.isVertexBuffer = true;
+				ScreenQuad::VertexBuffer = Device->createBuffer( bufferDesc );
+
+				if ( !Check( ScreenQuad::VertexBuffer, "Failed to create ScreenQuad::VertexBuffer" ) )
+					return false;
+
+				// Index buffer stuff
+				bufferDesc.byteSize = Model::ScreenQuad::Indices.size() * sizeof( uint32_t );
+				bufferDesc.debugName = "Screenquad index buffer";
+				bufferDesc.isVertexBuffer = false;
+				bufferDesc.isIndexBuffer = true;
+				ScreenQuad::IndexBuffer = Device->createBuffer( bufferDesc );
+
+				if ( !Check( ScreenQuad::IndexBuffer, "Failed to create ScreenQuad::IndexBuffer" ) )
+					return false;
+
+				Memory::Track( Memory::Category::VertexBuffers, 0, Model::ScreenQuad::Vertices.size() * sizeof( float ), 1 );
+				Memory::Track( Memory::Category::IndexBuffers, 0, bufferDesc.byteSize, 1 );
+
+				// ==================================================================================================
+				// CONSTANT BUFFER CREATION
+				// ==================================================================================================
+				// Every scene command list writes the global one once a frame
+				bufferDesc = nvrhi::utils::CreateVolatileConstantBufferDesc( sizeof( ConstantBufferData ), "Global constant buffer", GetVolatileVersions( SceneCommandLists.size() ) );
+				Scene::ConstantBufferGlobal = Device->createBuffer( bufferDesc );
+
+				if ( !Check( Scene::ConstantBufferGlobal, "Failed to create Scene::ConstantBufferGlobal" ) )
+					return false;
+
+				Memory::Track( Memory::Category::ConstantBuffers, sizeof( ConstantBufferData ), Memory::EstimateBufferBytes( bufferDesc ), 1 );
+
+				// Enough for the instanced paths, which write it once per list, PrepareScene grows it for the per-entity path
+				return CreateEntityBuffer( GetVolatileVersions( SceneCommandLists.size() ) );
+			} );
 
 		// ==========================================================================================================
 		// TEXTURE CREATION
@@ -358,133 +576,88 @@ namespace Renderer
 		// 3) create the framebuffers
 		// ==========================================================================================================
 
-		// Sampler
-		auto& textureSampler = nvrhi::SamplerDesc()
-			.setAllFilters( true )
-			.setMaxAnisotropy( 16.0f )
-			.setAllAddressModes( nvrhi::SamplerAddressMode::Wrap );
-		
-		Scene::DiffuseTextureSampler = Device->createSampler( textureSampler );
-		if ( !Check( Scene::DiffuseTextureSampler, "Failed to create Scene::DiffuseTextureSampler" ) )
-			return false;
-
-		using RStates = nvrhi::ResourceStates;
-		const RStates ColourBufferStates = RStates::RenderTarget;
-		const RStates DepthBufferStates = RStates::DepthWrite;
-
-		// Colour and depth attachment for the framebuffer
-		auto colourAttachmentDesc = nvrhi::TextureDesc()
-			.setWidth( dcp.backBufferWidth )
-			.setHeight( dcp.backBufferHeight )
-			.setFormat( dcp.swapChainFormat )
-			.setDimension( nvrhi::TextureDimension::Texture2D )
-			.setKeepInitialState( true )
-			.setInitialState( ColourBufferStates )
-			.setIsRenderTarget( true )
-			.setDebugName( "Colour attachment image" );
-
-		Scene::MainFramebufferColourImage = Device->createTexture( colourAttachmentDesc );
-		if ( !Check( Scene::MainFramebufferColourImage, "Failed to create Scene::MainFramebufferColourImage" ) )
-			return false;
-
-		auto depthAttachmentDesc = colourAttachmentDesc
-			.setFormat( (graphicsApi == nvrhi::GraphicsAPI::D3D11) ? nvrhi::Format::D24S8 : nvrhi::Format::D32 )
-			.setDimension( nvrhi::TextureDimension::Texture2D )
-			.setInitialState( DepthBufferStates )
-			.setDebugName( "Depth attachment image" );
-
-		Scene::MainFramebufferDepthImage = Device->createTexture( depthAttachmentDesc );
-		if ( !Check( Scene::MainFramebufferDepthImage, "Failed to create Scene::MainFramebufferDepthImage" ) )
-			return false;
-
-		// ==========================================================================================================
-		// FRAMEBUFFER CREATION
-		// ==========================================================================================================
-		auto mainFramebufferDesc = nvrhi::FramebufferDesc()
-			.addColorAttachment( Scene::MainFramebufferColourImage )
-			.setDepthAttachment( Scene::MainFramebufferDepthImage );
-
-		Scene::MainFramebuffer = Device->createFramebuffer( mainFramebufferDesc );
-		if ( !Check( Scene::MainFramebuffer, "Failed to create Scene::MainFramebuffer" ) )
-			return false;
-
-		const auto printFramebufferInfo = []( const nvrhi::FramebufferInfo& fbInfo, const char* name )
-		{
-			std::cout << "Framebuffer: " << name << std::endl
-				<< "  * Size:           " << fbInfo.width << "x" << fbInfo.height << std::endl
-				<< "  * Sample count:   " << fbInfo.sampleCount << std::endl
-				<< "  * Sample quality: " << fbInfo.sampleQuality << std::endl
-				<< "  * Colour format:  " << nvrhi::utils::FormatToString( fbInfo.colorFormats[0] ) << std::endl
-				<< "  * Depth format:   " << nvrhi::utils::FormatToString( fbInfo.depthFormat ) << std::endl;
-		};
+		const TaskId sampler = startup.Add( "Sampler", []()
+			{
+				auto& textureSampler = nvrhi::SamplerDesc()
+					.setAllFilters( true )
+					.setMaxAnisotropy( 16.0f )
+					.setAllAddressModes( nvrhi::SamplerAddressMode::Wrap );
+
+				Scene::DiffuseTextureSampler = Device->createSampler( textureSampler );
+				return Check( Scene::DiffuseTextureSampler, "Failed to create Scene::DiffuseTextureSampler" );
+			} );
+
+		// Pipelines need a framebuffer to know what they draw into, so the first frame's targets are made up front
+		nvrhi::IFramebuffer* sceneFramebuffer = nullptr;
+		const TaskId renderTargets = startup.Add( "Render targets", [&dcp, &sceneFramebuffer, graphicsApi]()
+			{
+				// Colour and depth attachment for the scene
+				// The frame graph owns the textures and their states, so they only need describing here
+				Scene::ColourDesc = nvrhi::TextureDesc()
+					.setWidth( dcp.backBufferWidth )
+					.setHeight( dcp.backBufferHeight )
+					.setFormat( dcp.swapChainFormat )
+					.setDimension( nvrhi::TextureDimension::Texture2D )
+					.setIsRenderTarget( true )
+					.setDebugName( "Colour attachment image" );
+
+				Scene::DepthDesc = nvrhi::TextureDesc( Scene::ColourDesc )
+					.setFormat( (graphicsApi == nvrhi::GraphicsAPI::D3D11) ? nvrhi::Format::D24S8 : nvrhi::Format::D32 )
+					.setDebugName( "Depth attachment image" );
+
+				// ==================================================================================================
+				// FRAMEBUFFER CREATION
+				// ==================================================================================================
+				nvrhi::ITexture* colourImage = FrameGraph.Reserve( Device, Scene::ColourDesc );
+				nvrhi::ITexture* depthImage = FrameGraph.Reserve( Device, Scene::DepthDesc );
+				if ( !Check( colourImage, "Failed to create the scene's colour image" ) || !Check( depthImage, "Failed to create the scene's depth image" ) )
+					return false;
+
+				sceneFramebuffer = FrameGraph.GetFramebuffer( Device, { colourImage }, depthImage );
+				if ( !Check( sceneFramebuffer, "Failed to create the scene's framebuffer" ) )
+					return false;
+
+				const auto printFramebufferInfo = []( const nvrhi::FramebufferInfo& fbInfo, const char* name )
+				{
+					std::cout << "Framebuffer: " << name << std::endl
+						<< "  * Size:           " << fbInfo.width << "x" << fbInfo.height << std::endl
+						<< "  * Sample count:   " << fbInfo.sampleCount << std::endl
+						<< "  * Sample quality: " << fbInfo.sampleQuality << std::endl
+						<< "  * Colour format:  " << nvrhi::utils::FormatToString( fbInfo.colorFormats[0] ) << std::endl
+						<< "  * Depth format:   " << nvrhi::utils::FormatToString( fbInfo.depthFormat ) << std::endl;
+				};
 
-		printFramebufferInfo( Scene::MainFramebuffer->getFramebufferInfo(), "Main framebuffer" );
-		printFramebufferInfo( DeviceManager->GetCurrentFramebuffer()->getFramebufferInfo(), "Backbuffer" );
+				printFramebufferInfo( sceneFramebuffer->getFramebufferInfo(), "Scene framebuffer" );
+				printFramebufferInfo( DeviceManager->GetCurrentFramebuffer()->getFramebufferInfo(), "Backbuffer" );
+				return true;
+			} );
 
 		// ==========================================================================================================
 		// DATA TRANSFER
 		// ==========================================================================================================
-		// Commands to copy this stuff to the GPU
-		TransferList->open();
-
-		// Screenquad resources
-		TransferList->beginTrackingBufferState( ScreenQuad::VertexBuffer, RStates::CopyDest );
-		TransferList->writeBuffer( ScreenQuad::VertexBuffer, Model::ScreenQuad::Vertices.data(), Model::ScreenQuad::Vertices.size() * sizeof( float ) );
-		TransferList->setPermanentBufferState( ScreenQuad::VertexBuffer, RStates::VertexBuffer );
-
-		TransferList->beginTrackingBufferState( ScreenQuad::IndexBuffer, RStates::CopyDest );
-		TransferList->writeBuffer( ScreenQuad::IndexBuffer, Model::ScreenQuad::Indices.data(), Model::ScreenQuad::Indices.size() * sizeof( uint32_t ) );
-		TransferList->setPermanentBufferState( ScreenQuad::IndexBuffer, RStates::IndexBuffer );
+		startup.Add( "Screen quad upload", []()
+			{
+				using RStates = nvrhi::ResourceStates;
 
-		// Constant buffers are written to at runtime
+				// Screenquad resources
+				Upload::WriteBuffer( ScreenQuad::VertexBuffer, Model::ScreenQuad::Vertices.data(), Model::ScreenQuad::Vertices.size() * sizeof( float ), RStates::VertexBuffer );
+				Upload::WriteBuffer( ScreenQuad::IndexBuffer, Model::ScreenQuad::Indices.data(), Model::ScreenQuad::Indices.size() * sizeof( uint32_t ), RStates::IndexBuffer );
 
-		TransferList->close();
+				// Constant buffers are written to at runtime
 
-		// YEE HAW
-		Device->executeCommandList( TransferList );
+				// YEE HAW
+				Upload::Flush();
+				return true;
+			}, { buffers }, OnThisThread );
 
-		// ==========================================================================================================
-		// LAYOUT BINDINGS
-		// 
-		// Layout bindings describe what kinds of parameters are passed to the shader
-		// ==========================================================================================================
-		nvrhi::BindingLayoutDesc layoutDesc;
-		layoutDesc.registerSpace = 0U;
-		layoutDesc.visibility = nvrhi::ShaderType::Vertex | nvrhi::ShaderType::Pixel;
-		// Per-frame bindings
-		layoutDesc.bindings =
-		{
-			nvrhi::BindingLayoutItem::VolatileConstantBuffer( 0 ),
-			nvrhi::BindingLayoutItem::VolatileConstantBuffer( 1 ),
-			nvrhi::BindingLayoutItem::Sampler( 0 ),
-		};
-		Scene::BindingLayoutGlobal = Device->createBindingLayout( layoutDesc );
-
-		// Per-entity bindings
-		layoutDesc.bindings =
-		{
-			nvrhi::BindingLayoutItem::Texture_SRV( 0 ),
-		};
-		Scene::BindingLayoutEntity = Device->createBindingLayout( layoutDesc );
-
-		nvrhi::BindingSetDesc setDesc;
-		setDesc.bindings =
-		{
-			nvrhi::BindingSetItem::ConstantBuffer( 0, Scene::ConstantBufferGlobal ),
-			nvrhi::BindingSetItem::ConstantBuffer( 1, Renderer::Scene::ConstantBufferEntity ),
-			nvrhi::BindingSetItem::Sampler( 0, Renderer::Scene::DiffuseTextureSampler ),
-			// Diffuse texture will be filled in by render entities
-		};
-		Scene::BindingSet = Device->createBindingSet( setDesc, Scene::BindingLayoutGlobal );
+		// The per-frame binding set, and the transform buffers instanced draws read from
+		startup.Add( "Global bindings", [&dcp, graphicsApi]()
+			{
+				CreateGlobalBindingSet();
 
-		// For the screen quad shader, we only need to bind the framebuffer's colour attachment
-		setDesc.bindings =
-		{
-			nvrhi::BindingSetItem::Texture_SRV( 0, Scene::MainFramebufferColourImage ),
-			nvrhi::BindingSetItem::Texture_SRV( 1, Scene::MainFramebufferDepthImage ),
-			nvrhi::BindingSetItem::Sampler( 0, Scene::DiffuseTextureSampler )
-		}; // We can use CreateBindingSetAndLayout because we know the set in advance here
-		nvrhi::utils::CreateBindingSetAndLayout( Device, nvrhi::ShaderType::Vertex | nvrhi::ShaderType::Pixel, 0, setDesc, ScreenQuad::BindingLayout, ScreenQuad::BindingSet );
+				// The device manager lets a couple of frames queue up behind the one being recorded
+				return Transforms::Init( Scene::BindingLayoutInstances, dcp.maxFramesInFlight + 2U, graphicsApi != nvrhi::GraphicsAPI::D3D11 );
+			}, { buffers, sampler, bindingLayouts }, OnThisThread );
 
 		// ==========================================================================================================
 		// PIPELINE CREATION
@@ -497,69 +670,234 @@ namespace Renderer
 		// own framebuffer which has depth testing and all. This setup allows for easy post-processing
 		// ==========================================================================================================
 
-		// Screen pipeline
-		nvrhi::GraphicsPipelineDesc pipelineDesc;
-		pipelineDesc.VS = ScreenQuad::VertexShader;
-		pipelineDesc.PS = ScreenQuad::PixelShader;
-		pipelineDesc.inputLayout = ScreenQuad::InputLayout;
-		pipelineDesc.primType = nvrhi::PrimitiveType::TriangleList;
-		pipelineDesc.renderState.depthStencilState.depthTestEnable = false;
-		pipelineDesc.renderState.depthStencilState.depthWriteEnable = false;
-		pipelineDesc.renderState.depthStencilState.stencilEnable = false;
-		pipelineDesc.renderState.rasterState.cullMode = nvrhi::RasterCullMode::None;
-		pipelineDesc.bindingLayouts = { ScreenQuad::BindingLayout };
-
-		// If you get errors in DX12 here, you are likely missing dxil.dll. You should have dxc.exe, dxcompiler.dll AND dxil.dll,
-		// as the 3rd one will perform shader validation/signature, and DX12 doesn't like unsigned shaders by default (you'd need to modify NVRHI to allow that)
-		ScreenQuad::Pipeline = Device->createGraphicsPipeline( pipelineDesc, DeviceManager->GetCurrentFramebuffer() );
-		if ( !Check( ScreenQuad::Pipeline, "Could not create ScreenQuad::Pipeline" ) )
-			return false;
+		// Most of the startup cost of pipelines is the driver compiling shaders, which the pipeline cache skips
+		// Whatever's left happens on the job threads, while the first frames skip what isn't ready yet
+		std::atomic<uint32_t> numPipelines = 0U;
 
-		// Scene pipeline
-		pipelineDesc.VS = Scene::VertexShader;
-		pipelineDesc.PS = Scene::PixelShader;
-		pipelineDesc.inputLayout = Scene::InputLayout;
-		pipelineDesc.renderState.depthStencilState.depthTestEnable = true;
-		pipelineDesc.renderState.depthStencilState.depthWriteEnable = true;
-		pipelineDesc.renderState.depthStencilState.depthFunc = nvrhi::ComparisonFunc::Less;
-		pipelineDesc.renderState.rasterState.cullMode = nvrhi::RasterCullMode::Front;
-		pipelineDesc.bindingLayouts = 
-		{
-			Scene::BindingLayoutGlobal,
-			Scene::BindingLayoutEntity
-		};
+		startup.Add( "Screen pipeline", [&numPipelines]()
+			{
+				nvrhi::GraphicsPipelineDesc pipelineDesc;
+				pipelineDesc.VS = ScreenQuad::VertexShader;
+				pipelineDesc.PS = ScreenQuad::PixelShader;
+				pipelineDesc.inputLayout = ScreenQuad::InputLayout;
+				pipelineDesc.primType = nvrhi::PrimitiveType::TriangleList;
+				pipelineDesc.renderState.depthStencilState.depthTestEnable = false;
+				pipelineDesc.renderState.depthStencilState.depthWriteEnable = false;
+				pipelineDesc.renderState.depthStencilState.stencilEnable = false;
+				pipelineDesc.renderState.rasterState.cullMode = nvrhi::RasterCullMode::None;
+				pipelineDesc.bindingLayouts = { ScreenQuad::BindingLayout };
+
+				// If you get errors in DX12 here, you are likely missing dxil.dll. You should have dxc.exe, dxcompiler.dll AND dxil.dll,
+				// as the 3rd one will perform shader validation/signature, and DX12 doesn't like unsigned shaders by default (you'd need to modify NVRHI to allow that)
+				ScreenQuad::PipelineId = PipelineCompiler::Declare( "ScreenQuad::Pipeline", pipelineDesc, DeviceManager->GetCurrentFramebuffer() );
+				numPipelines++;
+				return true;
+			}, { screenInputLayout, bindingLayouts } );
+
+		startup.Add( "Scene pipelines", [&numPipelines, &sceneFramebuffer]()
+			{
+				nvrhi::GraphicsPipelineDesc pipelineDesc;
+				pipelineDesc.VS = Scene::VertexShader;
+				pipelineDesc.PS = Scene::PixelShader;
+				pipelineDesc.inputLayout = Scene::InputLayout;
+				pipelineDesc.primType = nvrhi::PrimitiveType::TriangleList;
+				pipelineDesc.renderState.depthStencilState.depthTestEnable = true;
+				pipelineDesc.renderState.depthStencilState.depthWriteEnable = true;
+				pipelineDesc.renderState.depthStencilState.depthFunc = nvrhi::ComparisonFunc::Less;
+				pipelineDesc.renderState.depthStencilState.stencilEnable = false;
+				pipelineDesc.renderState.rasterState.cullMode = nvrhi::RasterCullMode::Front;
+				pipelineDesc.bindingLayouts = 
+				{
+					Scene::BindingLayoutGlobal,
+					Scene::BindingLayoutEntity
+				};
+
+				Scene::PipelineId = PipelineCompiler::Declare( "Scene::Pipeline", pipelineDesc, sceneFramebuffer );
+				numPipelines++;
+
+				// Instanced scene pipeline, the instance transforms go after the surface's texture
+				if ( nullptr != Scene::InstancedVertexShader )
+				{
+					pipelineDesc.VS = Scene::InstancedVertexShader;
+					pipelineDesc.bindingLayouts =
+					{
+						Scene::BindingLayoutGlobal,
+						Scene::BindingLayoutEntity,
+						Scene::BindingLayoutInstances
+					};
+
+					Scene::InstancedPipelineId = PipelineCompiler::Declare( "Scene::InstancedPipeline", pipelineDesc, sceneFramebuffer );
+					numPipelines++;
+				}
+
+				// Indirect scene pipeline, same bindings as the instanced one, the push constant is just never set
+				if ( nullptr != Scene::IndirectVertexShader )
+				{
+					pipelineDesc.VS = Scene::IndirectVertexShader;
+					pipelineDesc.inputLayout = Scene::IndirectInputLayout;
+
+					Scene::IndirectPipelineId = PipelineCompiler::Declare( "Scene::IndirectPipeline", pipelineDesc, sceneFramebuffer );
+					numPipelines++;
+				}
+
+				return true;
+			}, { sceneInputLayouts, bindingLayouts, renderTargets } );
+
+		// ==========================================================================================================
+		// ENTITY LOADING
+		// 
+		// Models and their textures only need the per-entity binding layout, so the level loads next to all of the above
+		// ==========================================================================================================
+		startup.Add( "Entities", []()
+			{
+				LoadEntities();
+				return true;
+			}, { bindingLayouts }, OnThisThread );
 
-		Scene::Pipeline = Device->createGraphicsPipeline( pipelineDesc, Scene::MainFramebuffer );
-		if ( !Check( Scene::Pipeline, "Could not create Scene::Pipeline" ) )
+		const bool succeeded = startup.Run( !SerialStartup );
+		startup.PrintTimeline();
+		if ( !succeeded )
+		{
 			return false;
+		}
+
+		const size_t pipelineCacheBytes = DeviceManager->GetLoadedPipelineCacheBytes();
+		std::cout << "Queued " << numPipelines << " pipelines, ";
+		if ( pipelineCacheBytes > 0U )
+		{
+			std::cout << "warm pipeline cache (" << pipelineCacheBytes / 1024U << " kB)" << std::endl;
+		}
+		else
+		{
+			std::cout << "cold pipeline cache" << std::endl;
+		}
 
 		return true;
 	}
 
 	void LoadEntities()
 	{
-		const auto createEntity = []( const char* modelPath, adm::Vec3 position, adm::Mat4 orientation )
+		const auto createEntity = []( const char* modelPath, adm::Vec3 position, adm::Mat4 orientation, bool isOccluder = false )
 		{
 			RenderEntities.push_back( {} );
 			auto& re = RenderEntities.back();
 
-			re.renderModelIndex = Model::LoadRenderModelFromGltf( modelPath );
+			re.renderModelIndex = Model::FindOrLoadRenderModel( modelPath, isOccluder );
 			//re.transform = glm::translate( glm::identity<adm::Mat4>(), position ) * orientation;
-			// We'll need a Mat4::Translation one day
+			// We'll need a Mat4::Translation one day, until then it goes straight into the 4th column
 			re.transform = orientation;
+			float* m = reinterpret_cast<float*>( &re.transform );
+			m[3] += position.x;
+			m[7] += position.y;
+			m[11] += position.z;
 		};
 
+		adm::TimerPreciseDouble timer;
+		const Upload::Stats uploadsBefore = Upload::GetStats();
+
 		// Create default texture
 		Texture::FindOrCreateMaterial( nullptr );
 
-		createEntity( "assets/TestEnvironment.glb", { 0.0f, 0.0f, 0.0f }, adm::Mat4::Identity );
+		// The level's walls hide most of the scattered patches, so it's rasterised for occlusion culling
+		createEntity( "assets/TestEnvironment.glb", { 0.0f, 0.0f, 0.0f }, adm::Mat4::Identity, true );
 		createEntity( "assets/MossPatch.glb", { 0.0f, 0.0f, 0.0f }, adm::Mat4::Identity );
+
+		// A grid of moss patches, each turned a bit differently, they all share one model so they get instanced
+		constexpr float ScatterSpacing = 1.5f;
+		const uint32_t scatterSide = uint32_t( std::ceil( std::sqrt( float( NumScatteredEntities ) ) ) );
+		for ( uint32_t i = 0U; i < NumScatteredEntities; i++ )
+		{
+			const float x = (float( i % scatterSide ) - scatterSide * 0.5f) * ScatterSpacing;
+			const float y = (float( i / scatterSide ) - scatterSide * 0.5f) * ScatterSpacing;
+			// The golden angle, so neighbours never line up
+			const float yaw = i * 2.39996f;
+
+			adm::Mat4 orientation = adm::Mat4::Identity;
+			float* m = reinterpret_cast<float*>( &orientation );
+			m[0] = std::cos( yaw );
+			m[1] = -std::sin( yaw );
+			m[4] = std::sin( yaw );
+			m[5] = std::cos( yaw );
+
+			createEntity( "assets/MossPatch.glb", { x, y, 0.0f }, orientation );
+		}
+
+		for ( const auto& renderEntity : RenderEntities )
+		{
+			const Model::RenderModel& renderModel = renderEntity.GetRenderModel();
+			EntityBounds.Add( renderEntity.transform, renderModel.boundsMin, renderModel.boundsMax );
+		}
+		EntityTree.Build( EntityBounds );
+
+		// Everything so far is static, so it goes into one pair of vertex and index buffers
+		Model::CreateSharedGeometry();
+
+		// Everything that was loaded goes to the GPU in as few submissions as possible
+		// This doesn't wait for it, surfaces show up as soon as their uploads are done
+		// Textures are still decoding, they come in over the next frames
+		Upload::Flush();
+
+		const Upload::Stats uploads = Upload::GetStats();
+		std::cout << "Loaded entities in " << timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0 << " ms, "
+			<< uploads.numRequests - uploadsBefore.numRequests << " uploads queued, "
+			<< Texture::Loader::GetStats().numRequests << " textures decoding" << std::endl;
+	}
+
+	// Anything that moves an entity after loading goes through here, so its box and the tree stay in step
+	void MoveEntity( size_t index, const adm::Mat4& transform )
+	{
+		Logic::RenderEntity& renderEntity = RenderEntities[index];
+		const Model::RenderModel& renderModel = renderEntity.GetRenderModel();
+		renderEntity.transform = transform;
+
+		EntityBounds.Set( index, transform, renderModel.boundsMin, renderModel.boundsMax );
+		const adm::Vec3 centre = { EntityBounds.centreX[index], EntityBounds.centreY[index], EntityBounds.centreZ[index] };
+		const adm::Vec3 extent = { EntityBounds.extentX[index], EntityBounds.extentY[index], EntityBounds.extentZ[index] };
+		EntityTree.Update( index, centre - extent, centre + extent );
 	}
 
-	void RenderScreenQuad()
+	// Closest triangle of any entity along the ray, outHit.entity says whose
+	// The entity tree narrows it down to the entities whose boxes the ray passes through
+	bool CastRay( const adm::Vec3& origin, const adm::Vec3& direction, float maxDistance, Bvh::RayHit& outHit )
+	{
+		static std::vector<uint32_t> candidates;
+		EntityTree.QueryRay( origin, direction, maxDistance, candidates );
+
+		outHit = {};
+		outHit.distance = maxDistance;
+		for ( const uint32_t entity : candidates )
+		{
+			const Logic::RenderEntity& renderEntity = RenderEntities[entity];
+			if ( renderEntity.GetRenderModel().triangles.CastRay( renderEntity.transform, origin, direction, outHit ) )
+			{
+				outHit.entity = entity;
+			}
+		}
+
+		return outHit.entity != Bvh::InvalidIndex;
+	}
+
+	// Acquired on the main command list, which is submitted before the screen quad's
+	bool ScreenQuadReady = false;
+
+	void RenderScreenQuad( nvrhi::ICommandList* commandList, nvrhi::ITexture* colourImage, nvrhi::ITexture* depthImage )
 	{
+		if ( !ScreenQuadReady )
+		{
+			return;
+		}
+
+		nvrhi::BindingSetDesc setDesc;
+		setDesc.bindings =
+		{
+			nvrhi::BindingSetItem::Texture_SRV( 0, colourImage ),
+			nvrhi::BindingSetItem::Texture_SRV( 1, depthImage ),
+			nvrhi::BindingSetItem::Sampler( 0, Scene::DiffuseTextureSampler )
+		};
+		ScreenQuad::BindingSet = ObjectCache::GetBindingSet( setDesc, ScreenQuad::BindingLayout );
+
 		// Clear the screen with black
-		nvrhi::utils::ClearColorAttachment( CommandList, DeviceManager->GetCurrentFramebuffer(), 0, nvrhi::Color{ 0.0f, 0.0f, 0.0f, 1.0f } );
+		nvrhi::utils::ClearColorAttachment( commandList, DeviceManager->GetCurrentFramebuffer(), 0, nvrhi::Color{ 0.0f, 0.0f, 0.0f, 1.0f } );
 		
 		// Set up the current graphics state
 		auto graphicsState = nvrhi::GraphicsState()
@@ -570,63 +908,627 @@ namespace Renderer
 			.setFramebuffer( DeviceManager->GetCurrentFramebuffer() );
 		// Without this, stuff won't render as the viewport will be 0,0
 		graphicsState.viewport.addViewportAndScissorRect( nvrhi::Viewport( 1600.0f, 900.0f ) );
-		CommandList->setGraphicsState( graphicsState );
+		commandList->setGraphicsState( graphicsState );
 
 		// Draw the thing
 		auto& args = nvrhi::DrawArguments()
 			.setVertexCount( Model::ScreenQuad::Indices.size() ); // Vertex count is actually index count in this case
-		CommandList->drawIndexed( args );
+		commandList->drawIndexed( args );
 	}
 
-	void RenderSceneIntoFramebuffer()
+	// Lets the texture streaming system know how big this surface is on screen
+	void RequestTextureDetail( const Logic::RenderEntity& renderEntity, const Model::RenderSurface& renderSurface )
 	{
-		// Let's tell the GPU it should fill the main buffer with some dark greenish blue
-		CommandList->clearTextureFloat( Scene::MainFramebufferColourImage, nvrhi::AllSubresources, nvrhi::Color{ 0.01f, 0.05f, 0.05f, 1.0f } );
-		// Also clear the depth buffer
-		CommandList->clearDepthStencilTexture( Scene::MainFramebufferDepthImage, nvrhi::AllSubresources, true, 1.0f, false, 0U );
+		const adm::Vec3 extents = (renderSurface.boundsMax - renderSurface.boundsMin) * 0.5f;
+		const adm::Vec3 centre = TransformPoint( renderEntity.transform, renderSurface.boundsMin + extents );
+		const adm::Vec3 delta = centre - ViewPosition;
 
-		// Update view & projection matrices
-		TransformData.time += 0.016f;
-		CommandList->writeBuffer( Scene::ConstantBufferGlobal, &TransformData, sizeof( TransformData ) );
+		const float radius = std::sqrt( extents.x * extents.x + extents.y * extents.y + extents.z * extents.z );
+		const float distance = std::max( std::sqrt( delta.x * delta.x + delta.y * delta.y + delta.z * delta.z ) - radius, 0.1f );
 
-		// Set up the current graphics state
-		auto graphicsState = nvrhi::GraphicsState()
-			.setPipeline( Scene::Pipeline )
-			.setFramebuffer( Scene::MainFramebuffer );
-		// Without this, stuff won't render as the viewport will be 0,0
-		graphicsState.viewport.addViewportAndScissorRect( nvrhi::Viewport( 1600.0f, 900.0f ) );
+		const float screenHeight = float( DeviceManager->GetDeviceParams().backBufferHeight );
+		const float pixelsPerWorldUnit = screenHeight / (2.0f * std::tan( ViewFov * deg2rad * 0.5f ) * distance);
 
-		// Draw all entities
-		for ( const auto& renderEntity : RenderEntities )
+		Texture::Streaming::RequestForScreenSize( renderSurface.textureObjectHandle, renderSurface.uvDensity, pixelsPerWorldUnit );
+	}
+
+	// World-space boxes of the visible entities' surfaces, rebuilt every frame
+	Culling::BoundsArray SurfaceBounds;
+	std::vector<uint8_t> EntityVisibility;
+	std::vector<uint8_t> SurfaceVisibility;
+	Culling::Stats CullingStats;
+	Occlusion::Stats OcclusionStats;
+	// F7 toggles it, to compare against frustum culling alone
+	bool OcclusionCulling = true;
+	// F8 toggles it, to compare against testing every entity's box
+	bool UseEntityTree = true;
+
+	// Entities are culled first, and only the surfaces of visible ones are tested after that
+	// Whatever is left after the frustum is tested against the occluders of visible entities
+	// SurfaceVisibility follows the order BuildDrawList goes through them
+	void CullScene()
+	{
+		const Culling::Frustum frustum = Culling::ExtractFrustum( TransformData.viewMatrix, TransformData.projectionMatrix );
+
+		EntityVisibility.resize( EntityBounds.Size() );
+		size_t numEntitiesVisible = UseEntityTree
+			? EntityTree.CullFrustum( frustum, EntityVisibility.data() )
+			: Culling::CullBoxes( frustum, EntityBounds, EntityVisibility.data() );
+		const size_t numEntitiesInFrustum = numEntitiesVisible;
+
+		if ( OcclusionCulling )
+		{
+			Occlusion::Begin( TransformData.viewMatrix, TransformData.projectionMatrix );
+			for ( size_t i = 0U; i < RenderEntities.size(); i++ )
+			{
+				const Model::OccluderMesh& occluder = RenderEntities[i].GetRenderModel().occluder;
+				if ( EntityVisibility[i] && !occluder.indices.empty() )
+				{
+					Occlusion::AddOccluder( occluder, RenderEntities[i].transform );
+				}
+			}
+
+			Occlusion::Rasterise();
+			numEntitiesVisible = Occlusion::TestBoxes( EntityBounds, EntityVisibility.data() );
+		}
+
+		size_t numSurfaces = 0U;
+		SurfaceBounds.Clear();
+		for ( size_t i = 0U; i < RenderEntities.size(); i++ )
+		{
+			const auto& renderSurfaces = RenderEntities[i].GetRenderSurfaces();
+			numSurfaces += renderSurfaces.size();
+
+			if ( !EntityVisibility[i] )
+			{
+				continue;
+			}
+
+			for ( const auto& renderSurface : renderSurfaces )
+			{
+				SurfaceBounds.Add( RenderEntities[i].transform, renderSurface.boundsMin, renderSurface.boundsMax );
+			}
+		}
+
+		SurfaceVisibility.resize( SurfaceBounds.Size() );
+		size_t numSurfacesVisible = Culling::CullBoxes( frustum, SurfaceBounds, SurfaceVisibility.data() );
+		const size_t numSurfacesInFrustum = numSurfacesVisible;
+
+		if ( OcclusionCulling )
 		{
-			// Update per-entity transform data
-			CommandList->writeBuffer( Scene::ConstantBufferEntity, &renderEntity.transform, sizeof( adm::Mat4 ) );
+			numSurfacesVisible = Occlusion::TestBoxes( SurfaceBounds, SurfaceVisibility.data() );
+			OcclusionStats = Occlusion::GetStats();
+		}
+		else
+		{
+			OcclusionStats = {};
+		}
+
+		CullingStats.numEntitiesVisible = numEntitiesVisible;
+		CullingStats.numEntitiesCulled = RenderEntities.size() - numEntitiesVisible;
+		CullingStats.numSurfacesVisible = numSurfacesVisible;
+		CullingStats.numSurfacesCulled = numSurfaces - numSurfacesVisible;
+		CullingStats.numEntitiesOccluded = numEntitiesInFrustum - numEntitiesVisible;
+		CullingStats.numSurfacesOccluded = numSurfacesInFrustum - numSurfacesVisible;
+	}
+
+	// A surface that passed culling and has all of its data on the GPU
+	struct DrawCommand
+	{
+		const Logic::RenderEntity* renderEntity;
+		const Model::RenderSurface* renderSurface;
+		// Into VisibleTransforms
+		uint32_t visibleEntity;
+	};
+
+	std::vector<DrawCommand> DrawCommands;
+	// Transforms of the entities that passed culling, side by side, so their MVPs can be computed in one batch
+	std::vector<adm::Mat4> VisibleTransforms;
+	std::vector<adm::Mat4> VisibleMVPs;
+	std::vector<DrawList::Item> DrawItems;
+	std::vector<DrawList::Item> DrawItemsScratch;
+	DrawList::Stats DrawStats;
+	// F2 toggles it, to compare against drawing in entity order
+	bool SortDraws = true;
+
+	// Entities that draw the same surface go into one instanced draw
+	std::vector<DrawList::InstanceGroup> InstanceGroups;
+	// F3 toggles it, to compare against one draw per entity
+	bool InstanceDraws = true;
+	// F4 toggles it, to compare against writing a volatile constant buffer for every entity
+	bool UseTransformBuffer = true;
+
+	// Every visible surface gets a sort key, so the draws can be reordered to share as much state as possible
+	void BuildDrawList()
+	{
+		DrawCommands.clear();
+		DrawItems.clear();
+		VisibleTransforms.clear();
+
+		size_t surfaceIndex = 0U;
+		for ( size_t entityIndex = 0U; entityIndex < RenderEntities.size(); entityIndex++ )
+		{
+			if ( !EntityVisibility[entityIndex] )
+			{
+				continue;
+			}
+
+			const auto& renderEntity = RenderEntities[entityIndex];
+			const uint32_t visibleEntity = VisibleTransforms.size();
+			VisibleTransforms.push_back( renderEntity.transform );
 
-			// Draw all surfaces
 			for ( const auto& renderSurface : renderEntity.GetRenderSurfaces() )
 			{
-				// Combine the global binding set (viewproj matrix + time + sampler)
-				// with the per-entity binding set (diffuse texture)
-				graphicsState.bindings =
+				const size_t boundsIndex = surfaceIndex++;
+				if ( !SurfaceVisibility[boundsIndex] )
 				{
-					Scene::BindingSet,
-					renderSurface.bindingSet,
-				};
-				// It is possible to use multiple vertex buffers (one for positions, one for normals etc.), 
-				// but we're only using one here
-				graphicsState.vertexBuffers = { { renderSurface.vertexBuffer, 0, 0 } };
-				graphicsState.indexBuffer = { renderSurface.indexBuffer, nvrhi::Format::R32_UINT, 0 };
+					continue;
+				}
+
+				// Surfaces whose data is still on its way to the GPU will show up in a later frame
+				if ( !Upload::Acquire( CommandList, renderSurface.vertexBuffer )
+					|| !Upload::Acquire( CommandList, renderSurface.indexBuffer )
+					|| !Upload::Acquire( CommandList, Texture::TextureObjects[renderSurface.textureObjectHandle] ) )
+				{
+					continue;
+				}
+
+				RequestTextureDetail( renderEntity, renderSurface );
+
+				// Culling already has the world-space centres
+				const float dx = SurfaceBounds.centreX[boundsIndex] - ViewPosition.x;
+				const float dy = SurfaceBounds.centreY[boundsIndex] - ViewPosition.y;
+				const float dz = SurfaceBounds.centreZ[boundsIndex] - ViewPosition.z;
+				const float depth = std::sqrt( dx * dx + dy * dy + dz * dz ) / MaxViewDistance;
+
+				// There's only the one scene pipeline for now, and materials are just textures
+				const uint64_t key = DrawList::MakeSortKey( 0U, renderSurface.textureObjectHandle, renderSurface.geometryId, depth );
+				DrawItems.push_back( { key, uint32_t( DrawCommands.size() ) } );
+				DrawCommands.push_back( { &renderEntity, &renderSurface, visibleEntity } );
+			}
+		}
+
+		DrawStats.sortMilliseconds = 0.0;
+		if ( SortDraws )
+		{
+			adm::TimerPreciseDouble timer;
+			DrawList::RadixSort( DrawItems, DrawItemsScratch );
+			DrawStats.sortMilliseconds = timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0;
+		}
+	}
+
+	// Every entity's transform goes into a volatile constant buffer right before its draws
+	void RecordWithEntityConstants( nvrhi::ICommandList* commandList, const nvrhi::GraphicsState& graphicsState,
+		uint32_t firstItem, uint32_t endItem, DrawList::Stats& stats )
+	{
+		DrawList::StateTracker stateTracker;
+		stateTracker.Reset( graphicsState, 1U );
+
+		const DrawCommand* previous = nullptr;
+		for ( uint32_t i = firstItem; i < endItem; i++ )
+		{
+			const DrawCommand& draw = DrawCommands[DrawItems[i].index];
+			const Model::DrawPacket& drawPacket = draw.renderSurface->drawPacket;
+
+			// Update per-entity transform data, only when the entity changes
+			// It's a volatile buffer, so NVRHI needs the graphics state again afterwards
+			if ( nullptr == previous || previous->renderEntity != draw.renderEntity )
+			{
+				commandList->writeBuffer( Scene::ConstantBufferEntity, &draw.renderEntity->transform, sizeof( adm::Mat4 ) );
+				stateTracker.Invalidate();
+				stats.numConstantWrites++;
+			}
+			previous = &draw;
+
+			if ( stateTracker.Update( drawPacket, stats ) )
+			{
+				commandList->setGraphicsState( stateTracker.GetState() );
+			}
+
+			// Draw the thing
+			auto& args = nvrhi::DrawArguments()
+				.setVertexCount( drawPacket.numIndices ) // Vertex count is actually index count in this case
+				.setStartIndexLocation( drawPacket.firstIndex )
+				.setStartVertexLocation( drawPacket.baseVertex );
+			commandList->drawIndexed( args );
+			stats.numDraws++;
+		}
+	}
+
+	// All transforms are copied into the frame's transform buffer up front, in draw order,
+	// so a group's matrices start at its first item, which the shader gets as a push constant
+	// Nothing in between invalidates the graphics state, and entities sharing a surface become one instanced draw
+	bool FillTransformBuffer()
+	{
+		DrawList::GroupInstances( DrawItems, InstanceGroups, []( uint32_t a, uint32_t b )
+			{
+				return InstanceDraws && DrawCommands[a].renderSurface == DrawCommands[b].renderSurface;
+			} );
+
+		// Every visible entity's final matrix, once, instead of two matrix multiplies on every vertex
+		adm::Mat4 viewProjection;
+		Transforms::MultiplyBatch( TransformData.projectionMatrix, &TransformData.viewMatrix, &viewProjection, 1U );
+		VisibleMVPs.resize( VisibleTransforms.size() );
+		Transforms::MultiplyBatch( viewProjection, VisibleTransforms.data(), VisibleMVPs.data(), VisibleTransforms.size() );
+
+		Transforms::Instance* instances = Transforms::Map( DrawItems.size() );
+		if ( nullptr == instances )
+		{
+			return false;
+		}
+
+		for ( size_t i = 0U; i < DrawItems.size(); i++ )
+		{
+			const uint32_t visibleEntity = DrawCommands[DrawItems[i].index].visibleEntity;
+			instances[i].modelViewProjection = VisibleMVPs[visibleEntity];
+			instances[i].model = VisibleTransforms[visibleEntity];
+		}
+		Transforms::Unmap();
 
-				CommandList->setGraphicsState( graphicsState );
+		return true;
+	}
+
+	void RecordWithTransformBuffer( nvrhi::ICommandList* commandList, const nvrhi::GraphicsState& sharedState,
+		uint32_t firstGroup, uint32_t endGroup, DrawList::Stats& stats )
+	{
+		// The global binding set has the per-entity buffer too, and NVRHI won't bind a volatile buffer
+		// that wasn't written in this command list
+		const adm::Mat4 identity = adm::Mat4::Identity;
+		commandList->writeBuffer( Scene::ConstantBufferEntity, &identity, sizeof( identity ) );
+
+		nvrhi::GraphicsState graphicsState = sharedState;
+		graphicsState.setPipeline( Scene::InstancedPipeline );
+		graphicsState.addBindingSet( nullptr );
+		graphicsState.addBindingSet( Transforms::GetBindingSet() );
+
+		DrawList::StateTracker stateTracker;
+		stateTracker.Reset( graphicsState, 1U );
+
+		for ( uint32_t g = firstGroup; g < endGroup; g++ )
+		{
+			const DrawList::InstanceGroup& group = InstanceGroups[g];
+			const Model::DrawPacket& drawPacket = DrawCommands[DrawItems[group.firstItem].index].renderSurface->drawPacket;
+			if ( stateTracker.Update( drawPacket, stats ) )
+			{
+				commandList->setGraphicsState( stateTracker.GetState() );
+			}
+
+			// SV_InstanceID doesn't include the start instance on every API, so the offset is passed separately
+			commandList->setPushConstants( &group.firstItem, sizeof( group.firstItem ) );
+
+			auto& args = nvrhi::DrawArguments()
+				.setVertexCount( drawPacket.numIndices )
+				.setInstanceCount( group.numItems )
+				.setStartIndexLocation( drawPacket.firstIndex )
+				.setStartVertexLocation( drawPacket.baseVertex );
+			commandList->drawIndexed( args );
+			stats.numDraws++;
 
-				// Draw the thing
-				auto& args = nvrhi::DrawArguments()
-					.setVertexCount( renderSurface.numIndices ); // Vertex count is actually index count in this case
-				CommandList->drawIndexed( args );
+			if ( group.numItems > 1U )
+			{
+				stats.numInstancedDraws++;
+				stats.numInstances += group.numItems;
 			}
 		}
 	}
 
+	std::vector<nvrhi::DrawIndexedIndirectArguments> IndirectArguments;
+	std::vector<DrawList::IndirectBatch> IndirectBatches;
+	// Rewritten every frame by the main command list, GPU-local, big enough for the largest frame so far
+	nvrhi::BufferHandle IndirectArgumentBuffer;
+	uint32_t IndirectArgumentCapacity = 0U;
+	// 0, 1, 2... read as a per-instance vertex attribute, which is how a draw's start instance reaches the shader
+	nvrhi::BufferHandle DrawInstanceBuffer;
+	uint32_t DrawInstanceCapacity = 0U;
+	// F6 toggles it, to compare against a drawIndexed call per instance group
+	bool UseIndirectDraws = true;
+
+	static const Model::DrawPacket& GetGroupDrawPacket( uint32_t groupIndex )
+	{
+		return DrawCommands[DrawItems[InstanceGroups[groupIndex].firstItem].index].renderSurface->drawPacket;
+	}
+
+	// Replaces the buffer if it can't hold 'count' elements, keeping the memory stats right
+	static bool EnsureBufferCapacity( nvrhi::BufferHandle& buffer, uint32_t& capacity, uint32_t count, nvrhi::BufferDesc desc, uint32_t elementBytes )
+	{
+		if ( count <= capacity )
+		{
+			return false;
+		}
+
+		if ( nullptr != buffer )
+		{
+			Memory::Track( Memory::GetBufferCategory( buffer->getDesc() ), 0, -int64_t( Memory::EstimateBufferBytes( buffer->getDesc() ) ), -1 );
+		}
+
+		// Room to grow, so it's not recreated every time a few more things come into view
+		capacity = std::max( { count, capacity * 2U, 1024U } );
+		desc.byteSize = uint64_t( capacity ) * elementBytes;
+		desc.keepInitialState = true;
+		buffer = Device->createBuffer( desc );
+		Memory::Track( Memory::GetBufferCategory( desc ), 0, Memory::EstimateBufferBytes( desc ), 1 );
+
+		return true;
+	}
+
+	// The instance groups' draw arguments go to the GPU in one write, and groups that don't need a state change in between
+	// are batched, so a batch of any size is a single drawIndexedIndirect
+	bool BuildIndirectDraws()
+	{
+		DrawList::BuildIndirectBatches( InstanceGroups, IndirectArguments, IndirectBatches, GetGroupDrawPacket );
+		if ( IndirectArguments.empty() )
+		{
+			return false;
+		}
+
+		EnsureBufferCapacity( IndirectArgumentBuffer, IndirectArgumentCapacity, IndirectArguments.size(),
+			nvrhi::BufferDesc()
+			.setDebugName( "Indirect argument buffer" )
+			.setIsDrawIndirectArgs( true )
+			.setInitialState( nvrhi::ResourceStates::IndirectArgument ),
+			sizeof( nvrhi::DrawIndexedIndirectArguments ) );
+
+		// The stream never changes, only gets longer
+		if ( EnsureBufferCapacity( DrawInstanceBuffer, DrawInstanceCapacity, DrawItems.size(),
+			nvrhi::BufferDesc()
+			.setDebugName( "Draw instance buffer" )
+			.setIsVertexBuffer( true )
+			.setInitialState( nvrhi::ResourceStates::VertexBuffer ),
+			sizeof( uint32_t ) ) )
+		{
+			std::vector<uint32_t> drawInstances( DrawInstanceCapacity );
+			std::iota( drawInstances.begin(), drawInstances.end(), 0U );
+			CommandList->writeBuffer( DrawInstanceBuffer, drawInstances.data(), drawInstances.size() * sizeof( uint32_t ) );
+		}
+
+		// Ordered after the previous frame's draws on the GPU, so there's no need for one buffer per frame in flight
+		CommandList->writeBuffer( IndirectArgumentBuffer, IndirectArguments.data(), IndirectArguments.size() * sizeof( nvrhi::DrawIndexedIndirectArguments ) );
+
+		return true;
+	}
+
+	void RecordIndirect( nvrhi::ICommandList* commandList, const nvrhi::GraphicsState& sharedState,
+		uint32_t firstBatch, uint32_t endBatch, DrawList::Stats& stats )
+	{
+		// Same as in RecordWithTransformBuffer
+		const adm::Mat4 identity = adm::Mat4::Identity;
+		commandList->writeBuffer( Scene::ConstantBufferEntity, &identity, sizeof( identity ) );
+
+		nvrhi::GraphicsState graphicsState = sharedState;
+		graphicsState.setPipeline( Scene::IndirectPipeline );
+		graphicsState.addBindingSet( nullptr );
+		graphicsState.addBindingSet( Transforms::GetBindingSet() );
+		graphicsState.addVertexBuffer( { nullptr, 0, 0 } );
+		graphicsState.addVertexBuffer( { DrawInstanceBuffer, 1, 0 } );
+		graphicsState.setIndirectParams( IndirectArgumentBuffer );
+
+		DrawList::StateTracker stateTracker;
+		stateTracker.Reset( graphicsState, 1U );
+
+		for ( uint32_t b = firstBatch; b < endBatch; b++ )
+		{
+			const DrawList::IndirectBatch& batch = IndirectBatches[b];
+			if ( stateTracker.Update( GetGroupDrawPacket( batch.firstGroup ), stats ) )
+			{
+				commandList->setGraphicsState( stateTracker.GetState() );
+			}
+
+			commandList->drawIndexedIndirect( batch.firstGroup * sizeof( nvrhi::DrawIndexedIndirectArguments ), batch.numGroups );
+			stats.numIndirectCalls++;
+			stats.numDraws += batch.numGroups;
+
+			for ( uint32_t g = batch.firstGroup; g < batch.firstGroup + batch.numGroups; g++ )
+			{
+				if ( InstanceGroups[g].numItems > 1U )
+				{
+					stats.numInstancedDraws++;
+					stats.numInstances += InstanceGroups[g].numItems;
+				}
+			}
+		}
+	}
+
+	// Set by PrepareScene for RecordScene
+	bool DrawWithTransformBuffer = false;
+	bool DrawIndirect = false;
+
+	// Up to 16 MB where the driver aligns versions to 256 bytes, and about 16 thousand entity changes a frame
+	// with two frames in flight
+	// Past that, NVRHI drops the per-entity writes and those entities get drawn with a stale transform
+	constexpr uint32_t MaxEntityBufferVersions = 64U * 1024U;
+
+	// Without the transform buffer, each entity change in the draw list writes the per-entity buffer again,
+	// and a frame can't do more writes than NVRHI has versions for, or they're dropped
+	// So the buffer is replaced with a bigger one whenever the draw list outgrows it, on the fallback path only
+	void EnsureEntityBufferVersions()
+	{
+		// Only Vulkan allocates every version up front, D3D11 renames the buffer and D3D12 goes through its upload manager
+		// The instanced paths only write it once per list, which the startup size already covers
+		if ( DrawWithTransformBuffer || Device->getGraphicsAPI() != nvrhi::GraphicsAPI::VULKAN )
+		{
+			return;
+		}
+
+		// At most one write per draw, plus the one every scene list does
+		const uint32_t writesPerFrame = DrawItems.size() + SceneCommandLists.size();
+		const uint32_t versions = std::min( GetVolatileVersions( writesPerFrame ), MaxEntityBufferVersions );
+		if ( versions <= Scene::EntityBufferVersions )
+		{
+			return;
+		}
+
+		static bool warnedAboutCap = false;
+		if ( versions == MaxEntityBufferVersions && !warnedAboutCap )
+		{
+			warnedAboutCap = true;
+			std::cout << "WARNING: " << writesPerFrame << " per-entity writes a frame may exceed the per-entity buffer's "
+				<< MaxEntityBufferVersions << " versions, build the instanced shaders to use the transform buffer instead" << std::endl;
+		}
+
+		// Room to grow, the old buffer and binding set go away once the GPU and the object cache are done with them
+		if ( CreateEntityBuffer( std::min( std::max( versions, Scene::EntityBufferVersions * 2U ), MaxEntityBufferVersions ) ) )
+		{
+			CreateGlobalBindingSet();
+		}
+	}
+
+	// Everything that has to happen on the main thread before the draws can be recorded
+	void PrepareScene()
+	{
+		// Whatever the compiler has finished by now, the same for every chunk of the frame
+		// Without the scene pipeline the scene pass only clears, and the instanced paths fall back to plain draws
+		ScreenQuad::Pipeline = PipelineCompiler::Get( ScreenQuad::PipelineId );
+		Scene::Pipeline = PipelineCompiler::Get( Scene::PipelineId );
+		Scene::InstancedPipeline = PipelineCompiler::Get( Scene::InstancedPipelineId );
+		Scene::IndirectPipeline = PipelineCompiler::Get( Scene::IndirectPipelineId );
+
+		ScreenQuadReady = nullptr != ScreenQuad::Pipeline
+			&& Upload::Acquire( CommandList, ScreenQuad::VertexBuffer ) && Upload::Acquire( CommandList, ScreenQuad::IndexBuffer );
+
+		TransformData.time += 0.016f;
+
+		CullScene();
+		BuildDrawList();
+
+		// Without the instanced shader, or until its pipeline is compiled, there's only the old way
+		DrawWithTransformBuffer = UseTransformBuffer && nullptr != Scene::InstancedPipeline && FillTransformBuffer();
+		DrawIndirect = DrawWithTransformBuffer && UseIndirectDraws && nullptr != Scene::IndirectPipeline && BuildIndirectDraws();
+		EnsureEntityBufferVersions();
+	}
+
+	// Chunks smaller than this aren't worth a command list of their own
+	constexpr uint32_t MinDrawsPerChunk = 512U;
+	std::vector<DrawList::Stats> ChunkStats;
+	// F5 toggles it, to compare against recording everything on the main thread
+	bool RecordInParallel = true;
+
+	// Records the draw list into as many of SceneCommandLists as it's worth, returns how many
+	// The first one also clears the scene's targets
+	uint32_t RecordScene( const RenderGraph::PassContext& pass, RenderGraph::ResourceId colour, RenderGraph::ResourceId depth )
+	{
+		adm::TimerPreciseDouble timer;
+
+		// Indirect batches, instance groups, or single draws
+		const uint32_t numDraws = nullptr == Scene::Pipeline ? 0U
+			: DrawIndirect ? IndirectBatches.size() : DrawWithTransformBuffer ? InstanceGroups.size() : DrawItems.size();
+		const uint32_t maxChunks = RecordInParallel ? SceneCommandLists.size() : 1U;
+		const uint32_t numChunks = std::clamp( (numDraws + MinDrawsPerChunk - 1U) / MinDrawsPerChunk, 1U, maxChunks );
+		ChunkStats.assign( numChunks, DrawList::Stats() );
+
+		Jobs::ParallelFor( numChunks, [&pass, colour, depth, numDraws, numChunks]( uint32_t chunk )
+			{
+				const uint32_t first = uint64_t( numDraws ) * chunk / numChunks;
+				const uint32_t end = uint64_t( numDraws ) * (chunk + 1U) / numChunks;
+				nvrhi::ICommandList* commandList = SceneCommandLists[chunk];
+
+				commandList->open();
+
+				// The first list gets the pass's transitions, and the others start out where it left the targets
+				if ( chunk == 0U )
+				{
+					pass.Begin( commandList );
+					// Let's tell the GPU it should fill the main buffer with some dark greenish blue
+					commandList->clearTextureFloat( pass.GetTexture( colour ), nvrhi::AllSubresources, nvrhi::Color{ 0.01f, 0.05f, 0.05f, 1.0f } );
+					// Also clear the depth buffer
+					commandList->clearDepthStencilTexture( pass.GetTexture( depth ), nvrhi::AllSubresources, true, 1.0f, false, 0U );
+					pass.End( commandList );
+				}
+				else
+				{
+					pass.Track( commandList );
+				}
+
+				// Volatile buffers only live as long as the command list they were written in
+				commandList->writeBuffer( Scene::ConstantBufferGlobal, &TransformData, sizeof( TransformData ) );
+
+				// Set up the state every draw shares
+				// The global binding set (viewproj matrix + time + sampler) is combined
+				// with each surface's binding set (diffuse texture) by the state tracker
+				auto graphicsState = nvrhi::GraphicsState()
+					.setPipeline( Scene::Pipeline )
+					.setFramebuffer( pass.GetFramebuffer() )
+					.addBindingSet( Scene::BindingSet );
+				// Without this, stuff won't render as the viewport will be 0,0
+				graphicsState.viewport.addViewportAndScissorRect( nvrhi::Viewport( 1600.0f, 900.0f ) );
+
+				if ( DrawIndirect )
+				{
+					RecordIndirect( commandList, graphicsState, first, end, ChunkStats[chunk] );
+				}
+				else if ( DrawWithTransformBuffer )
+				{
+					RecordWithTransformBuffer( commandList, graphicsState, first, end, ChunkStats[chunk] );
+				}
+				else
+				{
+					RecordWithEntityConstants( commandList, graphicsState, first, end, ChunkStats[chunk] );
+				}
+
+				commandList->close();
+			} );
+
+		DrawList::Stats stats;
+		for ( const auto& chunk : ChunkStats )
+		{
+			stats.numDraws += chunk.numDraws;
+			stats.numPipelineChanges += chunk.numPipelineChanges;
+			stats.numBindingChanges += chunk.numBindingChanges;
+			stats.numBufferChanges += chunk.numBufferChanges;
+			stats.numConstantWrites += chunk.numConstantWrites;
+			stats.numInstancedDraws += chunk.numInstancedDraws;
+			stats.numInstances += chunk.numInstances;
+			stats.numStateCalls += chunk.numStateCalls;
+			stats.numElidedCalls += chunk.numElidedCalls;
+			stats.numIndirectCalls += chunk.numIndirectCalls;
+		}
+
+		stats.numCommandLists = numChunks;
+		stats.sortMilliseconds = DrawStats.sortMilliseconds;
+		stats.submitMilliseconds = timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0;
+		DrawStats = stats;
+
+		return numChunks;
+	}
+
+	// Set by the scene pass, it's up to the draw list how many it needs
+	uint32_t NumSceneCommandLists = 0U;
+
+	// The scene goes into the colour and depth targets, which the screen quad then draws onto the backbuffer
+	// Post-processing would go between the two, reading the scene's targets and writing new ones
+	void BuildFrameGraph()
+	{
+		using RStates = nvrhi::ResourceStates;
+
+		FrameGraph.Reset();
+		const RenderGraph::ResourceId colour = FrameGraph.CreateTexture( Scene::ColourDesc );
+		const RenderGraph::ResourceId depth = FrameGraph.CreateTexture( Scene::DepthDesc );
+		const RenderGraph::ResourceId backbuffer = FrameGraph.ImportTexture( DeviceManager->GetCurrentBackBuffer() );
+
+		// Render the scene with projection'n'everything into the targets
+		const uint32_t scenePass = FrameGraph.AddPass( "Scene", [colour, depth]( RenderGraph::PassContext& pass )
+			{
+				NumSceneCommandLists = RecordScene( pass, colour, depth );
+			} );
+		FrameGraph.Write( scenePass, colour, RStates::RenderTarget );
+		FrameGraph.Write( scenePass, depth, RStates::DepthWrite );
+
+		// Render said targets as a quad on the screen, because
+		// backbuffer does not have a depth attachment
+		// This is actually one way to implement framebuffer blitting
+		const uint32_t screenPass = FrameGraph.AddPass( "Screen quad", [colour, depth]( RenderGraph::PassContext& pass )
+			{
+				ScreenQuadCommandList->open();
+				pass.Begin( ScreenQuadCommandList );
+				RenderScreenQuad( ScreenQuadCommandList, pass.GetTexture( colour ), pass.GetTexture( depth ) );
+				ScreenQuadCommandList->close();
+			} );
+		FrameGraph.Read( screenPass, colour );
+		FrameGraph.Read( screenPass, depth );
+		FrameGraph.Write( screenPass, backbuffer );
+
+		FrameGraph.Compile( Device );
+	}
+
 	// Adapted from glm::eulerAnglesXYZ by trying out different combinations until I got what I wanted
 	// Positive pitch will make the forward axis go up
 	// Positive yaw will make forward and right spin counter-clockwise (if you want it the other way, put -angles.y
@@ -683,6 +1585,26 @@ namespace Renderer
 				viewAngles.y -= mx * 0.2f;
 				viewAngles.x -= my * 0.2f;
 			}
+
+			// Left click picks whatever is in the middle of the screen
+			static bool wasPicking = false;
+			const bool picking = mstate & SDL_BUTTON_LMASK;
+			if ( picking && !wasPicking )
+			{
+				Bvh::RayHit hit;
+				adm::TimerPreciseDouble timer;
+				if ( CastRay( viewPosition, viewForward, MaxViewDistance, hit ) )
+				{
+					const Model::RenderModel& renderModel = RenderEntities[hit.entity].GetRenderModel();
+					std::cout << "Picked entity " << hit.entity << " (" << renderModel.name << "), surface " << hit.surface << ", triangle " << hit.triangle
+						<< ", " << hit.distance << " units away, in " << timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000000.0 << " us" << std::endl;
+				}
+				else
+				{
+					std::cout << "Picked nothing" << std::endl;
+				}
+			}
+			wasPicking = picking;
 		}
 
 		// Update view position
@@ -727,6 +1649,7 @@ namespace Renderer
 
 		// Calculate view matrix
 		TransformData.viewMatrix = CalculateViewMatrix( viewPosition, viewAngles );
+		ViewPosition = viewPosition;
 	}
 
 	void Render()
@@ -735,37 +1658,89 @@ namespace Renderer
 		// wait til the GPU's done rendering & presenting the last frame
 		DeviceManager->BeginFrame();
 
+		// Create whatever textures finished decoding, as many as fit into this frame's budget
+		Texture::Loader::Update();
+		// Queue up the texture mips that were asked for last frame
+		Texture::Streaming::Update();
+		// Streaming may have uploaded new mips, and whatever the upload thread recorded since last frame gets submitted
+		Upload::Flush();
+		Upload::Update();
+
 		// Open the command buffa
 		CommandList->open();
 
-		// Render the scene with projection'n'everything into a framebuffer
-		RenderSceneIntoFramebuffer();
-
-		// Render said framebuffer as a quad on the screen, because
-		// backbuffer does not have a depth attachment
-		// This is actually one way to implement framebuffer blitting
-		// Should make it more generic
-		RenderScreenQuad();
+		// Cull, sort, and get the scene's resources ready
+		PrepareScene();
 
-		// We've recorded all the commands we wanna send to the GPU, we're done here
+		// We've recorded all the commands we wanna send to the GPU from the main thread, we're done here
 		CommandList->close();
 
+		// Only wait for the uploads this frame actually used
+		Upload::SubmitFrameWaits();
+
 		// Send the commands to the GPU and execute immediately
 		// This will NOT block the current thread unlike OpenGL, that's why there is a semaphore etc.
 		// inside DeviceManager::BeginFrame
+		// It goes on its own, so the resource states it made permanent are known to the lists recorded below
 		Device->executeCommandList( CommandList );
 
+		// Record the scene and the screen quad, with whatever textures and transitions the graph worked out
+		NumSceneCommandLists = 0U;
+		BuildFrameGraph();
+		FrameGraph.Execute();
+
+		// The scene's chunks in order, then the screen quad, all in one go
+		std::vector<nvrhi::ICommandList*> commandLists;
+		for ( uint32_t i = 0U; i < NumSceneCommandLists; i++ )
+		{
+			commandLists.push_back( SceneCommandLists[i] );
+		}
+		commandLists.push_back( ScreenQuadCommandList );
+		Device->executeCommandLists( commandLists.data(), commandLists.size() );
+		// The transform buffer this frame filled can't be reused until the GPU is done with it
+		Transforms::FrameSubmitted();
+
 		// Display the backbuffer onto da screen
 		DeviceManager->Present();
 
 		// NVRHI does some garbage collection for any resource that is no longer in use
 		Device->runGarbageCollection();
+		ObjectCache::ReleaseUnused();
+
+		// Both from process start, until the scene pipeline is ready, frames only clear
+		const char* startupMode = SerialStartup ? " (serial startup)" : " (task graph)";
+		if ( !FirstPresentReported )
+		{
+			FirstPresentReported = true;
+			std::cout << "Time to first present: " << StartupTimer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0 << " ms" << startupMode << std::endl;
+		}
+		if ( !FirstFrameReported && nullptr != Scene::Pipeline )
+		{
+			FirstFrameReported = true;
+			std::cout << "Time to first scene frame: " << StartupTimer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0 << " ms" << startupMode << std::endl;
+		}
 	}
 
 	void Shutdown()
 	{
+		// Shutdown forgets every pipeline, so print them while they're still there
+		PipelineCompiler::WaitForAll();
+		PipelineCompiler::PrintStats();
+		PipelineCompiler::Shutdown();
 		CommandList = nullptr;
-		TransferList = nullptr;
+		SceneCommandLists.clear();
+		ScreenQuadCommandList = nullptr;
+		Texture::Loader::Shutdown();
+		Upload::Shutdown();
+
+		Memory::PrintStats();
+		Upload::PrintStats();
+		Texture::Loader::PrintStats();
+		Texture::Streaming::PrintStats();
+		Texture::Streaming::Shutdown();
+		Transforms::PrintStats();
+		FrameGraph.PrintStats();
+		ObjectCache::PrintStats();
 
 		for ( auto& textureObject : Texture::TextureObjects )
 		{
@@ -773,7 +1748,10 @@ namespace Renderer
 		}
 
 		Model::RenderModels.clear();
+		Model::ReleaseSharedGeometry();
 		RenderEntities.clear();
+		EntityBounds.Clear();
+		EntityTree.Clear();
 
 		ScreenQuad::VertexBuffer = nullptr;
 		ScreenQuad::IndexBuffer = nullptr;
@@ -784,6 +1762,7 @@ namespace Renderer
 		Scene::DiffuseTextureSampler = nullptr;
 		Scene::ConstantBufferEntity = nullptr;
 		Scene::ConstantBufferGlobal = nullptr;
+		Transforms::Shutdown();
 
 		ScreenQuad::BindingLayout = nullptr;
 		ScreenQuad::BindingSet = nullptr;
@@ -791,19 +1770,27 @@ namespace Renderer
 		ScreenQuad::InputLayout = nullptr;
 		ScreenQuad::Pipeline = nullptr;
 
-		Scene::MainFramebuffer = nullptr;
-		Scene::MainFramebufferColourImage = nullptr;
-		Scene::MainFramebufferDepthImage = nullptr;
+		FrameGraph.Clear();
 
 		Scene::VertexShader = nullptr;
 		Scene::PixelShader = nullptr;
+		Scene::InstancedVertexShader = nullptr;
 		
 		Scene::BindingLayoutGlobal = nullptr;
 		Scene::BindingLayoutEntity = nullptr;
+		Scene::BindingLayoutInstances = nullptr;
 		Scene::BindingSet = nullptr;
 
 		Scene::InputLayout = nullptr;
 		Scene::Pipeline = nullptr;
+		Scene::InstancedPipeline = nullptr;
+		Scene::IndirectVertexShader = nullptr;
+		Scene::IndirectInputLayout = nullptr;
+		Scene::IndirectPipeline = nullptr;
+		IndirectArgumentBuffer = nullptr;
+		DrawInstanceBuffer = nullptr;
+		ObjectCache::Clear();
+		Shader::ClosePack();
 
 		Device->waitForIdle();
 
@@ -824,57 +1811,21 @@ namespace System
 		
 		Window = SDL_CreateWindow( windowTitle, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, windowWidth, windowHeight, SDL_WINDOW_VULKAN );
 	
+		// Index loose assets and mount assets.pak if there is one
+		FileSystem::Init();
+		// Texture decoding happens on these
+		Jobs::Init();
+
+		// Loads the level too, next to the shaders and pipelines
 		if ( !Renderer::Init( Window, windowWidth, windowHeight, graphicsApi ) )
 		{
 			std::cout << "System::Init: couldn't initialise Renderer" << std::endl;
 			return false;
 		}
 
-		Renderer::LoadEntities();
-
 		return true;
 	}
 
-	constexpr size_t MaxFrames = 100U;
-	std::list<float> frameratesCapped;
-	std::list<float> frameratesUncapped;
-
-	void UpdateFramerates( float capped, float uncapped )
-	{
-		static int counter = 0;
-		
-		if ( frameratesCapped.size() >= MaxFrames )
-		{
-			frameratesCapped.pop_front();
-		}
-		if ( frameratesUncapped.size() >= MaxFrames )
-		{
-			frameratesUncapped.pop_front();
-		}
-
-		frameratesCapped.push_back( capped );
-		frameratesUncapped.push_back( uncapped );
-	
-		float averageCapped = 0.0f;
-		float averageUncapped = 0.0f;
-
-		for ( const auto& framerate : frameratesCapped )
-			averageCapped += framerate;
-
-		for ( const auto& framerate : frameratesUncapped )
-			averageUncapped += framerate;
-
-		averageCapped /= frameratesCapped.size();
-		averageUncapped /= frameratesUncapped.size();
-
-		if ( ++counter == 30 )
-		{
-			std::cout << "Capped fps:   " << std::setw( 4 ) << int( averageCapped ) << std::endl
-				      << "Uncapped fps: " << std::setw( 4 ) << int( averageUncapped ) << std::endl;
-			counter = 0;
-		}
-	}
-
 	void Update( bool& outShouldQuit )
 	{
 		static float time = 0.0f;
@@ -891,12 +1842,21 @@ namespace System
 					outShouldQuit = true;
 					return;
 				}
+
+				// Stats and the renderer's switches on F1-F8
+				Debug::HandleEvent( ev );
 			}
 		}
 
 		Renderer::Update( deltaTime );
 		Renderer::Render();
 
+		if ( Renderer::QuitAfterFirstFrame && Renderer::FirstFrameReported )
+		{
+			outShouldQuit = true;
+			return;
+		}
+
 		double deltaT = t.GetElapsed( adm::TimeUnits::Seconds );
 
 		// Weirdly enough this won't actually result in 90fps, but something like 83 or 85
@@ -908,13 +1868,16 @@ namespace System
 		}
 
 		deltaTime = t.GetElapsed( adm::TimeUnits::Seconds );
-		UpdateFramerates( 1.0f / deltaTime, 1.0f / deltaT );
+		Debug::FrameEnded( 1.0f / deltaTime, 1.0f / deltaT );
 	}
 
 	int Shutdown( const char* reason = nullptr )
 	{
 		Renderer::Shutdown();
 
+		Jobs::Shutdown();
+		FileSystem::Shutdown();
+
 		SDL_DestroyWindow( Window );
 
 		SDL_Quit();
@@ -934,6 +1897,45 @@ int main( int argc, char** argv )
 {
 	nvrhi::GraphicsAPI api = nvrhi::GraphicsAPI::VULKAN;
 	
+	// Tools that run and quit without opening a window
+	for ( int i = 1; i < argc; i++ )
+	{
+		// Packs the assets folder into assets.pak
+		if ( argv[i] == "-makepak"sv )
+		{
+			return FileSystem::BuildPak( "assets", "assets.pak", true ) ? 0 : 1;
+		}
+		// Packs every compiled shader listed in shaders.cfg, for all backends, into shaders.pack
+		if ( argv[i] == "-makeshaderpack"sv )
+		{
+			return Shader::BuildPack() ? 0 : 1;
+		}
+		if ( argv[i] == "-bench"sv )
+		{
+			return Benchmark::Run();
+		}
+		// Stress test for instancing
+		if ( argv[i] == "-scatter"sv && i + 1 < argc )
+		{
+			Renderer::NumScatteredEntities = std::max( std::atoi( argv[i + 1] ), 0 );
+		}
+		// The old way of starting up, to compare time to first frame against
+		if ( argv[i] == "-serialstartup"sv )
+		{
+			Renderer::SerialStartup = true;
+		}
+		// Prints the frame stats every so many frames
+		if ( argv[i] == "-stats"sv && i + 1 < argc )
+		{
+			Debug::StatsInterval = std::max( std::atoi( argv[i + 1] ), 0 );
+		}
+		// Quits after the first scene frame, so time to first frame can be measured by running this over and over
+		if ( argv[i] == "-firstframe"sv )
+		{
+			Renderer::QuitAfterFirstFrame = true;
+		}
+	}
+
 	// Linux has no DirectX obviously
 	if constexpr ( adm::Platform == adm::Platforms::Windows )
 	{
@@ -958,6 +1960,15 @@ int main( int argc, char** argv )
 				api = nvrhi::GraphicsAPI::VULKAN;
 				std::cout << "Vulkan is already enabled by default" << std::endl;
 			}
+			else if ( argv[i] == "-scatter"sv || argv[i] == "-stats"sv )
+			{
+				// Their counts were already read above
+				i++;
+			}
+			else if ( argv[i] == "-serialstartup"sv || argv[i] == "-firstframe"sv )
+			{
+				// Already read above
+			}
 			else
 			{
 				ss << "    " << argv[i] << std::endl;
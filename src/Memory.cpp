@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+
+#include <atomic>
+
+namespace Memory
+{
+	// Atomics because the upload thread and the job threads update these too, not just the main thread
+	struct CategoryCounters
+	{
+		std::atomic<int64_t> cpuBytes{ 0 };
+		std::atomic<int64_t> gpuBytes{ 0 };
+		std::atomic<int64_t> numResources{ 0 };
+	};
+
+	static CategoryCounters Counters[size_t( Category::Count )];
+
+	const char* CategoryToString( Category category )
+	{
+		switch ( category )
+		{
+		case Category::Textures: return "Textures";
+		case Category::RenderTargets: return "Render targets";
+		case Category::VertexBuffers: return "Vertex buffers";
+		case Category::IndexBuffers: return "Index buffers";
+		case Category::ConstantBuffers: return "Constant buffers";
+		case Category::Staging: return "Staging";
+		default: return "unknown";
+		}
+	}
+
+	void Track( Category category, int64_t cpuBytesDelta, int64_t gpuBytesDelta, int64_t numResourcesDelta )
+	{
+		CategoryCounters& counters = Counters[size_t( category )];
+		counters.cpuBytes += cpuBytesDelta;
+		counters.gpuBytes += gpuBytesDelta;
+		counters.numResources += numResourcesDelta;
+	}
+
+	Totals GetTotals( Category category )
+	{
+		const CategoryCounters& counters = Counters[size_t( category )];
+		return { counters.cpuBytes.load(), counters.gpuBytes.load(), counters.numResources.load() };
+	}
+
+	Totals GetGrandTotal()
+	{
+		Totals total;
+		for ( size_t i = 0U; i < size_t( Category::Count ); i++ )
+		{
+			const Totals totals = GetTotals( Category( i ) );
+			total.cpuBytes += totals.cpuBytes;
+			total.gpuBytes += totals.gpuBytes;
+			total.numResources += totals.numResources;
+		}
+
+		return total;
+	}
+
+	void PrintStats()
+	{
+		const auto printLine = []( const char* name, const Totals& totals )
+		{
+			std::cout << "  * " << std::left << std::setw( 18 ) << name << std::right
+				<< std::setw( 6 ) << totals.numResources << " resources, "
+				<< std::setw( 9 ) << totals.cpuBytes / 1024 << " kB CPU, "
+				<< std::setw( 9 ) << totals.gpuBytes / 1024 << " kB GPU" << std::endl;
+		};
+
+		std::cout << "Resource memory:" << std::endl;
+		for ( size_t i = 0U; i < size_t( Category::Count ); i++ )
+		{
+			printLine( CategoryToString( Category( i ) ), GetTotals( Category( i ) ) );
+		}
+		printLine( "Total", GetGrandTotal() );
+	}
+
+	// Drivers may add padding and alignment on top of this, but it's close enough
+	uint64_t EstimateTextureBytes( const nvrhi::TextureDesc& desc )
+	{
+		const nvrhi::FormatInfo& formatInfo = nvrhi::getFormatInfo( desc.format );
+		const uint32_t blockSize = std::max<uint32_t>( formatInfo.blockSize, 1U );
+
+		uint64_t bytes = 0U;
+		for ( uint32_t mip = 0U; mip < desc.mipLevels; mip++ )
+		{
+			const uint32_t width = std::max( desc.width >> mip, 1U );
+			const uint32_t height = std::max( desc.height >> mip, 1U );
+			const uint64_t blocksX = (width + blockSize - 1U) / blockSize;
+			const uint64_t blocksY = (height + blockSize - 1U) / blockSize;
+
+			bytes += blocksX * blocksY * formatInfo.bytesPerBlock;
+		}
+
+		return bytes * desc.arraySize * desc.depth * desc.sampleCount;
+	}
+
+	uint64_t EstimateBufferBytes( const nvrhi::BufferDesc& desc )
+	{
+		// Volatile buffers live in the upload ring, one copy per version
+		if ( desc.isVolatile )
+		{
+			return desc.byteSize * std::max( desc.maxVersions, 1U );
+		}
+
+		return desc.byteSize;
+	}
+
+	Category GetBufferCategory( const nvrhi::BufferDesc& desc )
+	{
+		if ( desc.isVertexBuffer )
+		{
+			return Category::VertexBuffers;
+		}
+		if ( desc.isIndexBuffer )
+		{
+			return Category::IndexBuffers;
+		}
+
+		return Category::ConstantBuffers;
+	}
+}
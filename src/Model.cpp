@@ -25,6 +25,16 @@ namespace Model
 		return vertexData.data();
 	}
 
+	// Lets fx-gltf read straight out of a mapped file or a decompressed pak entry
+	struct MemoryStreamBuffer : public std::streambuf
+	{
+		MemoryStreamBuffer( const uint8_t* data, size_t size )
+		{
+			char* begin = const_cast<char*>( reinterpret_cast<const char*>( data ) );
+			setg( begin, begin, begin + size );
+		}
+	};
+
 	struct GltfModel
 	{
 		struct BufferInfo
@@ -44,9 +54,18 @@ namespace Model
 		{
 			using namespace fx::gltf;
 
+			FileSystem::FileData fileData;
+			if ( !FileSystem::ReadFile( fileName, fileData ) )
+			{
+				std::cout << "Error while loading model '" << fileName << "', file not found" << std::endl;
+				return false;
+			}
+
 			try
 			{
-				modelFile = LoadFromBinary( fileName );
+				MemoryStreamBuffer buffer( fileData.data, fileData.size );
+				std::istream stream( &buffer );
+				modelFile = LoadFromBinary( stream, std::filesystem::path( fileName ).parent_path() );
 			}
 			catch ( std::system_error& error )
 			{
@@ -227,8 +246,81 @@ namespace Model
 	};
 
 	std::vector<RenderModel> RenderModels;
+	static uint32_t NumGeometries = 0U;
+
+	// Collected while loading, until CreateSharedGeometry uploads them
+	static bool CollectingSharedGeometry = true;
+	static std::vector<DrawVertex> SharedVertices;
+	static std::vector<uint32_t> SharedIndices;
+	static nvrhi::BufferHandle SharedVertexBuffer;
+	static nvrhi::BufferHandle SharedIndexBuffer;
 
-	int32_t LoadRenderModelFromGltf( const char* fileName )
+	static nvrhi::BindingSetHandle CreateSurfaceBindingSet( const RenderSurface& rs )
+	{
+		nvrhi::BindingSetDesc setDesc;
+		setDesc.bindings =
+		{
+			nvrhi::BindingSetItem::Texture_SRV( 0, Texture::TextureObjects[rs.textureObjectHandle] ),
+		};
+
+		return ObjectCache::GetBindingSet( setDesc, ::Renderer::Scene::BindingLayoutEntity );
+	}
+
+	// Bounds for culling, and how densely the UVs are laid out over the surface, for texture streaming
+	static void CalculateSurfaceMetrics( const DrawSurface& surface, RenderSurface& rs )
+	{
+		if ( surface.vertexData.empty() )
+		{
+			return;
+		}
+
+		rs.boundsMin = surface.vertexData[0].vertexPosition;
+		rs.boundsMax = surface.vertexData[0].vertexPosition;
+		for ( const auto& vertex : surface.vertexData )
+		{
+			const adm::Vec3& p = vertex.vertexPosition;
+			rs.boundsMin = { std::min( rs.boundsMin.x, p.x ), std::min( rs.boundsMin.y, p.y ), std::min( rs.boundsMin.z, p.z ) };
+			rs.boundsMax = { std::max( rs.boundsMax.x, p.x ), std::max( rs.boundsMax.y, p.y ), std::max( rs.boundsMax.z, p.z ) };
+		}
+
+		// Ratio between the UV area and the world area of all triangles
+		double worldArea = 0.0;
+		double uvArea = 0.0;
+		for ( size_t i = 0U; i + 2U < surface.vertexIndices.size(); i += 3U )
+		{
+			const DrawVertex& v0 = surface.vertexData[surface.vertexIndices[i]];
+			const DrawVertex& v1 = surface.vertexData[surface.vertexIndices[i + 1U]];
+			const DrawVertex& v2 = surface.vertexData[surface.vertexIndices[i + 2U]];
+
+			const adm::Vec3 edge1 = v1.vertexPosition - v0.vertexPosition;
+			const adm::Vec3 edge2 = v2.vertexPosition - v0.vertexPosition;
+			const adm::Vec3 normal = edge1.Cross( edge2 );
+			worldArea += std::sqrt( normal.x * normal.x + normal.y * normal.y + normal.z * normal.z ) * 0.5;
+
+			const float du1 = v1.vertexTextureCoords.x - v0.vertexTextureCoords.x;
+			const float dv1 = v1.vertexTextureCoords.y - v0.vertexTextureCoords.y;
+			const float du2 = v2.vertexTextureCoords.x - v0.vertexTextureCoords.x;
+			const float dv2 = v2.vertexTextureCoords.y - v0.vertexTextureCoords.y;
+			uvArea += std::abs( du1 * dv2 - du2 * dv1 ) * 0.5;
+		}
+
+		if ( worldArea > 0.0 && uvArea > 0.0 )
+		{
+			rs.uvDensity = float( std::sqrt( uvArea / worldArea ) );
+		}
+	}
+
+	static void AddSurfaceTriangles( const DrawSurface& surface, uint32_t surfaceIndex, Bvh::TriangleTree& tree )
+	{
+		for ( size_t i = 0U; i + 2U < surface.vertexIndices.size(); i += 3U )
+		{
+			tree.AddTriangle( surface.vertexData[surface.vertexIndices[i]].vertexPosition,
+				surface.vertexData[surface.vertexIndices[i + 1U]].vertexPosition,
+				surface.vertexData[surface.vertexIndices[i + 2U]].vertexPosition, surfaceIndex );
+		}
+	}
+
+	int32_t LoadRenderModelFromGltf( const char* fileName, bool isOccluder )
 	{
 		GltfModel modelFile;
 		if ( !modelFile.Init( fileName ) )
@@ -246,10 +338,22 @@ namespace Model
 			RenderSurface& rs = rm.surfaces.back();
 			rs.textureObjectHandle = Texture::FindOrCreateMaterial( surface.materialName.c_str() );
 			//rs.textureObjectHandle = Texture::FindOrCreateMaterial( "assets/256floor.png" );
-			rs.vertexBuffer = CreateBufferWithData( surface.vertexData, true, fileName );
-			rs.indexBuffer = CreateBufferWithData( surface.vertexIndices, false, fileName );
+			if ( CollectingSharedGeometry )
+			{
+				// The buffers come later, with everyone else's
+				rs.firstIndex = SharedIndices.size();
+				rs.baseVertex = SharedVertices.size();
+				SharedIndices.insert( SharedIndices.end(), surface.vertexIndices.begin(), surface.vertexIndices.end() );
+				SharedVertices.insert( SharedVertices.end(), surface.vertexData.begin(), surface.vertexData.end() );
+			}
+			else
+			{
+				rs.vertexBuffer = CreateBufferWithData( surface.vertexData, true, fileName );
+				rs.indexBuffer = CreateBufferWithData( surface.vertexIndices, false, fileName );
+			}
 			rs.numIndices = surface.vertexIndices.size();
 			rs.numVertices = surface.vertexData.size();
+			rs.geometryId = NumGeometries++;
 
 			std::cout << "Submodel " << surface.materialName << std::endl
 				<< "  " << rs.numIndices << " indices" << std::endl
@@ -262,15 +366,132 @@ namespace Model
 				rs.textureObjectHandle = 0;
 			}
 
-			nvrhi::BindingSetDesc setDesc;
-			setDesc.bindings =
+			CalculateSurfaceMetrics( surface, rs );
+			rs.bindingSet = CreateSurfaceBindingSet( rs );
+			rs.UpdateDrawPacket();
+			AddSurfaceTriangles( surface, rm.surfaces.size() - 1U, rm.triangles );
+
+			if ( isOccluder )
 			{
-				nvrhi::BindingSetItem::Texture_SRV( 0, Texture::TextureObjects[rs.textureObjectHandle] ),
-			};
+				const uint32_t firstVertex = rm.occluder.positions.size();
+				for ( const auto& vertex : surface.vertexData )
+				{
+					rm.occluder.positions.push_back( vertex.vertexPosition );
+				}
+				for ( const uint32_t index : surface.vertexIndices )
+				{
+					rm.occluder.indices.push_back( firstVertex + index );
+				}
+			}
+		}
 
-			rs.bindingSet = Renderer::Device->createBindingSet( setDesc, ::Renderer::Scene::BindingLayoutEntity );
+		adm::TimerPreciseDouble timer;
+		rm.triangles.Build();
+		std::cout << "Triangle tree: " << rm.triangles.GetNumTriangles() << " triangles, " << rm.triangles.GetNumNodes() << " nodes, "
+			<< rm.triangles.GetMemoryBytes() / 1024U << " kB, " << timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0 << " ms" << std::endl;
+
+		// Entities get culled as a whole first
+		for ( size_t i = 0U; i < rm.surfaces.size(); i++ )
+		{
+			const RenderSurface& rs = rm.surfaces[i];
+			if ( 0U == i )
+			{
+				rm.boundsMin = rs.boundsMin;
+				rm.boundsMax = rs.boundsMax;
+				continue;
+			}
+
+			rm.boundsMin = { std::min( rm.boundsMin.x, rs.boundsMin.x ), std::min( rm.boundsMin.y, rs.boundsMin.y ), std::min( rm.boundsMin.z, rs.boundsMin.z ) };
+			rm.boundsMax = { std::max( rm.boundsMax.x, rs.boundsMax.x ), std::max( rm.boundsMax.y, rs.boundsMax.y ), std::max( rm.boundsMax.z, rs.boundsMax.z ) };
 		}
 
 		return RenderModels.size() - 1;
 	}
+
+	int32_t FindOrLoadRenderModel( const char* fileName, bool isOccluder )
+	{
+		for ( size_t i = 0U; i < RenderModels.size(); i++ )
+		{
+			if ( RenderModels[i].name == fileName )
+			{
+				return int32_t( i );
+			}
+		}
+
+		return LoadRenderModelFromGltf( fileName, isOccluder );
+	}
+
+	bool LoadTriangleTreeFromGltf( const char* fileName, Bvh::TriangleTree& outTree )
+	{
+		GltfModel modelFile;
+		if ( !modelFile.Init( fileName ) )
+		{
+			return false;
+		}
+
+		outTree.Clear();
+		for ( size_t i = 0U; i < modelFile.mesh.surfaces.size(); i++ )
+		{
+			AddSurfaceTriangles( modelFile.mesh.surfaces[i], i, outTree );
+		}
+		outTree.Build();
+
+		return true;
+	}
+
+	void CreateSharedGeometry()
+	{
+		CollectingSharedGeometry = false;
+		if ( SharedIndices.empty() )
+		{
+			return;
+		}
+
+		SharedVertexBuffer = CreateBufferWithData( SharedVertices, true, "Shared vertex buffer" );
+		SharedIndexBuffer = CreateBufferWithData( SharedIndices, false, "Shared index buffer" );
+
+		std::cout << "Shared geometry: " << SharedVertices.size() << " vertices, " << SharedIndices.size() << " indices, "
+			<< (SharedVertices.size() * sizeof( DrawVertex ) + SharedIndices.size() * sizeof( uint32_t )) / 1024U << " kB" << std::endl;
+
+		// The upload has its own copy by now
+		SharedVertices = {};
+		SharedIndices = {};
+
+		for ( auto& renderModel : RenderModels )
+		{
+			for ( auto& renderSurface : renderModel.surfaces )
+			{
+				if ( nullptr == renderSurface.vertexBuffer )
+				{
+					renderSurface.vertexBuffer = SharedVertexBuffer;
+					renderSurface.indexBuffer = SharedIndexBuffer;
+					renderSurface.UpdateDrawPacket();
+				}
+			}
+		}
+	}
+
+	void ReleaseSharedGeometry()
+	{
+		SharedVertexBuffer = nullptr;
+		SharedIndexBuffer = nullptr;
+		SharedVertices = {};
+		SharedIndices = {};
+		CollectingSharedGeometry = true;
+	}
+
+	void UpdateTextureBindings( int32_t textureObjectHandle )
+	{
+		for ( auto& renderModel : RenderModels )
+		{
+			for ( auto& renderSurface : renderModel.surfaces )
+			{
+				if ( renderSurface.textureObjectHandle == textureObjectHandle )
+				{
+					renderSurface.bindingSet = CreateSurfaceBindingSet( renderSurface );
+					renderSurface.UpdateDrawPacket();
+				}
+			}
+		}
+	}
 }
@@ -0,0 +1,263 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+
+namespace ObjectCache
+{
+	struct PipelineEntry
+	{
+		nvrhi::GraphicsPipelineDesc desc;
+		nvrhi::FramebufferInfo framebufferInfo;
+		nvrhi::GraphicsPipelineHandle pipeline;
+	};
+
+	struct BindingSetEntry
+	{
+		nvrhi::BindingSetDesc desc;
+		nvrhi::IBindingLayout* layout{};
+		nvrhi::BindingSetHandle bindingSet;
+	};
+
+	// Hashes are only a shortcut, entries with the same one are told apart by comparing their descs
+	static std::unordered_map<size_t, std::vector<PipelineEntry>> Pipelines;
+	static std::unordered_map<size_t, std::vector<BindingSetEntry>> BindingSets;
+	static std::mutex Mutex;
+	static Stats CacheStats;
+
+	// One list of fields per struct, for both hashing and comparing, so the two can't disagree
+	// The sample positions only matter with programmable sample positions, which nothing here uses
+	static auto Fields( const nvrhi::RasterState& s )
+	{
+		return std::make_tuple( s.fillMode, s.cullMode, s.frontCounterClockwise, s.depthClipEnable, s.scissorEnable, s.multisampleEnable,
+			s.antialiasedLineEnable, s.depthBias, s.depthBiasClamp, s.slopeScaledDepthBias, s.forcedSampleCount,
+			s.programmableSamplePositionsEnable, s.conservativeRasterEnable, s.quadFillEnable );
+	}
+
+	static auto Fields( const nvrhi::DepthStencilState::StencilOpDesc& s )
+	{
+		return std::make_tuple( s.failOp, s.depthFailOp, s.passOp, s.stencilFunc );
+	}
+
+	static auto Fields( const nvrhi::DepthStencilState& s )
+	{
+		return std::tuple_cat( std::make_tuple( s.depthTestEnable, s.depthWriteEnable, s.depthFunc, s.stencilEnable,
+			s.stencilReadMask, s.stencilWriteMask, s.stencilRefValue ), Fields( s.frontFaceStencil ), Fields( s.backFaceStencil ) );
+	}
+
+	static auto Fields( const nvrhi::GraphicsPipelineDesc& d )
+	{
+		return std::make_tuple( d.primType, d.patchControlPoints, d.inputLayout.Get(),
+			d.VS.Get(), d.HS.Get(), d.DS.Get(), d.GS.Get(), d.PS.Get() );
+	}
+
+	static auto Fields( const nvrhi::FramebufferInfo& f )
+	{
+		return std::make_tuple( f.depthFormat, f.sampleCount, f.sampleQuality );
+	}
+
+	template<typename Tuple>
+	static void HashFields( size_t& seed, const Tuple& fields )
+	{
+		std::apply( [&seed]( const auto&... values )
+			{
+				(nvrhi::hash_combine( seed, values ), ...);
+			}, fields );
+	}
+
+	size_t HashGraphicsPipeline( const nvrhi::GraphicsPipelineDesc& desc, const nvrhi::FramebufferInfo& framebufferInfo )
+	{
+		size_t hash = 0U;
+		HashFields( hash, Fields( desc ) );
+		HashFields( hash, Fields( desc.renderState.rasterState ) );
+		HashFields( hash, Fields( desc.renderState.depthStencilState ) );
+		nvrhi::hash_combine( hash, desc.renderState.blendState );
+		nvrhi::hash_combine( hash, desc.shadingRateState );
+		for ( const nvrhi::BindingLayoutHandle& layout : desc.bindingLayouts )
+		{
+			nvrhi::hash_combine( hash, layout.Get() );
+		}
+
+		HashFields( hash, Fields( framebufferInfo ) );
+		for ( const nvrhi::Format format : framebufferInfo.colorFormats )
+		{
+			nvrhi::hash_combine( hash, format );
+		}
+
+		return hash;
+	}
+
+	bool IsSameGraphicsPipeline( const nvrhi::GraphicsPipelineDesc& a, const nvrhi::FramebufferInfo& framebufferA,
+		const nvrhi::GraphicsPipelineDesc& b, const nvrhi::FramebufferInfo& framebufferB )
+	{
+		if ( Fields( a ) != Fields( b )
+			|| Fields( a.renderState.rasterState ) != Fields( b.renderState.rasterState )
+			|| Fields( a.renderState.depthStencilState ) != Fields( b.renderState.depthStencilState )
+			|| a.renderState.blendState != b.renderState.blendState
+			|| a.shadingRateState != b.shadingRateState
+			|| a.bindingLayouts.size() != b.bindingLayouts.size()
+			|| Fields( framebufferA ) != Fields( framebufferB )
+			|| framebufferA.colorFormats.size() != framebufferB.colorFormats.size() )
+		{
+			return false;
+		}
+
+		for ( size_t i = 0U; i < a.bindingLayouts.size(); i++ )
+		{
+			if ( a.bindingLayouts[i] != b.bindingLayouts[i] )
+			{
+				return false;
+			}
+		}
+
+		for ( size_t i = 0U; i < framebufferA.colorFormats.size(); i++ )
+		{
+			if ( framebufferA.colorFormats[i] != framebufferB.colorFormats[i] )
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	size_t HashBindingSet( const nvrhi::BindingSetDesc& desc, nvrhi::IBindingLayout* layout )
+	{
+		size_t hash = std::hash<nvrhi::BindingSetDesc>()( desc );
+		nvrhi::hash_combine( hash, layout );
+		return hash;
+	}
+
+	nvrhi::GraphicsPipelineHandle GetGraphicsPipeline( const nvrhi::GraphicsPipelineDesc& desc, nvrhi::IFramebuffer* framebuffer )
+	{
+		const nvrhi::FramebufferInfo& framebufferInfo = framebuffer->getFramebufferInfo();
+		const size_t hash = HashGraphicsPipeline( desc, framebufferInfo );
+
+		const auto findPipeline = [&]() -> nvrhi::IGraphicsPipeline*
+		{
+			for ( const PipelineEntry& entry : Pipelines[hash] )
+			{
+				if ( IsSameGraphicsPipeline( entry.desc, entry.framebufferInfo, desc, framebufferInfo ) )
+				{
+					return entry.pipeline;
+				}
+			}
+			return nullptr;
+		};
+
+		{
+			std::lock_guard<std::mutex> lock( Mutex );
+			if ( nvrhi::IGraphicsPipeline* pipeline = findPipeline() )
+			{
+				CacheStats.pipelineHits++;
+				return pipeline;
+			}
+		}
+
+		// Compiling can take a while, and the pipeline compiler runs several at once, so this happens outside the lock
+		adm::TimerPreciseDouble timer;
+		nvrhi::GraphicsPipelineHandle pipeline = Renderer::Device->createGraphicsPipeline( desc, framebuffer );
+		const double milliseconds = timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0;
+
+		std::lock_guard<std::mutex> lock( Mutex );
+		CacheStats.missMilliseconds += milliseconds;
+		CacheStats.pipelineMisses++;
+		if ( nullptr == pipeline )
+		{
+			return nullptr;
+		}
+
+		// Someone else may have made the same one in the meantime, then theirs is the one everybody gets
+		if ( nvrhi::IGraphicsPipeline* existing = findPipeline() )
+		{
+			return existing;
+		}
+
+		std::vector<PipelineEntry>& entries = Pipelines[hash];
+		CacheStats.numCollisions += !entries.empty();
+		CacheStats.numPipelines++;
+		entries.push_back( { desc, framebufferInfo, pipeline } );
+		return pipeline;
+	}
+
+	nvrhi::BindingSetHandle GetBindingSet( const nvrhi::BindingSetDesc& desc, nvrhi::IBindingLayout* layout )
+	{
+		const size_t hash = HashBindingSet( desc, layout );
+
+		std::lock_guard<std::mutex> lock( Mutex );
+		std::vector<BindingSetEntry>& entries = BindingSets[hash];
+		for ( const BindingSetEntry& entry : entries )
+		{
+			if ( entry.layout == layout && entry.desc == desc )
+			{
+				CacheStats.bindingSetHits++;
+				return entry.bindingSet;
+			}
+		}
+
+		adm::TimerPreciseDouble timer;
+		nvrhi::BindingSetHandle bindingSet = Renderer::Device->createBindingSet( desc, layout );
+		CacheStats.missMilliseconds += timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0;
+		CacheStats.bindingSetMisses++;
+		if ( nullptr == bindingSet )
+		{
+			return nullptr;
+		}
+
+		CacheStats.numCollisions += !entries.empty();
+		CacheStats.numBindingSets++;
+		entries.push_back( { desc, layout, bindingSet } );
+		return bindingSet;
+	}
+
+	void ReleaseUnused()
+	{
+		std::lock_guard<std::mutex> lock( Mutex );
+		for ( auto it = BindingSets.begin(); it != BindingSets.end(); )
+		{
+			std::vector<BindingSetEntry>& entries = it->second;
+			const size_t numEntries = entries.size();
+
+			// A reference count of one after this is the cache's own
+			entries.erase( std::remove_if( entries.begin(), entries.end(), []( const BindingSetEntry& entry )
+				{
+					entry.bindingSet->AddRef();
+					return entry.bindingSet->Release() == 1U;
+				} ), entries.end() );
+
+			CacheStats.numReleased += numEntries - entries.size();
+			CacheStats.numBindingSets -= numEntries - entries.size();
+			it = entries.empty() ? BindingSets.erase( it ) : std::next( it );
+		}
+	}
+
+	void Clear()
+	{
+		std::lock_guard<std::mutex> lock( Mutex );
+		Pipelines.clear();
+		BindingSets.clear();
+		CacheStats.numPipelines = 0U;
+		CacheStats.numBindingSets = 0U;
+	}
+
+	Stats GetStats()
+	{
+		std::lock_guard<std::mutex> lock( Mutex );
+		return CacheStats;
+	}
+
+	void PrintStats()
+	{
+		const Stats stats = GetStats();
+
+		std::cout << "Object cache:" << std::endl
+			<< "  * Pipelines:        " << stats.numPipelines << " (" << stats.pipelineHits << " hits, " << stats.pipelineMisses << " misses)" << std::endl
+			<< "  * Binding sets:     " << stats.numBindingSets << " (" << stats.bindingSetHits << " hits, " << stats.bindingSetMisses << " misses, "
+			<< stats.numReleased << " released)" << std::endl
+			<< "  * Hash collisions:  " << stats.numCollisions << std::endl
+			<< "  * Creating misses:  " << stats.missMilliseconds << " ms" << std::endl;
+	}
+}
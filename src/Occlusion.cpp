@@ -0,0 +1,541 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+
+// SSE2 is always there on x64, anything else takes the scalar path
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define OCCLUSION_SSE 1
+#include <emmintrin.h>
+#else
+#define OCCLUSION_SSE 0
+#endif
+
+namespace Occlusion
+{
+	struct alignas( 16 ) ClipVertex
+	{
+		float x, y, z, w;
+	};
+
+	// A clipped and projected triangle, ready for the rasteriser
+	struct ScreenTriangle
+	{
+		// Pixel coordinates and 1/w of the corners, the reference rasteriser only looks at these
+		double x[3], y[3], depth[3];
+		// a * x + b * y + c, evaluated at pixel (x, y)'s centre
+		// Pushed in by half a pixel, so it's only >= 0 for pixels that are entirely inside
+		float edgeA[3], edgeB[3], edgeC[3];
+		// 1/w across the triangle, pushed back by half a pixel, so it's the farthest value anywhere in the pixel
+		float depthA, depthB, depthC;
+		float minDepth;
+		// Pixels that could be entirely inside, inclusive
+		int32_t minX, minY, maxX, maxY;
+	};
+
+	static adm::Mat4 ViewProjection;
+	static std::vector<ClipVertex> ClipVertices;
+	static std::vector<ScreenTriangle> Triangles;
+	static std::vector<uint32_t> TileBins[NumTilesX * NumTilesY];
+	static std::vector<float> Levels[NumLevels];
+	static uint32_t LevelWidths[NumLevels];
+	static uint32_t LevelHeights[NumLevels];
+	static Stats CurrentStats;
+
+	// The occluders' vertices, one SIMD register each
+	static void TransformVertices( const adm::Mat4& transform, const adm::Vec3* positions, size_t count, ClipVertex* outVertices )
+	{
+		// Row by row, transforming column vectors
+		const float* m = reinterpret_cast<const float*>( &transform );
+
+#if OCCLUSION_SSE
+		const __m128 column0 = _mm_setr_ps( m[0], m[4], m[8], m[12] );
+		const __m128 column1 = _mm_setr_ps( m[1], m[5], m[9], m[13] );
+		const __m128 column2 = _mm_setr_ps( m[2], m[6], m[10], m[14] );
+		const __m128 column3 = _mm_setr_ps( m[3], m[7], m[11], m[15] );
+
+		for ( size_t i = 0U; i < count; i++ )
+		{
+			__m128 clip = _mm_add_ps( _mm_mul_ps( column0, _mm_set1_ps( positions[i].x ) ), column3 );
+			clip = _mm_add_ps( clip, _mm_mul_ps( column1, _mm_set1_ps( positions[i].y ) ) );
+			clip = _mm_add_ps( clip, _mm_mul_ps( column2, _mm_set1_ps( positions[i].z ) ) );
+			_mm_store_ps( &outVertices[i].x, clip );
+		}
+#else
+		for ( size_t i = 0U; i < count; i++ )
+		{
+			const adm::Vec3& p = positions[i];
+			outVertices[i].x = m[0] * p.x + m[1] * p.y + m[2] * p.z + m[3];
+			outVertices[i].y = m[4] * p.x + m[5] * p.y + m[6] * p.z + m[7];
+			outVertices[i].z = m[8] * p.x + m[9] * p.y + m[10] * p.z + m[11];
+			outVertices[i].w = m[12] * p.x + m[13] * p.y + m[14] * p.z + m[15];
+		}
+#endif
+	}
+
+	// Doubles, since clipped vertices sit right at the near plane and end up far outside the screen
+	static void ProjectVertex( const ClipVertex& vertex, double& outX, double& outY, double& outDepth )
+	{
+		outDepth = 1.0 / vertex.w;
+		outX = (vertex.x * outDepth * 0.5 + 0.5) * Width;
+		outY = (0.5 - vertex.y * outDepth * 0.5) * Height;
+	}
+
+	static void SetupTriangle( const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2 )
+	{
+		ScreenTriangle t;
+		ProjectVertex( v0, t.x[0], t.y[0], t.depth[0] );
+		ProjectVertex( v1, t.x[1], t.y[1], t.depth[1] );
+		ProjectVertex( v2, t.x[2], t.y[2], t.depth[2] );
+
+		// Twice the signed area, and a triangle has to have at least the area of a pixel to cover one entirely
+		const double area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+		if ( std::abs( area ) < 2.0 )
+		{
+			return;
+		}
+
+		// Only pixels whose whole square fits between the triangle's extremes
+		const double minX = std::min( { t.x[0], t.x[1], t.x[2] } );
+		const double maxX = std::max( { t.x[0], t.x[1], t.x[2] } );
+		const double minY = std::min( { t.y[0], t.y[1], t.y[2] } );
+		const double maxY = std::max( { t.y[0], t.y[1], t.y[2] } );
+		t.minX = int32_t( std::ceil( std::clamp( minX, 0.0, double( Width ) ) ) );
+		t.maxX = int32_t( std::floor( std::clamp( maxX, 0.0, double( Width ) ) ) ) - 1;
+		t.minY = int32_t( std::ceil( std::clamp( minY, 0.0, double( Height ) ) ) );
+		t.maxY = int32_t( std::floor( std::clamp( maxY, 0.0, double( Height ) ) ) ) - 1;
+		if ( t.minX > t.maxX || t.minY > t.maxY )
+		{
+			return;
+		}
+
+		// Edge i goes from vertex i to the next one, and is positive on the inside whichever way the triangle winds
+		const double orientation = area > 0.0 ? 1.0 : -1.0;
+		double edgeA[3], edgeB[3], edgeC[3];
+		for ( int i = 0; i < 3; i++ )
+		{
+			const int j = (i + 1) % 3;
+			edgeA[i] = (t.y[i] - t.y[j]) * orientation;
+			edgeB[i] = (t.x[j] - t.x[i]) * orientation;
+			edgeC[i] = (t.x[i] * t.y[j] - t.x[j] * t.y[i]) * orientation;
+		}
+
+		// Barycentrics are the opposite edges over the area, and 1/w is linear in screen space
+		const double inverseArea = 1.0 / std::abs( area );
+		double depthA = (edgeA[1] * t.depth[0] + edgeA[2] * t.depth[1] + edgeA[0] * t.depth[2]) * inverseArea;
+		double depthB = (edgeB[1] * t.depth[0] + edgeB[2] * t.depth[1] + edgeB[0] * t.depth[2]) * inverseArea;
+		double depthC = (edgeC[1] * t.depth[0] + edgeC[2] * t.depth[1] + edgeC[0] * t.depth[2]) * inverseArea;
+
+		// Moved to pixel centres, then pushed in and back by half a pixel
+		// Edges are scaled to pixel units first, so their constants stay small enough for floats,
+		// and pushed in a hair further so rounding can't cover a pixel the triangle only touches
+		constexpr double EdgeEpsilon = 1.0 / 4096.0;
+		for ( int i = 0; i < 3; i++ )
+		{
+			const double scale = 1.0 / std::max( std::abs( edgeA[i] ), std::abs( edgeB[i] ) );
+			t.edgeA[i] = float( edgeA[i] * scale );
+			t.edgeB[i] = float( edgeB[i] * scale );
+			t.edgeC[i] = float( (edgeC[i] + 0.5 * (edgeA[i] + edgeB[i]) - 0.5 * (std::abs( edgeA[i] ) + std::abs( edgeB[i] ))) * scale - EdgeEpsilon );
+		}
+		depthC += 0.5 * (depthA + depthB) - 0.5 * (std::abs( depthA ) + std::abs( depthB ));
+		t.depthA = float( depthA );
+		t.depthB = float( depthB );
+		t.depthC = float( depthC );
+		t.minDepth = float( std::min( { t.depth[0], t.depth[1], t.depth[2] } ) );
+
+		const uint32_t index = Triangles.size();
+		Triangles.push_back( t );
+
+		for ( int32_t tileY = t.minY / TileHeight; tileY <= t.maxY / int32_t( TileHeight ); tileY++ )
+		{
+			for ( int32_t tileX = t.minX / TileWidth; tileX <= t.maxX / int32_t( TileWidth ); tileX++ )
+			{
+				TileBins[tileY * NumTilesX + tileX].push_back( index );
+			}
+		}
+	}
+
+	// Clipped against the near plane only, the rasteriser clamps everything else to the screen
+	static void AddTriangle( const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2 )
+	{
+		const ClipVertex* vertices[3] = { &v0, &v1, &v2 };
+		const int numInside = (v0.w >= NearW) + (v1.w >= NearW) + (v2.w >= NearW);
+		if ( 3 == numInside )
+		{
+			SetupTriangle( v0, v1, v2 );
+			return;
+		}
+
+		if ( 0 == numInside )
+		{
+			return;
+		}
+
+		ClipVertex polygon[4];
+		int numVertices = 0;
+		for ( int i = 0; i < 3; i++ )
+		{
+			const ClipVertex& a = *vertices[i];
+			const ClipVertex& b = *vertices[(i + 1) % 3];
+			if ( a.w >= NearW )
+			{
+				polygon[numVertices++] = a;
+			}
+
+			if ( (a.w >= NearW) != (b.w >= NearW) )
+			{
+				const float t = (NearW - a.w) / (b.w - a.w);
+				polygon[numVertices++] = { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, NearW };
+			}
+		}
+
+		SetupTriangle( polygon[0], polygon[1], polygon[2] );
+		if ( 4 == numVertices )
+		{
+			SetupTriangle( polygon[0], polygon[2], polygon[3] );
+		}
+	}
+
+	void Begin( const adm::Mat4& viewMatrix, const adm::Mat4& projectionMatrix )
+	{
+		Transforms::MultiplyBatch( projectionMatrix, &viewMatrix, &ViewProjection, 1U );
+
+		Triangles.clear();
+		for ( auto& bin : TileBins )
+		{
+			bin.clear();
+		}
+
+		if ( Levels[0].empty() )
+		{
+			for ( uint32_t level = 0U; level < NumLevels; level++ )
+			{
+				LevelWidths[level] = std::max( 1U, (Width + (1U << level) - 1U) >> level );
+				LevelHeights[level] = std::max( 1U, (Height + (1U << level) - 1U) >> level );
+				Levels[level].resize( LevelWidths[level] * LevelHeights[level] );
+			}
+		}
+
+		CurrentStats = {};
+	}
+
+	void AddOccluder( const Model::OccluderMesh& mesh, const adm::Mat4& transform )
+	{
+		adm::Mat4 modelViewProjection;
+		Transforms::MultiplyBatch( ViewProjection, &transform, &modelViewProjection, 1U );
+
+		ClipVertices.resize( mesh.positions.size() );
+		TransformVertices( modelViewProjection, mesh.positions.data(), mesh.positions.size(), ClipVertices.data() );
+
+		for ( size_t i = 0U; i + 2U < mesh.indices.size(); i += 3U )
+		{
+			AddTriangle( ClipVertices[mesh.indices[i]], ClipVertices[mesh.indices[i + 1U]], ClipVertices[mesh.indices[i + 2U]] );
+		}
+
+		CurrentStats.numOccluders++;
+		CurrentStats.numTriangles += mesh.indices.size() / 3U;
+	}
+
+	// Keeps the nearest covering triangle's depth in every pixel
+	static void RasteriseTile( uint32_t tile )
+	{
+		const int32_t tileMinX = (tile % NumTilesX) * TileWidth;
+		const int32_t tileMinY = (tile / NumTilesX) * TileHeight;
+		const int32_t tileMaxX = tileMinX + TileWidth - 1;
+		const int32_t tileMaxY = tileMinY + TileHeight - 1;
+		float* depthBuffer = Levels[0].data();
+
+		for ( int32_t y = tileMinY; y <= tileMaxY; y++ )
+		{
+			std::fill_n( &depthBuffer[y * Width + tileMinX], TileWidth, 0.0f );
+		}
+
+		for ( const uint32_t index : TileBins[tile] )
+		{
+			const ScreenTriangle& t = Triangles[index];
+			const int32_t minY = std::max( t.minY, tileMinY );
+			const int32_t maxY = std::min( t.maxY, tileMaxY );
+
+#if OCCLUSION_SSE
+			// Four pixels at a time, the extra ones at the ends are outside the triangle's edges anyway
+			const int32_t minX = std::max( t.minX, tileMinX ) & ~3;
+			const int32_t maxX = std::min( t.maxX, tileMaxX );
+
+			const __m128 laneOffsets = _mm_setr_ps( 0.0f, 1.0f, 2.0f, 3.0f );
+			const __m128 edgeA0 = _mm_set1_ps( t.edgeA[0] ), edgeA1 = _mm_set1_ps( t.edgeA[1] ), edgeA2 = _mm_set1_ps( t.edgeA[2] );
+			const __m128 depthA = _mm_set1_ps( t.depthA );
+			const __m128 minDepth = _mm_set1_ps( t.minDepth );
+			const __m128 zero = _mm_setzero_ps();
+
+			for ( int32_t y = minY; y <= maxY; y++ )
+			{
+				const float fy = float( y );
+				const __m128 rowEdge0 = _mm_set1_ps( t.edgeB[0] * fy + t.edgeC[0] );
+				const __m128 rowEdge1 = _mm_set1_ps( t.edgeB[1] * fy + t.edgeC[1] );
+				const __m128 rowEdge2 = _mm_set1_ps( t.edgeB[2] * fy + t.edgeC[2] );
+				const __m128 rowDepth = _mm_set1_ps( t.depthB * fy + t.depthC );
+				float* row = &depthBuffer[y * Width];
+
+				for ( int32_t x = minX; x <= maxX; x += 4 )
+				{
+					const __m128 xs = _mm_add_ps( _mm_set1_ps( float( x ) ), laneOffsets );
+
+					// Same order of operations as the scalar path
+					__m128 inside = _mm_cmpge_ps( _mm_add_ps( _mm_mul_ps( edgeA0, xs ), rowEdge0 ), zero );
+					inside = _mm_and_ps( inside, _mm_cmpge_ps( _mm_add_ps( _mm_mul_ps( edgeA1, xs ), rowEdge1 ), zero ) );
+					inside = _mm_and_ps( inside, _mm_cmpge_ps( _mm_add_ps( _mm_mul_ps( edgeA2, xs ), rowEdge2 ), zero ) );
+					if ( 0 == _mm_movemask_ps( inside ) )
+					{
+						continue;
+					}
+
+					const __m128 depth = _mm_max_ps( _mm_add_ps( _mm_mul_ps( depthA, xs ), rowDepth ), minDepth );
+					const __m128 previous = _mm_loadu_ps( &row[x] );
+					const __m128 nearest = _mm_max_ps( previous, depth );
+					_mm_storeu_ps( &row[x], _mm_or_ps( _mm_and_ps( inside, nearest ), _mm_andnot_ps( inside, previous ) ) );
+				}
+			}
+#else
+			const int32_t minX = std::max( t.minX, tileMinX );
+			const int32_t maxX = std::min( t.maxX, tileMaxX );
+
+			for ( int32_t y = minY; y <= maxY; y++ )
+			{
+				const float fy = float( y );
+				float* row = &depthBuffer[y * Width];
+
+				for ( int32_t x = minX; x <= maxX; x++ )
+				{
+					const float fx = float( x );
+					if ( t.edgeA[0] * fx + (t.edgeB[0] * fy + t.edgeC[0]) >= 0.0f
+						&& t.edgeA[1] * fx + (t.edgeB[1] * fy + t.edgeC[1]) >= 0.0f
+						&& t.edgeA[2] * fx + (t.edgeB[2] * fy + t.edgeC[2]) >= 0.0f )
+					{
+						const float depth = std::max( t.depthA * fx + (t.depthB * fy + t.depthC), t.minDepth );
+						row[x] = std::max( row[x], depth );
+					}
+				}
+			}
+#endif
+		}
+	}
+
+	// Every texel of a level is the farthest of the (up to) four below it
+	static void BuildHierarchy()
+	{
+		for ( uint32_t level = 1U; level < NumLevels; level++ )
+		{
+			const std::vector<float>& source = Levels[level - 1U];
+			const uint32_t sourceWidth = LevelWidths[level - 1U];
+			const uint32_t sourceHeight = LevelHeights[level - 1U];
+			std::vector<float>& destination = Levels[level];
+
+			for ( uint32_t y = 0U; y < LevelHeights[level]; y++ )
+			{
+				const uint32_t y0 = y * 2U;
+				const uint32_t y1 = std::min( y0 + 1U, sourceHeight - 1U );
+				for ( uint32_t x = 0U; x < LevelWidths[level]; x++ )
+				{
+					const uint32_t x0 = x * 2U;
+					const uint32_t x1 = std::min( x0 + 1U, sourceWidth - 1U );
+					destination[y * LevelWidths[level] + x] = std::min(
+						{ source[y0 * sourceWidth + x0], source[y0 * sourceWidth + x1], source[y1 * sourceWidth + x0], source[y1 * sourceWidth + x1] } );
+				}
+			}
+		}
+	}
+
+	void Rasterise( bool parallel )
+	{
+		adm::TimerPreciseDouble timer;
+
+		constexpr uint32_t NumTiles = NumTilesX * NumTilesY;
+		if ( parallel )
+		{
+			Jobs::ParallelFor( NumTiles, RasteriseTile );
+		}
+		else
+		{
+			for ( uint32_t tile = 0U; tile < NumTiles; tile++ )
+			{
+				RasteriseTile( tile );
+			}
+		}
+
+		BuildHierarchy();
+
+		CurrentStats.numRasterised = Triangles.size();
+		CurrentStats.rasterMilliseconds = timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0;
+	}
+
+	// Screen rectangle in pixels and the nearest 1/w of the box, false if any of it is behind the near plane
+	static bool ProjectBox( const adm::Vec3& boundsMin, const adm::Vec3& boundsMax,
+		int32_t& outMinX, int32_t& outMinY, int32_t& outMaxX, int32_t& outMaxY, float& outNearestDepth )
+	{
+		const float* m = reinterpret_cast<const float*>( &ViewProjection );
+
+		float minX = float( Width ), minY = float( Height ), maxX = 0.0f, maxY = 0.0f;
+		outNearestDepth = 0.0f;
+		for ( int corner = 0; corner < 8; corner++ )
+		{
+			const float px = (corner & 1) ? boundsMax.x : boundsMin.x;
+			const float py = (corner & 2) ? boundsMax.y : boundsMin.y;
+			const float pz = (corner & 4) ? boundsMax.z : boundsMin.z;
+
+			ClipVertex clip;
+			clip.x = m[0] * px + m[1] * py + m[2] * pz + m[3];
+			clip.y = m[4] * px + m[5] * py + m[6] * pz + m[7];
+			clip.w = m[12] * px + m[13] * py + m[14] * pz + m[15];
+			if ( clip.w < NearW )
+			{
+				return false;
+			}
+
+			double x, y, depth;
+			ProjectVertex( clip, x, y, depth );
+			minX = std::min( minX, float( x ) );
+			minY = std::min( minY, float( y ) );
+			maxX = std::max( maxX, float( x ) );
+			maxY = std::max( maxY, float( y ) );
+			outNearestDepth = std::max( outNearestDepth, float( depth ) );
+		}
+
+		// Every pixel the rectangle touches
+		outMinX = int32_t( std::floor( std::clamp( minX, 0.0f, float( Width - 1U ) ) ) );
+		outMinY = int32_t( std::floor( std::clamp( minY, 0.0f, float( Height - 1U ) ) ) );
+		outMaxX = int32_t( std::floor( std::clamp( maxX, 0.0f, float( Width - 1U ) ) ) );
+		outMaxY = int32_t( std::floor( std::clamp( maxY, 0.0f, float( Height - 1U ) ) ) );
+		return true;
+	}
+
+	bool IsBoxVisible( const adm::Vec3& boundsMin, const adm::Vec3& boundsMax )
+	{
+		int32_t minX, minY, maxX, maxY;
+		float nearestDepth;
+		if ( !ProjectBox( boundsMin, boundsMax, minX, minY, maxX, maxY, nearestDepth ) )
+		{
+			return true;
+		}
+
+		// The first level where the rectangle is at most 4x4 texels, its texels cover more than the rectangle, which is fine
+		uint32_t level = 0U;
+		while ( level + 1U < NumLevels && ((maxX >> level) - (minX >> level) > 3 || (maxY >> level) - (minY >> level) > 3) )
+		{
+			level++;
+		}
+
+		const float* depth = Levels[level].data();
+		const uint32_t width = LevelWidths[level];
+		for ( int32_t y = minY >> level; y <= maxY >> level; y++ )
+		{
+			for ( int32_t x = minX >> level; x <= maxX >> level; x++ )
+			{
+				// Some part of this texel has nothing in front of the box
+				if ( depth[y * width + x] <= nearestDepth )
+				{
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	size_t TestBoxes( const Culling::BoundsArray& bounds, uint8_t* inOutVisible )
+	{
+		adm::TimerPreciseDouble timer;
+
+		size_t numVisible = 0U;
+		for ( size_t i = 0U; i < bounds.Size(); i++ )
+		{
+			if ( !inOutVisible[i] )
+			{
+				continue;
+			}
+
+			const adm::Vec3 centre = { bounds.centreX[i], bounds.centreY[i], bounds.centreZ[i] };
+			const adm::Vec3 extent = { bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i] };
+			inOutVisible[i] = IsBoxVisible( centre - extent, centre + extent );
+
+			numVisible += inOutVisible[i];
+			CurrentStats.numBoxesTested++;
+			CurrentStats.numBoxesOccluded += !inOutVisible[i];
+		}
+
+		CurrentStats.testMilliseconds += timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0;
+		return numVisible;
+	}
+
+	void RasteriseReference( std::vector<float>& outDepth )
+	{
+		outDepth.assign( Width * Height, 0.0f );
+
+		for ( const ScreenTriangle& t : Triangles )
+		{
+			const double area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+
+			// Twice the signed area of (a, b, p), the same sign as 'area' when p is on the inside of edge ab
+			const auto edge = [&t]( int a, int b, double px, double py )
+			{
+				return (t.x[b] - t.x[a]) * (py - t.y[a]) - (px - t.x[a]) * (t.y[b] - t.y[a]);
+			};
+
+			for ( uint32_t y = 0U; y < Height; y++ )
+			{
+				for ( uint32_t x = 0U; x < Width; x++ )
+				{
+					// A pixel is covered if all four of its corners are, and its depth is the farthest of theirs
+					bool covered = true;
+					double depth = std::numeric_limits<double>::max();
+					for ( int corner = 0; corner < 4 && covered; corner++ )
+					{
+						const double px = double( x + (corner & 1) );
+						const double py = double( y + (corner >> 1) );
+						const double e0 = edge( 1, 2, px, py ) / area;
+						const double e1 = edge( 2, 0, px, py ) / area;
+						const double e2 = edge( 0, 1, px, py ) / area;
+						covered = e0 >= 0.0 && e1 >= 0.0 && e2 >= 0.0;
+						depth = std::min( depth, e0 * t.depth[0] + e1 * t.depth[1] + e2 * t.depth[2] );
+					}
+
+					if ( covered )
+					{
+						outDepth[y * Width + x] = std::max( outDepth[y * Width + x], float( depth ) );
+					}
+				}
+			}
+		}
+	}
+
+	bool IsBoxVisibleReference( const adm::Vec3& boundsMin, const adm::Vec3& boundsMax, const std::vector<float>& depth )
+	{
+		int32_t minX, minY, maxX, maxY;
+		float nearestDepth;
+		if ( !ProjectBox( boundsMin, boundsMax, minX, minY, maxX, maxY, nearestDepth ) )
+		{
+			return true;
+		}
+
+		for ( int32_t y = minY; y <= maxY; y++ )
+		{
+			for ( int32_t x = minX; x <= maxX; x++ )
+			{
+				if ( depth[y * Width + x] <= nearestDepth )
+				{
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	const float* GetDepth()
+	{
+		return Levels[0].data();
+	}
+
+	Stats GetStats()
+	{
+		return CurrentStats;
+	}
+}
@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+
+#include <condition_variable>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+
+namespace PipelineCompiler
+{
+	enum class State : uint8_t
+	{
+		Queued,
+		Compiling,
+		Ready,
+		Failed
+	};
+
+	struct Entry
+	{
+		std::string name;
+		nvrhi::GraphicsPipelineDesc desc;
+		nvrhi::FramebufferHandle framebuffer;
+		nvrhi::GraphicsPipelineHandle pipeline;
+		State state{ State::Queued };
+		double milliseconds{};
+	};
+
+	// Pointers, so an entry stays put while the list grows under a job that's compiling it
+	static std::vector<std::unique_ptr<Entry>> Entries;
+	static std::mutex Mutex;
+	static std::condition_variable Done;
+	static Stats CompilerStats;
+	static adm::TimerPreciseDouble BatchTimer;
+
+	static bool IsDone( State state )
+	{
+		return state == State::Ready || state == State::Failed;
+	}
+
+	static void Compile( Id id )
+	{
+		nvrhi::GraphicsPipelineDesc desc;
+		nvrhi::FramebufferHandle framebuffer;
+		{
+			std::lock_guard<std::mutex> lock( Mutex );
+			Entry& entry = *Entries[id];
+			entry.state = State::Compiling;
+			desc = entry.desc;
+			framebuffer = entry.framebuffer;
+		}
+
+		// The object cache makes it so permutations that turn out identical are only created once
+		adm::TimerPreciseDouble timer;
+		nvrhi::GraphicsPipelineHandle pipeline = ObjectCache::GetGraphicsPipeline( desc, framebuffer );
+		const double milliseconds = timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0;
+
+		{
+			std::lock_guard<std::mutex> lock( Mutex );
+			Entry& entry = *Entries[id];
+			entry.pipeline = pipeline;
+			entry.state = nullptr != pipeline ? State::Ready : State::Failed;
+			entry.milliseconds = milliseconds;
+			entry.framebuffer = nullptr;
+
+			CompilerStats.numReady += nullptr != pipeline;
+			CompilerStats.numFailed += nullptr == pipeline;
+			CompilerStats.compileMilliseconds += milliseconds;
+			CompilerStats.longestCompileMilliseconds = std::max( CompilerStats.longestCompileMilliseconds, milliseconds );
+			CompilerStats.queueDepth--;
+
+			if ( nullptr == pipeline )
+			{
+				std::cout << "PipelineCompiler: couldn't create pipeline '" << entry.name << "'" << std::endl;
+			}
+
+			if ( 0U == CompilerStats.queueDepth )
+			{
+				CompilerStats.batchMilliseconds = BatchTimer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0;
+				std::cout << "PipelineCompiler: " << CompilerStats.numReady << " pipelines ready after "
+					<< CompilerStats.batchMilliseconds << " ms" << std::endl;
+			}
+		}
+
+		Done.notify_all();
+	}
+
+	Id Declare( const char* name, const nvrhi::GraphicsPipelineDesc& desc, nvrhi::IFramebuffer* framebuffer )
+	{
+		Id id;
+		{
+			std::lock_guard<std::mutex> lock( Mutex );
+			id = Entries.size();
+			Entries.push_back( std::make_unique<Entry>() );
+			Entry& entry = *Entries.back();
+			entry.name = name;
+			entry.desc = desc;
+			entry.framebuffer = framebuffer;
+
+			if ( 0U == CompilerStats.queueDepth )
+			{
+				BatchTimer.Reset();
+			}
+
+			CompilerStats.numDeclared++;
+			CompilerStats.queueDepth++;
+			CompilerStats.maxQueueDepth = std::max( CompilerStats.maxQueueDepth, CompilerStats.queueDepth );
+		}
+
+		// By now the level has usually queued all of its texture decoding, and the first frame needs these first
+		Jobs::SubmitAhead( [id]()
+			{
+				Compile( id );
+			} );
+
+		return id;
+	}
+
+	nvrhi::GraphicsPipelineHandle Get( Id id )
+	{
+		std::lock_guard<std::mutex> lock( Mutex );
+		if ( id >= Entries.size() )
+		{
+			return nullptr;
+		}
+
+		return Entries[id]->pipeline;
+	}
+
+	nvrhi::GraphicsPipelineHandle Wait( Id id )
+	{
+		std::unique_lock<std::mutex> lock( Mutex );
+		if ( id >= Entries.size() )
+		{
+			return nullptr;
+		}
+
+		Done.wait( lock, [id]()
+			{
+				return IsDone( Entries[id]->state );
+			} );
+
+		return Entries[id]->pipeline;
+	}
+
+	void WaitForAll()
+	{
+		std::unique_lock<std::mutex> lock( Mutex );
+		Done.wait( lock, []()
+			{
+				return 0U == CompilerStats.queueDepth;
+			} );
+	}
+
+	uint32_t GetQueueDepth()
+	{
+		std::lock_guard<std::mutex> lock( Mutex );
+		return CompilerStats.queueDepth;
+	}
+
+	void Shutdown()
+	{
+		WaitForAll();
+
+		std::lock_guard<std::mutex> lock( Mutex );
+		Entries.clear();
+	}
+
+	Stats GetStats()
+	{
+		std::lock_guard<std::mutex> lock( Mutex );
+		return CompilerStats;
+	}
+
+	void PrintStats()
+	{
+		std::lock_guard<std::mutex> lock( Mutex );
+		const Stats& stats = CompilerStats;
+
+		std::cout << "Pipeline compiler:" << std::endl
+			<< "  * Pipelines:        " << stats.numReady << " of " << stats.numDeclared << " ready, " << stats.numFailed << " failed" << std::endl
+			<< "  * Queue:            " << stats.queueDepth << " waiting, at most " << stats.maxQueueDepth << std::endl
+			<< "  * Compiling:        " << stats.compileMilliseconds << " ms in total, " << stats.longestCompileMilliseconds << " ms longest, "
+			<< stats.batchMilliseconds << " ms for the last batch" << std::endl;
+
+		for ( const auto& entry : Entries )
+		{
+			std::cout << "    - " << std::setw( 24 ) << std::left << entry->name << std::right;
+			switch ( entry->state )
+			{
+			case State::Queued: std::cout << "queued"; break;
+			case State::Compiling: std::cout << "compiling"; break;
+			case State::Ready: std::cout << entry->milliseconds << " ms"; break;
+			case State::Failed: std::cout << "failed"; break;
+			}
+			std::cout << std::endl;
+		}
+	}
+}
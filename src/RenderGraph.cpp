@@ -0,0 +1,495 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+
+namespace RenderGraph
+{
+	using RStates = nvrhi::ResourceStates;
+
+	static bool HasState( RStates states, RStates state )
+	{
+		return (uint32_t( states ) & uint32_t( state )) != 0U;
+	}
+
+	// Everything that decides whether two transient textures can live in the same physical one
+	static bool IsCompatible( const nvrhi::TextureDesc& a, const nvrhi::TextureDesc& b )
+	{
+		return a.width == b.width && a.height == b.height && a.depth == b.depth
+			&& a.arraySize == b.arraySize && a.mipLevels == b.mipLevels
+			&& a.sampleCount == b.sampleCount && a.sampleQuality == b.sampleQuality
+			&& a.format == b.format && a.dimension == b.dimension
+			&& a.isRenderTarget == b.isRenderTarget && a.isUAV == b.isUAV && a.isTypeless == b.isTypeless;
+	}
+
+	// The graph tracks their states itself, across frames too
+	static nvrhi::TextureDesc MakePhysicalDesc( const nvrhi::TextureDesc& desc )
+	{
+		nvrhi::TextureDesc physicalDesc = desc;
+		physicalDesc.keepInitialState = false;
+		physicalDesc.initialState = RStates::Common;
+		physicalDesc.isVirtual = false;
+		return physicalDesc;
+	}
+
+	nvrhi::ITexture* PassContext::GetTexture( ResourceId resource ) const
+	{
+		return graph->GetTexture( resource );
+	}
+
+	nvrhi::IFramebuffer* PassContext::GetFramebuffer() const
+	{
+		return graph->passes[pass].framebuffer;
+	}
+
+	void PassContext::Begin( nvrhi::ICommandList* commandList ) const
+	{
+		const Graph::Pass& graphPass = graph->passes[pass];
+		for ( const Transition& transition : graphPass.states )
+		{
+			commandList->beginTrackingTextureState( graph->pool[transition.physical].texture, nvrhi::AllSubresources, transition.before );
+		}
+
+		if ( graphPass.numTransitions == 0U )
+		{
+			return;
+		}
+
+		for ( const Transition& transition : graphPass.states )
+		{
+			if ( transition.before != transition.after )
+			{
+				commandList->setTextureState( graph->pool[transition.physical].texture, nvrhi::AllSubresources, transition.after );
+			}
+		}
+		commandList->commitBarriers();
+	}
+
+	void PassContext::Track( nvrhi::ICommandList* commandList ) const
+	{
+		for ( const Transition& transition : graph->passes[pass].states )
+		{
+			commandList->beginTrackingTextureState( graph->pool[transition.physical].texture, nvrhi::AllSubresources, transition.after );
+		}
+	}
+
+	void PassContext::End( nvrhi::ICommandList* commandList ) const
+	{
+		const Graph::Pass& graphPass = graph->passes[pass];
+		if ( graphPass.states.empty() )
+		{
+			return;
+		}
+
+		for ( const Transition& transition : graphPass.states )
+		{
+			commandList->setTextureState( graph->pool[transition.physical].texture, nvrhi::AllSubresources, transition.after );
+		}
+		commandList->commitBarriers();
+	}
+
+	void Graph::Reset()
+	{
+		resources.clear();
+		passes.clear();
+	}
+
+	void Graph::Clear()
+	{
+		Reset();
+		framebuffers.clear();
+		for ( const PhysicalTexture& physical : pool )
+		{
+			if ( nullptr != physical.texture )
+			{
+				Memory::Track( Memory::Category::RenderTargets, 0, -int64_t( physical.bytes ), -1 );
+			}
+		}
+		pool.clear();
+	}
+
+	ResourceId Graph::CreateTexture( const nvrhi::TextureDesc& desc )
+	{
+		Resource resource;
+		resource.desc = MakePhysicalDesc( desc );
+		resources.push_back( resource );
+		return resources.size() - 1U;
+	}
+
+	ResourceId Graph::ImportTexture( nvrhi::ITexture* texture )
+	{
+		Resource resource;
+		resource.imported = texture;
+		resource.isImported = true;
+		resources.push_back( resource );
+		return resources.size() - 1U;
+	}
+
+	uint32_t Graph::AddPass( const char* name, std::function<void( PassContext& )> execute )
+	{
+		Pass pass;
+		pass.name = name;
+		pass.execute = std::move( execute );
+		passes.push_back( std::move( pass ) );
+		return passes.size() - 1U;
+	}
+
+	// A pass that touches the same texture twice, e.g. depth as DepthRead and ShaderResource, needs both states at once
+	static void AddAccess( std::vector<Access>& accesses, ResourceId resource, RStates state, bool write )
+	{
+		for ( Access& access : accesses )
+		{
+			if ( access.resource == resource )
+			{
+				access.state = access.state | state;
+				access.read |= !write;
+				access.write |= write;
+				return;
+			}
+		}
+
+		accesses.push_back( { resource, state, !write, write } );
+	}
+
+	void Graph::Read( uint32_t pass, ResourceId resource, RStates state )
+	{
+		AddAccess( passes[pass].accesses, resource, state, false );
+	}
+
+	void Graph::Write( uint32_t pass, ResourceId resource, RStates state )
+	{
+		AddAccess( passes[pass].accesses, resource, state, true );
+	}
+
+	// Walks backwards from the passes writing imported textures, a pass is needed if a needed pass after it reads what it writes
+	// Writing a texture that something later overwrites before reading still counts, which is conservative but never wrong
+	void Graph::CullPasses()
+	{
+		std::vector<uint8_t> needed( resources.size(), 0U );
+		for ( size_t i = passes.size(); i-- > 0U; )
+		{
+			Pass& pass = passes[i];
+
+			pass.culled = true;
+			for ( const Access& access : pass.accesses )
+			{
+				if ( access.write && (resources[access.resource].isImported || needed[access.resource]) )
+				{
+					pass.culled = false;
+					break;
+				}
+			}
+
+			if ( pass.culled )
+			{
+				stats.numCulledPasses++;
+				continue;
+			}
+
+			for ( const Access& access : pass.accesses )
+			{
+				if ( access.read )
+				{
+					needed[access.resource] = 1U;
+				}
+			}
+		}
+	}
+
+	void Graph::ReleaseIdleTextures()
+	{
+		for ( size_t i = pool.size(); i-- > 0U; )
+		{
+			PhysicalTexture& physical = pool[i];
+			if ( frameIndex - physical.lastUsedFrame <= MaxIdleFrames )
+			{
+				continue;
+			}
+
+			// Along with every framebuffer that has it attached
+			framebuffers.erase( std::remove_if( framebuffers.begin(), framebuffers.end(), [&physical]( const CachedFramebuffer& cached )
+				{
+					return std::find( cached.attachments.begin(), cached.attachments.end(), physical.texture.Get() ) != cached.attachments.end();
+				} ), framebuffers.end() );
+
+			if ( nullptr != physical.texture )
+			{
+				Memory::Track( Memory::Category::RenderTargets, 0, -int64_t( physical.bytes ), -1 );
+			}
+
+			pool.erase( pool.begin() + i );
+			stats.numReleasedTextures++;
+		}
+	}
+
+	// Prefers a free texture that's already in the state the first pass wants, which saves a transition
+	uint32_t Graph::AcquirePhysical( nvrhi::IDevice* device, const nvrhi::TextureDesc& desc, RStates firstState )
+	{
+		uint32_t found = InvalidResource;
+		for ( uint32_t i = 0U; i < pool.size(); i++ )
+		{
+			const PhysicalTexture& physical = pool[i];
+			if ( physical.inUse || !IsCompatible( physical.desc, desc ) )
+			{
+				continue;
+			}
+
+			if ( InvalidResource == found || physical.state == firstState )
+			{
+				found = i;
+			}
+			if ( physical.state == firstState )
+			{
+				break;
+			}
+		}
+
+		if ( InvalidResource == found )
+		{
+			PhysicalTexture physical;
+			physical.desc = desc;
+			physical.bytes = Memory::EstimateTextureBytes( desc );
+			if ( nullptr != device )
+			{
+				physical.texture = device->createTexture( desc );
+				if ( Check( physical.texture, "Failed to create a render graph texture" ) )
+				{
+					Memory::Track( Memory::Category::RenderTargets, 0, physical.bytes, 1 );
+				}
+			}
+
+			pool.push_back( physical );
+			found = pool.size() - 1U;
+			stats.numCreatedTextures++;
+		}
+
+		pool[found].inUse = true;
+		pool[found].lastUsedFrame = frameIndex;
+		return found;
+	}
+
+	void Graph::Compile( nvrhi::IDevice* device )
+	{
+		adm::TimerPreciseDouble timer;
+
+		frameIndex++;
+		stats = Stats();
+		stats.numPasses = passes.size();
+
+		CullPasses();
+
+		// Lifetimes, and the flags the passes need
+		for ( uint32_t i = 0U; i < passes.size(); i++ )
+		{
+			if ( passes[i].culled )
+			{
+				continue;
+			}
+
+			for ( const Access& access : passes[i].accesses )
+			{
+				Resource& resource = resources[access.resource];
+				if ( resource.isImported )
+				{
+					continue;
+				}
+
+				resource.firstPass = std::min( resource.firstPass, i );
+				resource.lastPass = std::max( resource.lastPass, i );
+				resource.desc.isRenderTarget |= HasState( access.state, RStates::RenderTarget | RStates::DepthWrite | RStates::DepthRead );
+				resource.desc.isUAV |= HasState( access.state, RStates::UnorderedAccess );
+			}
+		}
+
+		for ( PhysicalTexture& physical : pool )
+		{
+			physical.inUse = false;
+		}
+		ReleaseIdleTextures();
+
+		// Textures go back into the pool after their last pass, so the next pass can pick them up, then work out the transitions
+		for ( uint32_t i = 0U; i < passes.size(); i++ )
+		{
+			Pass& pass = passes[i];
+			pass.states.clear();
+			pass.numTransitions = 0U;
+			pass.framebuffer = nullptr;
+			if ( pass.culled )
+			{
+				continue;
+			}
+
+			for ( const Access& access : pass.accesses )
+			{
+				Resource& resource = resources[access.resource];
+				if ( resource.isImported )
+				{
+					continue;
+				}
+
+				if ( resource.firstPass == i )
+				{
+					resource.physical = AcquirePhysical( device, resource.desc, access.state );
+					stats.numTransientTextures++;
+					stats.transientBytes += Memory::EstimateTextureBytes( resource.desc );
+				}
+
+				PhysicalTexture& physical = pool[resource.physical];
+				pass.states.push_back( { resource.physical, physical.state, access.state } );
+				pass.numTransitions += physical.state != access.state;
+				physical.state = access.state;
+			}
+
+			for ( const Access& access : pass.accesses )
+			{
+				const Resource& resource = resources[access.resource];
+				if ( !resource.isImported && resource.lastPass == i )
+				{
+					pool[resource.physical].inUse = false;
+				}
+			}
+
+			stats.numTransitions += pass.numTransitions;
+			stats.numBarrierBatches += pass.numTransitions != 0U;
+		}
+
+		for ( const PhysicalTexture& physical : pool )
+		{
+			if ( physical.lastUsedFrame == frameIndex )
+			{
+				stats.numPhysicalTextures++;
+				stats.physicalBytes += physical.bytes;
+			}
+		}
+
+		// Passes drawing into imported textures bring their own framebuffers
+		if ( nullptr != device )
+		{
+			for ( Pass& pass : passes )
+			{
+				std::vector<nvrhi::ITexture*> colourAttachments;
+				nvrhi::ITexture* depthAttachment = nullptr;
+				bool transientOnly = true;
+				for ( const Access& access : pass.accesses )
+				{
+					const Resource& resource = resources[access.resource];
+					if ( !access.write || !HasState( access.state, RStates::RenderTarget | RStates::DepthWrite ) )
+					{
+						continue;
+					}
+
+					transientOnly &= !resource.isImported;
+					if ( HasState( access.state, RStates::DepthWrite ) )
+					{
+						depthAttachment = GetTexture( access.resource );
+					}
+					else
+					{
+						colourAttachments.push_back( GetTexture( access.resource ) );
+					}
+				}
+
+				if ( !pass.culled && transientOnly && (!colourAttachments.empty() || nullptr != depthAttachment) )
+				{
+					pass.framebuffer = GetFramebuffer( device, colourAttachments, depthAttachment );
+				}
+			}
+		}
+
+		stats.compileMilliseconds = timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0;
+	}
+
+	void Graph::Execute()
+	{
+		for ( uint32_t i = 0U; i < passes.size(); i++ )
+		{
+			if ( passes[i].culled )
+			{
+				continue;
+			}
+
+			PassContext context;
+			context.graph = this;
+			context.pass = i;
+			passes[i].execute( context );
+		}
+	}
+
+	nvrhi::ITexture* Graph::Reserve( nvrhi::IDevice* device, const nvrhi::TextureDesc& desc )
+	{
+		const uint32_t physical = AcquirePhysical( device, MakePhysicalDesc( desc ), RStates::Common );
+		pool[physical].inUse = false;
+		return pool[physical].texture;
+	}
+
+	nvrhi::IFramebuffer* Graph::GetFramebuffer( nvrhi::IDevice* device, const std::vector<nvrhi::ITexture*>& colourAttachments, nvrhi::ITexture* depthAttachment )
+	{
+		std::vector<nvrhi::ITexture*> attachments = colourAttachments;
+		attachments.push_back( depthAttachment );
+
+		for ( const CachedFramebuffer& cached : framebuffers )
+		{
+			if ( cached.attachments == attachments )
+			{
+				return cached.framebuffer;
+			}
+		}
+
+		auto framebufferDesc = nvrhi::FramebufferDesc();
+		for ( nvrhi::ITexture* texture : colourAttachments )
+		{
+			framebufferDesc.addColorAttachment( texture );
+		}
+		if ( nullptr != depthAttachment )
+		{
+			framebufferDesc.setDepthAttachment( depthAttachment );
+		}
+
+		CachedFramebuffer cached;
+		cached.attachments = std::move( attachments );
+		cached.framebuffer = device->createFramebuffer( framebufferDesc );
+		if ( !Check( cached.framebuffer, "Failed to create a render graph framebuffer" ) )
+		{
+			return nullptr;
+		}
+
+		framebuffers.push_back( cached );
+		return cached.framebuffer;
+	}
+
+	bool Graph::IsPassCulled( uint32_t pass ) const
+	{
+		return passes[pass].culled;
+	}
+
+	uint32_t Graph::GetPhysicalIndex( ResourceId resource ) const
+	{
+		return resources[resource].physical;
+	}
+
+	nvrhi::ITexture* Graph::GetTexture( ResourceId resource ) const
+	{
+		const Resource& graphResource = resources[resource];
+		if ( graphResource.isImported )
+		{
+			return graphResource.imported;
+		}
+
+		return InvalidResource != graphResource.physical ? pool[graphResource.physical].texture.Get() : nullptr;
+	}
+
+	const std::vector<Transition>& Graph::GetTransitions( uint32_t pass ) const
+	{
+		return passes[pass].states;
+	}
+
+	void Graph::PrintStats() const
+	{
+		std::cout << "Render graph:" << std::endl
+			<< "  * Passes:           " << stats.numPasses << " (" << stats.numCulledPasses << " culled)" << std::endl
+			<< "  * Textures:         " << stats.numTransientTextures << " transient in " << stats.numPhysicalTextures << " physical, "
+			<< pool.size() << " pooled" << std::endl
+			<< "  * Memory:           " << stats.physicalBytes / 1024U << " kB instead of " << stats.transientBytes / 1024U << " kB" << std::endl
+			<< "  * Transitions:      " << stats.numTransitions << " in " << stats.numBarrierBatches << " batches" << std::endl
+			<< "  * Compile:          " << stats.compileMilliseconds << " ms" << std::endl;
+	}
+}
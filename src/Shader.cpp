@@ -2,35 +2,289 @@
 
 #include "Common.hpp"
 
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
 namespace Shader
 {
-	bool LoadShaderBinary( const char* fileName, ShaderBinary& outShaderBinary )
+	constexpr char PackMagic[4] = { 'N', 'S', 'H', 'P' };
+	constexpr uint32_t PackVersion = 1U;
+	// Bytecode is used in place, and some drivers want it at least 4-byte aligned
+	constexpr uint64_t PackAlignment = 16U;
+	constexpr const char* Backends[] = { "dx11", "dx12", "vk" };
+
+	struct PackHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t numEntries;
+		uint32_t stringTableSize;
+	};
+
+	// Right after the header, sorted by hash, followed by the names
+	struct PackEntry
+	{
+		uint64_t nameHash;
+		uint32_t nameOffset;
+		uint32_t nameLength;
+		uint64_t dataOffset;
+		uint64_t size;
+	};
+
+	static std::shared_ptr<FileSystem::MappedFile> PackFile;
+	static const PackEntry* PackEntries = nullptr;
+	static const char* PackNames = nullptr;
+	static uint32_t NumPackEntries = 0U;
+
+	// FNV-1a
+	static uint64_t HashName( const std::string& name )
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		for ( const char c : name )
+		{
+			hash ^= uint8_t( c );
+			hash *= 1099511628211ULL;
+		}
+
+		return hash;
+	}
+
+	static const PackEntry* FindInPack( const std::string& name )
 	{
-		outShaderBinary.clear();
+		const uint64_t hash = HashName( name );
+		const PackEntry* end = PackEntries + NumPackEntries;
+		const PackEntry* entry = std::lower_bound( PackEntries, end, hash, []( const PackEntry& entry, uint64_t hash )
+			{
+				return entry.nameHash < hash;
+			} );
 
-		std::ifstream file( fileName, std::ios::binary | std::ios::ate );
-		if ( !file )
+		if ( entry == end || entry->nameHash != hash || name.compare( 0, std::string::npos, PackNames + entry->nameOffset, entry->nameLength ) )
+		{
+			return nullptr;
+		}
+
+		return entry;
+	}
+
+	// Every line of shaders.cfg is "file.hlsl -T profile -E entry", and NVRHI-SC names the binary file_entry.bin
+	static bool ReadConfig( const std::string& configPath, std::vector<std::string>& outBinaryFiles )
+	{
+		std::ifstream config( configPath );
+		if ( !config )
 		{
-			std::cout << "Renderer::Shader::LoadShaderBinary: Cannot load " << fileName << " (doesn't exist)" << std::endl;
 			return false;
 		}
 
-		size_t fileSize = file.tellg();
-		file.seekg( 0U );
+		std::string line;
+		while ( std::getline( config, line ) )
+		{
+			std::istringstream tokens( line );
+			std::string sourceFile, token, entryName;
+			if ( !(tokens >> sourceFile) )
+			{
+				continue;
+			}
 
-		outShaderBinary.reserve( fileSize );
+			while ( tokens >> token )
+			{
+				if ( token == "-E" )
+				{
+					tokens >> entryName;
+				}
+			}
 
-		// If only this could be done in one line...
-		uint8_t* data = new uint8_t[fileSize];
-		file.read( reinterpret_cast<char*>(data), fileSize );
-		outShaderBinary.insert( outShaderBinary.begin(), data, data + fileSize );
-		delete[] data;
+			const size_t extension = sourceFile.find_last_of( '.' );
+			if ( entryName.empty() || extension == std::string::npos )
+			{
+				std::cout << "Shader::BuildPack: skipping '" << line << "', it has no entry point" << std::endl;
+				continue;
+			}
+
+			outBinaryFiles.push_back( sourceFile.substr( 0, extension ) + "_" + entryName + ".bin" );
+		}
+
+		return true;
+	}
+
+	bool BuildPack( const char* shaderDirectory, const char* packPath )
+	{
+		std::vector<std::string> binaryFiles;
+		if ( !ReadConfig( std::string( shaderDirectory ) + "/shaders.cfg", binaryFiles ) )
+		{
+			std::cout << "Shader::BuildPack: cannot read '" << shaderDirectory << "/shaders.cfg'" << std::endl;
+			return false;
+		}
+
+		std::ofstream pack( packPath, std::ios::binary );
+		if ( !pack )
+		{
+			std::cout << "Shader::BuildPack: cannot write '" << packPath << "'" << std::endl;
+			return false;
+		}
+
+		// Names and data first, the table goes in front of the data once it's known how big it is
+		struct Binary
+		{
+			std::string name;
+			FileSystem::MappedFile file;
+		};
+		std::vector<std::unique_ptr<Binary>> binaries;
+		for ( const char* backend : Backends )
+		{
+			for ( const std::string& binaryFile : binaryFiles )
+			{
+				auto binary = std::make_unique<Binary>();
+				binary->name = std::string( backend ) + "/" + binaryFile;
+				// Not every backend has to have every permutation, e.g. when the compiler wasn't run for it
+				if ( !binary->file.Open( (std::string( shaderDirectory ) + "/" + binary->name).c_str() ) || 0U == binary->file.GetSize() )
+				{
+					std::cout << "  " << binary->name << ": missing, skipped" << std::endl;
+					continue;
+				}
+
+				binaries.push_back( std::move( binary ) );
+			}
+		}
+
+		if ( binaries.empty() )
+		{
+			std::cout << "Shader::BuildPack: no compiled shaders in '" << shaderDirectory << "'" << std::endl;
+			return false;
+		}
 
-		file.close();
+		std::vector<PackEntry> entries;
+		std::string stringTable;
+		for ( const auto& binary : binaries )
+		{
+			PackEntry entry{};
+			entry.nameHash = HashName( binary->name );
+			entry.nameOffset = stringTable.size();
+			entry.nameLength = binary->name.size();
+			entry.size = binary->file.GetSize();
+			entries.push_back( entry );
+			stringTable += binary->name;
+		}
+
+		const auto alignUp = []( uint64_t offset )
+		{
+			return (offset + PackAlignment - 1U) / PackAlignment * PackAlignment;
+		};
+
+		uint64_t offset = alignUp( sizeof( PackHeader ) + entries.size() * sizeof( PackEntry ) + stringTable.size() );
+		for ( size_t i = 0U; i < entries.size(); i++ )
+		{
+			entries[i].dataOffset = offset;
+			offset = alignUp( offset + entries[i].size );
+		}
+
+		// The data stays in config order, only the table is sorted
+		std::vector<PackEntry> sortedEntries = entries;
+		std::sort( sortedEntries.begin(), sortedEntries.end(), []( const PackEntry& a, const PackEntry& b )
+			{
+				return a.nameHash < b.nameHash;
+			} );
+		for ( size_t i = 1U; i < sortedEntries.size(); i++ )
+		{
+			if ( sortedEntries[i].nameHash == sortedEntries[i - 1U].nameHash )
+			{
+				std::cout << "Shader::BuildPack: two shader names have the same hash, rename one of them" << std::endl;
+				return false;
+			}
+		}
+
+		PackHeader header{};
+		std::memcpy( header.magic, PackMagic, sizeof( PackMagic ) );
+		header.version = PackVersion;
+		header.numEntries = sortedEntries.size();
+		header.stringTableSize = stringTable.size();
+		pack.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+		pack.write( reinterpret_cast<const char*>( sortedEntries.data() ), sortedEntries.size() * sizeof( PackEntry ) );
+		pack.write( stringTable.data(), stringTable.size() );
+
+		uint64_t totalSize = 0U;
+		for ( size_t i = 0U; i < entries.size(); i++ )
+		{
+			static const char Zeroes[PackAlignment]{};
+			pack.write( Zeroes, entries[i].dataOffset - uint64_t( pack.tellp() ) );
+			pack.write( reinterpret_cast<const char*>( binaries[i]->file.GetData() ), entries[i].size );
+			totalSize += entries[i].size;
+
+			std::cout << "  " << binaries[i]->name << ": " << entries[i].size << " bytes" << std::endl;
+		}
+
+		std::cout << "Shader::BuildPack: packed " << entries.size() << " shaders, " << totalSize << " bytes into '" << packPath << "'" << std::endl;
+		return pack.good();
+	}
+
+	bool OpenPack( const char* packPath )
+	{
+		ClosePack();
+
+		auto packFile = std::make_shared<FileSystem::MappedFile>();
+		if ( !packFile->Open( packPath ) )
+		{
+			return false;
+		}
+
+		const uint8_t* packData = packFile->GetData();
+		const size_t packSize = packFile->GetSize();
+		const PackHeader* header = reinterpret_cast<const PackHeader*>( packData );
+		if ( packSize < sizeof( PackHeader ) || std::memcmp( header->magic, PackMagic, sizeof( PackMagic ) ) || header->version != PackVersion
+			|| packSize < sizeof( PackHeader ) + uint64_t( header->numEntries ) * sizeof( PackEntry ) + header->stringTableSize )
+		{
+			std::cout << "Shader::OpenPack: '" << packPath << "' is not a valid shader pack" << std::endl;
+			return false;
+		}
+
+		const PackEntry* entries = reinterpret_cast<const PackEntry*>( packData + sizeof( PackHeader ) );
+		for ( uint32_t i = 0U; i < header->numEntries; i++ )
+		{
+			if ( entries[i].dataOffset + entries[i].size > packSize || entries[i].nameOffset + entries[i].nameLength > header->stringTableSize )
+			{
+				std::cout << "Shader::OpenPack: '" << packPath << "' is truncated" << std::endl;
+				return false;
+			}
+		}
+
+		PackEntries = entries;
+		PackNames = reinterpret_cast<const char*>( entries + header->numEntries );
+		NumPackEntries = header->numEntries;
+		PackFile = std::move( packFile );
+
+		std::cout << "Shader::OpenPack: " << NumPackEntries << " shaders in '" << packPath << "'" << std::endl;
+		return true;
+	}
+
+	void ClosePack()
+	{
+		PackFile = nullptr;
+		PackEntries = nullptr;
+		PackNames = nullptr;
+		NumPackEntries = 0U;
+	}
+
+	bool Load( const char* backend, const char* binaryFile, FileSystem::FileData& outBytecode )
+	{
+		outBytecode = FileSystem::FileData();
+
+		const std::string name = std::string( backend ) + "/" + binaryFile;
+		if ( nullptr != PackFile )
+		{
+			if ( const PackEntry* entry = FindInPack( name ) )
+			{
+				outBytecode.data = PackFile->GetData() + entry->dataOffset;
+				outBytecode.size = entry->size;
+				outBytecode.mapping = PackFile;
+				return true;
+			}
+		}
 
-		if ( !outShaderBinary.size() || outShaderBinary.size() != fileSize )
+		// Loose files are mapped too, either way nothing gets copied
+		if ( !FileSystem::ReadFile( "assets/shaders/" + name, outBytecode ) || 0U == outBytecode.size )
 		{
-			std::cout << "Renderer::Shader::LoadShaderBinary: Cannot load " << fileName << " for unknown reasons" << std::endl;
+			std::cout << "Shader::Load: cannot load '" << name << "'" << std::endl;
+			outBytecode = FileSystem::FileData();
 			return false;
 		}
 
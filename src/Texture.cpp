@@ -2,23 +2,93 @@
 
 #include "Common.hpp"
 
+#include <atomic>
+
+namespace Texture
+{
+	// stb_image allocates through these, so we can tell how much memory decoding really takes
+	// Every block is prefixed with its size, padded to keep the alignment malloc gives us
+	constexpr size_t DecoderBlockHeader = 16U;
+	static std::atomic<uint64_t> DecoderBytes{ 0U };
+	static std::atomic<uint64_t> DecoderPeakBytes{ 0U };
+
+	static void* DecoderMalloc( size_t size )
+	{
+		uint8_t* block = static_cast<uint8_t*>( std::malloc( size + DecoderBlockHeader ) );
+		if ( nullptr == block )
+		{
+			return nullptr;
+		}
+
+		std::memcpy( block, &size, sizeof( size ) );
+
+		const uint64_t current = DecoderBytes += size;
+		uint64_t peak = DecoderPeakBytes.load();
+		while ( current > peak && !DecoderPeakBytes.compare_exchange_weak( peak, current ) )
+		{
+		}
+
+		return block + DecoderBlockHeader;
+	}
+
+	static void DecoderFree( void* pointer )
+	{
+		if ( nullptr == pointer )
+		{
+			return;
+		}
+
+		uint8_t* block = static_cast<uint8_t*>( pointer ) - DecoderBlockHeader;
+		size_t size;
+		std::memcpy( &size, block, sizeof( size ) );
+
+		DecoderBytes -= size;
+		std::free( block );
+	}
+
+	static void* DecoderRealloc( void* pointer, size_t size )
+	{
+		void* newPointer = DecoderMalloc( size );
+		if ( nullptr != pointer && nullptr != newPointer )
+		{
+			size_t oldSize;
+			std::memcpy( &oldSize, static_cast<uint8_t*>( pointer ) - DecoderBlockHeader, sizeof( oldSize ) );
+			std::memcpy( newPointer, pointer, std::min( oldSize, size ) );
+			DecoderFree( pointer );
+		}
+
+		return newPointer;
+	}
+
+	uint64_t GetDecoderPeakBytes()
+	{
+		return DecoderPeakBytes.load();
+	}
+
+	void ResetDecoderPeakBytes()
+	{
+		DecoderPeakBytes = DecoderBytes.load();
+	}
+}
+
+#define STBI_MALLOC( size ) Texture::DecoderMalloc( size )
+#define STBI_REALLOC( pointer, size ) Texture::DecoderRealloc( pointer, size )
+#define STBI_FREE( pointer ) Texture::DecoderFree( pointer )
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 namespace Texture
 {
-	void TextureData::Init( const char* fileName )
+	void TextureData::Init( const char* fileName, bool keepNativeComponents )
 	{
-		int x, y, comps;
-
 		// Try out BMP, JPG, JPEG, TGA and PNG
-		constexpr const char* ImageTypes[] =
+		static const std::vector<std::string> ImageTypes =
 		{
 			".bmp", ".jpg", ".jpeg", ".tga", ".png" };
 
-		data = stbi_load( fileName, &x, &y, &comps, 4 );
-
-		if ( nullptr == data )
+		// Ask the file index instead of probing the disk with every extension
+		std::string imagePath = fileName;
+		if ( !FileSystem::Exists( imagePath ) )
 		{
 			auto path = std::filesystem::path( fileName );
 			if ( path.has_extension() )
@@ -30,18 +100,29 @@ namespace Texture
 				path = path.parent_path() / path.filename();
 			}
 
-			std::string pathStr = path.string();
-
-			for ( const auto& imageType : ImageTypes )
+			if ( !FileSystem::FindWithExtensions( path.generic_string(), ImageTypes, imagePath ) )
 			{
-				std::string imagePath = pathStr + imageType;
-				if ( data = stbi_load( imagePath.c_str(), &x, &y, &comps, 4 ) )
-				{
-					break;
-				}
+				return;
 			}
 		}
 
+		FileSystem::FileData fileData;
+		if ( !FileSystem::ReadFile( imagePath, fileData ) )
+		{
+			return;
+		}
+
+		InitFromMemory( fileData.data, fileData.size, keepNativeComponents );
+	}
+
+	void TextureData::InitFromMemory( const uint8_t* fileData, size_t fileSize, bool keepNativeComponents )
+	{
+		int x, y, comps;
+
+		// Asking stb_image for 4 components makes it convert into yet another buffer,
+		// so RGB images are better off expanded by CopyRowsAsRgba while they're being uploaded
+		data = stbi_load_from_memory( fileData, int( fileSize ), &x, &y, &comps, keepNativeComponents ? 0 : 4 );
+
 		if ( nullptr == data )
 		{
 			return;
@@ -49,20 +130,66 @@ namespace Texture
 
 		width = x;
 		height = y;
-		components = 4;
+		components = keepNativeComponents ? comps : 4;
 		bytesPerComponent = 1;
 	}
 
+	void TextureData::CopyRowsAsRgba( uint8_t* destination, size_t rowPitch ) const
+	{
+		for ( uint32_t y = 0U; y < height; y++ )
+		{
+			const uint8_t* source = data + size_t( y ) * width * components;
+			uint8_t* row = destination + y * rowPitch;
+
+			// Same expansion rules as stb_image, grey goes into RGB and alpha defaults to opaque
+			switch ( components )
+			{
+			case 1:
+				for ( uint32_t x = 0U; x < width; x++, row += 4, source += 1 )
+				{
+					row[0] = row[1] = row[2] = source[0];
+					row[3] = 255U;
+				}
+				break;
+			case 2:
+				for ( uint32_t x = 0U; x < width; x++, row += 4, source += 2 )
+				{
+					row[0] = row[1] = row[2] = source[0];
+					row[3] = source[1];
+				}
+				break;
+			case 3:
+				for ( uint32_t x = 0U; x < width; x++, row += 4, source += 3 )
+				{
+					row[0] = source[0];
+					row[1] = source[1];
+					row[2] = source[2];
+					row[3] = 255U;
+				}
+				break;
+			default:
+				std::memcpy( row, source, width * 4U );
+				break;
+			}
+		}
+	}
+
 	TextureData::TextureData( TextureData&& texture ) noexcept
 	{
 		*this = std::move( texture );
 	}
 
 	TextureData::~TextureData()
+	{
+		Release();
+	}
+
+	void TextureData::Release()
 	{
 		if ( nullptr != data )
 		{
-			delete[] data;
+			// The pixels come from stbi_load or DecoderMalloc, so delete[] is not an option
+			stbi_image_free( data );
 			data = nullptr;
 		}
 	}
@@ -90,58 +217,106 @@ namespace Texture
 		return Format::RGBA8_UNORM;
 	}
 
+	nvrhi::TextureHandle CreateTextureObject( const std::vector<MipLevel>& mips, uint32_t firstMip, nvrhi::Format format, const char* debugName )
+	{
+		const MipLevel& topMip = mips[firstMip];
+
+		auto& textureDesc = nvrhi::TextureDesc()
+			.setDimension( nvrhi::TextureDimension::Texture2D )
+			.setWidth( topMip.width )
+			.setHeight( topMip.height )
+			.setMipLevels( mips.size() - firstMip )
+			.setFormat( format );
+
+		textureDesc.debugName = debugName;
+
+		auto textureObject = Renderer::Device->createTexture( textureDesc );
+
+		std::vector<Upload::TextureWrite> writes;
+		for ( uint32_t mip = firstMip; mip < mips.size(); mip++ )
+		{
+			// Only RGBA8 for now, and the uploader shares the pixels instead of copying them
+			const auto& pixels = mips[mip].pixels;
+			writes.push_back( { mip - firstMip, pixels->data(), mips[mip].width * 4U, pixels->size(), pixels } );
+		}
+		Upload::WriteTexture( textureObject, writes, nvrhi::ResourceStates::ShaderResource );
+
+		return textureObject;
+	}
+
 	nvrhi::static_vector<TextureData, 32U> TextureDatas;
 	nvrhi::static_vector<nvrhi::TextureHandle, 32U> TextureObjects;
 
-	int32_t FindOrCreateMaterial( const char* materialName )
+	static int32_t DefaultTextureHandle = -1;
+
+	// Claims a slot in TextureDatas and TextureObjects, which shows 'placeholder' until the real texture is created
+	static int32_t ReserveHandle( nvrhi::ITexture* placeholder )
 	{
-		TextureData textureData;
+		TextureDatas.push_back( TextureData() );
+		TextureObjects.push_back( placeholder );
 
+		return TextureObjects.size() - 1;
+	}
+
+	int32_t FindOrCreateMaterial( const char* materialName, Retention retention )
+	{
 		if ( nullptr != materialName )
 		{
-			textureData.Init( materialName );
-
-			if ( !textureData )
+			if ( DefaultTextureHandle < 0 )
 			{
-				return -1;
+				FindOrCreateMaterial( nullptr );
 			}
+
+			const int32_t textureHandle = ReserveHandle( TextureObjects[DefaultTextureHandle] );
+			Loader::Request( textureHandle, materialName, retention );
+
+			return textureHandle;
 		}
-		else
-		{
-			textureData.width = 16;
-			textureData.height = 16;
-			textureData.components = 4;
-			textureData.bytesPerComponent = 1;
-			const int stride = 16 * 4;
 
-			textureData.data = new uint8_t[16 * 16 * 4];
+		// No material, so this is the default texture, a procedural grid
+		TextureData textureData;
+		textureData.width = 16;
+		textureData.height = 16;
+		textureData.components = 4;
+		textureData.bytesPerComponent = 1;
+		const int stride = 16 * 4;
+
+		// Same allocator as stb_image, so TextureData::Release can free it
+		textureData.data = static_cast<uint8_t*>( DecoderMalloc( 16 * 16 * 4 ) );
 
-			for ( int y = 0; y < 16; y++ )
+		for ( int y = 0; y < 16; y++ )
+		{
+			for ( int x = 0; x < 16; x++ )
 			{
-				for ( int x = 0; x < 16; x++ )
+				uint8_t* pixel = &textureData.data[y * stride + x * 4];
+				pixel[0] = 50;
+				pixel[1] = 60;
+				pixel[2] = 50;
+				pixel[3] = 255;
+
+				if ( !(y % 4) || !(x % 4) )
+				{
+					pixel[0] = 240;
+					pixel[1] = 240;
+					pixel[2] = 240;
+				}
+				else
 				{
-					uint8_t* pixel = &textureData.data[y * stride + x * 4];
-					pixel[0] = 50;
-					pixel[1] = 60;
-					pixel[2] = 50;
-					pixel[3] = 255;
-
-					if ( !(y % 4) || !(x % 4) )
-					{
-						pixel[0] = 240;
-						pixel[1] = 240;
-						pixel[2] = 240;
-					}
-					else
-					{
-						pixel[0] -= 40.0f * std::sin( x / 5.0f );
-						pixel[1] += 50.0f * std::sin( y / 5.0f );
-						pixel[2] += 50.0f * std::sin( (x + y) / 5.0f );
-					}
+					pixel[0] -= 40.0f * std::sin( x / 5.0f );
+					pixel[1] += 50.0f * std::sin( y / 5.0f );
+					pixel[2] += 50.0f * std::sin( (x + y) / 5.0f );
 				}
 			}
 		}
 
+		DefaultTextureHandle = ReserveHandle( nullptr );
+		CreateFromData( DefaultTextureHandle, std::move( textureData ), "default", retention );
+
+		return DefaultTextureHandle;
+	}
+
+	uint64_t CreateFromData( int32_t textureHandle, TextureData&& textureData, const char* debugName, Retention retention )
+	{
 		// Diffuse texture
 		auto& textureDesc = nvrhi::TextureDesc()
 			.setDimension( nvrhi::TextureDimension::Texture2D )
@@ -149,23 +324,38 @@ namespace Texture
 			//.setInitialState( nvrhi::ResourceStates::Common | nvrhi::ResourceStates::ShaderResource )
 			.setWidth( textureData.width )
 			.setHeight( textureData.height )
-			.setFormat( textureData.GetNvrhiFormat() );
+			// Anything with fewer components is expanded on upload
+			.setFormat( nvrhi::Format::RGBA8_UNORM );
 
-		textureDesc.debugName = nullptr == materialName ? "default" : materialName;
+		textureDesc.debugName = debugName;
 
 		auto textureObject = Renderer::Device->createTexture( textureDesc );
 
-		Renderer::CommandList->open();
-		Renderer::CommandList->beginTrackingTextureState( textureObject, nvrhi::AllSubresources, nvrhi::ResourceStates::Common );
-		Renderer::CommandList->writeTexture( textureObject, 0, 0, textureData.data, textureData.GetNvrhiRowBytes() );
-		Renderer::CommandList->setPermanentTextureState( textureObject, nvrhi::ResourceStates::ShaderResource );
-		Renderer::CommandList->close();
+		const uint64_t cpuBytes = textureData.GetDataBytes();
+		Memory::Track( Memory::Category::Textures, cpuBytes, Memory::EstimateTextureBytes( textureDesc ), 1 );
 
-		Renderer::Device->executeCommandList( Renderer::CommandList );
+		// TextureDatas never moves its elements around, so the upload thread can safely hold onto this
+		TextureDatas[textureHandle] = std::move( textureData );
+		TextureData* uploadedData = &TextureDatas[textureHandle];
 
-		TextureDatas.push_back( std::move( textureData ) );
-		TextureObjects.push_back( std::move( textureObject ) );
+		// The pixels get expanded straight into the staging texture at its row pitch, instead of
+		// into a temporary buffer which writeTexture would then copy into its upload buffer again
+		// Once they're in there, nobody needs them anymore
+		const uint64_t uploadBytes = uint64_t( textureDesc.width ) * textureDesc.height * 4U;
+		Upload::FillTexture( textureObject, uploadBytes,
+			[uploadedData, retention, cpuBytes]( uint32_t mipLevel, uint8_t* destination, size_t rowPitch )
+			{
+				uploadedData->CopyRowsAsRgba( destination, rowPitch );
 
-		return TextureObjects.size() - 1;
+				if ( retention == Retention::ReleaseAfterUpload )
+				{
+					uploadedData->Release();
+					Memory::Track( Memory::Category::Textures, -int64_t( cpuBytes ), 0 );
+				}
+			}, nvrhi::ResourceStates::ShaderResource );
+
+		TextureObjects[textureHandle] = std::move( textureObject );
+
+		return uploadBytes;
 	}
 }
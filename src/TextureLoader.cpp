@@ -0,0 +1,191 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+
+#include <deque>
+
+namespace Texture::Loader
+{
+	// Everything a job thread hands back to the main thread
+	struct DecodedTexture
+	{
+		int32_t textureHandle{ -1 };
+		std::string name;
+		Retention retention{};
+		TextureData textureData;
+		// Only for streamed textures, building it is the slowest part so the job thread does it too
+		std::vector<MipLevel> mips;
+	};
+
+	static Jobs::CompletionQueue<DecodedTexture> Completions;
+	// Decoded, but didn't fit into a frame's budget yet
+	static std::deque<DecodedTexture> Backlog;
+	// Requested, but not decoded yet
+	static std::atomic<uint32_t> NumDecoding{ 0U };
+	// Set on shutdown, so jobs that haven't started yet skip the decoding
+	static std::atomic<bool> Cancelled{ false };
+
+	static uint64_t BudgetBytes = DefaultFrameBudgetBytes;
+	static double BudgetMilliseconds = DefaultFrameBudgetMilliseconds;
+
+	static FrameStats LastFrame;
+	static Stats Totals;
+	// How long the latest busy frames spent creating textures, for the percentiles
+	// A ring, so a long session doesn't keep every frame it ever had
+	static std::vector<double> BusyFrameMilliseconds;
+	static size_t NextBusyFrame = 0U;
+
+	// Runs on a job thread
+	static void Decode( DecodedTexture& decoded )
+	{
+		// Whoever keeps the pixels around expects RGBA, otherwise the expansion happens during the upload
+		decoded.textureData.Init( decoded.name.c_str(), decoded.retention == Retention::ReleaseAfterUpload );
+
+		// Big textures go through the streaming system, which only uploads their smallest mips for now
+		if ( decoded.textureData && Streaming::ShouldStream( decoded.textureData ) )
+		{
+			Streaming::GenerateMipChain( decoded.textureData, decoded.mips );
+
+			// Mip 0 was expanded into the chain, no need to hold onto both while waiting in the backlog
+			if ( decoded.retention == Retention::ReleaseAfterUpload )
+			{
+				decoded.textureData.Release();
+			}
+		}
+	}
+
+	void Request( int32_t textureHandle, const char* fileName, Retention retention )
+	{
+		NumDecoding++;
+		Totals.numRequests++;
+
+		DecodedTexture request;
+		request.textureHandle = textureHandle;
+		request.name = fileName;
+		request.retention = retention;
+
+		Jobs::Submit( [decoded = std::make_shared<DecodedTexture>( std::move( request ) )]
+			{
+				if ( !Cancelled )
+				{
+					Decode( *decoded );
+				}
+
+				Completions.Push( std::move( *decoded ) );
+				NumDecoding--;
+			} );
+	}
+
+	void SetFrameBudget( uint64_t bytes, double milliseconds )
+	{
+		BudgetBytes = bytes;
+		BudgetMilliseconds = milliseconds;
+	}
+
+	void Update()
+	{
+		adm::TimerPreciseDouble timer;
+		Completions.PopAll( Backlog );
+
+		FrameStats frame;
+		while ( !Backlog.empty() )
+		{
+			// Always let one through no matter how big it is, otherwise it would never make it
+			if ( frame.numCreated > 0U
+				&& (frame.uploadedBytes >= BudgetBytes || timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0 >= BudgetMilliseconds) )
+			{
+				break;
+			}
+
+			DecodedTexture decoded = std::move( Backlog.front() );
+			Backlog.pop_front();
+
+			if ( !decoded.textureData && decoded.mips.empty() )
+			{
+				std::cout << "Texture::Loader: cannot load '" << decoded.name << "', keeping the default texture" << std::endl;
+				Totals.numFailed++;
+				continue;
+			}
+
+			if ( decoded.mips.empty() )
+			{
+				frame.uploadedBytes += CreateFromData( decoded.textureHandle, std::move( decoded.textureData ), decoded.name.c_str(), decoded.retention );
+			}
+			else
+			{
+				frame.uploadedBytes += Streaming::CreateStreamedTexture( decoded.textureHandle, std::move( decoded.textureData ),
+					std::move( decoded.mips ), decoded.name.c_str(), decoded.retention );
+			}
+
+			// Surfaces were bound to the default texture until now
+			Model::UpdateTextureBindings( decoded.textureHandle );
+			frame.numCreated++;
+		}
+
+		frame.milliseconds = timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0;
+		frame.numWaiting = Backlog.size();
+		frame.numDecoding = NumDecoding;
+		LastFrame = frame;
+
+		if ( frame.numCreated > 0U )
+		{
+			Totals.numCreated += frame.numCreated;
+			Totals.uploadedBytes += frame.uploadedBytes;
+			Totals.numBusyFrames++;
+
+			if ( BusyFrameMilliseconds.size() < BusyFrameWindow )
+			{
+				BusyFrameMilliseconds.push_back( frame.milliseconds );
+			}
+			else
+			{
+				BusyFrameMilliseconds[NextBusyFrame] = frame.milliseconds;
+			}
+			NextBusyFrame = (NextBusyFrame + 1U) % BusyFrameWindow;
+		}
+	}
+
+	FrameStats GetFrameStats()
+	{
+		return LastFrame;
+	}
+
+	Stats GetStats()
+	{
+		Stats stats = Totals;
+
+		if ( !BusyFrameMilliseconds.empty() )
+		{
+			std::vector<double> sorted = BusyFrameMilliseconds;
+			std::sort( sorted.begin(), sorted.end() );
+
+			stats.medianMilliseconds = sorted[sorted.size() / 2U];
+			stats.p99Milliseconds = sorted[std::min( sorted.size() * 99U / 100U, sorted.size() - 1U )];
+			stats.maxMilliseconds = sorted.back();
+		}
+
+		return stats;
+	}
+
+	void PrintStats()
+	{
+		const Stats stats = GetStats();
+
+		std::cout << "Texture loader:" << std::endl
+			<< "  * Requests:         " << stats.numRequests << " (" << stats.numFailed << " failed)" << std::endl
+			<< "  * Created:          " << stats.numCreated << ", " << stats.uploadedBytes / 1024U << " kB uploaded" << std::endl
+			<< "  * Budget:           " << BudgetBytes / 1024U << " kB or " << BudgetMilliseconds << " ms per frame" << std::endl
+			<< "  * Busy frames:      " << stats.numBusyFrames << std::endl
+			<< "  * Frame cost:       last " << std::min<uint64_t>( stats.numBusyFrames, BusyFrameWindow ) << " busy frames, " << stats.medianMilliseconds << " ms median, " << stats.p99Milliseconds << " ms p99, "
+			<< stats.maxMilliseconds << " ms max" << std::endl;
+	}
+
+	void Shutdown()
+	{
+		Cancelled = true;
+		Jobs::WaitForIdle();
+
+		Completions.PopAll( Backlog );
+		Backlog.clear();
+	}
+}
@@ -0,0 +1,510 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+
+namespace Texture::Streaming
+{
+	struct StreamedTexture
+	{
+		int32_t textureHandle{ -1 };
+		// The file it was loaded from, the finer mips get decoded from it again
+		std::string name;
+		// Every level is here with its size, but only the base mips keep their pixels in system memory
+		// The finer ones are decoded again when they're needed, and dropped once they're handed to the uploader
+		std::vector<MipLevel> mips;
+		// Coarsest mip that must always stay resident
+		uint32_t baseMip{};
+		// A job is decoding the finer mips
+		bool decoding{ false };
+		// They couldn't be decoded again, so the texture stays at its base mips
+		bool decodeFailed{ false };
+		// Finest mip currently on the GPU
+		uint32_t residentMip{};
+		// Finest mip that was asked for since the last update
+		uint32_t requestedMip{};
+		uint64_t lastUsedFrame{};
+		bool touched{ false };
+		// The new set of mips, swapped in once its upload has been submitted
+		nvrhi::TextureHandle pendingTextureObject;
+
+		// What the mips take up on the GPU
+		uint64_t GetBytesFromMip( uint32_t firstMip ) const
+		{
+			uint64_t bytes = 0U;
+			for ( uint32_t mip = firstMip; mip < mips.size(); mip++ )
+			{
+				bytes += uint64_t( mips[mip].width ) * mips[mip].height * 4U;
+			}
+
+			return bytes;
+		}
+
+		// And what's in system memory right now
+		uint64_t GetPixelBytes() const
+		{
+			uint64_t bytes = 0U;
+			for ( const auto& mip : mips )
+			{
+				bytes += mip.GetPixelBytes();
+			}
+
+			return bytes;
+		}
+
+		// The finer mips are decoded all at once, so either all of them are here or none are
+		bool HasPixelsFrom( uint32_t firstMip ) const
+		{
+			return firstMip >= baseMip || nullptr != mips[firstMip].pixels;
+		}
+
+		void ReleaseFineMips()
+		{
+			if ( baseMip == 0U || nullptr == mips[0].pixels )
+			{
+				return;
+			}
+
+			const uint64_t oldBytes = GetPixelBytes();
+			for ( uint32_t mip = 0U; mip < baseMip; mip++ )
+			{
+				mips[mip].pixels = nullptr;
+			}
+
+			Memory::Track( Memory::Category::Textures, int64_t( GetPixelBytes() ) - int64_t( oldBytes ), 0 );
+		}
+	};
+
+	// A mip chain decoded again on a job thread
+	struct DecodedMips
+	{
+		int32_t textureHandle{ -1 };
+		std::vector<MipLevel> mips;
+	};
+
+	static std::vector<StreamedTexture> StreamedTextures;
+	static Jobs::CompletionQueue<DecodedMips> Decoded;
+	static uint64_t BudgetBytes = 128ULL * 1024ULL * 1024ULL;
+	static uint64_t ResidentBytes = 0U;
+	static uint64_t FrameIndex = 0U;
+	static uint32_t PendingRequests = 0U;
+	static uint64_t NumUpgrades = 0U;
+	static uint64_t NumEvictions = 0U;
+	static uint64_t NumDecodes = 0U;
+
+	static StreamedTexture* Find( int32_t textureHandle )
+	{
+		for ( auto& streamedTexture : StreamedTextures )
+		{
+			if ( streamedTexture.textureHandle == textureHandle )
+			{
+				return &streamedTexture;
+			}
+		}
+
+		return nullptr;
+	}
+
+	// Simple 2x2 box filter, good enough for diffuse textures
+	void GenerateMipChain( const TextureData& textureData, std::vector<MipLevel>& outMips )
+	{
+		outMips.clear();
+
+		MipLevel mip0;
+		mip0.width = textureData.width;
+		mip0.height = textureData.height;
+		std::vector<uint8_t> pixels( mip0.width * mip0.height * 4U );
+		// RGB images get expanded straight into mip 0
+		textureData.CopyRowsAsRgba( pixels.data(), mip0.width * 4U );
+		mip0.pixels = std::make_shared<const std::vector<uint8_t>>( std::move( pixels ) );
+		outMips.push_back( std::move( mip0 ) );
+
+		while ( outMips.back().width > 1U || outMips.back().height > 1U )
+		{
+			const MipLevel& source = outMips.back();
+
+			MipLevel mip;
+			mip.width = std::max( source.width / 2U, 1U );
+			mip.height = std::max( source.height / 2U, 1U );
+			const uint8_t* sourcePixels = source.pixels->data();
+			std::vector<uint8_t> pixels( mip.width * mip.height * 4U );
+
+			for ( uint32_t y = 0U; y < mip.height; y++ )
+			{
+				const uint32_t y0 = std::min( y * 2U, source.height - 1U );
+				const uint32_t y1 = std::min( y * 2U + 1U, source.height - 1U );
+
+				for ( uint32_t x = 0U; x < mip.width; x++ )
+				{
+					const uint32_t x0 = std::min( x * 2U, source.width - 1U );
+					const uint32_t x1 = std::min( x * 2U + 1U, source.width - 1U );
+
+					const uint8_t* p00 = &sourcePixels[(y0 * source.width + x0) * 4U];
+					const uint8_t* p01 = &sourcePixels[(y0 * source.width + x1) * 4U];
+					const uint8_t* p10 = &sourcePixels[(y1 * source.width + x0) * 4U];
+					const uint8_t* p11 = &sourcePixels[(y1 * source.width + x1) * 4U];
+					uint8_t* out = &pixels[(y * mip.width + x) * 4U];
+
+					for ( uint32_t c = 0U; c < 4U; c++ )
+					{
+						out[c] = (p00[c] + p01[c] + p10[c] + p11[c] + 2U) / 4U;
+					}
+				}
+			}
+
+			// Careful, this may invalidate 'source'
+			mip.pixels = std::make_shared<const std::vector<uint8_t>>( std::move( pixels ) );
+			outMips.push_back( std::move( mip ) );
+		}
+	}
+
+	// Reads the file again and rebuilds the mip chain on a job thread, Update picks it up when it's done
+	static void DecodeFineMips( StreamedTexture& streamedTexture )
+	{
+		streamedTexture.decoding = true;
+		NumDecodes++;
+
+		Jobs::Submit( [textureHandle = streamedTexture.textureHandle, name = streamedTexture.name]
+			{
+				DecodedMips decoded;
+				decoded.textureHandle = textureHandle;
+
+				TextureData textureData;
+				textureData.Init( name.c_str(), true );
+				if ( textureData )
+				{
+					GenerateMipChain( textureData, decoded.mips );
+				}
+
+				Decoded.Push( std::move( decoded ) );
+			} );
+	}
+
+	static void TakeDecodedMips()
+	{
+		std::vector<DecodedMips> decodedMips;
+		Decoded.PopAll( decodedMips );
+
+		for ( auto& decoded : decodedMips )
+		{
+			StreamedTexture* streamedTexture = Find( decoded.textureHandle );
+			if ( nullptr == streamedTexture )
+			{
+				continue;
+			}
+
+			streamedTexture->decoding = false;
+
+			// The file is gone, or isn't the same image anymore
+			if ( decoded.mips.size() != streamedTexture->mips.size()
+				|| decoded.mips[0].width != streamedTexture->mips[0].width || decoded.mips[0].height != streamedTexture->mips[0].height )
+			{
+				std::cout << "Texture::Streaming: cannot decode '" << streamedTexture->name << "' again, keeping its base mips" << std::endl;
+				streamedTexture->decodeFailed = true;
+				continue;
+			}
+
+			const uint64_t oldBytes = streamedTexture->GetPixelBytes();
+			for ( uint32_t mip = 0U; mip < streamedTexture->baseMip; mip++ )
+			{
+				streamedTexture->mips[mip].pixels = std::move( decoded.mips[mip].pixels );
+			}
+			Memory::Track( Memory::Category::Textures, int64_t( streamedTexture->GetPixelBytes() ) - int64_t( oldBytes ), 0 );
+		}
+	}
+
+	// Swaps the texture object behind a handle for one with a different set of resident mips
+	// Every mip from firstMip on has to be in system memory
+	static void MakeResident( StreamedTexture& streamedTexture, uint32_t firstMip )
+	{
+		const uint64_t oldBytes = streamedTexture.GetBytesFromMip( streamedTexture.residentMip );
+		ResidentBytes -= oldBytes;
+
+		// The uploader shares the mips' pixels until they're in a staging texture, so the finer ones can go right after this
+		// If an older set of mips is still on its way, it just gets replaced
+		streamedTexture.pendingTextureObject = CreateTextureObject( streamedTexture.mips, firstMip, nvrhi::Format::RGBA8_UNORM, streamedTexture.name.c_str() );
+		streamedTexture.residentMip = firstMip;
+
+		ResidentBytes += streamedTexture.GetBytesFromMip( firstMip );
+		Memory::Track( Memory::Category::Textures, 0, int64_t( streamedTexture.GetBytesFromMip( firstMip ) ) - int64_t( oldBytes ) );
+	}
+
+	// Keeps rendering with the old mips until the new ones are uploaded, instead of not rendering at all
+	static void SwapInUploadedTextures()
+	{
+		for ( auto& streamedTexture : StreamedTextures )
+		{
+			if ( nullptr == streamedTexture.pendingTextureObject || Upload::IsPending( streamedTexture.pendingTextureObject ) )
+			{
+				continue;
+			}
+
+			TextureObjects[streamedTexture.textureHandle] = std::move( streamedTexture.pendingTextureObject );
+			streamedTexture.pendingTextureObject = nullptr;
+
+			// The old texture object will be freed by NVRHI once the binding sets stop referencing it
+			// and the GPU is done with it
+			Model::UpdateTextureBindings( streamedTexture.textureHandle );
+		}
+	}
+
+	bool ShouldStream( const TextureData& textureData )
+	{
+		return textureData.bytesPerComponent == 1U
+			&& (textureData.width > BaseResidentSize || textureData.height > BaseResidentSize);
+	}
+
+	uint64_t CreateStreamedTexture( int32_t textureHandle, TextureData&& textureData, std::vector<MipLevel>&& mips, const char* debugName, Retention retention )
+	{
+		StreamedTexture streamedTexture;
+		streamedTexture.textureHandle = textureHandle;
+		streamedTexture.name = nullptr == debugName ? "streamed" : debugName;
+		streamedTexture.mips = std::move( mips );
+
+		// Mip 0 was expanded into the chain
+		if ( retention == Retention::ReleaseAfterUpload )
+		{
+			textureData.Release();
+		}
+
+		// Find the first mip that fits into the always-resident size
+		streamedTexture.baseMip = 0U;
+		while ( streamedTexture.mips[streamedTexture.baseMip].width > BaseResidentSize
+			|| streamedTexture.mips[streamedTexture.baseMip].height > BaseResidentSize )
+		{
+			streamedTexture.baseMip++;
+		}
+
+		streamedTexture.residentMip = streamedTexture.baseMip;
+		streamedTexture.requestedMip = streamedTexture.baseMip;
+		streamedTexture.lastUsedFrame = FrameIndex;
+
+		const uint64_t uploadBytes = streamedTexture.GetBytesFromMip( streamedTexture.baseMip );
+		TextureObjects[textureHandle] = CreateTextureObject( streamedTexture.mips, streamedTexture.baseMip, nvrhi::Format::RGBA8_UNORM, streamedTexture.name.c_str() );
+		ResidentBytes += uploadBytes;
+
+		// Only the base mips were uploaded, the rest can be decoded again if it's ever needed
+		const uint64_t cpuBytes = streamedTexture.GetPixelBytes() + (textureData ? textureData.GetDataBytes() : 0U);
+		Memory::Track( Memory::Category::Textures, cpuBytes, uploadBytes, 1 );
+		streamedTexture.ReleaseFineMips();
+
+		TextureDatas[textureHandle] = std::move( textureData );
+		StreamedTextures.push_back( std::move( streamedTexture ) );
+
+		std::cout << "Texture::Streaming: streaming '" << StreamedTextures.back().name << "' ("
+			<< StreamedTextures.back().mips.size() << " mips, " << StreamedTextures.back().baseMip << " initially skipped)" << std::endl;
+
+		return uploadBytes;
+	}
+
+	void RequestForScreenSize( int32_t textureHandle, float uvDensity, float pixelsPerWorldUnit )
+	{
+		StreamedTexture* streamedTexture = Find( textureHandle );
+		if ( nullptr == streamedTexture )
+		{
+			return;
+		}
+
+		// How many texels of mip 0 land on a single screen pixel
+		const MipLevel& mip0 = streamedTexture->mips[0];
+		const float texelsPerWorldUnit = std::max( mip0.width, mip0.height ) * uvDensity;
+		const float texelsPerPixel = texelsPerWorldUnit / std::max( pixelsPerWorldUnit, 0.0001f );
+
+		uint32_t mip = 0U;
+		if ( texelsPerPixel > 1.0f )
+		{
+			mip = std::min( uint32_t( std::log2( texelsPerPixel ) ), streamedTexture->baseMip );
+		}
+
+		if ( !streamedTexture->touched || mip < streamedTexture->requestedMip )
+		{
+			streamedTexture->requestedMip = mip;
+		}
+
+		streamedTexture->touched = true;
+		streamedTexture->lastUsedFrame = FrameIndex;
+	}
+
+	bool IsStreamed( int32_t textureHandle )
+	{
+		return nullptr != Find( textureHandle );
+	}
+
+	uint32_t GetResidentMip( int32_t textureHandle )
+	{
+		const StreamedTexture* streamedTexture = Find( textureHandle );
+		return nullptr == streamedTexture ? 0U : streamedTexture->residentMip;
+	}
+
+	uint32_t GetRequestedMip( int32_t textureHandle )
+	{
+		const StreamedTexture* streamedTexture = Find( textureHandle );
+		return nullptr == streamedTexture ? 0U : streamedTexture->requestedMip;
+	}
+
+	void SetBudget( uint64_t bytes )
+	{
+		BudgetBytes = bytes;
+	}
+
+	Stats GetStats()
+	{
+		Stats stats;
+		stats.numStreamedTextures = StreamedTextures.size();
+		stats.numPendingRequests = PendingRequests;
+		stats.residentBytes = ResidentBytes;
+		stats.budgetBytes = BudgetBytes;
+		stats.numUpgrades = NumUpgrades;
+		stats.numEvictions = NumEvictions;
+		stats.numDecodes = NumDecodes;
+		return stats;
+	}
+
+	void PrintStats()
+	{
+		const Stats stats = GetStats();
+
+		std::cout << "Texture streaming:" << std::endl
+			<< "  * Textures:         " << stats.numStreamedTextures << std::endl
+			<< "  * Pending requests: " << stats.numPendingRequests << std::endl
+			<< "  * Resident:         " << stats.residentBytes / 1024U << " / " << stats.budgetBytes / 1024U << " kB" << std::endl
+			<< "  * Upgrades:         " << stats.numUpgrades << std::endl
+			<< "  * Evictions:        " << stats.numEvictions << std::endl
+			<< "  * Decoded again:    " << stats.numDecodes << std::endl;
+	}
+
+	// Drops the least recently used texture back to its base mips, returns false if nothing could be evicted
+	static bool EvictLeastRecentlyUsed( const StreamedTexture* except )
+	{
+		StreamedTexture* victim = nullptr;
+		for ( auto& streamedTexture : StreamedTextures )
+		{
+			// Textures used in the last frame are not up for eviction
+			if ( &streamedTexture == except || streamedTexture.touched || streamedTexture.residentMip >= streamedTexture.baseMip )
+			{
+				continue;
+			}
+
+			if ( nullptr == victim || streamedTexture.lastUsedFrame < victim->lastUsedFrame )
+			{
+				victim = &streamedTexture;
+			}
+		}
+
+		if ( nullptr == victim )
+		{
+			return false;
+		}
+
+		MakeResident( *victim, victim->baseMip );
+		victim->requestedMip = victim->baseMip;
+		NumEvictions++;
+		return true;
+	}
+
+	void Update()
+	{
+		SwapInUploadedTextures();
+		TakeDecodedMips();
+
+		// Gather everything that wants finer mips than it has
+		std::vector<StreamedTexture*> requests;
+		for ( auto& streamedTexture : StreamedTextures )
+		{
+			if ( streamedTexture.touched && streamedTexture.requestedMip < streamedTexture.residentMip )
+			{
+				requests.push_back( &streamedTexture );
+			}
+		}
+
+		// The biggest jumps in quality go first
+		std::sort( requests.begin(), requests.end(), []( const StreamedTexture* a, const StreamedTexture* b )
+			{
+				return (a->residentMip - a->requestedMip) > (b->residentMip - b->requestedMip);
+			} );
+
+		uint32_t numUpgrades = 0U;
+		for ( StreamedTexture* request : requests )
+		{
+			if ( numUpgrades >= MaxUpgradesPerFrame )
+			{
+				break;
+			}
+
+			// The finer mips have to be decoded again first, which takes a few frames
+			if ( !request->HasPixelsFrom( request->requestedMip ) )
+			{
+				if ( !request->decoding && !request->decodeFailed )
+				{
+					DecodeFineMips( *request );
+				}
+				continue;
+			}
+
+			uint32_t targetMip = request->requestedMip;
+			const uint64_t currentBytes = request->GetBytesFromMip( request->residentMip );
+
+			// Make room for it, and if that's not possible, settle for a coarser mip
+			while ( targetMip < request->residentMip )
+			{
+				const uint64_t extraBytes = request->GetBytesFromMip( targetMip ) - currentBytes;
+				if ( ResidentBytes + extraBytes <= BudgetBytes )
+				{
+					break;
+				}
+
+				if ( !EvictLeastRecentlyUsed( request ) )
+				{
+					targetMip++;
+				}
+			}
+
+			if ( targetMip < request->residentMip )
+			{
+				MakeResident( *request, targetMip );
+				request->ReleaseFineMips();
+				numUpgrades++;
+				NumUpgrades++;
+			}
+		}
+
+		// The budget may have been lowered in the meantime
+		while ( ResidentBytes > BudgetBytes && EvictLeastRecentlyUsed( nullptr ) )
+		{
+		}
+
+		PendingRequests = 0U;
+		for ( auto& streamedTexture : StreamedTextures )
+		{
+			if ( streamedTexture.touched && streamedTexture.requestedMip < streamedTexture.residentMip )
+			{
+				PendingRequests++;
+			}
+			// Decoded for a request that has gone away in the meantime, the ones still waiting for the budget keep theirs
+			else
+			{
+				streamedTexture.ReleaseFineMips();
+			}
+
+			streamedTexture.touched = false;
+		}
+
+		FrameIndex++;
+	}
+
+	void Shutdown()
+	{
+		// Decoding jobs still hold on to their results
+		Jobs::WaitForIdle();
+		std::vector<DecodedMips> decodedMips;
+		Decoded.PopAll( decodedMips );
+
+		for ( const auto& streamedTexture : StreamedTextures )
+		{
+			Memory::Track( Memory::Category::Textures, -int64_t( streamedTexture.GetPixelBytes() ), 0 );
+		}
+
+		StreamedTextures.clear();
+		ResidentBytes = 0U;
+		PendingRequests = 0U;
+	}
+}
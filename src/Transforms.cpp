@@ -0,0 +1,265 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+
+// SSE is always there on x64, anything else takes the scalar path
+#if defined( __SSE__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 1 )
+#define TRANSFORMS_SSE 1
+#include <xmmintrin.h>
+#else
+#define TRANSFORMS_SSE 0
+#endif
+
+namespace Transforms
+{
+	struct FrameBuffer
+	{
+		nvrhi::BufferHandle buffer;
+		nvrhi::BindingSetHandle bindingSet;
+		// Set after the frame that filled the buffer was submitted
+		nvrhi::EventQueryHandle submitted;
+		Instance* mapped{};
+		uint32_t capacity{};
+		bool inFlight{ false };
+	};
+
+	static std::vector<FrameBuffer> Frames;
+	static nvrhi::BindingLayoutHandle BindingLayout;
+	static uint32_t CurrentFrame = 0U;
+	static bool PersistentMapping = false;
+	static Stats LastFrame;
+
+	static void ReleaseFrameBuffer( FrameBuffer& frame )
+	{
+		if ( nullptr == frame.buffer )
+		{
+			return;
+		}
+
+		if ( PersistentMapping )
+		{
+			Renderer::Device->unmapBuffer( frame.buffer );
+		}
+
+		Memory::Track( Memory::Category::ConstantBuffers, 0, -int64_t( Memory::EstimateBufferBytes( frame.buffer->getDesc() ) ), -1 );
+
+		frame.bindingSet = nullptr;
+		frame.buffer = nullptr;
+		frame.mapped = nullptr;
+		frame.capacity = 0U;
+	}
+
+	static bool CreateFrameBuffer( FrameBuffer& frame, uint32_t capacity )
+	{
+		ReleaseFrameBuffer( frame );
+
+		auto bufferDesc = nvrhi::BufferDesc()
+			.setByteSize( capacity * sizeof( Instance ) )
+			.setStructStride( sizeof( Instance ) )
+			.setCpuAccess( nvrhi::CpuAccessMode::Write )
+			.setInitialState( nvrhi::ResourceStates::ShaderResource )
+			.setKeepInitialState( true )
+			.setDebugName( "Entity transforms" );
+
+		frame.buffer = Renderer::Device->createBuffer( bufferDesc );
+		if ( !Check( frame.buffer, "Transforms: failed to create a transform buffer" ) )
+		{
+			return false;
+		}
+
+		Memory::Track( Memory::Category::ConstantBuffers, 0, Memory::EstimateBufferBytes( bufferDesc ), 1 );
+
+		nvrhi::BindingSetDesc setDesc;
+		setDesc.bindings =
+		{
+			nvrhi::BindingSetItem::StructuredBuffer_SRV( 1, frame.buffer ),
+			nvrhi::BindingSetItem::PushConstants( 2, sizeof( uint32_t ) )
+		};
+		frame.bindingSet = Renderer::Device->createBindingSet( setDesc, BindingLayout );
+		frame.capacity = capacity;
+
+		// Stays mapped until the buffer is released
+		if ( PersistentMapping )
+		{
+			frame.mapped = static_cast<Instance*>( Renderer::Device->mapBuffer( frame.buffer, nvrhi::CpuAccessMode::Write ) );
+			return Check( frame.mapped, "Transforms: failed to map a transform buffer" );
+		}
+
+		return true;
+	}
+
+	bool Init( nvrhi::IBindingLayout* bindingLayout, uint32_t numBuffers, bool persistentMapping )
+	{
+		BindingLayout = bindingLayout;
+		PersistentMapping = persistentMapping;
+
+		Frames.resize( numBuffers );
+		for ( auto& frame : Frames )
+		{
+			frame.submitted = Renderer::Device->createEventQuery();
+			if ( !CreateFrameBuffer( frame, InitialCapacity ) )
+			{
+				return false;
+			}
+		}
+
+		std::cout << "Transforms: " << numBuffers << " buffers of " << InitialCapacity << " instances, "
+			<< (PersistentMapping ? "persistently mapped" : "mapped every frame") << std::endl;
+		return true;
+	}
+
+	void Shutdown()
+	{
+		for ( auto& frame : Frames )
+		{
+			ReleaseFrameBuffer( frame );
+		}
+
+		Frames.clear();
+		BindingLayout = nullptr;
+	}
+
+	Instance* Map( uint32_t count )
+	{
+		CurrentFrame = (CurrentFrame + 1U) % Frames.size();
+		FrameBuffer& frame = Frames[CurrentFrame];
+
+		Stats stats;
+		stats.numBuffers = Frames.size();
+		stats.numGrowths = LastFrame.numGrowths;
+
+		// The device manager already keeps the CPU from running too far ahead, so this is normally done
+		if ( frame.inFlight )
+		{
+			adm::TimerPreciseDouble timer;
+			Renderer::Device->waitEventQuery( frame.submitted );
+			stats.waitMilliseconds = timer.GetElapsed( adm::TimeUnits::Seconds ) * 1000.0;
+			frame.inFlight = false;
+		}
+
+		// Only this frame's buffer grows, the others catch up once their turn comes
+		if ( count > frame.capacity )
+		{
+			if ( !CreateFrameBuffer( frame, std::max( count, frame.capacity * 2U ) ) )
+			{
+				return nullptr;
+			}
+			stats.numGrowths++;
+		}
+
+		if ( !PersistentMapping )
+		{
+			frame.mapped = static_cast<Instance*>( Renderer::Device->mapBuffer( frame.buffer, nvrhi::CpuAccessMode::Write ) );
+		}
+
+		stats.numTransforms = count;
+		stats.capacity = frame.capacity;
+		LastFrame = stats;
+
+		return frame.mapped;
+	}
+
+	void Unmap()
+	{
+		FrameBuffer& frame = Frames[CurrentFrame];
+		if ( !PersistentMapping && nullptr != frame.mapped )
+		{
+			Renderer::Device->unmapBuffer( frame.buffer );
+			frame.mapped = nullptr;
+		}
+	}
+
+	nvrhi::IBindingSet* GetBindingSet()
+	{
+		return Frames[CurrentFrame].bindingSet;
+	}
+
+	void FrameSubmitted()
+	{
+		if ( Frames.empty() )
+		{
+			return;
+		}
+
+		FrameBuffer& frame = Frames[CurrentFrame];
+		Renderer::Device->resetEventQuery( frame.submitted );
+		Renderer::Device->setEventQuery( frame.submitted, nvrhi::CommandQueue::Graphics );
+		frame.inFlight = true;
+	}
+
+	Stats GetStats()
+	{
+		return LastFrame;
+	}
+
+	void PrintStats()
+	{
+		const Stats stats = GetStats();
+
+		std::cout << "Transforms:" << std::endl
+			<< "  * Last frame:       " << stats.numTransforms << " of " << stats.capacity << " instances" << std::endl
+			<< "  * Buffers:          " << stats.numBuffers << (PersistentMapping ? ", persistently mapped" : ", mapped every frame")
+			<< ", grown " << stats.numGrowths << " times" << std::endl
+			<< "  * GPU wait:         " << stats.waitMilliseconds << " ms" << std::endl;
+	}
+
+	// adm::Mat4 is row-major, so row r of the result is the sum of the right matrix's rows,
+	// each scaled by one element of the left matrix's row r
+	void MultiplyBatchScalar( const adm::Mat4& left, const adm::Mat4* rightMatrices, adm::Mat4* outMatrices, size_t count )
+	{
+		const float* l = reinterpret_cast<const float*>( &left );
+		for ( size_t i = 0U; i < count; i++ )
+		{
+			const float* r = reinterpret_cast<const float*>( &rightMatrices[i] );
+			float* out = reinterpret_cast<float*>( &outMatrices[i] );
+
+			for ( int row = 0; row < 4; row++ )
+			{
+				for ( int column = 0; column < 4; column++ )
+				{
+					// Same order of operations as the SSE path
+					float sum = l[row * 4 + 0] * r[0 * 4 + column];
+					sum += l[row * 4 + 1] * r[1 * 4 + column];
+					sum += l[row * 4 + 2] * r[2 * 4 + column];
+					sum += l[row * 4 + 3] * r[3 * 4 + column];
+					out[row * 4 + column] = sum;
+				}
+			}
+		}
+	}
+
+	void MultiplyBatch( const adm::Mat4& left, const adm::Mat4* rightMatrices, adm::Mat4* outMatrices, size_t count )
+	{
+#if TRANSFORMS_SSE
+		// The left matrix is the same for the whole batch, so its elements are broadcast once
+		const float* l = reinterpret_cast<const float*>( &left );
+		__m128 broadcast[16];
+		for ( int i = 0; i < 16; i++ )
+		{
+			broadcast[i] = _mm_set1_ps( l[i] );
+		}
+
+		for ( size_t i = 0U; i < count; i++ )
+		{
+			const float* r = reinterpret_cast<const float*>( &rightMatrices[i] );
+			float* out = reinterpret_cast<float*>( &outMatrices[i] );
+
+			const __m128 r0 = _mm_loadu_ps( r + 0 );
+			const __m128 r1 = _mm_loadu_ps( r + 4 );
+			const __m128 r2 = _mm_loadu_ps( r + 8 );
+			const __m128 r3 = _mm_loadu_ps( r + 12 );
+
+			for ( int row = 0; row < 4; row++ )
+			{
+				__m128 sum = _mm_mul_ps( broadcast[row * 4 + 0], r0 );
+				sum = _mm_add_ps( sum, _mm_mul_ps( broadcast[row * 4 + 1], r1 ) );
+				sum = _mm_add_ps( sum, _mm_mul_ps( broadcast[row * 4 + 2], r2 ) );
+				sum = _mm_add_ps( sum, _mm_mul_ps( broadcast[row * 4 + 3], r3 ) );
+				_mm_storeu_ps( out + row * 4, sum );
+			}
+		}
+#else
+		MultiplyBatchScalar( left, rightMatrices, outMatrices, count );
+#endif
+	}
+}
@@ -0,0 +1,829 @@
+// SPDX-License-Identifier: MIT
+
+#include "Common.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace Upload
+{
+	struct Request
+	{
+		nvrhi::BufferHandle buffer;
+		nvrhi::TextureHandle texture;
+		nvrhi::ResourceStates finalState{};
+		uint64_t bytes{};
+		// Buffers carry a copy of their data, textures fill the staging texture themselves
+		std::vector<uint8_t> bufferData;
+		StagingFiller filler;
+
+		nvrhi::IResource* GetResource() const
+		{
+			return nullptr != buffer ? static_cast<nvrhi::IResource*>( buffer.Get() ) : texture.Get();
+		}
+	};
+
+	// A closed command list full of uploads, waiting for the main thread to submit it
+	struct RecordedBatch
+	{
+		uint64_t id{};
+		nvrhi::CommandListHandle commandList;
+		// Where the ring's write position was when this batch was closed
+		uint64_t ringEnd{};
+		// Only the resources and their final states are left in these
+		std::vector<Request> requests;
+	};
+
+	// The event query tells the upload thread when the batch's staging memory can be reused
+	struct SubmittedBatch
+	{
+		uint64_t id{};
+		nvrhi::EventQueryHandle query;
+		uint64_t ringEnd{};
+	};
+
+	// A resource the copy queue has written to, which the graphics queue doesn't know about yet
+	struct PendingAcquire
+	{
+		nvrhi::BufferHandle buffer;
+		nvrhi::TextureHandle texture;
+		nvrhi::ResourceStates finalState{};
+		uint64_t copyInstance{};
+	};
+
+	static bool UseCopyQueue = false;
+	static bool UseUploadThread = false;
+	// Mapping a buffer waits for the GPU to be done with it, so the ring is mapped once and stays that way
+	// D3D11 can't copy out of a mapped buffer, so there it's mapped while recording and unmapped for each batch
+	static bool PersistentRing = false;
+	static nvrhi::CommandQueue UploadQueue = nvrhi::CommandQueue::Graphics;
+
+	// ==========================================================================================================
+	// MAIN THREAD STATE
+	// ==========================================================================================================
+	static std::vector<Request> PendingRequests;
+	static uint64_t PendingBytes = 0U;
+	// How many uploads of each resource haven't been submitted yet
+	static std::unordered_map<nvrhi::IResource*, uint32_t> InTransit;
+	static std::unordered_map<nvrhi::IResource*, PendingAcquire> PendingAcquires;
+	// The latest copy queue submission the current frame depends on
+	static uint64_t FrameWaitInstance = 0U;
+	static uint64_t LastWaitedInstance = 0U;
+
+	// ==========================================================================================================
+	// SHARED STATE
+	// ==========================================================================================================
+	static std::mutex QueueMutex;
+	static std::condition_variable WorkAvailable;
+	static std::condition_variable BatchSubmitted;
+	// Signalled when the upload thread hands off a batch or runs out of work, Shutdown waits on it
+	static std::condition_variable BatchRecorded;
+	static std::deque<std::vector<Request>> RecordJobs;
+	static std::deque<RecordedBatch> RecordedBatches;
+	static std::vector<SubmittedBatch> SubmittedBatches;
+	static std::vector<nvrhi::CommandListHandle> FreeCommandLists;
+	static std::vector<nvrhi::EventQueryHandle> FreeQueries;
+	static bool StopUploadThread = false;
+	static bool UploadThreadBusy = false;
+	static std::thread UploadThread;
+
+	static std::mutex StatsMutex;
+	static Stats CurrentStats;
+
+	// ==========================================================================================================
+	// UPLOAD THREAD STATE
+	//
+	// Belongs to the main thread when there is no upload thread
+	// ==========================================================================================================
+	static nvrhi::CommandListHandle CurrentCommandList;
+	static std::vector<Request> CurrentRequests;
+	static std::deque<SubmittedBatch> BatchesInFlight;
+	static uint64_t LastRecordedBatch = 0U;
+	static uint64_t LastCompletedBatch = 0U;
+
+	// Positions only ever grow, the actual offset is position % RingBytes
+	// Everything between RingTail and RingHead may still be read by the GPU
+	static nvrhi::BufferHandle RingBuffer;
+	static uint8_t* RingMapped = nullptr;
+	static uint64_t RingHead = 0U;
+	static uint64_t RingTail = 0U;
+
+	struct PooledStagingTexture
+	{
+		nvrhi::StagingTextureHandle stagingTexture;
+		// The batch that last copied out of it
+		uint64_t lastBatch{};
+	};
+
+	static std::vector<PooledStagingTexture> StagingTextures;
+
+	static void SubmitRecordedBatches();
+
+	// Moves the batches the main thread has submitted into BatchesInFlight
+	static void TakeSubmittedBatches( bool wait )
+	{
+		std::unique_lock<std::mutex> lock( QueueMutex );
+		if ( wait )
+		{
+			BatchSubmitted.wait( lock, [] { return !SubmittedBatches.empty(); } );
+		}
+
+		for ( auto& batch : SubmittedBatches )
+		{
+			BatchesInFlight.push_back( std::move( batch ) );
+		}
+		SubmittedBatches.clear();
+	}
+
+	// Retires every batch the GPU has finished, freeing up its part of the ring
+	static void Reclaim()
+	{
+		TakeSubmittedBatches( false );
+
+		while ( !BatchesInFlight.empty() && Renderer::Device->pollEventQuery( BatchesInFlight.front().query ) )
+		{
+			SubmittedBatch& batch = BatchesInFlight.front();
+			LastCompletedBatch = batch.id;
+			RingTail = batch.ringEnd;
+
+			Renderer::Device->resetEventQuery( batch.query );
+			{
+				std::lock_guard<std::mutex> lock( QueueMutex );
+				FreeQueries.push_back( std::move( batch.query ) );
+			}
+			BatchesInFlight.pop_front();
+		}
+
+		// Big staging textures shouldn't stick around forever
+		for ( size_t i = 0U; i < StagingTextures.size(); )
+		{
+			const PooledStagingTexture& pooled = StagingTextures[i];
+			if ( pooled.lastBatch <= LastCompletedBatch && LastCompletedBatch - pooled.lastBatch > StagingTextureLifetime )
+			{
+				Memory::Track( Memory::Category::Staging, 0, -int64_t( Memory::EstimateTextureBytes( pooled.stagingTexture->getDesc() ) ), -1 );
+				StagingTextures.erase( StagingTextures.begin() + i );
+				continue;
+			}
+			i++;
+		}
+	}
+
+	// Blocks until the oldest batch in flight is done, and reports how long that took
+	static bool WaitForOldestBatch()
+	{
+		adm::TimerPreciseDouble timer;
+
+		TakeSubmittedBatches( false );
+		if ( BatchesInFlight.empty() )
+		{
+			// Without an upload thread, nobody else is going to submit anything
+			if ( !UseUploadThread )
+			{
+				return false;
+			}
+
+			TakeSubmittedBatches( true );
+		}
+
+		Renderer::Device->waitEventQuery( BatchesInFlight.front().query );
+
+		{
+			std::lock_guard<std::mutex> lock( StatsMutex );
+			CurrentStats.numStalls++;
+			CurrentStats.stallSeconds += timer.GetElapsed( adm::TimeUnits::Seconds );
+		}
+
+		Reclaim();
+		return true;
+	}
+
+	static nvrhi::ICommandList* GetCommandList()
+	{
+		if ( nullptr == CurrentCommandList )
+		{
+			{
+				std::lock_guard<std::mutex> lock( QueueMutex );
+				if ( !FreeCommandLists.empty() )
+				{
+					CurrentCommandList = std::move( FreeCommandLists.back() );
+					FreeCommandLists.pop_back();
+				}
+			}
+
+			if ( nullptr == CurrentCommandList )
+			{
+				CurrentCommandList = Renderer::Device->createCommandList( nvrhi::CommandListParameters().setQueueType( UploadQueue ) );
+			}
+
+			CurrentCommandList->open();
+		}
+
+		return CurrentCommandList;
+	}
+
+	// Closes the current command list and gives it to the main thread to submit
+	static void HandOff()
+	{
+		if ( nullptr == CurrentCommandList )
+		{
+			return;
+		}
+
+		if ( !PersistentRing && nullptr != RingMapped )
+		{
+			Renderer::Device->unmapBuffer( RingBuffer );
+			RingMapped = nullptr;
+		}
+
+		CurrentCommandList->close();
+
+		RecordedBatch batch;
+		batch.id = ++LastRecordedBatch;
+		batch.commandList = std::move( CurrentCommandList );
+		batch.ringEnd = RingHead;
+		batch.requests = std::move( CurrentRequests );
+
+		CurrentCommandList = nullptr;
+		CurrentRequests.clear();
+
+		{
+			std::lock_guard<std::mutex> lock( QueueMutex );
+			RecordedBatches.push_back( std::move( batch ) );
+		}
+		BatchRecorded.notify_one();
+	}
+
+	// Returns the position of a free, aligned range in the ring, or UINT64_MAX if there's no way to get one
+	static uint64_t AllocateFromRing( uint64_t bytes )
+	{
+		if ( bytes > RingBytes )
+		{
+			return UINT64_MAX;
+		}
+
+		Reclaim();
+
+		while ( true )
+		{
+			// Nothing in use, might as well start from the beginning so that even the biggest allocation fits
+			if ( RingHead == RingTail )
+			{
+				RingHead = RingTail = (RingHead + RingBytes - 1U) / RingBytes * RingBytes;
+			}
+
+			uint64_t position = (RingHead + RingAlignment - 1U) & ~(RingAlignment - 1U);
+			// Allocations don't wrap around, skip to the start instead
+			if ( position % RingBytes + bytes > RingBytes )
+			{
+				position += RingBytes - position % RingBytes;
+			}
+
+			if ( position + bytes - RingTail <= RingBytes )
+			{
+				RingHead = position + bytes;
+
+				std::lock_guard<std::mutex> lock( StatsMutex );
+				CurrentStats.peakRingBytes = std::max( CurrentStats.peakRingBytes, RingHead - RingTail );
+				return position;
+			}
+
+			// The space we need is still used by batches that haven't been submitted yet,
+			// including possibly the one being recorded right now
+			if ( BatchesInFlight.empty() || BatchesInFlight.back().ringEnd < position + bytes - RingBytes )
+			{
+				HandOff();
+				if ( !UseUploadThread )
+				{
+					SubmitRecordedBatches();
+				}
+			}
+
+			if ( !WaitForOldestBatch() )
+			{
+				return UINT64_MAX;
+			}
+		}
+	}
+
+	// Maps can block on the GPU, which wouldn't show up anywhere else
+	static void AddMapTime( const adm::TimerPreciseDouble& timer )
+	{
+		std::lock_guard<std::mutex> lock( StatsMutex );
+		CurrentStats.numMaps++;
+		CurrentStats.mapSeconds += timer.GetElapsed( adm::TimeUnits::Seconds );
+	}
+
+	static uint8_t* MapRing()
+	{
+		adm::TimerPreciseDouble timer;
+		uint8_t* mapped = static_cast<uint8_t*>( Renderer::Device->mapBuffer( RingBuffer, nvrhi::CpuAccessMode::Write ) );
+		AddMapTime( timer );
+		return mapped;
+	}
+
+	static uint8_t* GetRingMemory( uint64_t position )
+	{
+		// Only on D3D11, where it stays mapped until the batch is handed off
+		if ( nullptr == RingMapped )
+		{
+			RingMapped = MapRing();
+		}
+
+		return RingMapped + position % RingBytes;
+	}
+
+	// A staging texture that's free to be written to, reserved until the batch being recorded is done on the GPU
+	static nvrhi::IStagingTexture* AcquireStagingTexture( const nvrhi::TextureDesc& desc )
+	{
+		Reclaim();
+
+		const auto matches = []( const nvrhi::TextureDesc& a, const nvrhi::TextureDesc& b )
+		{
+			return a.width == b.width && a.height == b.height && a.mipLevels == b.mipLevels && a.format == b.format;
+		};
+
+		for ( auto& pooled : StagingTextures )
+		{
+			if ( pooled.lastBatch <= LastCompletedBatch && matches( pooled.stagingTexture->getDesc(), desc ) )
+			{
+				pooled.lastBatch = LastRecordedBatch + 1U;
+
+				std::lock_guard<std::mutex> lock( StatsMutex );
+				CurrentStats.numStagingTexturesReused++;
+				return pooled.stagingTexture;
+			}
+		}
+
+		PooledStagingTexture pooled;
+		pooled.stagingTexture = Renderer::Device->createStagingTexture( desc, nvrhi::CpuAccessMode::Write );
+		pooled.lastBatch = LastRecordedBatch + 1U;
+		StagingTextures.push_back( pooled );
+
+		Memory::Track( Memory::Category::Staging, 0, Memory::EstimateTextureBytes( desc ), 1 );
+		return StagingTextures.back().stagingTexture;
+	}
+
+	static void RecordBuffer( Request& request )
+	{
+		const uint64_t position = AllocateFromRing( request.bytes );
+		nvrhi::ICommandList* commandList = GetCommandList();
+
+		commandList->beginTrackingBufferState( request.buffer, nvrhi::ResourceStates::CopyDest );
+		if ( position == UINT64_MAX )
+		{
+			// Too big for the ring, let NVRHI deal with it
+			commandList->writeBuffer( request.buffer, request.bufferData.data(), request.bytes );
+
+			std::lock_guard<std::mutex> lock( StatsMutex );
+			CurrentStats.numRingFallbacks++;
+		}
+		else
+		{
+			std::memcpy( GetRingMemory( position ), request.bufferData.data(), request.bytes );
+			commandList->copyBuffer( request.buffer, 0U, RingBuffer, position % RingBytes, request.bytes );
+		}
+
+		// Copy queues can't transition into graphics states, Acquire does that on the graphics queue
+		if ( !UseCopyQueue )
+		{
+			commandList->setPermanentBufferState( request.buffer, request.finalState );
+		}
+	}
+
+	static void RecordTexture( Request& request )
+	{
+		const nvrhi::TextureDesc& desc = request.texture->getDesc();
+		nvrhi::IStagingTexture* stagingTexture = AcquireStagingTexture( desc );
+		nvrhi::ICommandList* commandList = GetCommandList();
+
+		commandList->beginTrackingTextureState( request.texture, nvrhi::AllSubresources, nvrhi::ResourceStates::Common );
+		for ( uint32_t mip = 0U; mip < desc.mipLevels; mip++ )
+		{
+			const auto slice = nvrhi::TextureSlice().setMipLevel( mip );
+
+			size_t rowPitch = 0U;
+			adm::TimerPreciseDouble timer;
+			uint8_t* mapped = static_cast<uint8_t*>( Renderer::Device->mapStagingTexture( stagingTexture, slice, nvrhi::CpuAccessMode::Write, &rowPitch ) );
+			AddMapTime( timer );
+			if ( nullptr == mapped )
+			{
+				std::cout << "Upload::RecordTexture: cannot map staging texture for '" << desc.debugName << "'" << std::endl;
+				continue;
+			}
+
+			request.filler( mip, mapped, rowPitch );
+			Renderer::Device->unmapStagingTexture( stagingTexture );
+
+			commandList->copyTexture( request.texture, slice, stagingTexture, slice );
+		}
+
+		if ( !UseCopyQueue )
+		{
+			commandList->setPermanentTextureState( request.texture, request.finalState );
+		}
+	}
+
+	static void RecordBatch( std::vector<Request>& requests )
+	{
+		for ( auto& request : requests )
+		{
+			if ( nullptr != request.buffer )
+			{
+				RecordBuffer( request );
+			}
+			else
+			{
+				RecordTexture( request );
+			}
+
+			// The data is in the command list or staging memory now
+			request.bufferData = {};
+			request.filler = nullptr;
+			CurrentRequests.push_back( std::move( request ) );
+		}
+
+		HandOff();
+	}
+
+	static void UploadThreadMain()
+	{
+		while ( true )
+		{
+			std::vector<Request> requests;
+			{
+				std::unique_lock<std::mutex> lock( QueueMutex );
+				UploadThreadBusy = false;
+				BatchRecorded.notify_one();
+				WorkAvailable.wait( lock, [] { return StopUploadThread || !RecordJobs.empty(); } );
+
+				if ( RecordJobs.empty() )
+				{
+					return;
+				}
+
+				requests = std::move( RecordJobs.front() );
+				RecordJobs.pop_front();
+				UploadThreadBusy = true;
+			}
+
+			RecordBatch( requests );
+		}
+	}
+
+	// Runs on the main thread, so the upload thread never touches the queues directly
+	static void SubmitRecordedBatches()
+	{
+		std::deque<RecordedBatch> batches;
+		{
+			std::lock_guard<std::mutex> lock( QueueMutex );
+			batches.swap( RecordedBatches );
+		}
+
+		for ( auto& batch : batches )
+		{
+			const uint64_t instance = Renderer::Device->executeCommandList( batch.commandList, UploadQueue );
+
+			SubmittedBatch submitted;
+			submitted.id = batch.id;
+			submitted.ringEnd = batch.ringEnd;
+			{
+				std::lock_guard<std::mutex> lock( QueueMutex );
+				if ( !FreeQueries.empty() )
+				{
+					submitted.query = std::move( FreeQueries.back() );
+					FreeQueries.pop_back();
+				}
+			}
+			if ( nullptr == submitted.query )
+			{
+				submitted.query = Renderer::Device->createEventQuery();
+			}
+			Renderer::Device->setEventQuery( submitted.query, UploadQueue );
+
+			for ( auto& request : batch.requests )
+			{
+				nvrhi::IResource* resource = request.GetResource();
+				if ( --InTransit[resource] == 0U )
+				{
+					InTransit.erase( resource );
+				}
+
+				if ( UseCopyQueue )
+				{
+					PendingAcquires[resource] = { request.buffer, request.texture, request.finalState, instance };
+				}
+			}
+
+			{
+				std::lock_guard<std::mutex> lock( QueueMutex );
+				SubmittedBatches.push_back( std::move( submitted ) );
+				FreeCommandLists.push_back( std::move( batch.commandList ) );
+			}
+			BatchSubmitted.notify_one();
+
+			std::lock_guard<std::mutex> lock( StatsMutex );
+			CurrentStats.numSubmissions++;
+		}
+	}
+
+	bool Init( bool copyQueueAvailable )
+	{
+		const nvrhi::GraphicsAPI api = Renderer::Device->getGraphicsAPI();
+
+		// NVRHI's D3D11 command lists record straight into the immediate context, so no threads and no queues there
+		// Vulkan stays on the graphics queue too: NVRHI creates everything with exclusive sharing and has no way to record
+		// the queue family ownership transfer, so the graphics queue could see undefined contents after a copy queue upload
+		// D3D12 has no such thing, resources decay to COMMON at the end of a copy queue submission and get promoted from there
+		UseCopyQueue = copyQueueAvailable && api == nvrhi::GraphicsAPI::D3D12;
+		UseUploadThread = api != nvrhi::GraphicsAPI::D3D11;
+		PersistentRing = api != nvrhi::GraphicsAPI::D3D11;
+		UploadQueue = UseCopyQueue ? nvrhi::CommandQueue::Copy : nvrhi::CommandQueue::Graphics;
+
+		auto& ringDesc = nvrhi::BufferDesc()
+			.setByteSize( RingBytes )
+			.setCpuAccess( nvrhi::CpuAccessMode::Write )
+			.setInitialState( nvrhi::ResourceStates::CopySource )
+			.setKeepInitialState( true )
+			.setDebugName( "Upload staging ring" );
+
+		RingBuffer = Renderer::Device->createBuffer( ringDesc );
+		if ( !Check( RingBuffer, "Failed to create Upload::RingBuffer" ) )
+			return false;
+
+		Memory::Track( Memory::Category::Staging, 0, RingBytes, 1 );
+
+		if ( PersistentRing )
+		{
+			RingMapped = MapRing();
+			if ( !Check( RingMapped, "Failed to map Upload::RingBuffer" ) )
+				return false;
+		}
+
+		if ( UseUploadThread )
+		{
+			StopUploadThread = false;
+			UploadThread = std::thread( UploadThreadMain );
+		}
+
+		std::cout << "Upload: recording on " << (UseUploadThread ? "a separate thread" : "the main thread")
+			<< ", submitting to the " << (UseCopyQueue ? "copy" : "graphics") << " queue" << std::endl;
+
+		return true;
+	}
+
+	void Shutdown()
+	{
+		Flush();
+
+		// Let the upload thread finish, submitting whatever it records in the meantime,
+		// as it may be waiting for one of its own batches to get through before it can go on
+		if ( UseUploadThread )
+		{
+			std::unique_lock<std::mutex> lock( QueueMutex );
+			while ( true )
+			{
+				BatchRecorded.wait( lock, [] { return !RecordedBatches.empty() || (RecordJobs.empty() && !UploadThreadBusy); } );
+				if ( RecordedBatches.empty() )
+				{
+					break;
+				}
+
+				lock.unlock();
+				SubmitRecordedBatches();
+				lock.lock();
+			}
+
+			StopUploadThread = true;
+			lock.unlock();
+			WorkAvailable.notify_one();
+			UploadThread.join();
+
+			SubmitRecordedBatches();
+		}
+
+		Renderer::Device->waitForIdle();
+		Reclaim();
+
+		for ( const auto& pooled : StagingTextures )
+		{
+			Memory::Track( Memory::Category::Staging, 0, -int64_t( Memory::EstimateTextureBytes( pooled.stagingTexture->getDesc() ) ), -1 );
+		}
+		Memory::Track( Memory::Category::Staging, 0, -int64_t( RingBytes ), -1 );
+
+		StagingTextures.clear();
+		BatchesInFlight.clear();
+		FreeQueries.clear();
+		FreeCommandLists.clear();
+		InTransit.clear();
+		PendingAcquires.clear();
+		if ( nullptr != RingMapped )
+		{
+			Renderer::Device->unmapBuffer( RingBuffer );
+			RingMapped = nullptr;
+		}
+		RingBuffer = nullptr;
+	}
+
+	static void Enqueue( Request&& request )
+	{
+		InTransit[request.GetResource()]++;
+		PendingBytes += request.bytes;
+
+		{
+			std::lock_guard<std::mutex> lock( StatsMutex );
+			CurrentStats.numRequests++;
+			CurrentStats.numBytes += request.bytes;
+		}
+
+		PendingRequests.push_back( std::move( request ) );
+
+		if ( PendingBytes >= FlushThresholdBytes || PendingRequests.size() >= FlushThresholdRequests )
+		{
+			Flush();
+		}
+	}
+
+	void WriteBuffer( nvrhi::IBuffer* buffer, const void* data, size_t bytes, nvrhi::ResourceStates finalState )
+	{
+		Request request;
+		request.buffer = buffer;
+		request.finalState = finalState;
+		request.bytes = bytes;
+		request.bufferData.assign( static_cast<const uint8_t*>( data ), static_cast<const uint8_t*>( data ) + bytes );
+
+		Enqueue( std::move( request ) );
+	}
+
+	void FillTexture( nvrhi::ITexture* texture, uint64_t bytes, StagingFiller filler, nvrhi::ResourceStates finalState )
+	{
+		Request request;
+		request.texture = texture;
+		request.finalState = finalState;
+		request.bytes = bytes;
+		request.filler = std::move( filler );
+
+		Enqueue( std::move( request ) );
+	}
+
+	void WriteTexture( nvrhi::ITexture* texture, const std::vector<TextureWrite>& writes, nvrhi::ResourceStates finalState )
+	{
+		uint64_t bytes = 0U;
+		uint64_t copiedBytes = 0U;
+		for ( const auto& write : writes )
+		{
+			bytes += write.bytes;
+			copiedBytes += nullptr == write.owner ? write.bytes : 0U;
+		}
+
+		// Like WriteBuffer, data without an owner is copied into the request, as the upload thread may only get to it frames later
+		// Each write's data is found by its offset into the copy, the filler's captures get moved around
+		std::vector<uint8_t> data( copiedBytes );
+		std::vector<uint64_t> offsets( writes.size() );
+		uint64_t offset = 0U;
+		for ( size_t i = 0U; i < writes.size(); i++ )
+		{
+			if ( nullptr != writes[i].owner )
+			{
+				continue;
+			}
+
+			std::memcpy( data.data() + offset, writes[i].data, writes[i].bytes );
+			offsets[i] = offset;
+			offset += writes[i].bytes;
+		}
+
+		FillTexture( texture, bytes, [writes, offsets = std::move( offsets ), data = std::move( data )]( uint32_t mipLevel, uint8_t* destination, size_t rowPitch )
+			{
+				for ( size_t i = 0U; i < writes.size(); i++ )
+				{
+					const TextureWrite& write = writes[i];
+					if ( write.mipLevel != mipLevel )
+					{
+						continue;
+					}
+
+					// The copied 'writes' keep the owners alive
+					const uint8_t* source = nullptr != write.owner ? static_cast<const uint8_t*>( write.data ) : data.data() + offsets[i];
+					const size_t numRows = write.bytes / write.rowPitch;
+					for ( size_t row = 0U; row < numRows; row++ )
+					{
+						std::memcpy( destination + row * rowPitch, source + row * write.rowPitch, write.rowPitch );
+					}
+				}
+			}, finalState );
+	}
+
+	void Flush()
+	{
+		if ( PendingRequests.empty() )
+		{
+			return;
+		}
+
+		if ( UseUploadThread )
+		{
+			{
+				std::lock_guard<std::mutex> lock( QueueMutex );
+				RecordJobs.push_back( std::move( PendingRequests ) );
+			}
+			WorkAvailable.notify_one();
+		}
+		else
+		{
+			RecordBatch( PendingRequests );
+			SubmitRecordedBatches();
+		}
+
+		PendingRequests.clear();
+		PendingBytes = 0U;
+	}
+
+	void Update()
+	{
+		SubmitRecordedBatches();
+	}
+
+	bool IsPending( nvrhi::IResource* resource )
+	{
+		return InTransit.find( resource ) != InTransit.end();
+	}
+
+	static bool Acquire( nvrhi::ICommandList* commandList, nvrhi::IResource* resource )
+	{
+		if ( IsPending( resource ) )
+		{
+			return false;
+		}
+
+		const auto iterator = PendingAcquires.find( resource );
+		if ( iterator == PendingAcquires.end() )
+		{
+			return true;
+		}
+
+		// Only D3D12 uses the copy queue, which leaves everything in COMMON
+		const PendingAcquire& acquire = iterator->second;
+		if ( nullptr != acquire.buffer )
+		{
+			commandList->beginTrackingBufferState( acquire.buffer, nvrhi::ResourceStates::Common );
+			commandList->setPermanentBufferState( acquire.buffer, acquire.finalState );
+		}
+		else
+		{
+			commandList->beginTrackingTextureState( acquire.texture, nvrhi::AllSubresources, nvrhi::ResourceStates::Common );
+			commandList->setPermanentTextureState( acquire.texture, acquire.finalState );
+		}
+
+		FrameWaitInstance = std::max( FrameWaitInstance, acquire.copyInstance );
+		PendingAcquires.erase( iterator );
+		return true;
+	}
+
+	bool Acquire( nvrhi::ICommandList* commandList, nvrhi::IBuffer* buffer )
+	{
+		return Acquire( commandList, static_cast<nvrhi::IResource*>( buffer ) );
+	}
+
+	bool Acquire( nvrhi::ICommandList* commandList, nvrhi::ITexture* texture )
+	{
+		return Acquire( commandList, static_cast<nvrhi::IResource*>( texture ) );
+	}
+
+	void SubmitFrameWaits()
+	{
+		// The copy queue finishes its submissions in order, so waiting for the latest one is enough
+		if ( FrameWaitInstance > LastWaitedInstance )
+		{
+			Renderer::Device->queueWaitForCommandList( nvrhi::CommandQueue::Graphics, nvrhi::CommandQueue::Copy, FrameWaitInstance );
+			LastWaitedInstance = FrameWaitInstance;
+
+			std::lock_guard<std::mutex> lock( StatsMutex );
+			CurrentStats.numQueueWaits++;
+		}
+	}
+
+	Stats GetStats()
+	{
+		std::lock_guard<std::mutex> lock( StatsMutex );
+		return CurrentStats;
+	}
+
+	void PrintStats()
+	{
+		const Stats stats = GetStats();
+
+		std::cout << "Uploads:" << std::endl
+			<< "  * Requests:         " << stats.numRequests << std::endl
+			<< "  * Submissions:      " << stats.numSubmissions << " (" << stats.numRequests - std::min( stats.numSubmissions, stats.numRequests ) << " saved)" << std::endl
+			<< "  * Uploaded:         " << stats.numBytes / 1024U << " kB" << std::endl
+			<< "  * Queue:            " << (UseCopyQueue ? "copy" : "graphics") << ", " << stats.numQueueWaits << " graphics queue waits" << std::endl
+			<< "  * Ring peak usage:  " << stats.peakRingBytes / 1024U << " / " << RingBytes / 1024U << " kB" << std::endl
+			<< "  * Ring stalls:      " << stats.numStalls << " (" << stats.stallSeconds * 1000.0 << " ms waiting for the GPU)" << std::endl
+			<< "  * Maps:             " << stats.numMaps << " (" << stats.mapSeconds * 1000.0 << " ms, including waiting for the GPU)" << std::endl
+			<< "  * Ring fallbacks:   " << stats.numRingFallbacks << std::endl
+			<< "  * Staging reuses:   " << stats.numStagingTexturesReused << std::endl;
+	}
+}